@@ -501,6 +501,58 @@ extern int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 		const char *filter_expression,
 		int exclusion_count, char **exclusion_names);
 
+/*
+ * A batch of events enabled on a channel with a single request to the
+ * session daemon.
+ */
+struct lttng_event_batch;
+
+/*
+ * Create an empty event batch.
+ *
+ * Returns a new batch on success, NULL on error. The batch must be destroyed
+ * with lttng_event_batch_destroy().
+ */
+extern struct lttng_event_batch *lttng_event_batch_create(void);
+
+/*
+ * Destroy an event batch.
+ */
+extern void lttng_event_batch_destroy(struct lttng_event_batch *batch);
+
+/*
+ * Add an event to a batch, with the same filter and exclusion options as
+ * lttng_enable_event_with_exclusions(). The event, filter expression and
+ * exclusion names are copied.
+ *
+ * Events with a userspace probe location can't be added to a batch and must
+ * be enabled with lttng_enable_event_with_exclusions().
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_event_batch_add(struct lttng_event_batch *batch,
+		const struct lttng_event *event, const char *filter_expression,
+		int exclusion_count, char **exclusion_names);
+
+/*
+ * Create or enable all the events of a batch on a channel.
+ *
+ * If channel_name is NULL, the default channel is used (channel0) and created
+ * if not found.
+ *
+ * The session daemon receives all the events of the batch before enabling any
+ * of them, so that a malformed batch (e.g. a truncated filter bytecode or
+ * exclusion list) leaves the session untouched. Only this framing is checked
+ * up front: the events are then enabled in the order they were added to the
+ * batch, stopping at the first one that can't be enabled (e.g. an unknown
+ * channel or an invalid event type). The batch is not applied atomically, the
+ * events enabled before the error remain enabled.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_enable_event_batch(struct lttng_handle *handle,
+		const char *channel_name, struct lttng_event_batch *batch);
+
 /*
  * Disable event(s) of a channel and domain.
  *
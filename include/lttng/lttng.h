@@ -170,6 +170,20 @@ extern int lttng_set_consumer_url(struct lttng_handle *handle,
  */
 extern int lttng_data_pending(const char *session_name);
 
+/*
+ * Same as lttng_data_pending(), but waits up to timeout_ms milliseconds for
+ * the data of the session to stop being pending before returning. The call
+ * returns as soon as the consumer daemons report the session's buffers as
+ * drained. The session daemon may cap the wait, in which case 1 is returned
+ * before timeout_ms has elapsed: call it again to keep waiting.
+ *
+ * Return 0 if there is _no_ data pending, 1 if data is still pending once the
+ * timeout has expired or a negative value readable by lttng_strerror() on
+ * error.
+ */
+extern int lttng_data_pending_wait(const char *session_name,
+		unsigned int timeout_ms);
+
 /*
  * Deprecated, replaced by lttng_regenerate_metadata.
  */
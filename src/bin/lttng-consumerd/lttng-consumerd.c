@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <grp.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
 #include <signal.h>
@@ -37,6 +38,7 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <assert.h>
+#include <ctype.h>
 #include <urcu/compiler.h>
 #include <ulimit.h>
 
@@ -54,8 +56,10 @@
 
 /* threads (channel handling, poll, metadata, sessiond) */
 
-static pthread_t channel_thread, data_thread, metadata_thread,
+static pthread_t channel_thread, metadata_thread,
 		sessiond_thread, metadata_timer_thread, health_thread;
+/* One data thread per data shard of the consumer. */
+static pthread_t *data_threads;
 static bool metadata_timer_thread_online;
 
 /* to count the number of times the user pressed ctrl+c */
@@ -71,6 +75,10 @@ static const char *progname;
 static char command_sock_path[PATH_MAX]; /* Global command socket path */
 static char error_sock_path[PATH_MAX]; /* Global error path */
 static enum lttng_consumer_type opt_type = LTTNG_CONSUMER_KERNEL;
+static unsigned int opt_data_threads;
+static unsigned int opt_snapshot_threads;
+static int opt_io_uring;
+static int opt_relayd_zerocopy;
 
 /* the liblttngconsumerd context */
 static struct lttng_consumer_local_data *ctx;
@@ -165,6 +173,18 @@ static void usage(FILE *fp)
 			"Show version number.\n");
 	fprintf(fp, "  -g, --group NAME                   "
 			"Specify the tracing group name. (default: tracing)\n");
+	fprintf(fp, "  -t, --data-threads COUNT           "
+			"Consume the trace data with COUNT threads. (default: %d)\n",
+			DEFAULT_CONSUMERD_DATA_THREADS);
+	fprintf(fp, "                                     "
+			"The streams of a channel are consumed by a single thread.\n");
+	fprintf(fp, "  -s, --snapshot-threads COUNT       "
+			"Copy the streams of a snapshot with COUNT threads. (default: %d)\n",
+			DEFAULT_CONSUMERD_SNAPSHOT_THREADS);
+	fprintf(fp, "  -i, --io-uring                     "
+			"Write the local trace files using io_uring, if supported.\n");
+	fprintf(fp, "  -z, --relayd-zerocopy              "
+			"Send trace data to the relay daemon with MSG_ZEROCOPY, if supported.\n");
 	fprintf(fp, "  -k, --kernel                       "
 			"Consumer kernel buffers (default).\n");
 	fprintf(fp, "  -u, --ust                          "
@@ -177,6 +197,115 @@ static void usage(FILE *fp)
 			);
 }
 
+/*
+ * Parse a strictly positive number of threads.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int parse_nb_threads(const char *arg, unsigned int *nb_threads)
+{
+	unsigned long v;
+
+	errno = 0;
+	v = strtoul(arg, NULL, 0);
+	if (errno != 0 || !isdigit(arg[0]) || v == 0 || v > UINT_MAX) {
+		return -1;
+	}
+	*nb_threads = (unsigned int) v;
+	return 0;
+}
+
+/*
+ * Set the number of data threads from the environment unless it was
+ * specified on the command line. The session daemon's environment is
+ * inherited by the consumer daemons it spawns.
+ */
+static void set_data_threads(void)
+{
+	const char *env_value;
+
+	if (opt_data_threads) {
+		goto end;
+	}
+
+	opt_data_threads = DEFAULT_CONSUMERD_DATA_THREADS;
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+	if (!env_value) {
+		goto end;
+	}
+	if (parse_nb_threads(env_value, &opt_data_threads)) {
+		WARN("Invalid value \"%s\" for environment variable %s, using %d data thread(s)",
+				env_value, DEFAULT_CONSUMERD_DATA_THREADS_ENV,
+				DEFAULT_CONSUMERD_DATA_THREADS);
+		opt_data_threads = DEFAULT_CONSUMERD_DATA_THREADS;
+	}
+end:
+	DBG3("Number of consumer data threads set to %u", opt_data_threads);
+}
+
+/*
+ * Set the number of snapshot copy threads from the environment unless it was
+ * specified on the command line.
+ */
+static void set_snapshot_threads(void)
+{
+	const char *env_value;
+
+	if (opt_snapshot_threads) {
+		goto end;
+	}
+
+	opt_snapshot_threads = DEFAULT_CONSUMERD_SNAPSHOT_THREADS;
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV);
+	if (!env_value) {
+		goto end;
+	}
+	if (parse_nb_threads(env_value, &opt_snapshot_threads)) {
+		WARN("Invalid value \"%s\" for environment variable %s, using %d snapshot thread(s)",
+				env_value, DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV,
+				DEFAULT_CONSUMERD_SNAPSHOT_THREADS);
+		opt_snapshot_threads = DEFAULT_CONSUMERD_SNAPSHOT_THREADS;
+	}
+end:
+	DBG3("Number of consumer snapshot threads set to %u",
+			opt_snapshot_threads);
+}
+
+/*
+ * Enable the io_uring output backend if requested through the environment.
+ */
+static void set_io_uring(void)
+{
+	const char *env_value;
+
+	if (opt_io_uring) {
+		return;
+	}
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_IO_URING_ENV);
+	if (env_value && !strcmp(env_value, "1")) {
+		opt_io_uring = 1;
+	}
+}
+
+/*
+ * Enable zero-copy sends to the relay daemon if requested through the
+ * environment.
+ */
+static void set_relayd_zerocopy(void)
+{
+	const char *env_value;
+
+	if (opt_relayd_zerocopy) {
+		return;
+	}
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_RELAYD_ZEROCOPY_ENV);
+	if (env_value && !strcmp(env_value, "1")) {
+		opt_relayd_zerocopy = 1;
+	}
+}
+
 /*
  * daemon argument parsing
  */
@@ -194,6 +323,10 @@ static int parse_args(int argc, char **argv)
 		{ "verbose", 0, 0, 'v' },
 		{ "version", 0, 0, 'V' },
 		{ "kernel", 0, 0, 'k' },
+		{ "data-threads", 1, 0, 't' },
+		{ "snapshot-threads", 1, 0, 's' },
+		{ "io-uring", 0, 0, 'i' },
+		{ "relayd-zerocopy", 0, 0, 'z' },
 #ifdef HAVE_LIBLTTNG_UST_CTL
 		{ "ust", 0, 0, 'u' },
 #endif
@@ -202,7 +335,7 @@ static int parse_args(int argc, char **argv)
 
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "dhqvVku" "c:e:g:",
+		c = getopt_long(argc, argv, "dhqvVkuiz" "c:e:g:t:s:",
 				long_options, &option_index);
 		if (c == -1) {
 			break;
@@ -260,6 +393,28 @@ static int parse_args(int argc, char **argv)
 		case 'k':
 			opt_type = LTTNG_CONSUMER_KERNEL;
 			break;
+		case 'i':
+			opt_io_uring = 1;
+			break;
+		case 'z':
+			opt_relayd_zerocopy = 1;
+			break;
+		case 't':
+			if (parse_nb_threads(optarg, &opt_data_threads)) {
+				ERR("Wrong value in --data-threads parameter: %s",
+						optarg);
+				ret = -1;
+				goto end;
+			}
+			break;
+		case 's':
+			if (parse_nb_threads(optarg, &opt_snapshot_threads)) {
+				ERR("Wrong value in --snapshot-threads parameter: %s",
+						optarg);
+				ret = -1;
+				goto end;
+			}
+			break;
 #ifdef HAVE_LIBLTTNG_UST_CTL
 		case 'u':
 # if (CAA_BITS_PER_LONG == 64)
@@ -306,6 +461,7 @@ static void set_ulimit(void)
 int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
+	unsigned int i, nb_data_threads = 0;
 	void *status;
 	struct lttng_consumer_local_data *tmp_ctx;
 
@@ -326,6 +482,10 @@ int main(int argc, char **argv)
 		retval = -1;
 		goto exit_options;
 	}
+	set_data_threads();
+	set_snapshot_threads();
+	set_io_uring();
+	set_relayd_zerocopy();
 
 	/* Daemonize */
 	if (opt_daemon) {
@@ -417,7 +577,7 @@ int main(int argc, char **argv)
 
 	/* create the consumer instance with and assign the callbacks */
 	ctx = lttng_consumer_create(opt_type, lttng_consumer_read_subbuffer,
-		NULL, lttng_consumer_on_recv_stream, NULL);
+		NULL, lttng_consumer_on_recv_stream, NULL, opt_data_threads);
 	if (!ctx) {
 		retval = -1;
 		goto exit_init_data;
@@ -482,6 +642,9 @@ int main(int argc, char **argv)
 	}
 
 	ctx->type = opt_type;
+	ctx->use_io_uring = opt_io_uring;
+	ctx->use_relayd_zerocopy = opt_relayd_zerocopy;
+	ctx->nb_snapshot_threads = opt_snapshot_threads;
 
 	if (utils_create_pipe(health_quit_pipe)) {
 		retval = -1;
@@ -543,15 +706,26 @@ int main(int argc, char **argv)
 		goto exit_metadata_thread;
 	}
 
-	/* Create thread to manage the polling/writing of trace data */
-	ret = pthread_create(&data_thread, default_pthread_attr(),
-			consumer_thread_data_poll, (void *) ctx);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create");
+	/* Create the threads to manage the polling/writing of trace data */
+	data_threads = zmalloc(sizeof(*data_threads) * ctx->nb_data_shards);
+	if (!data_threads) {
+		PERROR("zmalloc data threads");
 		retval = -1;
 		goto exit_data_thread;
 	}
+	for (i = 0; i < ctx->nb_data_shards; i++) {
+		ret = pthread_create(&data_threads[i], default_pthread_attr(),
+				consumer_thread_data_poll,
+				(void *) &ctx->data_shards[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create");
+			retval = -1;
+			goto exit_data_thread;
+		}
+		nb_data_threads++;
+	}
+	DBG("Started %u consumer data thread(s)", nb_data_threads);
 
 	/* Create the thread to manage the reception of fds */
 	ret = pthread_create(&sessiond_thread, default_pthread_attr(),
@@ -578,13 +752,16 @@ int main(int argc, char **argv)
 	}
 exit_sessiond_thread:
 
-	ret = pthread_join(data_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join data_thread");
-		retval = -1;
+	for (i = 0; i < nb_data_threads; i++) {
+		ret = pthread_join(data_threads[i], &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join data_thread");
+			retval = -1;
+		}
 	}
 exit_data_thread:
+	free(data_threads);
 
 	ret = pthread_join(metadata_thread, &status);
 	if (ret) {
@@ -644,6 +821,8 @@ exit_init_data:
 		}
 		ret = consumer_timer_thread_get_channel_monitor_pipe();
 		if (ret >= 0) {
+			DBG("%" PRIu64 " channel monitor samples were dropped",
+					consumer_timer_thread_get_dropped_monitor_samples());
 			ret = close(ret);
 			if (ret) {
 				PERROR("close channel monitor pipe");
@@ -651,6 +830,13 @@ exit_init_data:
 		}
 		metadata_timer_thread_online = false;
 	}
+	ret = consumer_get_data_pending_pipe();
+	if (ret >= 0) {
+		ret = close(ret);
+		if (ret) {
+			PERROR("close data pending pipe");
+		}
+	}
 	tmp_ctx = ctx;
 	ctx = NULL;
 	cmm_barrier();	/* Clear ctx for signal handler. */
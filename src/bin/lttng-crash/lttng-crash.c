@@ -33,11 +33,13 @@
 #include <byteswap.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <version.h>
 #include <lttng/lttng.h>
 #include <common/common.h>
 #include <common/utils.h>
+#include <common/dynamic-array.h>
 
 #define DEFAULT_VIEWER "babeltrace"
 
@@ -196,6 +198,9 @@ static char *progname,
 
 static char *input_path;
 
+/* Number of extraction threads, 0 for one per online CPU. */
+static long opt_jobs;
+
 int lttng_opt_quiet, lttng_opt_verbose, lttng_opt_mi;
 
 enum {
@@ -209,6 +214,7 @@ static struct option long_options[] = {
 	{ "verbose",		0, NULL, 'v' },
 	{ "viewer",		1, NULL, 'e' },
 	{ "extract",		1, NULL, 'x' },
+	{ "jobs",		1, NULL, 'j' },
 	{ "list-options",	0, NULL, OPT_DUMP_OPTIONS },
 	{ NULL, 0, NULL, 0 },
 };
@@ -271,7 +277,7 @@ static int parse_args(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
-	while ((opt = getopt_long(argc, argv, "+Vhve:x:", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "+Vhve:x:j:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'V':
 			version(stdout);
@@ -295,6 +301,18 @@ static int parse_args(int argc, char **argv)
 			free(opt_output_path);
 			opt_output_path = strdup(optarg);
 			break;
+		case 'j':
+		{
+			char *endptr;
+
+			errno = 0;
+			opt_jobs = strtol(optarg, &endptr, 10);
+			if (errno || *endptr != '\0' || opt_jobs <= 0) {
+				ERR("Invalid number of jobs: %s", optarg);
+				goto error;
+			}
+			break;
+		}
 		case OPT_DUMP_OPTIONS:
 			list_options(stdout);
 			ret = 1;
@@ -647,16 +665,24 @@ uint64_t subbuffer_id_get_index(uint32_t mode, uint64_t id,
 		return id;
 }
 
+/*
+ * Locate the packet of the sub-buffer at "offset" within the crash buffer
+ * mapping "buf". On success, "packet" and "packet_size" are set to the
+ * location and length of the data to extract. The header of a partially
+ * committed sub-buffer is patched in place to reflect its actual length.
+ *
+ * Return 0 on success, -ENODATA if the sub-buffer holds no data, or else a
+ * negative value.
+ */
 static
-int copy_crash_subbuf(const struct lttng_crash_layout *layout,
-		int fd_dest, char *buf, uint64_t offset)
+int get_crash_subbuf(const struct lttng_crash_layout *layout,
+		char *buf, uint64_t offset, char **packet,
+		uint64_t *packet_size)
 {
 	uint64_t buf_size, subbuf_size, num_subbuf, sbidx, id,
 		sb_bindex, rpages_offset, p_offset, seq_cc,
-		committed, commit_count_mask, consumed_cur,
-		packet_size;
+		committed, commit_count_mask, consumed_cur;
 	char *subbuf_ptr;
-	ssize_t writelen;
 
 	/*
 	 * Get the current subbuffer by applying the proper mask to
@@ -679,7 +705,7 @@ int copy_crash_subbuf(const struct lttng_crash_layout *layout,
 		return -EINVAL;
 	}
 
-	DBG("Copy crash subbuffer at offset %" PRIu64, offset);
+	DBG("Get crash subbuffer at offset %" PRIu64, offset);
 	sbidx = subbuf_index(offset, buf_size, subbuf_size);
 
 	/*
@@ -731,15 +757,15 @@ int copy_crash_subbuf(const struct lttng_crash_layout *layout,
 		 * Packet header can be used.
 		 */
 		if (layout->length.packet_size) {
-			memcpy(&packet_size,
+			memcpy(packet_size,
 				subbuf_ptr + layout->offset.packet_size,
 				layout->length.packet_size);
 			if (layout->reverse_byte_order) {
-				packet_size = __bswap_64(packet_size);
+				*packet_size = __bswap_64(*packet_size);
 			}
-			packet_size /= CHAR_BIT;
+			*packet_size /= CHAR_BIT;
 		} else {
-			packet_size = subbuf_size;
+			*packet_size = subbuf_size;
 		}
 	} else {
 		uint64_t patch_size;
@@ -761,18 +787,10 @@ int copy_crash_subbuf(const struct lttng_crash_layout *layout,
 			memcpy(subbuf_ptr + layout->offset.packet_size,
 				&patch_size, layout->length.packet_size);
 		}
-		packet_size = committed;
+		*packet_size = committed;
 	}
 
-	/*
-	 * Copy packet into fd_dest.
-	 */
-	writelen = lttng_write(fd_dest, subbuf_ptr, packet_size);
-	if (writelen < packet_size) {
-		PERROR("Error writing to output file");
-		return -1;
-	}
-	DBG("Copied %" PRIu64 " bytes of data", packet_size);
+	*packet = subbuf_ptr;
 	return 0;
 
 nodata:
@@ -780,31 +798,96 @@ nodata:
 }
 
 static
-int copy_crash_data(const struct lttng_crash_layout *layout, int fd_dest,
-		int fd_src)
+int write_crash_run(int fd_dest, const char *run, uint64_t run_len)
+{
+	ssize_t writelen;
+
+	if (!run_len) {
+		return 0;
+	}
+
+	writelen = lttng_write(fd_dest, run, run_len);
+	if (writelen < run_len) {
+		PERROR("Error writing to output file");
+		return -1;
+	}
+	DBG("Copied %" PRIu64 " bytes of data", run_len);
+	return 0;
+}
+
+/*
+ * Map the crash buffer of "fd_src". The mapping is private so that the
+ * headers of partially committed sub-buffers can be patched without
+ * modifying the source file. A file shorter than the crash record is read
+ * into an anonymous mapping, leaving its missing tail zeroed.
+ *
+ * Return the mapping, to be released with munmap(), or NULL on error.
+ */
+static
+char *map_crash_data(const struct lttng_crash_layout *layout, int fd_src)
 {
 	char *buf;
-	int ret = 0, has_data = 0;
+	int ret;
 	struct stat statbuf;
 	size_t src_file_len;
-	uint64_t prod_offset, consumed_offset;
-	uint64_t offset, subbuf_size;
 	ssize_t readlen;
 
 	ret = fstat(fd_src, &statbuf);
 	if (ret) {
-		return ret;
+		PERROR("fstat");
+		return NULL;
 	}
 	src_file_len = layout->mmap_length;
-	buf = zmalloc(src_file_len);
-	if (!buf) {
-		return -1;
+	if (!src_file_len) {
+		ERR("Empty crash record");
+		return NULL;
+	}
+
+	if (statbuf.st_size >= src_file_len) {
+		buf = mmap(NULL, src_file_len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd_src, 0);
+		if (buf == MAP_FAILED) {
+			PERROR("Mapping file");
+			return NULL;
+		}
+		return buf;
+	}
+
+	buf = mmap(NULL, src_file_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		PERROR("Mapping anonymous memory");
+		return NULL;
 	}
 	readlen = lttng_read(fd_src, buf, src_file_len);
 	if (readlen < 0) {
 		PERROR("Error reading input file");
-		ret = -1;
-		goto end;
+		ret = munmap(buf, src_file_len);
+		if (ret) {
+			PERROR("munmap");
+		}
+		return NULL;
+	}
+	return buf;
+}
+
+/*
+ * Copy the committed data of a crash buffer into fd_dest. Packets that are
+ * contiguous in the buffer (i.e. consecutive full sub-buffers) are written
+ * as a single run.
+ */
+static
+int copy_crash_data(const struct lttng_crash_layout *layout, int fd_dest,
+		int fd_src)
+{
+	char *buf, *packet, *run = NULL;
+	int ret = 0, unmapret, has_data = 0;
+	uint64_t prod_offset, consumed_offset;
+	uint64_t offset, subbuf_size, packet_size, run_len = 0;
+
+	buf = map_crash_data(layout, fd_src);
+	if (!buf) {
+		return -1;
 	}
 
 	prod_offset = crash_get_field(layout, buf, prod_offset);
@@ -815,17 +898,34 @@ int copy_crash_data(const struct lttng_crash_layout *layout, int fd_dest,
 
 	for (offset = consumed_offset; offset < prod_offset;
 			offset += subbuf_size) {
-		ret = copy_crash_subbuf(layout, fd_dest, buf, offset);
-		if (!ret) {
-			has_data = 1;
+		ret = get_crash_subbuf(layout, buf, offset, &packet,
+				&packet_size);
+		if (ret) {
+			break;
 		}
+		has_data = 1;
+
+		if (run_len && packet == run + run_len) {
+			run_len += packet_size;
+			continue;
+		}
+		ret = write_crash_run(fd_dest, run, run_len);
 		if (ret) {
 			goto end;
 		}
+		run = packet;
+		run_len = packet_size;
 	}
-end:
-	free(buf);
 	if (ret && ret != -ENODATA) {
+		goto end;
+	}
+	ret = write_crash_run(fd_dest, run, run_len);
+end:
+	unmapret = munmap(buf, layout->mmap_length);
+	if (unmapret) {
+		PERROR("munmap");
+	}
+	if (ret) {
 		return ret;
 	}
 	if (has_data) {
@@ -894,64 +994,186 @@ end:
 	return ret;
 }
 
+struct extract_files_ctx {
+	int input_dir_fd, output_dir_fd;
+	/* Names of the files of the input directory. */
+	struct lttng_dynamic_pointer_array files;
+	pthread_mutex_t lock;
+	/* Protected by lock. */
+	size_t next_file;
+	/* Protected by lock. */
+	int ret;
+};
+
+/*
+ * Extraction worker: extract files of the input directory until all of them
+ * have been handed out or an error is encountered by any worker.
+ */
+static
+void *extract_files_worker(void *data)
+{
+	struct extract_files_ctx *ctx = data;
+	const size_t count = lttng_dynamic_pointer_array_get_count(&ctx->files);
+
+	for (;;) {
+		const char *name;
+		int ret;
+
+		pthread_mutex_lock(&ctx->lock);
+		if (ctx->ret < 0 || ctx->next_file >= count) {
+			pthread_mutex_unlock(&ctx->lock);
+			break;
+		}
+		name = lttng_dynamic_pointer_array_get_pointer(&ctx->files,
+				ctx->next_file++);
+		pthread_mutex_unlock(&ctx->lock);
+
+		ret = extract_file(ctx->output_dir_fd, name,
+			ctx->input_dir_fd, name);
+		if (ret == -ENODATA) {
+			DBG("No data in file '%s', skipping", name);
+		} else if (ret < 0) {
+			pthread_mutex_lock(&ctx->lock);
+			ctx->ret = ret;
+			pthread_mutex_unlock(&ctx->lock);
+			break;
+		} else if (ret > 0) {
+			DBG("Skipping file '%s'", name);
+		}
+	}
+	return NULL;
+}
+
+static
+long get_nr_jobs(size_t nr_files)
+{
+	long nr_jobs = opt_jobs;
+
+	if (!nr_jobs) {
+		nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nr_jobs <= 0) {
+			nr_jobs = 1;
+		}
+	}
+	return min_t(long, nr_jobs, nr_files);
+}
+
+/*
+ * Extract the files of the input directory, one file per extraction thread
+ * at a time.
+ */
 static
 int extract_all_files(const char *output_path,
 		const char *input_path)
 {
 	DIR *input_dir, *output_dir;
-	int input_dir_fd, output_dir_fd, ret = 0, closeret;
+	int ret = 0, closeret;
 	struct dirent *entry;	/* input */
+	struct extract_files_ctx ctx = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	pthread_t *threads = NULL;
+	long i, nr_jobs, nr_threads = 0;
+
+	lttng_dynamic_pointer_array_init(&ctx.files, free);
 
 	/* Open input directory */
 	input_dir = opendir(input_path);
 	if (!input_dir) {
 		PERROR("Cannot open '%s' path", input_path);
-		return -1;
+		ret = -1;
+		goto end_no_closedir;
 	}
-	input_dir_fd = dirfd(input_dir);
-	if (input_dir_fd < 0) {
+	ctx.input_dir_fd = dirfd(input_dir);
+	if (ctx.input_dir_fd < 0) {
 		PERROR("dirfd");
-		return -1;
+		ret = -1;
+		goto end_close_input;
 	}
 
 	/* Open output directory */
 	output_dir = opendir(output_path);
 	if (!output_dir) {
 		PERROR("Cannot open '%s' path", output_path);
-		return -1;
+		ret = -1;
+		goto end_close_input;
 	}
-	output_dir_fd = dirfd(output_dir);
-	if (output_dir_fd < 0) {
+	ctx.output_dir_fd = dirfd(output_dir);
+	if (ctx.output_dir_fd < 0) {
 		PERROR("dirfd");
-		return -1;
+		ret = -1;
+		goto end;
 	}
 
 	while ((entry = readdir(input_dir))) {
+		char *name;
+
 		if (!strcmp(entry->d_name, ".")
 				|| !strcmp(entry->d_name, ".."))
 			continue;
-		ret = extract_file(output_dir_fd, entry->d_name,
-			input_dir_fd, entry->d_name);
-		if (ret == -ENODATA) {
-			DBG("No data in file '%s', skipping", entry->d_name);
-			ret = 0;
-			continue;
-		} else if (ret < 0) {
+		name = strdup(entry->d_name);
+		if (!name) {
+			PERROR("strdup");
+			ret = -1;
+			goto end;
+		}
+		ret = lttng_dynamic_pointer_array_add_pointer(&ctx.files,
+				name);
+		if (ret) {
+			ERR("Failed to add file '%s' to extraction list",
+				name);
+			free(name);
+			ret = -1;
+			goto end;
+		}
+	}
+
+	nr_jobs = get_nr_jobs(lttng_dynamic_pointer_array_get_count(
+			&ctx.files));
+	DBG("Extracting %zu file(s) of '%s' using %ld thread(s)",
+		lttng_dynamic_pointer_array_get_count(&ctx.files),
+		input_path, nr_jobs);
+	if (nr_jobs > 1) {
+		threads = zmalloc(sizeof(*threads) * (nr_jobs - 1));
+		if (!threads) {
+			PERROR("zmalloc extraction threads");
+			ret = -1;
+			goto end;
+		}
+	}
+	/* The current thread acts as the last worker. */
+	for (nr_threads = 0; nr_threads < nr_jobs - 1; nr_threads++) {
+		ret = pthread_create(&threads[nr_threads], NULL,
+				extract_files_worker, &ctx);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create extraction thread");
+			/* Carry on with the threads that could be created. */
 			break;
-		} else if (ret > 0) {
-			DBG("Skipping file '%s'", entry->d_name);
-			ret = 0;
-			continue;
 		}
 	}
+	extract_files_worker(&ctx);
+	for (i = 0; i < nr_threads; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join extraction thread");
+		}
+	}
+	ret = ctx.ret;
+end:
+	free(threads);
 	closeret = closedir(output_dir);
 	if (closeret) {
 		PERROR("closedir");
 	}
+end_close_input:
 	closeret = closedir(input_dir);
 	if (closeret) {
 		PERROR("closedir");
 	}
+end_no_closedir:
+	lttng_dynamic_pointer_array_reset(&ctx.files);
 	return ret;
 }
 
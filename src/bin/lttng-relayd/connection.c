@@ -18,7 +18,10 @@
  */
 
 #define _LGPL_SOURCE
+#include <fcntl.h>
 #include <common/common.h>
+#include <common/defaults.h>
+#include <common/utils.h>
 #include <urcu/rculist.h>
 
 #include "connection.h"
@@ -111,6 +114,9 @@ struct relay_connection *connection_create(struct lttcomm_sock *sock,
 	lttng_ht_node_init_ulong(&conn->sock_n, (unsigned long) conn->sock->fd);
 	if (conn->type == RELAY_CONTROL) {
 		lttng_dynamic_buffer_init(&conn->protocol.ctrl.reception_buffer);
+	} else if (conn->type == RELAY_DATA) {
+		conn->protocol.data.splice_pipe[0] = -1;
+		conn->protocol.data.splice_pipe[1] = -1;
 	}
 	connection_reset_protocol_state(conn);
 end:
@@ -130,6 +136,8 @@ static void rcu_free_connection(struct rcu_head *head)
 	if (conn->type == RELAY_CONTROL) {
 		lttng_dynamic_buffer_reset(
 				&conn->protocol.ctrl.reception_buffer);
+	} else if (conn->type == RELAY_DATA) {
+		utils_close_pipe(conn->protocol.data.splice_pipe);
 	}
 	free(conn);
 }
@@ -181,6 +189,76 @@ void connection_ht_add(struct lttng_ht *relay_connections_ht,
 	conn->socket_ht = relay_connections_ht;
 }
 
+void connection_ht_del(struct relay_connection *conn)
+{
+	struct lttng_ht_iter iter;
+	int ret;
+
+	assert(conn->in_socket_ht);
+	rcu_read_lock();
+	iter.iter.node = &conn->sock_n.node;
+	ret = lttng_ht_del(conn->socket_ht, &iter);
+	assert(!ret);
+	rcu_read_unlock();
+	conn->in_socket_ht = 0;
+	conn->socket_ht = NULL;
+}
+
+/*
+ * Create the pipe used to splice the payloads received on a data connection
+ * to the stream files.
+ *
+ * The connection's socket is made non-blocking since, unlike recvmsg(),
+ * splice(2) has no per-call equivalent of MSG_DONTWAIT for the socket.
+ */
+int connection_create_splice_pipe(struct relay_connection *conn)
+{
+	int ret, flags;
+
+	assert(conn->type == RELAY_DATA);
+	assert(conn->protocol.data.splice_pipe[0] < 0);
+
+	ret = utils_create_pipe_cloexec(conn->protocol.data.splice_pipe);
+	if (ret) {
+		goto end;
+	}
+
+#ifdef F_SETPIPE_SZ
+	/*
+	 * Every received segment uses a pipe buffer slot; enlarge the pipe so
+	 * that a full reception chunk can be spliced at once. Failing to do so
+	 * only results in shorter splices.
+	 */
+	if (fcntl(conn->protocol.data.splice_pipe[1], F_SETPIPE_SZ,
+			DEFAULT_RELAYD_SPLICE_PIPE_SIZE) < 0) {
+		DBG("Failed to set size of splice pipe of connection %d: %s",
+				conn->sock->fd, strerror(errno));
+	}
+#endif /* F_SETPIPE_SZ */
+
+	flags = fcntl(conn->sock->fd, F_GETFL);
+	if (flags < 0) {
+		PERROR("fcntl F_GETFL on data connection socket %d",
+				conn->sock->fd);
+		ret = -1;
+		goto error;
+	}
+
+	ret = fcntl(conn->sock->fd, F_SETFL, flags | O_NONBLOCK);
+	if (ret < 0) {
+		PERROR("fcntl F_SETFL O_NONBLOCK on data connection socket %d",
+				conn->sock->fd);
+		goto error;
+	}
+end:
+	return ret;
+error:
+	utils_close_pipe(conn->protocol.data.splice_pipe);
+	conn->protocol.data.splice_pipe[0] = -1;
+	conn->protocol.data.splice_pipe[1] = -1;
+	return ret;
+}
+
 int connection_set_session(struct relay_connection *conn,
 		struct relay_session *session)
 {
@@ -127,6 +127,12 @@ struct relay_connection {
 				struct data_connection_state_receive_header receive_header;
 				struct data_connection_state_receive_payload receive_payload;
 			} state;
+			/*
+			 * Pipe through which payloads are spliced from the
+			 * socket to the stream files. Set to -1 unless
+			 * zero-copy reception is enabled.
+			 */
+			int splice_pipe[2];
 		} data;
 		struct {
 			enum ctrl_connection_state state_id;
@@ -148,6 +154,8 @@ bool connection_get(struct relay_connection *connection);
 void connection_put(struct relay_connection *connection);
 void connection_ht_add(struct lttng_ht *relay_connections_ht,
 		struct relay_connection *conn);
+void connection_ht_del(struct relay_connection *conn);
+int connection_create_splice_pipe(struct relay_connection *conn);
 int connection_set_session(struct relay_connection *conn,
 		struct relay_session *session);
 
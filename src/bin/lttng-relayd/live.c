@@ -29,6 +29,9 @@
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -46,6 +49,8 @@
 #include <common/compat/socket.h>
 #include <common/compat/endian.h>
 #include <common/defaults.h>
+#include <common/dynamic-array.h>
+#include <common/dynamic-buffer.h>
 #include <common/futex.h>
 #include <common/index/index.h>
 #include <common/sessiond-comm/sessiond-comm.h>
@@ -72,17 +77,29 @@
 static struct lttng_uri *live_uri;
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * A live worker thread owns the viewer connections handed to it by the
+ * dispatcher thread and services their commands until they are closed.
  */
-static int live_conn_pipe[2] = { -1, -1 };
+struct live_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * queued and ready to be processed.
+	 */
+	int conn_pipe[2];
+	bool thread_created;
+};
 
 /* Shared between threads */
 static int live_dispatch_thread_exit;
 
 static pthread_t live_listener_thread;
 static pthread_t live_dispatcher_thread;
-static pthread_t live_worker_thread;
+
+/* Pool of nr_live_workers viewer connection worker threads. */
+static struct live_worker *live_workers;
+static unsigned int nr_live_workers;
 
 /*
  * Relay command queue.
@@ -105,6 +122,8 @@ void cleanup_relayd_live(void)
 	DBG("Cleaning up");
 
 	free(live_uri);
+	free(live_workers);
+	live_workers = NULL;
 }
 
 /*
@@ -671,6 +690,24 @@ error_sock_control:
 	return NULL;
 }
 
+/*
+ * Select the worker thread to which a new viewer connection is handed.
+ *
+ * A viewer connection is serviced by a single worker for its whole lifetime:
+ * the viewer session it creates, and thus the viewer streams it reads, are
+ * only ever used by that connection. New connections are spread across the
+ * workers in a round-robin fashion.
+ */
+static struct live_worker *live_worker_select(void)
+{
+	static unsigned int next_worker;
+	struct live_worker *worker;
+
+	worker = &live_workers[next_worker];
+	next_worker = (next_worker + 1) % nr_live_workers;
+	return worker;
+}
+
 /*
  * This thread manages the dispatching of the requests to worker threads
  */
@@ -703,6 +740,8 @@ void *thread_dispatcher(void *data)
 		}
 
 		do {
+			struct live_worker *worker;
+
 			health_code_update();
 
 			/* Dequeue commands */
@@ -715,8 +754,9 @@ void *thread_dispatcher(void *data)
 				break;
 			}
 			conn = caa_container_of(node, struct relay_connection, qnode);
-			DBG("Dispatching viewer request waiting on sock %d",
-					conn->sock->fd);
+			worker = live_worker_select();
+			DBG("Dispatching viewer request waiting on sock %d to worker %u",
+					conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -724,7 +764,8 @@ void *thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(live_conn_pipe[1], &conn, sizeof(conn));
+			ret = lttng_write(worker->conn_pipe[1], &conn,
+					sizeof(conn));
 			if (ret < 0) {
 				PERROR("write conn pipe");
 				connection_put(conn);
@@ -1354,59 +1395,31 @@ index_ready:
 }
 
 /*
- * Send the next index for a stream.
+ * Get the next index of a viewer stream, as sent in reply to
+ * LTTNG_VIEWER_GET_NEXT_INDEX. The index status is LTTNG_VIEWER_INDEX_OK if an
+ * index was read, in which case the viewer stream moves on to the next one.
+ *
+ * The flags of the index are set in host byte order. The viewer stream can be
+ * put in the HUP situation, see check_index_status().
  *
  * Return 0 on success or else a negative value.
+ *
+ * Called with rstream lock held.
  */
-static
-int viewer_get_next_index(struct relay_connection *conn)
+static int get_next_viewer_index(struct relay_connection *conn,
+		struct relay_viewer_stream *vstream,
+		struct lttng_viewer_index *index)
 {
 	int ret;
-	struct lttng_viewer_get_next_index request_index;
-	struct lttng_viewer_index viewer_index;
 	struct ctf_packet_index packet_index;
-	struct relay_viewer_stream *vstream = NULL;
-	struct relay_stream *rstream = NULL;
-	struct ctf_trace *ctf_trace = NULL;
-	struct relay_viewer_stream *metadata_viewer_stream = NULL;
-
-	assert(conn);
-
-	DBG("Viewer get next index");
-
-	memset(&viewer_index, 0, sizeof(viewer_index));
-	health_code_update();
-
-	ret = recv_request(conn->sock, &request_index, sizeof(request_index));
-	if (ret < 0) {
-		goto end;
-	}
-	health_code_update();
-
-	vstream = viewer_stream_get_by_id(be64toh(request_index.stream_id));
-	if (!vstream) {
-		DBG("Client requested index of unknown stream id %" PRIu64,
-				(uint64_t) be64toh(request_index.stream_id));
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
-	}
-
-	/* Use back. ref. Protected by refcounts. */
-	rstream = vstream->stream;
-	ctf_trace = rstream->trace;
-
-	/* metadata_viewer_stream may be NULL. */
-	metadata_viewer_stream =
-			ctf_trace_get_viewer_metadata_stream(ctf_trace);
-
-	pthread_mutex_lock(&rstream->lock);
+	struct relay_stream *rstream = vstream->stream;
 
 	/*
 	 * The viewer should not ask for index on metadata stream.
 	 */
 	if (rstream->is_metadata) {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_HUP);
-		goto send_reply;
+		index->status = htobe32(LTTNG_VIEWER_INDEX_HUP);
+		goto end;
 	}
 
 	/* Try to open an index if one is needed for that stream. */
@@ -1418,23 +1431,23 @@ int viewer_get_next_index(struct relay_connection *conn)
 			 * packet arrives, it might not be ready at the
 			 * beginning of the session
 			 */
-			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
+			index->status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
 		} else {
 			/* Unhandled error. */
-			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+			index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
 		}
-		goto send_reply;
+		goto end;
 	}
 
-	ret = check_index_status(vstream, rstream, ctf_trace, &viewer_index);
+	ret = check_index_status(vstream, rstream, rstream->trace, index);
 	if (ret < 0) {
-		goto error_put;
+		goto error;
 	} else if (ret == 1) {
 		/*
 		 * We have no index to send and check_index_status has populated
-		 * viewer_index's status.
+		 * the index's status.
 		 */
-		goto send_reply;
+		goto end;
 	}
 	/* At this point, ret is 0 thus we will be able to read the index. */
 	assert(!ret);
@@ -1456,7 +1469,7 @@ int viewer_get_next_index(struct relay_connection *conn)
 				vstream->current_tracefile_id, NULL, file_path,
 				sizeof(file_path));
 		if (ret < 0) {
-			goto error_put;
+			goto error;
 		}
 
 		status = lttng_trace_chunk_open_file(
@@ -1464,33 +1477,35 @@ int viewer_get_next_index(struct relay_connection *conn)
 				file_path, O_RDONLY, 0, &fd);
 		if (status != LTTNG_TRACE_CHUNK_STATUS_OK) {
 			PERROR("Failed to open trace file for viewer stream");
-			goto error_put;
+			ret = -1;
+			goto error;
 		}
 		vstream->stream_file.fd = stream_fd_create(fd);
 		if (!vstream->stream_file.fd) {
 			if (close(fd)) {
 				PERROR("Failed to close viewer stream file");
 			}
-			goto error_put;
+			ret = -1;
+			goto error;
 		}
 	}
 
 	ret = check_new_streams(conn);
 	if (ret < 0) {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+		index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	} else if (ret == 1) {
-		viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
+		index->flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
 	}
 
 	ret = lttng_index_file_read(vstream->index_file, &packet_index);
 	if (ret) {
 		ERR("Relay error reading index file %d",
 				vstream->index_file->fd);
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+		index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	} else {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_OK);
+		index->status = htobe32(LTTNG_VIEWER_INDEX_OK);
 		vstream->index_sent_seqcount++;
 	}
 
@@ -1500,33 +1515,99 @@ int viewer_get_next_index(struct relay_connection *conn)
 	DBG("Sending viewer index for stream %" PRIu64 " offset %" PRIu64,
 		rstream->stream_handle,
 		(uint64_t) be64toh(packet_index.offset));
-	viewer_index.offset = packet_index.offset;
-	viewer_index.packet_size = packet_index.packet_size;
-	viewer_index.content_size = packet_index.content_size;
-	viewer_index.timestamp_begin = packet_index.timestamp_begin;
-	viewer_index.timestamp_end = packet_index.timestamp_end;
-	viewer_index.events_discarded = packet_index.events_discarded;
-	viewer_index.stream_id = packet_index.stream_id;
+	index->offset = packet_index.offset;
+	index->packet_size = packet_index.packet_size;
+	index->content_size = packet_index.content_size;
+	index->timestamp_begin = packet_index.timestamp_begin;
+	index->timestamp_end = packet_index.timestamp_end;
+	index->events_discarded = packet_index.events_discarded;
+	index->stream_id = packet_index.stream_id;
 
-send_reply:
-	if (rstream) {
-		pthread_mutex_unlock(&rstream->lock);
-	}
-
-	if (metadata_viewer_stream) {
-		pthread_mutex_lock(&metadata_viewer_stream->stream->lock);
-		DBG("get next index metadata check: recv %" PRIu64
-				" sent %" PRIu64,
-			metadata_viewer_stream->stream->metadata_received,
-			metadata_viewer_stream->metadata_sent);
-		if (!metadata_viewer_stream->stream->metadata_received ||
-				metadata_viewer_stream->stream->metadata_received >
-					metadata_viewer_stream->metadata_sent) {
-			viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_METADATA;
-		}
-		pthread_mutex_unlock(&metadata_viewer_stream->stream->lock);
+end:
+	ret = 0;
+error:
+	return ret;
+}
+
+/*
+ * Check whether the viewer must get new metadata before reading the packets
+ * of a trace.
+ */
+static bool viewer_trace_has_new_metadata(struct ctf_trace *ctf_trace)
+{
+	bool new_metadata = false;
+	struct relay_viewer_stream *metadata_viewer_stream;
+
+	/* metadata_viewer_stream may be NULL. */
+	metadata_viewer_stream =
+			ctf_trace_get_viewer_metadata_stream(ctf_trace);
+	if (!metadata_viewer_stream) {
+		goto end;
+	}
+
+	pthread_mutex_lock(&metadata_viewer_stream->stream->lock);
+	DBG("get next index metadata check: recv %" PRIu64
+			" sent %" PRIu64,
+		metadata_viewer_stream->stream->metadata_received,
+		metadata_viewer_stream->metadata_sent);
+	if (!metadata_viewer_stream->stream->metadata_received ||
+			metadata_viewer_stream->stream->metadata_received >
+				metadata_viewer_stream->metadata_sent) {
+		new_metadata = true;
+	}
+	pthread_mutex_unlock(&metadata_viewer_stream->stream->lock);
+	viewer_stream_put(metadata_viewer_stream);
+end:
+	return new_metadata;
+}
+
+/*
+ * Send the next index for a stream.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_next_index(struct relay_connection *conn)
+{
+	int ret;
+	struct lttng_viewer_get_next_index request_index;
+	struct lttng_viewer_index viewer_index;
+	struct relay_viewer_stream *vstream = NULL;
+
+	assert(conn);
+
+	DBG("Viewer get next index");
+
+	memset(&viewer_index, 0, sizeof(viewer_index));
+	health_code_update();
+
+	ret = recv_request(conn->sock, &request_index, sizeof(request_index));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	vstream = viewer_stream_get_by_id(be64toh(request_index.stream_id));
+	if (!vstream) {
+		DBG("Client requested index of unknown stream id %" PRIu64,
+				(uint64_t) be64toh(request_index.stream_id));
+		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto send_reply;
+	}
+
+	pthread_mutex_lock(&vstream->stream->lock);
+	ret = get_next_viewer_index(conn, vstream, &viewer_index);
+	pthread_mutex_unlock(&vstream->stream->lock);
+	if (ret < 0) {
+		goto end;
 	}
 
+	/* Use back. ref. Protected by refcounts. */
+	if (viewer_trace_has_new_metadata(vstream->stream->trace)) {
+		viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_METADATA;
+	}
+
+send_reply:
 	viewer_index.flags = htobe32(viewer_index.flags);
 	health_code_update();
 
@@ -1542,90 +1623,423 @@ send_reply:
 				vstream->stream->stream_handle);
 	}
 end:
-	if (metadata_viewer_stream) {
-		viewer_stream_put(metadata_viewer_stream);
-	}
 	if (vstream) {
 		viewer_stream_put(vstream);
 	}
 	return ret;
+}
+
+/*
+ * Stream whose indexes are gathered in reply to LTTNG_VIEWER_GET_NEXT_INDEXES.
+ */
+struct viewer_indexes_stream {
+	struct relay_viewer_stream *vstream;
+	/* No more index of this stream can be part of the reply. */
+	bool done;
+};
+
+/* Index gathered in reply to LTTNG_VIEWER_GET_NEXT_INDEXES. */
+struct viewer_indexes_entry {
+	struct lttng_viewer_stream_index index;
+	/* Position of the index's stream in the gathered streams. */
+	size_t stream_pos;
+};
+
+static void viewer_indexes_stream_put(void *element)
+{
+	struct viewer_indexes_stream *stream = element;
 
-error_put:
-	pthread_mutex_unlock(&rstream->lock);
-	if (metadata_viewer_stream) {
-		viewer_stream_put(metadata_viewer_stream);
+	viewer_stream_put(stream->vstream);
+}
+
+/*
+ * Get a reference on the data viewer streams of a session which were sent to
+ * the viewer.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int get_session_viewer_streams(struct relay_session *session,
+		struct lttng_dynamic_array *streams)
+{
+	int ret = 0;
+	struct lttng_ht_iter iter;
+	struct relay_viewer_stream *vstream;
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(viewer_streams_ht->ht, &iter.iter, vstream,
+			stream_n.node) {
+		struct viewer_indexes_stream stream = {};
+		bool skip;
+
+		health_code_update();
+
+		if (!viewer_stream_get(vstream)) {
+			continue;
+		}
+
+		pthread_mutex_lock(&vstream->stream->lock);
+		skip = vstream->stream->trace->session != session ||
+				vstream->stream->is_metadata ||
+				!vstream->sent_flag;
+		pthread_mutex_unlock(&vstream->stream->lock);
+		if (skip) {
+			viewer_stream_put(vstream);
+			continue;
+		}
+
+		stream.vstream = vstream;
+		ret = lttng_dynamic_array_add_element(streams, &stream);
+		if (ret) {
+			ERR("Failed to add viewer stream to the index reply");
+			viewer_stream_put(vstream);
+			goto end;
+		}
 	}
-	viewer_stream_put(vstream);
+
+end:
+	rcu_read_unlock();
 	return ret;
 }
 
 /*
- * Send the next index for a stream
+ * Send the next indexes of a stream, or of all the streams of a session.
  *
  * Return 0 on success or else a negative value.
  */
 static
-int viewer_get_packet(struct relay_connection *conn)
+int viewer_get_next_indexes(struct relay_connection *conn)
 {
 	int ret;
-	off_t lseek_ret;
-	char *reply = NULL;
-	struct lttng_viewer_get_packet get_packet_info;
-	struct lttng_viewer_trace_packet reply_header;
-	struct relay_viewer_stream *vstream = NULL;
-	uint32_t reply_size = sizeof(reply_header);
-	uint32_t packet_data_len = 0;
-	ssize_t read_len;
+	size_t i;
+	uint32_t max_indexes, flags;
+	uint64_t id;
+	bool progress = true;
+	struct lttng_viewer_get_next_indexes request;
+	struct lttng_viewer_indexes reply;
+	struct lttng_dynamic_array streams, entries;
+	struct lttng_dynamic_buffer payload;
+	struct relay_session *session = NULL;
 
-	DBG2("Relay get data packet");
+	assert(conn);
+
+	DBG("Viewer get next indexes");
 
+	memset(&reply, 0, sizeof(reply));
+	lttng_dynamic_array_init(&streams, sizeof(struct viewer_indexes_stream),
+			viewer_indexes_stream_put);
+	lttng_dynamic_array_init(&entries, sizeof(struct viewer_indexes_entry),
+			NULL);
+	lttng_dynamic_buffer_init(&payload);
 	health_code_update();
 
-	ret = recv_request(conn->sock, &get_packet_info,
-			sizeof(get_packet_info));
+	ret = recv_request(conn->sock, &request, sizeof(request));
 	if (ret < 0) {
 		goto end;
 	}
 	health_code_update();
 
-	/* From this point on, the error label can be reached. */
+	id = be64toh(request.id);
+	flags = be32toh(request.flags);
+	max_indexes = be32toh(request.max_indexes);
+	if (max_indexes == 0 ||
+			max_indexes > DEFAULT_LIVE_MAX_INDEXES_PER_REPLY) {
+		max_indexes = DEFAULT_LIVE_MAX_INDEXES_PER_REPLY;
+	}
+
+	if (flags & LTTNG_VIEWER_GET_NEXT_INDEXES_SESSION) {
+		session = session_get_by_id(id);
+		if (!session) {
+			DBG("Relay session %" PRIu64 " not found", id);
+			reply.status = htobe32(LTTNG_VIEWER_INDEXES_ERR);
+			goto send_reply;
+		}
+		if (!viewer_session_is_attached(conn->viewer_session,
+				session)) {
+			reply.status = htobe32(LTTNG_VIEWER_INDEXES_ERR);
+			goto send_reply;
+		}
+		ret = get_session_viewer_streams(session, &streams);
+		if (ret) {
+			goto end;
+		}
+	} else {
+		struct viewer_indexes_stream stream = {};
+
+		stream.vstream = viewer_stream_get_by_id(id);
+		if (!stream.vstream) {
+			DBG("Client requested indexes of unknown stream id %" PRIu64,
+					id);
+			reply.status = htobe32(LTTNG_VIEWER_INDEXES_ERR);
+			goto send_reply;
+		}
+		ret = lttng_dynamic_array_add_element(&streams, &stream);
+		if (ret) {
+			viewer_stream_put(stream.vstream);
+			goto end;
+		}
+	}
+
+	/*
+	 * Streams take turns so that the streams following a busy one get
+	 * their share of the reply.
+	 */
+	while (progress &&
+			lttng_dynamic_array_get_count(&entries) < max_indexes) {
+		progress = false;
+
+		for (i = 0; i < lttng_dynamic_array_get_count(&streams) &&
+				lttng_dynamic_array_get_count(&entries) <
+					max_indexes; i++) {
+			struct viewer_indexes_stream *stream =
+					lttng_dynamic_array_get_element(
+						&streams, i);
+			struct viewer_indexes_entry entry;
+			uint32_t status;
+
+			if (stream->done) {
+				continue;
+			}
+
+			health_code_update();
+
+			memset(&entry, 0, sizeof(entry));
+			entry.stream_pos = i;
+			entry.index.stream_id = htobe64(
+					stream->vstream->stream->stream_handle);
+
+			pthread_mutex_lock(&stream->vstream->stream->lock);
+			ret = get_next_viewer_index(conn, stream->vstream,
+					&entry.index.index);
+			pthread_mutex_unlock(&stream->vstream->stream->lock);
+			if (ret < 0) {
+				goto end;
+			}
+
+			status = be32toh(entry.index.index.status);
+			if (status == LTTNG_VIEWER_INDEX_RETRY) {
+				/* No index ready, leave it out of the reply. */
+				stream->done = true;
+				continue;
+			}
+			if (status != LTTNG_VIEWER_INDEX_OK) {
+				stream->done = true;
+			}
+
+			ret = lttng_dynamic_array_add_element(&entries, &entry);
+			if (ret) {
+				ERR("Failed to add index to the index reply");
+				goto end;
+			}
+			progress = true;
+		}
+	}
+
+	/*
+	 * Check for new metadata once the indexes of a stream are read since
+	 * they may refer to metadata received in the meantime.
+	 */
+	for (i = 0; i < lttng_dynamic_array_get_count(&streams); i++) {
+		struct viewer_indexes_stream *stream =
+				lttng_dynamic_array_get_element(&streams, i);
+		bool new_metadata = false, checked = false;
+		size_t j;
+
+		for (j = 0; j < lttng_dynamic_array_get_count(&entries); j++) {
+			struct viewer_indexes_entry *entry =
+					lttng_dynamic_array_get_element(
+						&entries, j);
+
+			if (entry->stream_pos != i) {
+				continue;
+			}
+			if (!checked) {
+				new_metadata = viewer_trace_has_new_metadata(
+						stream->vstream->stream->trace);
+				checked = true;
+			}
+			if (new_metadata) {
+				entry->index.index.flags |=
+						LTTNG_VIEWER_FLAG_NEW_METADATA;
+			}
+			entry->index.index.flags =
+					htobe32(entry->index.index.flags);
+		}
+	}
+
+	reply.status = htobe32(LTTNG_VIEWER_INDEXES_OK);
+	reply.index_count = htobe32(lttng_dynamic_array_get_count(&entries));
+
+send_reply:
+	ret = lttng_dynamic_buffer_append(&payload, &reply, sizeof(reply));
+	if (ret) {
+		goto end;
+	}
+	for (i = 0; i < lttng_dynamic_array_get_count(&entries); i++) {
+		const struct viewer_indexes_entry *entry =
+				lttng_dynamic_array_get_element(&entries, i);
+
+		ret = lttng_dynamic_buffer_append(&payload, &entry->index,
+				sizeof(entry->index));
+		if (ret) {
+			goto end;
+		}
+	}
+	health_code_update();
+
+	ret = send_response(conn->sock, payload.data, payload.size);
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	DBG("Sent %zu indexes in reply to get next indexes of %s %" PRIu64,
+			lttng_dynamic_array_get_count(&entries),
+			session ? "session" : "stream", id);
+end:
+	lttng_dynamic_buffer_reset(&payload);
+	lttng_dynamic_array_reset(&entries);
+	lttng_dynamic_array_reset(&streams);
+	if (session) {
+		session_put(session);
+	}
+	return ret;
+}
+
+/*
+ * Send 'len' bytes of a trace file, starting at 'offset', on a viewer socket
+ * without using nor changing the file position.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int send_file_range(struct lttcomm_sock *sock, int fd, off_t offset,
+		size_t len)
+{
+	int ret = 0;
+
+#ifdef __linux__
+	while (len > 0) {
+		ssize_t sent;
+
+		sent = sendfile(sock->fd, fd, &offset, len);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EINVAL || errno == ENOSYS) {
+				/* Not supported by this file, copy the rest. */
+				goto copy;
+			}
+			PERROR("sendfile of trace file fd %d to viewer", fd);
+			ret = -1;
+			goto end;
+		} else if (sent == 0) {
+			ERR("Unexpected end of trace file fd %d at offset %jd",
+					fd, (intmax_t) offset);
+			ret = -1;
+			goto end;
+		}
+		len -= sent;
+	}
+	goto end;
+
+copy:
+#endif /* __linux__ */
+	while (len > 0) {
+		char buf[16384];
+		ssize_t read_len, sent;
+
+		read_len = pread(fd, buf, min_t(size_t, len, sizeof(buf)),
+				offset);
+		if (read_len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PERROR("pread of trace file fd %d", fd);
+			ret = -1;
+			goto end;
+		} else if (read_len == 0) {
+			ERR("Unexpected end of trace file fd %d at offset %jd",
+					fd, (intmax_t) offset);
+			ret = -1;
+			goto end;
+		}
+
+		sent = send_response(sock, buf, read_len);
+		if (sent < 0) {
+			ret = -1;
+			goto end;
+		}
+		offset += read_len;
+		len -= read_len;
+	}
+
+end:
+	return ret;
+}
+
+/*
+ * Send a packet of a viewer stream, preceded by its reply header.
+ *
+ * The packet is sent from the stream's trace file, which is only referenced
+ * under the stream lock: the lock is not held during the send so that a slow
+ * viewer does not hold back the reception of the stream's data.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int send_viewer_packet(struct relay_connection *conn,
+		const struct lttng_viewer_get_packet *get_packet_info)
+{
+	int ret;
+	struct stat st;
+	struct lttng_viewer_trace_packet reply_header;
+	struct relay_viewer_stream *vstream = NULL;
+	struct stream_fd *packet_fd = NULL;
+	const uint64_t offset = be64toh(get_packet_info->offset);
+	uint32_t packet_data_len = 0;
+	int flags = 0;
+
 	memset(&reply_header, 0, sizeof(reply_header));
 
-	vstream = viewer_stream_get_by_id(be64toh(get_packet_info.stream_id));
+	vstream = viewer_stream_get_by_id(be64toh(get_packet_info->stream_id));
 	if (!vstream) {
 		DBG("Client requested packet of unknown stream id %" PRIu64,
-				(uint64_t) be64toh(get_packet_info.stream_id));
+				(uint64_t) be64toh(get_packet_info->stream_id));
 		reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
-		goto send_reply_nolock;
-	} else {
-		packet_data_len = be32toh(get_packet_info.len);
-		reply_size += packet_data_len;
+		goto send_reply;
 	}
 
-	reply = zmalloc(reply_size);
-	if (!reply) {
-		PERROR("packet reply zmalloc");
-		reply_size = sizeof(reply_header);
+	pthread_mutex_lock(&vstream->stream->lock);
+	packet_fd = vstream->stream_file.fd;
+	if (packet_fd) {
+		stream_fd_get(packet_fd);
+	}
+	pthread_mutex_unlock(&vstream->stream->lock);
+	if (!packet_fd) {
+		ERR("Client requested packet of stream %" PRIu64 " without trace file",
+				vstream->stream->stream_handle);
 		goto error;
 	}
 
-	pthread_mutex_lock(&vstream->stream->lock);
-	lseek_ret = lseek(vstream->stream_file.fd->fd,
-			be64toh(get_packet_info.offset), SEEK_SET);
-	if (lseek_ret < 0) {
-		PERROR("lseek fd %d to offset %" PRIu64,
-				vstream->stream_file.fd->fd,
-				(uint64_t) be64toh(get_packet_info.offset));
+	/*
+	 * The packet must be complete before sending the reply header: the
+	 * status of a reply can't be changed once the packet data is sent.
+	 */
+	ret = fstat(packet_fd->fd, &st);
+	if (ret < 0) {
+		PERROR("fstat of trace file fd %d", packet_fd->fd);
 		goto error;
 	}
-	read_len = lttng_read(vstream->stream_file.fd->fd,
-			reply + sizeof(reply_header), packet_data_len);
-	if (read_len < packet_data_len) {
-		PERROR("Relay reading trace file, fd: %d, offset: %" PRIu64,
-				vstream->stream_file.fd->fd,
-				(uint64_t) be64toh(get_packet_info.offset));
+	if (offset > (uint64_t) st.st_size ||
+			be32toh(get_packet_info->len) >
+				(uint64_t) st.st_size - offset) {
+		ERR("Relay reading trace file, fd: %d, offset: %" PRIu64
+				", len: %" PRIu32 " past end of file",
+				packet_fd->fd, offset,
+				(uint32_t) be32toh(get_packet_info->len));
 		goto error;
 	}
+	packet_data_len = be32toh(get_packet_info->len);
 	reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_OK);
 	reply_header.len = htobe32(packet_data_len);
 	goto send_reply;
@@ -1634,37 +2048,129 @@ error:
 	reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
 
 send_reply:
+	health_code_update();
+
+#ifdef MSG_MORE
+	if (packet_data_len) {
+		/* Coalesce the header with the start of the packet data. */
+		flags |= MSG_MORE;
+	}
+#endif
+	ret = conn->sock->ops->sendmsg(conn->sock, &reply_header,
+			sizeof(reply_header), flags);
+	if (ret < 0) {
+		ERR("Relayd failed to send response.");
+		goto end;
+	}
+	if (packet_data_len) {
+		ret = send_file_range(conn->sock, packet_fd->fd, offset,
+				packet_data_len);
+		if (ret < 0) {
+			ERR("Relayd failed to send packet data.");
+			goto end;
+		}
+	}
+
+	health_code_update();
+
+	DBG("Sent %zu bytes for stream %" PRIu64,
+			sizeof(reply_header) + packet_data_len,
+			(uint64_t) be64toh(get_packet_info->stream_id));
+	ret = 0;
+
+end:
+	if (packet_fd) {
+		stream_fd_put(packet_fd);
+	}
 	if (vstream) {
-		pthread_mutex_unlock(&vstream->stream->lock);
+		viewer_stream_put(vstream);
 	}
-send_reply_nolock:
+	return ret;
+}
+
+/*
+ * Send a data packet of a stream.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packet(struct relay_connection *conn)
+{
+	int ret;
+	struct lttng_viewer_get_packet get_packet_info;
+
+	DBG2("Relay get data packet");
 
 	health_code_update();
 
-	if (reply) {
-		memcpy(reply, &reply_header, sizeof(reply_header));
-		ret = send_response(conn->sock, reply, reply_size);
-	} else {
-		/* No reply to send. */
-		ret = send_response(conn->sock, &reply_header,
-				reply_size);
+	ret = recv_request(conn->sock, &get_packet_info,
+			sizeof(get_packet_info));
+	if (ret < 0) {
+		goto end;
 	}
+	health_code_update();
+
+	ret = send_viewer_packet(conn, &get_packet_info);
+end:
+	return ret;
+}
+
+/*
+ * Send several data packets, possibly of different streams, in the order of
+ * the request.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packets(struct relay_connection *conn)
+{
+	int ret;
+	uint32_t i, packet_count;
+	struct lttng_viewer_get_packets request;
+	struct lttng_viewer_get_packet *packets = NULL;
+
+	DBG2("Relay get data packets");
 
 	health_code_update();
+
+	ret = recv_request(conn->sock, &request, sizeof(request));
 	if (ret < 0) {
-		PERROR("sendmsg of packet data failed");
-		goto end_free;
+		goto end;
 	}
+	health_code_update();
 
-	DBG("Sent %u bytes for stream %" PRIu64, reply_size,
-			(uint64_t) be64toh(get_packet_info.stream_id));
+	packet_count = be32toh(request.packet_count);
+	if (packet_count == 0 ||
+			packet_count > DEFAULT_LIVE_MAX_PACKETS_PER_REQUEST) {
+		ERR("Invalid packet count in get packets request: %" PRIu32
+				" (max %d)", packet_count,
+				DEFAULT_LIVE_MAX_PACKETS_PER_REQUEST);
+		ret = -1;
+		goto end;
+	}
 
-end_free:
-	free(reply);
-end:
-	if (vstream) {
-		viewer_stream_put(vstream);
+	packets = calloc(packet_count, sizeof(*packets));
+	if (!packets) {
+		PERROR("get packets request calloc");
+		ret = -1;
+		goto end;
 	}
+
+	ret = recv_request(conn->sock, packets,
+			packet_count * sizeof(*packets));
+	if (ret < 0) {
+		goto end;
+	}
+
+	for (i = 0; i < packet_count; i++) {
+		ret = send_viewer_packet(conn, &packets[i]);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+
+end:
+	free(packets);
 	return ret;
 }
 
@@ -1937,6 +2443,15 @@ void live_relay_unknown_command(struct relay_connection *conn)
 	(void) send_response(conn->sock, &reply, sizeof(reply));
 }
 
+/*
+ * The batched index and packet commands are part of the 2.12 protocol.
+ */
+static
+bool viewer_supports_batched_commands(const struct relay_connection *conn)
+{
+	return conn->major > 2 || (conn->major == 2 && conn->minor >= 12);
+}
+
 /*
  * Process the commands received on the control socket
  */
@@ -1987,7 +2502,20 @@ int process_control(struct lttng_viewer_cmd *recv_hdr,
 	case LTTNG_VIEWER_DETACH_SESSION:
 		ret = viewer_detach_session(conn);
 		break;
+	case LTTNG_VIEWER_GET_NEXT_INDEXES:
+		if (!viewer_supports_batched_commands(conn)) {
+			goto unknown_command;
+		}
+		ret = viewer_get_next_indexes(conn);
+		break;
+	case LTTNG_VIEWER_GET_PACKETS:
+		if (!viewer_supports_batched_commands(conn)) {
+			goto unknown_command;
+		}
+		ret = viewer_get_packets(conn);
+		break;
 	default:
+	unknown_command:
 		ERR("Received unknown viewer command (%u)",
 				be32toh(recv_hdr->cmd));
 		live_relay_unknown_command(conn);
@@ -2025,8 +2553,10 @@ void *thread_worker(void *data)
 	struct lttng_ht_iter iter;
 	struct lttng_viewer_cmd recv_hdr;
 	struct relay_connection *destroy_conn;
+	struct live_worker *worker = data;
+	int *live_conn_pipe = worker->conn_pipe;
 
-	DBG("[thread] Live viewer relay worker started");
+	DBG("[thread] Live viewer relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -2059,7 +2589,8 @@ restart:
 		health_code_update();
 
 		/* Infinite blocking call, waiting for transmission */
-		DBG3("Relayd live viewer worker thread polling...");
+		DBG3("Relayd live viewer worker thread %u polling...",
+				worker->id);
 		health_poll_entry();
 		ret = lttng_poll_wait(&events, -1);
 		health_poll_exit();
@@ -2112,7 +2643,8 @@ restart:
 						goto error;
 					}
 					connection_ht_add(viewer_connections_ht, conn);
-					DBG("Connection socket %d added to poll", conn->sock->fd);
+					DBG("Connection socket %d added to poll of worker %u",
+							conn->sock->fd, worker->id);
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Relay live pipe error");
 					goto error;
@@ -2184,7 +2716,7 @@ viewer_connections_ht_error:
 	if (err) {
 		DBG("Viewer worker thread exited with error");
 	}
-	DBG("Viewer worker thread cleanup complete");
+	DBG("Viewer worker thread %u cleanup complete", worker->id);
 error_testpoint:
 	if (err) {
 		health_error();
@@ -2199,12 +2731,68 @@ error_testpoint:
 }
 
 /*
- * Create the relay command pipe to wake thread_manage_apps.
- * Closed in cleanup().
+ * Allocate the worker pool and create the connection pipe of each worker.
+ * The pipes are closed by their respective worker thread.
+ */
+static int create_live_workers(unsigned int nr_workers)
+{
+	int ret = 0;
+	unsigned int i;
+
+	live_workers = zmalloc(sizeof(*live_workers) * nr_workers);
+	if (!live_workers) {
+		PERROR("zmalloc live workers");
+		ret = -1;
+		goto end;
+	}
+	nr_live_workers = nr_workers;
+
+	for (i = 0; i < nr_live_workers; i++) {
+		live_workers[i].id = i;
+		live_workers[i].conn_pipe[0] = -1;
+		live_workers[i].conn_pipe[1] = -1;
+	}
+
+	for (i = 0; i < nr_live_workers; i++) {
+		ret = utils_create_pipe_cloexec(live_workers[i].conn_pipe);
+		if (ret) {
+			goto end;
+		}
+	}
+end:
+	return ret;
+}
+
+/*
+ * Join the worker threads that were launched and close the pipes of those
+ * that were not. Returns 0 on success, -1 if any of the threads could not be
+ * joined.
  */
-static int create_conn_pipe(void)
+static int join_live_workers(void)
 {
-	return utils_create_pipe_cloexec(live_conn_pipe);
+	int ret, retval = 0;
+	unsigned int i;
+	void *status;
+
+	if (!live_workers) {
+		goto end;
+	}
+
+	for (i = 0; i < nr_live_workers; i++) {
+		if (!live_workers[i].thread_created) {
+			utils_close_pipe(live_workers[i].conn_pipe);
+			continue;
+		}
+
+		ret = pthread_join(live_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join live worker %u", i);
+			retval = -1;
+		}
+	}
+end:
+	return retval;
 }
 
 int relayd_live_join(void)
@@ -2219,10 +2807,7 @@ int relayd_live_join(void)
 		retval = -1;
 	}
 
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
+	if (join_live_workers()) {
 		retval = -1;
 	}
 
@@ -2241,9 +2826,10 @@ int relayd_live_join(void)
 /*
  * main
  */
-int relayd_live_create(struct lttng_uri *uri)
+int relayd_live_create(struct lttng_uri *uri, unsigned int nr_worker_threads)
 {
 	int ret = 0, retval = 0;
+	unsigned int i;
 	void *status;
 	int is_root;
 
@@ -2264,8 +2850,8 @@ int relayd_live_create(struct lttng_uri *uri)
 		}
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_conn_pipe()) {
+	/* Setup the worker threads' connection pipes. */
+	if (create_live_workers(nr_worker_threads)) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -2289,15 +2875,20 @@ int relayd_live_create(struct lttng_uri *uri)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&live_worker_thread, default_pthread_attr(),
-			thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create viewer worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < nr_live_workers; i++) {
+		ret = pthread_create(&live_workers[i].thread,
+				default_pthread_attr(), thread_worker,
+				&live_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create viewer worker %u", i);
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		live_workers[i].thread_created = true;
 	}
+	DBG("Started %u live viewer worker thread(s)", nr_live_workers);
 
 	/* Setup the listener thread */
 	ret = pthread_create(&live_listener_thread, default_pthread_attr(),
@@ -2320,13 +2911,6 @@ int relayd_live_create(struct lttng_uri *uri)
 	 */
 
 exit_listener_thread:
-
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
-		retval = -1;
-	}
 exit_worker_thread:
 
 	ret = pthread_join(live_dispatcher_thread, &status);
@@ -2338,6 +2922,9 @@ exit_worker_thread:
 exit_dispatcher_thread:
 
 exit_init_data:
+	if (join_live_workers()) {
+		retval = -1;
+	}
 	cleanup_relayd_live();
 
 	return retval;
@@ -24,7 +24,8 @@
 
 #include "lttng-relayd.h"
 
-int relayd_live_create(struct lttng_uri *live_uri);
+int relayd_live_create(struct lttng_uri *live_uri,
+		unsigned int nr_worker_threads);
 int relayd_live_stop(void);
 int relayd_live_join(void);
 
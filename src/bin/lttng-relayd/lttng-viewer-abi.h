@@ -50,6 +50,9 @@ enum lttng_viewer_command {
 	LTTNG_VIEWER_GET_NEW_STREAMS	= 7,
 	LTTNG_VIEWER_CREATE_SESSION	= 8,
 	LTTNG_VIEWER_DETACH_SESSION	= 9,
+	/* Batched commands, protocol 2.12+. */
+	LTTNG_VIEWER_GET_NEXT_INDEXES	= 10,
+	LTTNG_VIEWER_GET_PACKETS	= 11,
 };
 
 enum lttng_viewer_attach_return_code {
@@ -70,6 +73,17 @@ enum lttng_viewer_next_index_return_code {
 	LTTNG_VIEWER_INDEX_EOF		= 6, /* End of index file. */
 };
 
+enum lttng_viewer_get_next_indexes_return_code {
+	LTTNG_VIEWER_INDEXES_OK		= 1, /* Indexes follow, if any. */
+	LTTNG_VIEWER_INDEXES_ERR	= 2, /* Unknown stream or session. */
+};
+
+/* Flags of the get_next_indexes request. */
+enum {
+	/* The id is a session id, get the indexes of all its streams. */
+	LTTNG_VIEWER_GET_NEXT_INDEXES_SESSION	= (1 << 0),
+};
+
 enum lttng_viewer_get_packet_return_code {
 	LTTNG_VIEWER_GET_PACKET_OK	= 1,
 	LTTNG_VIEWER_GET_PACKET_RETRY	= 2,
@@ -191,6 +205,35 @@ struct lttng_viewer_index {
 	uint32_t flags;		/* LTTNG_VIEWER_FLAG_* */
 } __attribute__ ((__packed__));
 
+/*
+ * LTTNG_VIEWER_GET_NEXT_INDEXES payload.
+ *
+ * The indexes of a stream are those that consecutive
+ * LTTNG_VIEWER_GET_NEXT_INDEX commands would return, in the same order,
+ * except LTTNG_VIEWER_INDEX_RETRY which is never returned: a stream without
+ * index in a reply has no index ready yet. When the indexes of all the
+ * streams of a session are requested, the streams take turns.
+ */
+struct lttng_viewer_get_next_indexes {
+	/* Stream id, or session id if LTTNG_VIEWER_GET_NEXT_INDEXES_SESSION. */
+	uint64_t id;
+	uint32_t flags;		/* LTTNG_VIEWER_GET_NEXT_INDEXES_* */
+	/* Maximal number of indexes to return, bounded by the relay daemon. */
+	uint32_t max_indexes;
+} LTTNG_PACKED;
+
+struct lttng_viewer_stream_index {
+	uint64_t stream_id;	/* Viewer stream id, see lttng_viewer_stream. */
+	struct lttng_viewer_index index;
+} LTTNG_PACKED;
+
+struct lttng_viewer_indexes {
+	uint32_t status;	/* enum lttng_viewer_get_next_indexes_return_code */
+	uint32_t index_count;
+	/* struct lttng_viewer_stream_index */
+	char index_list[];
+} LTTNG_PACKED;
+
 /*
  * LTTNG_VIEWER_GET_PACKET payload.
  */
@@ -207,6 +250,18 @@ struct lttng_viewer_trace_packet {
 	char data[];
 } LTTNG_PACKED;
 
+/*
+ * LTTNG_VIEWER_GET_PACKETS payload.
+ *
+ * The reply is made of one struct lttng_viewer_trace_packet, followed by its
+ * data, for each requested packet, in the order of the request.
+ */
+struct lttng_viewer_get_packets {
+	uint32_t packet_count;	/* Bounded by the relay daemon. */
+	/* struct lttng_viewer_get_packet */
+	char packet_list[];
+} LTTNG_PACKED;
+
 /*
  * LTTNG_VIEWER_GET_METADATA payload.
  */
@@ -19,6 +19,7 @@
  */
 
 #define _LGPL_SOURCE
+#include <ctype.h>
 #include <getopt.h>
 #include <grp.h>
 #include <limits.h>
@@ -99,6 +100,10 @@ enum relay_connection_status {
 /* command line options */
 char *opt_output_path, *opt_working_directory;
 static int opt_daemon, opt_background, opt_print_version;
+static unsigned int opt_worker_threads = DEFAULT_RELAYD_WORKER_THREADS;
+static unsigned int opt_live_worker_threads =
+		DEFAULT_RELAYD_LIVE_WORKER_THREADS;
+static int opt_zero_copy;
 enum relay_group_output_by opt_group_output_by = RELAYD_GROUP_OUTPUT_BY_UNKNOWN;
 
 /*
@@ -132,19 +137,30 @@ const char * const config_section_name = "relayd";
 int thread_quit_pipe[2] = { -1, -1 };
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * A worker thread owns the connections handed to it by the dispatcher thread
+ * and services them until they are closed.
  */
-static int relay_conn_pipe[2] = { -1, -1 };
+struct relay_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * queued and ready to be processed.
+	 */
+	int conn_pipe[2];
+	bool thread_created;
+};
 
 /* Shared between threads */
 static int dispatch_thread_exit;
 
 static pthread_t listener_thread;
 static pthread_t dispatcher_thread;
-static pthread_t worker_thread;
 static pthread_t health_thread;
 
+/* Pool of opt_worker_threads connection worker threads. */
+static struct relay_worker *relay_workers;
+
 /*
  * last_relay_stream_id_lock protects last_relay_stream_id increment
  * atomicity on 32-bit architectures.
@@ -189,6 +205,9 @@ static struct option long_options[] = {
 	{ "working-directory", 1, 0, 'w', },
 	{ "group-output-by-session", 0, 0, 's', },
 	{ "group-output-by-host", 0, 0, 'p', },
+	{ "worker-threads", 1, 0, 't', },
+	{ "live-worker-threads", 1, 0, 'T', },
+	{ "zero-copy", 0, 0, 'z', },
 	{ NULL, 0, 0, 0, },
 };
 
@@ -355,6 +374,42 @@ static int set_option(int opt, const char *arg, const char *optname)
 		}
 		opt_group_output_by = RELAYD_GROUP_OUTPUT_BY_HOST;
 		break;
+	case 't':
+	{
+		unsigned long v;
+
+		errno = 0;
+		v = strtoul(arg, NULL, 0);
+		if (errno != 0 || !isdigit(arg[0]) || v == 0 || v > UINT_MAX) {
+			ERR("Wrong value in --worker-threads parameter: %s", arg);
+			ret = -1;
+			goto end;
+		}
+		opt_worker_threads = (unsigned int) v;
+		DBG3("Number of relay worker threads set to %u",
+				opt_worker_threads);
+		break;
+	}
+	case 'T':
+	{
+		unsigned long v;
+
+		errno = 0;
+		v = strtoul(arg, NULL, 0);
+		if (errno != 0 || !isdigit(arg[0]) || v == 0 || v > UINT_MAX) {
+			ERR("Wrong value in --live-worker-threads parameter: %s",
+					arg);
+			ret = -1;
+			goto end;
+		}
+		opt_live_worker_threads = (unsigned int) v;
+		DBG3("Number of live viewer worker threads set to %u",
+				opt_live_worker_threads);
+		break;
+	}
+	case 'z':
+		opt_zero_copy = 1;
+		break;
 	default:
 		/* Unknown option or other error.
 		 * Error is printed by getopt, just return */
@@ -605,6 +660,8 @@ static void relayd_cleanup(void)
 	uri_free(data_uri);
 	/* Live URI is freed in the live thread. */
 
+	free(relay_workers);
+
 	if (tracing_group_name_override) {
 		free((void *) tracing_group_name);
 	}
@@ -992,6 +1049,14 @@ restart:
 					goto error;
 				}
 
+				if (type == RELAY_DATA && opt_zero_copy) {
+					ret = connection_create_splice_pipe(new_conn);
+					if (ret) {
+						WARN("Failed to enable zero-copy reception on data connection %d, falling back to buffered reception",
+								newsock->fd);
+					}
+				}
+
 				/* Enqueue request for the dispatcher thread. */
 				cds_wfcq_enqueue(&relay_conn_queue.head, &relay_conn_queue.tail,
 						 &new_conn->qnode);
@@ -1044,6 +1109,25 @@ error_sock_control:
 	return NULL;
 }
 
+/*
+ * Select the worker thread to which a new connection is handed.
+ *
+ * New connections are spread across the workers in a round-robin fashion.
+ * Since the session (if any) carried by a connection is only known once
+ * its first command or packet is received, data connections are later
+ * handed over to the worker servicing their session's control connection
+ * (see relay_worker_hand_over_connection()).
+ */
+static struct relay_worker *relay_worker_select(void)
+{
+	static unsigned int next_worker;
+	struct relay_worker *worker;
+
+	worker = &relay_workers[next_worker];
+	next_worker = (next_worker + 1) % opt_worker_threads;
+	return worker;
+}
+
 /*
  * This thread manages the dispatching of the requests to worker threads
  */
@@ -1075,6 +1159,8 @@ static void *relay_thread_dispatcher(void *data)
 		}
 
 		do {
+			struct relay_worker *worker;
+
 			health_code_update();
 
 			/* Dequeue commands */
@@ -1086,8 +1172,10 @@ static void *relay_thread_dispatcher(void *data)
 				break;
 			}
 			new_conn = caa_container_of(node, struct relay_connection, qnode);
+			worker = relay_worker_select();
 
-			DBG("Dispatching request waiting on sock %d", new_conn->sock->fd);
+			DBG("Dispatching request waiting on sock %d to worker %u",
+					new_conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -1095,7 +1183,8 @@ static void *relay_thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(relay_conn_pipe[1], &new_conn, sizeof(new_conn));
+			ret = lttng_write(worker->conn_pipe[1], &new_conn,
+					sizeof(new_conn));
 			if (ret < 0) {
 				PERROR("write connection pipe");
 				connection_put(new_conn);
@@ -1819,6 +1908,50 @@ end:
 	return ret;
 }
 
+/*
+ * Check whether the data of a stream is still pending up to the packet
+ * numbered last_net_seq_num and flag the stream as checked by the current
+ * data pending check.
+ *
+ * Return 1 if data is pending, 0 otherwise.
+ */
+static int stream_data_pending(struct relay_stream *stream,
+		struct relay_session *session, uint64_t last_net_seq_num)
+{
+	int ret;
+	uint64_t stream_seq;
+
+	pthread_mutex_lock(&stream->lock);
+
+	if (session_streams_have_index(session)) {
+		/*
+		 * Ensure that both the index and stream data have been
+		 * flushed up to the requested point.
+		 */
+		stream_seq = min(stream->prev_data_seq, stream->prev_index_seq);
+	} else {
+		stream_seq = stream->prev_data_seq;
+	}
+	DBG("Data pending for stream id %" PRIu64 ": prev_data_seq %" PRIu64
+			", prev_index_seq %" PRIu64
+			", and last_seq %" PRIu64, stream->stream_handle,
+			stream->prev_data_seq, stream->prev_index_seq,
+			last_net_seq_num);
+
+	/* Avoid wrapping issue */
+	if (((int64_t) (stream_seq - last_net_seq_num)) >= 0) {
+		/* Data has in fact been written and is NOT pending */
+		ret = 0;
+	} else {
+		/* Data still being streamed thus pending */
+		ret = 1;
+	}
+
+	stream->data_pending_check_done = true;
+	pthread_mutex_unlock(&stream->lock);
+	return ret;
+}
+
 /*
  * Check for data pending for a given stream id from the session daemon.
  */
@@ -1832,7 +1965,6 @@ static int relay_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 	struct relay_stream *stream;
 	ssize_t send_ret;
 	int ret;
-	uint64_t stream_seq;
 
 	DBG("Data pending command received");
 
@@ -1858,35 +1990,7 @@ static int relay_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 		goto end;
 	}
 
-	pthread_mutex_lock(&stream->lock);
-
-	if (session_streams_have_index(session)) {
-		/*
-		 * Ensure that both the index and stream data have been
-		 * flushed up to the requested point.
-		 */
-		stream_seq = min(stream->prev_data_seq, stream->prev_index_seq);
-	} else {
-		stream_seq = stream->prev_data_seq;
-	}
-	DBG("Data pending for stream id %" PRIu64 ": prev_data_seq %" PRIu64
-			", prev_index_seq %" PRIu64
-			", and last_seq %" PRIu64, msg.stream_id,
-			stream->prev_data_seq, stream->prev_index_seq,
-			msg.last_net_seq_num);
-
-	/* Avoid wrapping issue */
-	if (((int64_t) (stream_seq - msg.last_net_seq_num)) >= 0) {
-		/* Data has in fact been written and is NOT pending */
-		ret = 0;
-	} else {
-		/* Data still being streamed thus pending */
-		ret = 1;
-	}
-
-	stream->data_pending_check_done = true;
-	pthread_mutex_unlock(&stream->lock);
-
+	ret = stream_data_pending(stream, session, msg.last_net_seq_num);
 	stream_put(stream);
 end:
 
@@ -1964,6 +2068,38 @@ end_no_session:
 	return ret;
 }
 
+/*
+ * Clear the data_pending_check_done flag of all the streams of a session.
+ */
+static void session_begin_data_pending(uint64_t session_id)
+{
+	struct lttng_ht_iter iter;
+	struct relay_stream *stream;
+
+	/*
+	 * Iterate over all streams to set the begin data pending flag.
+	 * For now, the streams are indexed by stream handle so we have
+	 * to iterate over all streams to find the one associated with
+	 * the right session_id.
+	 */
+	rcu_read_lock();
+	cds_lfht_for_each_entry(relay_streams_ht->ht, &iter.iter, stream,
+			node.node) {
+		if (!stream_get(stream)) {
+			continue;
+		}
+		if (stream->trace->session->id == session_id) {
+			pthread_mutex_lock(&stream->lock);
+			stream->data_pending_check_done = false;
+			pthread_mutex_unlock(&stream->lock);
+			DBG("Set begin data pending flag to stream %" PRIu64,
+					stream->stream_handle);
+		}
+		stream_put(stream);
+	}
+	rcu_read_unlock();
+}
+
 /*
  * Initialize a data pending command. This means that a consumer is about
  * to ask for data pending for each stream it holds. Simply iterate over
@@ -1977,10 +2113,8 @@ static int relay_begin_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 {
 	int ret;
 	ssize_t send_ret;
-	struct lttng_ht_iter iter;
 	struct lttcomm_relayd_begin_data_pending msg;
 	struct lttcomm_relayd_generic_reply reply;
-	struct relay_stream *stream;
 
 	assert(recv_hdr);
 	assert(conn);
@@ -2002,28 +2136,7 @@ static int relay_begin_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 	memcpy(&msg, payload->data, sizeof(msg));
 	msg.session_id = be64toh(msg.session_id);
 
-	/*
-	 * Iterate over all streams to set the begin data pending flag.
-	 * For now, the streams are indexed by stream handle so we have
-	 * to iterate over all streams to find the one associated with
-	 * the right session_id.
-	 */
-	rcu_read_lock();
-	cds_lfht_for_each_entry(relay_streams_ht->ht, &iter.iter, stream,
-			node.node) {
-		if (!stream_get(stream)) {
-			continue;
-		}
-		if (stream->trace->session->id == msg.session_id) {
-			pthread_mutex_lock(&stream->lock);
-			stream->data_pending_check_done = false;
-			pthread_mutex_unlock(&stream->lock);
-			DBG("Set begin data pending flag to stream %" PRIu64,
-					stream->stream_handle);
-		}
-		stream_put(stream);
-	}
-	rcu_read_unlock();
+	session_begin_data_pending(msg.session_id);
 
 	memset(&reply, 0, sizeof(reply));
 	/* All good, send back reply. */
@@ -2043,42 +2156,17 @@ end_no_session:
 }
 
 /*
- * End data pending command. This will check, for a given session id, if
- * each stream associated with it has its data_pending_check_done flag
- * set. If not, this means that the client lost track of the stream but
- * the data is still being streamed on our side. In this case, we inform
- * the client that data is in flight.
- *
- * Return to the client if there is data in flight or not with a ret_code.
+ * Check whether a stream of a session which was not checked since the
+ * beginning of the data pending check still has data in flight. This means
+ * that the client lost track of the stream but the data is still being
+ * streamed on our side.
  */
-static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
-		struct relay_connection *conn,
-		const struct lttng_buffer_view *payload)
+static bool session_data_is_inflight(struct relay_session *session,
+		uint64_t session_id)
 {
-	int ret;
-	ssize_t send_ret;
+	bool inflight = false;
 	struct lttng_ht_iter iter;
-	struct lttcomm_relayd_end_data_pending msg;
-	struct lttcomm_relayd_generic_reply reply;
 	struct relay_stream *stream;
-	uint32_t is_data_inflight = 0;
-
-	DBG("End data pending command");
-
-	if (!conn->session || !conn->version_check_done) {
-		ERR("Trying to check for data before version check");
-		ret = -1;
-		goto end_no_session;
-	}
-
-	if (payload->size < sizeof(msg)) {
-		ERR("Unexpected payload size in \"relay_end_data_pending\": expected >= %zu bytes, got %zu bytes",
-				sizeof(msg), payload->size);
-		ret = -1;
-		goto end_no_session;
-	}
-	memcpy(&msg, payload->data, sizeof(msg));
-	msg.session_id = be64toh(msg.session_id);
 
 	/*
 	 * Iterate over all streams to see if the begin data pending
@@ -2090,7 +2178,7 @@ static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 		if (!stream_get(stream)) {
 			continue;
 		}
-		if (stream->trace->session->id != msg.session_id) {
+		if (stream->trace->session->id != session_id) {
 			stream_put(stream);
 			continue;
 		}
@@ -2098,7 +2186,7 @@ static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 		if (!stream->data_pending_check_done) {
 			uint64_t stream_seq;
 
-			if (session_streams_have_index(conn->session)) {
+			if (session_streams_have_index(session)) {
 				/*
 				 * Ensure that both the index and stream data have been
 				 * flushed up to the requested point.
@@ -2108,7 +2196,7 @@ static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 				stream_seq = stream->prev_data_seq;
 			}
 			if (!stream->closed || !(((int64_t) (stream_seq - stream->last_net_seq_num)) >= 0)) {
-				is_data_inflight = 1;
+				inflight = true;
 				DBG("Data is still in flight for stream %" PRIu64,
 						stream->stream_handle);
 				pthread_mutex_unlock(&stream->lock);
@@ -2120,6 +2208,47 @@ static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
 		stream_put(stream);
 	}
 	rcu_read_unlock();
+	return inflight;
+}
+
+/*
+ * End data pending command. This will check, for a given session id, if
+ * each stream associated with it has its data_pending_check_done flag
+ * set. If not, this means that the client lost track of the stream but
+ * the data is still being streamed on our side. In this case, we inform
+ * the client that data is in flight.
+ *
+ * Return to the client if there is data in flight or not with a ret_code.
+ */
+static int relay_end_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
+		struct relay_connection *conn,
+		const struct lttng_buffer_view *payload)
+{
+	int ret;
+	ssize_t send_ret;
+	struct lttcomm_relayd_end_data_pending msg;
+	struct lttcomm_relayd_generic_reply reply;
+	uint32_t is_data_inflight;
+
+	DBG("End data pending command");
+
+	if (!conn->session || !conn->version_check_done) {
+		ERR("Trying to check for data before version check");
+		ret = -1;
+		goto end_no_session;
+	}
+
+	if (payload->size < sizeof(msg)) {
+		ERR("Unexpected payload size in \"relay_end_data_pending\": expected >= %zu bytes, got %zu bytes",
+				sizeof(msg), payload->size);
+		ret = -1;
+		goto end_no_session;
+	}
+	memcpy(&msg, payload->data, sizeof(msg));
+	msg.session_id = be64toh(msg.session_id);
+
+	is_data_inflight = session_data_is_inflight(conn->session,
+			msg.session_id);
 
 	memset(&reply, 0, sizeof(reply));
 	/* All good, send back reply. */
@@ -2138,6 +2267,192 @@ end_no_session:
 	return ret;
 }
 
+/*
+ * Check the data pending of all the streams of a session at once (2.12+).
+ * The streams listed by the client are checked as by the data pending and
+ * quiescent control commands, then the other streams of the session are
+ * checked as by the end data pending command.
+ *
+ * Return to the client whether data is pending with a ret_code.
+ */
+static int relay_session_data_pending(const struct lttcomm_relayd_hdr *recv_hdr,
+		struct relay_connection *conn,
+		const struct lttng_buffer_view *payload)
+{
+	int ret = 0;
+	ssize_t send_ret;
+	uint32_t i, stream_count;
+	struct relay_session *session = conn->session;
+	struct lttcomm_relayd_session_data_pending msg;
+	struct lttcomm_relayd_generic_reply reply;
+	const char *streams_be;
+
+	DBG("Session data pending command received");
+
+	if (!session || !conn->version_check_done) {
+		ERR("Trying to check for data before version check");
+		ret = -1;
+		goto end_no_session;
+	}
+
+	if (payload->size < sizeof(msg)) {
+		ERR("Unexpected payload size in \"relay_session_data_pending\": expected >= %zu bytes, got %zu bytes",
+				sizeof(msg), payload->size);
+		ret = -1;
+		goto end_no_session;
+	}
+	memcpy(&msg, payload->data, sizeof(msg));
+	msg.session_id = be64toh(msg.session_id);
+	stream_count = be32toh(msg.stream_count);
+
+	if ((payload->size - sizeof(msg)) /
+			sizeof(struct lttcomm_relayd_session_data_pending_stream) <
+			stream_count) {
+		ERR("Unexpected payload size in \"relay_session_data_pending\": %zu bytes can't hold %" PRIu32 " streams",
+				payload->size, stream_count);
+		ret = -1;
+		goto end_no_session;
+	}
+
+	session_begin_data_pending(msg.session_id);
+
+	streams_be = payload->data + sizeof(msg);
+	for (i = 0; i < stream_count; i++) {
+		struct lttcomm_relayd_session_data_pending_stream entry;
+		struct relay_stream *stream;
+
+		memcpy(&entry, streams_be + i * sizeof(entry), sizeof(entry));
+		entry.stream_id = be64toh(entry.stream_id);
+		entry.last_net_seq_num = be64toh(entry.last_net_seq_num);
+
+		stream = stream_get_by_id(entry.stream_id);
+		if (!stream) {
+			if (entry.metadata) {
+				continue;
+			}
+			ERR("Unknown stream %" PRIu64 " in \"relay_session_data_pending\"",
+					entry.stream_id);
+			ret = -1;
+			goto reply;
+		}
+
+		if (entry.metadata) {
+			/* See relay_quiescent_control(). */
+			pthread_mutex_lock(&stream->lock);
+			stream->data_pending_check_done = true;
+			pthread_mutex_unlock(&stream->lock);
+		} else {
+			ret = stream_data_pending(stream, session,
+					entry.last_net_seq_num);
+		}
+		stream_put(stream);
+		if (ret) {
+			goto reply;
+		}
+	}
+
+	ret = session_data_is_inflight(session, msg.session_id);
+reply:
+	DBG("Session data pending for session %" PRIu64 " checked %" PRIu32 " streams: %d",
+			msg.session_id, stream_count, ret);
+	memset(&reply, 0, sizeof(reply));
+	reply.ret_code = htobe32(ret);
+	send_ret = conn->sock->ops->sendmsg(conn->sock, &reply, sizeof(reply), 0);
+	if (send_ret < (ssize_t) sizeof(reply)) {
+		ERR("Failed to send \"session data pending\" command reply (ret = %zd)",
+				send_ret);
+		ret = -1;
+	}
+	if (ret > 0) {
+		ret = 0;
+	}
+
+end_no_session:
+	return ret;
+}
+
+/*
+ * Convert a received index to host byte order. `index_be` holds at least
+ * the fields of the index format in use on the connection.
+ */
+static void relay_index_from_be(struct lttcomm_relayd_index *index,
+		const void *index_be, size_t index_len,
+		const struct relay_connection *conn)
+{
+	memcpy(index, index_be, index_len);
+	index->relay_stream_id = be64toh(index->relay_stream_id);
+	index->net_seq_num = be64toh(index->net_seq_num);
+	index->packet_size = be64toh(index->packet_size);
+	index->content_size = be64toh(index->content_size);
+	index->timestamp_begin = be64toh(index->timestamp_begin);
+	index->timestamp_end = be64toh(index->timestamp_end);
+	index->events_discarded = be64toh(index->events_discarded);
+	index->stream_id = be64toh(index->stream_id);
+
+	if (conn->minor >= 8) {
+		index->stream_instance_id =
+				be64toh(index->stream_instance_id);
+		index->packet_seq_num = be64toh(index->packet_seq_num);
+	}
+}
+
+/*
+ * Add an index, in host byte order, to its stream.
+ *
+ * `stream` is a cache of the last stream to which an index was added; the
+ * reference it holds is released by the caller.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_add_index(const struct lttcomm_relayd_index *index_info,
+		struct relay_stream **stream)
+{
+	int ret;
+
+	if (!*stream || (*stream)->stream_handle != index_info->relay_stream_id) {
+		if (*stream) {
+			stream_put(*stream);
+		}
+		*stream = stream_get_by_id(index_info->relay_stream_id);
+		if (!*stream) {
+			ERR("stream_get_by_id not found");
+			ret = -1;
+			goto end;
+		}
+	}
+
+	pthread_mutex_lock(&(*stream)->lock);
+	ret = stream_add_index(*stream, index_info);
+	pthread_mutex_unlock(&(*stream)->lock);
+end:
+	return ret;
+}
+
+/*
+ * Send the reply of an index command.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_send_index_reply(struct relay_connection *conn, int status)
+{
+	int ret = 0;
+	ssize_t send_ret;
+	struct lttcomm_relayd_generic_reply reply;
+
+	memset(&reply, 0, sizeof(reply));
+	if (status < 0) {
+		reply.ret_code = htobe32(LTTNG_ERR_UNK);
+	} else {
+		reply.ret_code = htobe32(LTTNG_OK);
+	}
+	send_ret = conn->sock->ops->sendmsg(conn->sock, &reply, sizeof(reply), 0);
+	if (send_ret < (ssize_t) sizeof(reply)) {
+		ERR("Failed to send \"recv index\" command reply (ret = %zd)", send_ret);
+		ret = -1;
+	}
+	return ret;
+}
+
 /*
  * Receive an index for a specific stream.
  *
@@ -2148,11 +2463,9 @@ static int relay_recv_index(const struct lttcomm_relayd_hdr *recv_hdr,
 		const struct lttng_buffer_view *payload)
 {
 	int ret;
-	ssize_t send_ret;
 	struct relay_session *session = conn->session;
 	struct lttcomm_relayd_index index_info;
-	struct lttcomm_relayd_generic_reply reply;
-	struct relay_stream *stream;
+	struct relay_stream *stream = NULL;
 	size_t msg_len;
 
 	assert(conn);
@@ -2174,48 +2487,83 @@ static int relay_recv_index(const struct lttcomm_relayd_hdr *recv_hdr,
 		ret = -1;
 		goto end_no_session;
 	}
-	memcpy(&index_info, payload->data, msg_len);
-	index_info.relay_stream_id = be64toh(index_info.relay_stream_id);
-	index_info.net_seq_num = be64toh(index_info.net_seq_num);
-	index_info.packet_size = be64toh(index_info.packet_size);
-	index_info.content_size = be64toh(index_info.content_size);
-	index_info.timestamp_begin = be64toh(index_info.timestamp_begin);
-	index_info.timestamp_end = be64toh(index_info.timestamp_end);
-	index_info.events_discarded = be64toh(index_info.events_discarded);
-	index_info.stream_id = be64toh(index_info.stream_id);
+	relay_index_from_be(&index_info, payload->data, msg_len, conn);
 
-	if (conn->minor >= 8) {
-		index_info.stream_instance_id =
-				be64toh(index_info.stream_instance_id);
-		index_info.packet_seq_num = be64toh(index_info.packet_seq_num);
+	ret = relay_add_index(&index_info, &stream);
+	if (stream) {
+		stream_put(stream);
 	}
 
-	stream = stream_get_by_id(index_info.relay_stream_id);
-	if (!stream) {
-		ERR("stream_get_by_id not found");
+	if (relay_send_index_reply(conn, ret)) {
 		ret = -1;
-		goto end;
 	}
 
-	pthread_mutex_lock(&stream->lock);
-	ret = stream_add_index(stream, &index_info);
-	pthread_mutex_unlock(&stream->lock);
-	if (ret) {
-		goto end_stream_put;
+end_no_session:
+	return ret;
+}
+
+/*
+ * Receive a batch of indexes (2.12+). A single reply is sent for the whole
+ * batch.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_recv_indexes(const struct lttcomm_relayd_hdr *recv_hdr,
+		struct relay_connection *conn,
+		const struct lttng_buffer_view *payload)
+{
+	int ret = 0;
+	uint32_t i, index_count;
+	struct relay_session *session = conn->session;
+	struct lttcomm_relayd_send_indexes msg;
+	struct relay_stream *stream = NULL;
+	const char *index_be;
+
+	assert(conn);
+
+	if (!session || !conn->version_check_done) {
+		ERR("Trying to receive indexes before version check");
+		ret = -1;
+		goto end_no_session;
 	}
 
-end_stream_put:
-	stream_put(stream);
-end:
-	memset(&reply, 0, sizeof(reply));
-	if (ret < 0) {
-		reply.ret_code = htobe32(LTTNG_ERR_UNK);
-	} else {
-		reply.ret_code = htobe32(LTTNG_OK);
+	if (payload->size < sizeof(msg)) {
+		ERR("Unexpected payload size in \"relay_recv_indexes\": expected >= %zu bytes, got %zu bytes",
+				sizeof(msg), payload->size);
+		ret = -1;
+		goto end_no_session;
 	}
-	send_ret = conn->sock->ops->sendmsg(conn->sock, &reply, sizeof(reply), 0);
-	if (send_ret < (ssize_t) sizeof(reply)) {
-		ERR("Failed to send \"recv index\" command reply (ret = %zd)", send_ret);
+	memcpy(&msg, payload->data, sizeof(msg));
+	index_count = be32toh(msg.index_count);
+
+	if ((payload->size - sizeof(msg)) / sizeof(struct lttcomm_relayd_index) <
+			index_count) {
+		ERR("Unexpected payload size in \"relay_recv_indexes\": %zu bytes can't hold %" PRIu32 " indexes",
+				payload->size, index_count);
+		ret = -1;
+		goto end_no_session;
+	}
+
+	DBG("Relay receiving batch of %" PRIu32 " indexes", index_count);
+
+	index_be = payload->data + sizeof(msg);
+	for (i = 0; i < index_count; i++) {
+		struct lttcomm_relayd_index index_info;
+
+		relay_index_from_be(&index_info, index_be,
+				sizeof(index_info), conn);
+		index_be += sizeof(index_info);
+
+		/* Keep going; the batch is acknowledged as a whole. */
+		if (relay_add_index(&index_info, &stream) < 0) {
+			ret = -1;
+		}
+	}
+	if (stream) {
+		stream_put(stream);
+	}
+
+	if (relay_send_index_reply(conn, ret)) {
 		ret = -1;
 	}
 
@@ -2893,10 +3241,18 @@ static int relay_process_control_command(struct relay_connection *conn,
 		DBG_CMD("RELAYD_END_DATA_PENDING", conn);
 		ret = relay_end_data_pending(header, conn, payload);
 		break;
+	case RELAYD_SESSION_DATA_PENDING:
+		DBG_CMD("RELAYD_SESSION_DATA_PENDING", conn);
+		ret = relay_session_data_pending(header, conn, payload);
+		break;
 	case RELAYD_SEND_INDEX:
 		DBG_CMD("RELAYD_SEND_INDEX", conn);
 		ret = relay_recv_index(header, conn, payload);
 		break;
+	case RELAYD_SEND_INDEXES:
+		DBG_CMD("RELAYD_SEND_INDEXES", conn);
+		ret = relay_recv_indexes(header, conn, payload);
+		break;
 	case RELAYD_STREAMS_SENT:
 		DBG_CMD("RELAYD_STREAMS_SENT", conn);
 		ret = relay_streams_sent(header, conn, payload);
@@ -3227,6 +3583,7 @@ static enum relay_connection_status relay_process_data_receive_payload(
 	bool new_stream = false, close_requested = false, index_flushed = false;
 	uint64_t left_to_receive = state->left_to_receive;
 	struct relay_session *session;
+	const int *splice_pipe = conn->protocol.data.splice_pipe;
 
 	DBG3("Receiving data for stream id %" PRIu64 " seqnum %" PRIu64 ", %" PRIu64" bytes received, %" PRIu64 " bytes left to receive",
 			state->header.stream_id, state->header.net_seq_num,
@@ -3255,14 +3612,24 @@ static enum relay_connection_status relay_process_data_receive_payload(
 	 * The size of the "chunk" received on any iteration is bounded by:
 	 *   - the data left to receive,
 	 *   - the data immediately available on the socket,
-	 *   - the on-stack data buffer
+	 *   - the on-stack data buffer (or splice pipe)
 	 */
 	while (left_to_receive > 0 && !partial_recv) {
 		size_t recv_size = min(left_to_receive, chunk_size);
 		struct lttng_buffer_view packet_chunk;
 
-		ret = conn->sock->ops->recvmsg(conn->sock, data_buffer,
-				recv_size, MSG_DONTWAIT);
+		if (splice_pipe[0] >= 0) {
+			/*
+			 * Move the payload to the pipe without copying it
+			 * to user space.
+			 */
+			ret = splice(conn->sock->fd, NULL, splice_pipe[1], NULL,
+					recv_size,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		} else {
+			ret = conn->sock->ops->recvmsg(conn->sock, data_buffer,
+					recv_size, MSG_DONTWAIT);
+		}
 		if (ret < 0) {
 			if (errno != EAGAIN && errno != EWOULDBLOCK) {
 				PERROR("Socket %d error", conn->sock->fd);
@@ -3284,11 +3651,16 @@ static enum relay_connection_status relay_process_data_receive_payload(
 			recv_size = ret;
 		}
 
-		packet_chunk = lttng_buffer_view_init(data_buffer,
-				0, recv_size);
-		assert(packet_chunk.data);
+		if (splice_pipe[0] >= 0) {
+			ret = stream_write_from_pipe(stream, splice_pipe[0],
+					recv_size);
+		} else {
+			packet_chunk = lttng_buffer_view_init(data_buffer,
+					0, recv_size);
+			assert(packet_chunk.data);
 
-		ret = stream_write(stream, &packet_chunk, 0);
+			ret = stream_write(stream, &packet_chunk, 0);
+		}
 		if (ret) {
 			ERR("Relay error writing data to file");
 			status = RELAY_CONNECTION_STATUS_ERROR;
@@ -3429,6 +3801,50 @@ static void relay_thread_close_connection(struct lttng_poll_event *events,
 	DBG("%s connection closed with %d", type_str, pollfd);
 }
 
+/*
+ * Hand over a data connection to the worker servicing the control connection
+ * of its session so that all of a session's connections are serviced by the
+ * same worker. The reference owned by the worker's connection table is
+ * transferred to the destination worker.
+ *
+ * Return true if the connection is no longer owned by the calling worker.
+ */
+static bool relay_worker_hand_over_connection(struct relay_worker *worker,
+		struct lttng_poll_event *events, int pollfd,
+		struct relay_connection *conn)
+{
+	ssize_t ret;
+	int session_worker_id;
+	struct relay_worker *dest_worker;
+
+	if (!conn->session) {
+		return false;
+	}
+
+	session_worker_id = uatomic_read(&conn->session->worker_id);
+	if (session_worker_id < 0 || session_worker_id == (int) worker->id) {
+		return false;
+	}
+
+	dest_worker = &relay_workers[session_worker_id];
+	(void) lttng_poll_del(events, pollfd);
+	connection_ht_del(conn);
+
+	ret = lttng_write(dest_worker->conn_pipe[1], &conn, sizeof(conn));
+	if (ret < sizeof(conn)) {
+		PERROR("Failed to hand over connection %d to worker %u",
+				pollfd, dest_worker->id);
+		session_abort(conn->session);
+		relay_thread_close_connection(events, pollfd, conn);
+		goto end;
+	}
+
+	DBG("Connection socket %d handed over from worker %u to worker %u",
+			pollfd, worker->id, dest_worker->id);
+end:
+	return true;
+}
+
 /*
  * This thread does the actual work
  */
@@ -3440,8 +3856,10 @@ static void *relay_thread_worker(void *data)
 	struct lttng_ht *relay_connections_ht;
 	struct lttng_ht_iter iter;
 	struct relay_connection *destroy_conn = NULL;
+	struct relay_worker *worker = data;
+	int *relay_conn_pipe = worker->conn_pipe;
 
-	DBG("[thread] Relay worker started");
+	DBG("[thread] Relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -3476,7 +3894,7 @@ restart:
 		health_code_update();
 
 		/* Infinite blocking call, waiting for transmission */
-		DBG3("Relayd worker thread polling...");
+		DBG3("Relayd worker thread %u polling...", worker->id);
 		health_poll_entry();
 		ret = lttng_poll_wait(&events, -1);
 		health_poll_exit();
@@ -3528,7 +3946,8 @@ restart:
 						goto error;
 					}
 					connection_ht_add(relay_connections_ht, conn);
-					DBG("Connection socket %d added", conn->sock->fd);
+					DBG("Connection socket %d added to worker %u",
+							conn->sock->fd, worker->id);
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Relay connection pipe error");
 					goto error;
@@ -3585,6 +4004,15 @@ restart:
 						relay_thread_close_connection(&events,
 								pollfd,
 								ctrl_conn);
+					} else if (ctrl_conn->session) {
+						/*
+						 * Bind the session to this worker; its
+						 * data connections will be handed over
+						 * to it.
+						 */
+						(void) uatomic_cmpxchg(
+								&ctrl_conn->session->worker_id,
+								-1, (int) worker->id);
 					}
 					seen_control = 1;
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
@@ -3689,6 +4117,9 @@ restart:
 				} else {
 					/* Keep last seen port. */
 					last_seen_data_fd = pollfd;
+					(void) relay_worker_hand_over_connection(
+							worker, &events, pollfd,
+							data_conn);
 					connection_put(data_conn);
 					goto restart;
 				}
@@ -3737,7 +4168,7 @@ relay_connections_ht_error:
 	if (err) {
 		DBG("Thread exited with error");
 	}
-	DBG("Worker thread cleanup complete");
+	DBG("Worker thread %u cleanup complete", worker->id);
 error_testpoint:
 	if (err) {
 		health_error();
@@ -3750,24 +4181,71 @@ error_testpoint:
 }
 
 /*
- * Create the relay command pipe to wake thread_manage_apps.
- * Closed in cleanup().
+ * Allocate the worker pool and create the connection pipe of each worker.
+ * The pipes are closed by their respective worker thread.
  */
-static int create_relay_conn_pipe(void)
+static int create_relay_workers(void)
 {
-	int ret;
+	int ret = 0;
+	unsigned int i;
+
+	relay_workers = zmalloc(sizeof(*relay_workers) * opt_worker_threads);
+	if (!relay_workers) {
+		PERROR("zmalloc relay workers");
+		ret = -1;
+		goto end;
+	}
 
-	ret = utils_create_pipe_cloexec(relay_conn_pipe);
+	for (i = 0; i < opt_worker_threads; i++) {
+		relay_workers[i].id = i;
+		relay_workers[i].conn_pipe[0] = -1;
+		relay_workers[i].conn_pipe[1] = -1;
+	}
 
+	for (i = 0; i < opt_worker_threads; i++) {
+		ret = utils_create_pipe_cloexec(relay_workers[i].conn_pipe);
+		if (ret) {
+			goto end;
+		}
+	}
+end:
 	return ret;
 }
 
+/*
+ * Join the worker threads that were launched. Returns 0 on success, -1 if
+ * any of the threads could not be joined.
+ */
+static int join_relay_workers(void)
+{
+	int ret, retval = 0;
+	unsigned int i;
+	void *status;
+
+	for (i = 0; i < opt_worker_threads; i++) {
+		if (!relay_workers[i].thread_created) {
+			utils_close_pipe(relay_workers[i].conn_pipe);
+			continue;
+		}
+
+		ret = pthread_join(relay_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join worker_thread %u", i);
+			retval = -1;
+		}
+	}
+
+	return retval;
+}
+
 /*
  * main
  */
 int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
+	unsigned int i;
 	void *status;
 
 	/* Parse environment variables */
@@ -3873,8 +4351,8 @@ int main(int argc, char **argv)
 		goto exit_init_data;
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_relay_conn_pipe()) {
+	/* Setup the worker threads' connection pipes. */
+	if (create_relay_workers()) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -3933,15 +4411,20 @@ int main(int argc, char **argv)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&worker_thread, default_pthread_attr(),
-			relay_thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < opt_worker_threads; i++) {
+		ret = pthread_create(&relay_workers[i].thread,
+				default_pthread_attr(), relay_thread_worker,
+				&relay_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create worker %u", i);
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		relay_workers[i].thread_created = true;
 	}
+	DBG("Started %u relay worker thread(s)", opt_worker_threads);
 
 	/* Setup the listener thread */
 	ret = pthread_create(&listener_thread, default_pthread_attr(),
@@ -3953,7 +4436,7 @@ int main(int argc, char **argv)
 		goto exit_listener_thread;
 	}
 
-	ret = relayd_live_create(live_uri);
+	ret = relayd_live_create(live_uri, opt_live_worker_threads);
 	if (ret) {
 		ERR("Starting live viewer threads");
 		retval = -1;
@@ -3979,14 +4462,19 @@ exit_live:
 	}
 
 exit_listener_thread:
-	ret = pthread_join(worker_thread, &status);
+exit_worker_thread:
+	/*
+	 * Stop all threads in case only part of the worker pool could be
+	 * launched.
+	 */
+	if (retval) {
+		(void) lttng_relay_stop_threads();
+	}
+	ret = join_relay_workers();
 	if (ret) {
-		errno = ret;
-		PERROR("pthread_join worker_thread");
 		retval = -1;
 	}
 
-exit_worker_thread:
 	ret = pthread_join(dispatcher_thread, &status);
 	if (ret) {
 		errno = ret;
@@ -292,6 +292,7 @@ struct relay_session *session_create(const char *session_name,
 
 	session->major = major;
 	session->minor = minor;
+	session->worker_id = -1;
 	lttng_ht_node_init_u64(&session->session_n, session->id);
 	urcu_ref_init(&session->ref);
 	CDS_INIT_LIST_HEAD(&session->recv_list);
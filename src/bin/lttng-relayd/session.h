@@ -122,6 +122,14 @@ struct relay_session {
 	 */
 	unsigned long new_streams;
 
+	/*
+	 * Index of the worker thread servicing the control connection of
+	 * this session, or -1 if the session is not bound to a worker yet.
+	 * Data connections carrying the session's streams are handed over to
+	 * that worker. Accessed with uatomic_*.
+	 */
+	int worker_id;
+
 	/*
 	 * Node in the global session hash table.
 	 */
@@ -1014,18 +1014,82 @@ end:
 	return ret;
 }
 
-/* Note that the packet is not necessarily complete. */
-int stream_write(struct relay_stream *stream,
-		const struct lttng_buffer_view *packet, size_t padding_len)
+/*
+ * Append 'padding_len' zero bytes to the stream's current file.
+ *
+ * Rather than writing zeroes, the file is extended with ftruncate(); the
+ * resulting hole reads back as zeroes. Zeroes are written if the file can't
+ * be extended that way.
+ */
+static int stream_write_padding(struct relay_stream *stream,
+		size_t padding_len)
 {
 	int ret = 0;
 	ssize_t write_ret;
+	off_t padded_offset;
 	size_t padding_to_write = padding_len;
 	char padding_buffer[FILE_IO_STACK_BUFFER_SIZE];
+	const int fd = stream->stream_fd->fd;
+
+	if (!padding_len) {
+		goto end;
+	}
+
+	padded_offset = lseek(fd, padding_len, SEEK_CUR);
+	if (padded_offset < 0) {
+		PERROR("Failed to seek past padding in file of %sstream %" PRIu64,
+				stream->is_metadata ? "metadata " : "",
+				stream->stream_handle);
+		ret = -1;
+		goto end;
+	}
+
+	ret = ftruncate(fd, padded_offset);
+	if (!ret) {
+		goto end;
+	}
+
+	DBG("Failed to extend file of stream %" PRIu64 " to offset %" PRIu64 " (%s), writing padding",
+			stream->stream_handle, (uint64_t) padded_offset,
+			strerror(errno));
+	if (lseek(fd, -((off_t) padding_len), SEEK_CUR) < 0) {
+		PERROR("Failed to seek back to padding in file of %sstream %" PRIu64,
+				stream->is_metadata ? "metadata " : "",
+				stream->stream_handle);
+		ret = -1;
+		goto end;
+	}
 
-	ASSERT_LOCKED(stream->lock);
 	memset(padding_buffer, 0,
 			min(sizeof(padding_buffer), padding_to_write));
+	while (padding_to_write > 0) {
+		const size_t padding_to_write_this_pass =
+				min(padding_to_write, sizeof(padding_buffer));
+
+		write_ret = lttng_write(fd, padding_buffer,
+				padding_to_write_this_pass);
+		if (write_ret != padding_to_write_this_pass) {
+			PERROR("Failed to write padding to file of %sstream %" PRIu64,
+					stream->is_metadata ? "metadata " : "",
+					stream->stream_handle);
+			ret = -1;
+			goto end;
+		}
+		padding_to_write -= padding_to_write_this_pass;
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
+/* Note that the packet is not necessarily complete. */
+int stream_write(struct relay_stream *stream,
+		const struct lttng_buffer_view *packet, size_t padding_len)
+{
+	int ret = 0;
+	ssize_t write_ret;
+
+	ASSERT_LOCKED(stream->lock);
 
 	if (!stream->stream_fd || !stream->trace_chunk) {
 		ERR("Protocol error: received a packet for a stream that doesn't have a current trace chunk: stream_id = %" PRIu64 ", channel_name = %s",
@@ -1045,31 +1109,102 @@ int stream_write(struct relay_stream *stream,
 		}
 	}
 
-	while (padding_to_write > 0) {
-		const size_t padding_to_write_this_pass =
-				min(padding_to_write, sizeof(padding_buffer));
+	ret = stream_write_padding(stream, padding_len);
+	if (ret) {
+		goto end;
+	}
 
-		write_ret = lttng_write(stream->stream_fd->fd,
-				padding_buffer, padding_to_write_this_pass);
-		if (write_ret != padding_to_write_this_pass) {
-			PERROR("Failed to write padding to file of %sstream %" PRIu64,
+	if (stream->is_metadata) {
+		stream->metadata_received += packet ? packet->size : 0;
+		stream->metadata_received += padding_len;
+	}
+
+	DBG("Wrote to %sstream %" PRIu64 ": data_length = %zu, padding_length = %zu",
+			stream->is_metadata ? "metadata " : "",
+			stream->stream_handle,
+			packet ? packet->size : (size_t) 0, padding_len);
+end:
+	return ret;
+}
+
+/*
+ * Move 'len' bytes of packet data, already received in 'pipe_fd', to the
+ * stream's current file using splice(2), without copying them to user space.
+ *
+ * The data is copied through a stack buffer if the stream's file does not
+ * support splice(2). The pipe is always drained of 'len' bytes on success.
+ *
+ * Note that the packet is not necessarily complete.
+ */
+int stream_write_from_pipe(struct relay_stream *stream, int pipe_fd,
+		size_t len)
+{
+	int ret = 0;
+	size_t left_to_write = len;
+
+	ASSERT_LOCKED(stream->lock);
+
+	if (!stream->stream_fd || !stream->trace_chunk) {
+		ERR("Protocol error: received a packet for a stream that doesn't have a current trace chunk: stream_id = %" PRIu64 ", channel_name = %s",
+				stream->stream_handle, stream->channel_name);
+		ret = -1;
+		goto end;
+	}
+
+	while (left_to_write > 0) {
+		ssize_t splice_ret;
+
+		splice_ret = splice(pipe_fd, NULL, stream->stream_fd->fd, NULL,
+				left_to_write, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (splice_ret < 0 && errno == EINTR) {
+			continue;
+		} else if (splice_ret < 0 && errno == EINVAL) {
+			/* The output file does not support splice(2). */
+			break;
+		} else if (splice_ret <= 0) {
+			PERROR("Failed to splice data to file of %sstream %" PRIu64,
 					stream->is_metadata ? "metadata " : "",
 					stream->stream_handle);
 			ret = -1;
 			goto end;
 		}
-		padding_to_write -= padding_to_write_this_pass;
+		left_to_write -= splice_ret;
+	}
+
+	while (left_to_write > 0) {
+		ssize_t io_ret;
+		char copy_buffer[FILE_IO_STACK_BUFFER_SIZE];
+		const size_t copy_size_this_pass =
+				min(left_to_write, sizeof(copy_buffer));
+
+		io_ret = lttng_read(pipe_fd, copy_buffer, copy_size_this_pass);
+		if (io_ret != copy_size_this_pass) {
+			PERROR("Failed to read data of %sstream %" PRIu64 " from pipe",
+					stream->is_metadata ? "metadata " : "",
+					stream->stream_handle);
+			ret = -1;
+			goto end;
+		}
+
+		io_ret = lttng_write(stream->stream_fd->fd, copy_buffer,
+				copy_size_this_pass);
+		if (io_ret != copy_size_this_pass) {
+			PERROR("Failed to write to stream file of %sstream %" PRIu64,
+					stream->is_metadata ? "metadata " : "",
+					stream->stream_handle);
+			ret = -1;
+			goto end;
+		}
+		left_to_write -= copy_size_this_pass;
 	}
 
 	if (stream->is_metadata) {
-		stream->metadata_received += packet ? packet->size : 0;
-		stream->metadata_received += padding_len;
+		stream->metadata_received += len;
 	}
 
-	DBG("Wrote to %sstream %" PRIu64 ": data_length = %zu, padding_length = %zu",
+	DBG("Spliced to %sstream %" PRIu64 ": data_length = %zu",
 			stream->is_metadata ? "metadata " : "",
-			stream->stream_handle,
-			packet ? packet->size : (size_t) 0, padding_len);
+			stream->stream_handle, len);
 end:
 	return ret;
 }
@@ -197,6 +197,8 @@ int stream_init_packet(struct relay_stream *stream, size_t packet_size,
 		bool *file_rotated);
 int stream_write(struct relay_stream *stream,
 		const struct lttng_buffer_view *packet, size_t padding_len);
+int stream_write_from_pipe(struct relay_stream *stream, int pipe_fd,
+		size_t len);
 /* Called after the reception of a complete data packet. */
 int stream_update_index(struct relay_stream *stream, uint64_t net_seq_num,
 		bool rotate_index, bool *flushed, uint64_t total_size);
@@ -236,20 +236,23 @@ static int handle_registration(struct lttcomm_sock *reg_sock,
 	major_version = be32toh(msg.major_version);
 	minor_version = be32toh(msg.minor_version);
 
-	/* Test communication protocol version of the registring agent. */
+	/*
+	 * Test communication protocol version of the registring agent. Minor
+	 * versions are backward compatible: the lowest one is used.
+	 */
 	if (major_version != AGENT_MAJOR_VERSION) {
 		ret = -EINVAL;
 		goto error_socket;
 	}
-	if (minor_version != AGENT_MINOR_VERSION) {
-		ret = -EINVAL;
-		goto error_socket;
+	if (minor_version > AGENT_MINOR_VERSION) {
+		minor_version = AGENT_MINOR_VERSION;
 	}
 
-	DBG2("[agent-thread] New registration for pid %d domain %d on socket %d",
-			pid, domain, new_sock->fd);
+	DBG2("[agent-thread] New registration for pid %d domain %d on socket %d using protocol %" PRIu32 ".%" PRIu32,
+			pid, domain, new_sock->fd, major_version,
+			minor_version);
 
-	app = agent_create_app(pid, domain, new_sock);
+	app = agent_create_app(pid, domain, minor_version, new_sock);
 	if (!app) {
 		ret = -ENOMEM;
 		goto error_socket;
@@ -25,6 +25,7 @@
 #include <common/sessiond-comm/agent.h>
 
 #include <common/compat/endian.h>
+#include <common/dynamic-buffer.h>
 
 #include "agent.h"
 #include "ust-app.h"
@@ -385,67 +386,76 @@ error:
 }
 
 /*
- * Internal enable agent event on a agent application. This function
- * communicates with the agent to enable a given event.
+ * Serialize the enable event command payload of an event, which is the
+ * fixed-size struct followed by the variable-length filter expression (+1 for
+ * the ending \0), at the end of a buffer.
  *
  * Return LTTNG_OK on success or else a LTTNG_ERR* code.
  */
-static int enable_event(struct agent_app *app, struct agent_event *event)
+static int serialize_enable_event(const struct agent_event *event,
+		struct lttng_dynamic_buffer *buf)
 {
-	int ret;
-	char *bytes_to_send;
-	uint64_t data_size;
 	size_t filter_expression_length;
-	uint32_t reply_ret_code;
 	struct lttcomm_agent_enable_event msg;
-	struct lttcomm_agent_generic_reply reply;
-
-	assert(app);
-	assert(app->sock);
-	assert(event);
 
-	DBG2("Agent enabling event %s for app pid: %d and socket %d", event->name,
-			app->pid, app->sock->fd);
-
-	/*
-	 * Calculate the payload's size, which is the fixed-size struct followed
-	 * by the variable-length filter expression (+1 for the ending \0).
-	 */
 	if (!event->filter_expression) {
 		filter_expression_length = 0;
 	} else {
 		filter_expression_length = strlen(event->filter_expression) + 1;
 	}
-	data_size = sizeof(msg) + filter_expression_length;
 
 	memset(&msg, 0, sizeof(msg));
 	msg.loglevel_value = htobe32(event->loglevel_value);
 	msg.loglevel_type = htobe32(event->loglevel_type);
 	if (lttng_strncpy(msg.name, event->name, sizeof(msg.name))) {
-		ret = LTTNG_ERR_INVALID;
-		goto error;
+		return LTTNG_ERR_INVALID;
 	}
 	msg.filter_expression_length = htobe32(filter_expression_length);
 
-	ret = send_header(app->sock, data_size, AGENT_CMD_ENABLE, 0);
-	if (ret < 0) {
-		goto error_io;
+	if (lttng_dynamic_buffer_append(buf, &msg, sizeof(msg))) {
+		return LTTNG_ERR_NOMEM;
 	}
+	if (filter_expression_length > 0 &&
+			lttng_dynamic_buffer_append(buf,
+				event->filter_expression,
+				filter_expression_length)) {
+		return LTTNG_ERR_NOMEM;
+	}
+	return LTTNG_OK;
+}
 
-	bytes_to_send = zmalloc(data_size);
-	if (!bytes_to_send) {
-		ret = LTTNG_ERR_NOMEM;
+/*
+ * Internal enable agent event on a agent application. This function
+ * communicates with the agent to enable a given event.
+ *
+ * Return LTTNG_OK on success or else a LTTNG_ERR* code.
+ */
+static int enable_event(struct agent_app *app, struct agent_event *event)
+{
+	int ret;
+	uint32_t reply_ret_code;
+	struct lttng_dynamic_buffer payload;
+	struct lttcomm_agent_generic_reply reply;
+
+	assert(app);
+	assert(app->sock);
+	assert(event);
+
+	DBG2("Agent enabling event %s for app pid: %d and socket %d", event->name,
+			app->pid, app->sock->fd);
+
+	lttng_dynamic_buffer_init(&payload);
+	ret = serialize_enable_event(event, &payload);
+	if (ret != LTTNG_OK) {
 		goto error;
 	}
 
-	memcpy(bytes_to_send, &msg, sizeof(msg));
-	if (filter_expression_length > 0) {
-		memcpy(bytes_to_send + sizeof(msg), event->filter_expression,
-				filter_expression_length);
+	ret = send_header(app->sock, payload.size, AGENT_CMD_ENABLE, 0);
+	if (ret < 0) {
+		goto error_io;
 	}
 
-	ret = send_payload(app->sock, bytes_to_send, data_size);
-	free(bytes_to_send);
+	ret = send_payload(app->sock, payload.data, payload.size);
 	if (ret < 0) {
 		goto error_io;
 	}
@@ -468,11 +478,14 @@ static int enable_event(struct agent_app *app, struct agent_event *event)
 		goto error;
 	}
 
-	return LTTNG_OK;
+	ret = LTTNG_OK;
+	goto end;
 
 error_io:
 	ret = LTTNG_ERR_UST_ENABLE_FAIL;
 error:
+end:
+	lttng_dynamic_buffer_reset(&payload);
 	return ret;
 }
 
@@ -582,6 +595,146 @@ error:
 	return ret;
 }
 
+/*
+ * Append a Pascal-style string to a buffer. Size is serialized as a 32-bit big
+ * endian integer and includes the ending \0.
+ *
+ * Return LTTNG_OK on success or else a LTTNG_ERR* code.
+ */
+static int serialize_pstring(const char *str, struct lttng_dynamic_buffer *buf)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t len_be;
+
+	if (len > UINT32_MAX) {
+		ERR("Application context name > MAX_UINT32");
+		return LTTNG_ERR_INVALID;
+	}
+
+	len_be = htobe32((uint32_t) len);
+	if (lttng_dynamic_buffer_append(buf, &len_be, sizeof(len_be)) ||
+			lttng_dynamic_buffer_append(buf, str, len)) {
+		return LTTNG_ERR_NOMEM;
+	}
+	return LTTNG_OK;
+}
+
+/*
+ * Internal bulk enable call on an agent application. Every enabled event and
+ * every application context of the given agent are sent to the application
+ * in a single command, which is acknowledged by a single reply, rather than
+ * paying for one round-trip per event and per context.
+ *
+ * The agent application must support the AGENT_MINOR_VERSION_ENABLE_BULK
+ * protocol version. RCU read side lock MUST be acquired.
+ *
+ * Return LTTNG_OK on success or else a LTTNG_ERR* code.
+ */
+static int enable_bulk(struct agent_app *app, struct agent *agt)
+{
+	int ret;
+	uint32_t reply_ret_code;
+	struct agent_event *event;
+	struct agent_app_ctx *ctx;
+	struct lttng_ht_iter iter;
+	struct lttng_dynamic_buffer payload;
+	struct lttcomm_agent_enable_bulk msg;
+	struct lttcomm_agent_generic_reply reply;
+	uint32_t event_count = 0, app_ctx_count = 0;
+
+	assert(app);
+	assert(app->sock);
+	assert(agt);
+
+	lttng_dynamic_buffer_init(&payload);
+
+	/* The counts are patched once the payload is complete. */
+	memset(&msg, 0, sizeof(msg));
+	if (lttng_dynamic_buffer_append(&payload, &msg, sizeof(msg))) {
+		ret = LTTNG_ERR_NOMEM;
+		goto error;
+	}
+
+	cds_lfht_for_each_entry(agt->events->ht, &iter.iter, event, node.node) {
+		/* Skip event if disabled. */
+		if (!event->enabled) {
+			continue;
+		}
+
+		ret = serialize_enable_event(event, &payload);
+		if (ret != LTTNG_OK) {
+			goto error;
+		}
+		event_count++;
+	}
+
+	cds_list_for_each_entry_rcu(ctx, &agt->app_ctx_list, list_node) {
+		ret = serialize_pstring(ctx->provider_name, &payload);
+		if (ret != LTTNG_OK) {
+			goto error;
+		}
+		ret = serialize_pstring(ctx->ctx_name, &payload);
+		if (ret != LTTNG_OK) {
+			goto error;
+		}
+		app_ctx_count++;
+	}
+
+	if (!event_count && !app_ctx_count) {
+		ret = LTTNG_OK;
+		goto end;
+	}
+
+	DBG2("Agent enabling %" PRIu32 " event(s) and %" PRIu32 " application context(s) for app pid: %d and socket %d",
+			event_count, app_ctx_count, app->pid, app->sock->fd);
+
+	msg.event_count = htobe32(event_count);
+	msg.app_ctx_count = htobe32(app_ctx_count);
+	memcpy(payload.data, &msg, sizeof(msg));
+
+	ret = send_header(app->sock, payload.size, AGENT_CMD_ENABLE_BULK, 0);
+	if (ret < 0) {
+		goto error_io;
+	}
+
+	ret = send_payload(app->sock, payload.data, payload.size);
+	if (ret < 0) {
+		goto error_io;
+	}
+
+	ret = recv_reply(app->sock, &reply, sizeof(reply));
+	if (ret < 0) {
+		goto error_io;
+	}
+
+	reply_ret_code = be32toh(reply.ret_code);
+	log_reply_code(reply_ret_code);
+	switch (reply_ret_code) {
+	case AGENT_RET_CODE_SUCCESS:
+		break;
+	case AGENT_RET_CODE_UNKNOWN_NAME:
+		/*
+		 * The agent enables everything it can; an unknown logger name
+		 * does not prevent the other events from being enabled.
+		 */
+		ret = LTTNG_ERR_UST_EVENT_NOT_FOUND;
+		goto error;
+	default:
+		ret = LTTNG_ERR_UNK;
+		goto error;
+	}
+
+	ret = LTTNG_OK;
+	goto end;
+
+error_io:
+	ret = LTTNG_ERR_UST_ENABLE_FAIL;
+error:
+end:
+	lttng_dynamic_buffer_reset(&payload);
+	return ret;
+}
+
 /*
  * Internal disable agent event call on a agent application. This function
  * communicates with the agent to disable a given event.
@@ -947,7 +1100,7 @@ error:
  * Return newly allocated object or else NULL on error.
  */
 struct agent_app *agent_create_app(pid_t pid, enum lttng_domain_type domain,
-		struct lttcomm_sock *sock)
+		uint32_t minor_version, struct lttcomm_sock *sock)
 {
 	struct agent_app *app;
 
@@ -961,6 +1114,7 @@ struct agent_app *agent_create_app(pid_t pid, enum lttng_domain_type domain,
 
 	app->pid = pid;
 	app->domain = domain;
+	app->minor_version = minor_version;
 	app->sock = sock;
 	lttng_ht_node_init_ulong(&app->node, (unsigned long) app->sock->fd);
 
@@ -1431,6 +1585,16 @@ void agent_update(struct agent *agt, int sock)
 	 * there is a serious code flow error.
 	 */
 	assert(app);
+
+	if (app->minor_version >= AGENT_MINOR_VERSION_ENABLE_BULK) {
+		ret = enable_bulk(app, agt);
+		if (ret != LTTNG_OK) {
+			DBG2("Agent update unable to enable events and application contexts on app pid: %d sock %d",
+					app->pid, app->sock->fd);
+		}
+		goto end;
+	}
+
 	cds_lfht_for_each_entry(agt->events->ht, &iter.iter, event, node.node) {
 		/* Skip event if disabled. */
 		if (!event->enabled) {
@@ -1456,5 +1620,6 @@ void agent_update(struct agent *agt, int sock)
 		}
 	}
 
+end:
 	rcu_read_unlock();
 }
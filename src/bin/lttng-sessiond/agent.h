@@ -26,7 +26,9 @@
 
 /* Agent protocol version that is verified during the agent registration. */
 #define AGENT_MAJOR_VERSION		2
-#define AGENT_MINOR_VERSION		0
+#define AGENT_MINOR_VERSION		1
+/* First minor version of the protocol supporting AGENT_CMD_ENABLE_BULK. */
+#define AGENT_MINOR_VERSION_ENABLE_BULK	1
 
 /*
  * Hash table that contains the agent app created upon registration indexed by
@@ -67,6 +69,12 @@ struct agent_app {
 	/* Domain of the application. */
 	enum lttng_domain_type domain;
 
+	/*
+	 * Minor version of the protocol used with the application, the lowest
+	 * of the agent's and of the session daemon's.
+	 */
+	uint32_t minor_version;
+
 	/*
 	 * AGENT TCP socket that was created upon registration.
 	 */
@@ -160,7 +168,7 @@ int agent_add_context(const struct lttng_event_context *ctx,
 
 /* Agent app API. */
 struct agent_app *agent_create_app(pid_t pid, enum lttng_domain_type domain,
-		struct lttcomm_sock *sock);
+		uint32_t minor_version, struct lttcomm_sock *sock);
 void agent_add_app(struct agent_app *app);
 void agent_delete_app(struct agent_app *app);
 struct agent_app *agent_find_app_by_sock(int sock);
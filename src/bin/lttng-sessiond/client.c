@@ -17,11 +17,13 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <inttypes.h>
 #include <stddef.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <common/compat/getenv.h>
+#include <common/time.h>
 #include <common/unix.h>
 #include <common/utils.h>
 #include <lttng/userspace-probe-internal.h>
@@ -38,6 +40,7 @@
 #include "testpoint.h"
 #include "utils.h"
 #include "manage-consumer.h"
+#include "data-pending.h"
 
 static bool is_root;
 
@@ -47,6 +50,42 @@ static struct thread_state {
 	int client_sock;
 } thread_state;
 
+/* A client connection waiting to be served by a command worker. */
+struct client_connection {
+	int sock;
+	struct cds_list_head node;
+};
+
+/*
+ * Connections accepted by the client thread and served, in order, by the
+ * command worker threads.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct cds_list_head list;
+	bool quit;
+} connection_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.list = CDS_LIST_HEAD_INIT(connection_queue.list),
+};
+
+/*
+ * Serializes the commands which are not read-only. The session daemon has
+ * always processed them one at a time, which some of them rely on (e.g. the
+ * command completion handler is global). Read-only commands are processed
+ * concurrently with them and with each other; the commands on a session
+ * still take the session list lock and the session lock, in that order.
+ */
+static pthread_mutex_t client_cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Serializes the initialization of the kernel tracer, which read-only kernel
+ * domain commands may trigger concurrently with any other command.
+ */
+static pthread_mutex_t kernel_tracer_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void set_thread_status(bool running)
 {
 	DBG("Marking client thread's state as %s", running ? "running" : "error");
@@ -510,6 +549,11 @@ error_create:
 
 /*
  * Count number of session permitted by uid/gid.
+ *
+ * The session list lock must be held. As for cmd_list_lttng_sessions(), the
+ * sessions are not locked: their credentials never change and their
+ * "destroyed" flag is only set with the session list lock held. Counting
+ * thus never waits for a command in progress on one of the sessions.
  */
 static unsigned int lttng_sessions_count(uid_t uid, gid_t gid)
 {
@@ -523,13 +567,11 @@ static unsigned int lttng_sessions_count(uid_t uid, gid_t gid)
 		if (!session_get(session)) {
 			continue;
 		}
-		session_lock(session);
 		/* Only count the sessions the user can control. */
 		if (session_access_ok(session, uid, gid) &&
 				!session->destroyed) {
 			i++;
 		}
-		session_unlock(session);
 		session_put(session);
 	}
 	return i;
@@ -641,6 +683,195 @@ error:
 	return ret;
 }
 
+/*
+ * Event of a LTTNG_ENABLE_EVENT_BATCH command, as received from the client.
+ */
+struct event_batch_entry {
+	struct lttng_event *event;
+	char *filter_expression;
+	struct lttng_filter_bytecode *bytecode;
+	struct lttng_event_exclusion *exclusion;
+};
+
+static void event_batch_entry_fini(struct event_batch_entry *entry)
+{
+	lttng_event_destroy(entry->event);
+	free(entry->filter_expression);
+	free(entry->bytecode);
+	free(entry->exclusion);
+}
+
+/*
+ * Receive an event of a batch and its exclusions and filter from the client.
+ *
+ * On error, the entry may be partially filled and must be released with
+ * event_batch_entry_fini().
+ *
+ * Return LTTNG_OK on success else a LTTNG_ERR code.
+ */
+static int receive_event_batch_entry(int sock, int *sock_error,
+		struct event_batch_entry *entry)
+{
+	int ret;
+	struct lttcomm_event_batch_entry comm_entry;
+
+	ret = lttcomm_recv_unix_sock(sock, &comm_entry, sizeof(comm_entry));
+	if (ret <= 0) {
+		*sock_error = 1;
+		ret = LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	if (comm_entry.exclusion_count > 0) {
+		const size_t count = comm_entry.exclusion_count;
+
+		entry->exclusion = zmalloc(sizeof(struct lttng_event_exclusion) +
+				(count * LTTNG_SYMBOL_NAME_LEN));
+		if (!entry->exclusion) {
+			ret = LTTNG_ERR_EXCLUSION_NOMEM;
+			goto end;
+		}
+
+		entry->exclusion->count = count;
+		ret = lttcomm_recv_unix_sock(sock, entry->exclusion->names,
+				count * LTTNG_SYMBOL_NAME_LEN);
+		if (ret <= 0) {
+			*sock_error = 1;
+			ret = LTTNG_ERR_EXCLUSION_INVAL;
+			goto end;
+		}
+	}
+
+	if (comm_entry.expression_len > 0) {
+		const size_t expression_len = comm_entry.expression_len;
+
+		if (expression_len > LTTNG_FILTER_MAX_LEN) {
+			ret = LTTNG_ERR_FILTER_INVAL;
+			goto end;
+		}
+
+		entry->filter_expression = zmalloc(expression_len);
+		if (!entry->filter_expression) {
+			ret = LTTNG_ERR_FILTER_NOMEM;
+			goto end;
+		}
+
+		ret = lttcomm_recv_unix_sock(sock, entry->filter_expression,
+				expression_len);
+		if (ret <= 0) {
+			*sock_error = 1;
+			ret = LTTNG_ERR_FILTER_INVAL;
+			goto end;
+		}
+	}
+
+	if (comm_entry.bytecode_len > 0) {
+		const size_t bytecode_len = comm_entry.bytecode_len;
+
+		if (bytecode_len > LTTNG_FILTER_MAX_LEN) {
+			ret = LTTNG_ERR_FILTER_INVAL;
+			goto end;
+		}
+
+		entry->bytecode = zmalloc(bytecode_len);
+		if (!entry->bytecode) {
+			ret = LTTNG_ERR_FILTER_NOMEM;
+			goto end;
+		}
+
+		ret = lttcomm_recv_unix_sock(sock, entry->bytecode,
+				bytecode_len);
+		if (ret <= 0) {
+			*sock_error = 1;
+			ret = LTTNG_ERR_FILTER_INVAL;
+			goto end;
+		}
+
+		if ((entry->bytecode->len + sizeof(*entry->bytecode)) !=
+				bytecode_len) {
+			ret = LTTNG_ERR_FILTER_INVAL;
+			goto end;
+		}
+	}
+
+	entry->event = lttng_event_copy(ALIGNED_CONST_PTR(comm_entry.event));
+	if (!entry->event) {
+		ret = LTTNG_ERR_NOMEM;
+		goto end;
+	}
+
+	ret = LTTNG_OK;
+end:
+	return ret;
+}
+
+/*
+ * Command LTTNG_ENABLE_EVENT_BATCH.
+ *
+ * All the events of the batch are received, and their framing checked,
+ * before any of them is enabled, so that a malformed batch leaves the session
+ * untouched. The events themselves are only checked by cmd_enable_event() as
+ * they are enabled, in order under the session lock, stopping at the first
+ * error: a batch failing there is left partly applied.
+ *
+ * Return LTTNG_OK on success else a LTTNG_ERR code.
+ */
+static int enable_event_batch(struct command_ctx *cmd_ctx, int sock,
+		int *sock_error)
+{
+	int ret = LTTNG_OK;
+	size_t i;
+	const size_t count = cmd_ctx->lsm->u.enable_batch.count;
+	struct event_batch_entry *entries = NULL;
+
+	if (count == 0) {
+		goto end;
+	}
+
+	entries = zmalloc(count * sizeof(*entries));
+	if (!entries) {
+		ret = LTTNG_ERR_NOMEM;
+		goto end;
+	}
+
+	DBG("Receiving batch of %zu events from client", count);
+	for (i = 0; i < count; i++) {
+		ret = receive_event_batch_entry(sock, sock_error, &entries[i]);
+		if (ret != LTTNG_OK) {
+			goto end;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		struct event_batch_entry *entry = &entries[i];
+
+		/* The command owns the filter, bytecode and exclusion. */
+		ret = cmd_enable_event(cmd_ctx->session,
+				ALIGNED_CONST_PTR(cmd_ctx->lsm->domain),
+				cmd_ctx->lsm->u.enable_batch.channel_name,
+				entry->event, entry->filter_expression,
+				entry->bytecode, entry->exclusion,
+				kernel_poll_pipe[1]);
+		entry->filter_expression = NULL;
+		entry->bytecode = NULL;
+		entry->exclusion = NULL;
+		if (ret != LTTNG_OK) {
+			DBG("Failed to enable event %s of batch (%zu/%zu)",
+					entry->event->name, i + 1, count);
+			goto end;
+		}
+	}
+
+end:
+	if (entries) {
+		for (i = 0; i < count; i++) {
+			event_batch_entry_fini(&entries[i]);
+		}
+	}
+	free(entries);
+	return ret;
+}
+
 /*
  * Version of setup_lttng_msg() without command header.
  */
@@ -699,6 +930,64 @@ static int send_unix_sock(int sock, void *buf, size_t len)
 	return lttcomm_send_unix_sock(sock, buf, len);
 }
 
+/*
+ * Commands which only report the state of the session daemon. They may be
+ * processed concurrently with any other command.
+ *
+ * Data pending commands are not read-only: they query the consumer daemons
+ * about the session's streams, which the serialized commands may be
+ * reconfiguring.
+ */
+static bool command_is_read_only(const struct lttcomm_session_msg *lsm)
+{
+	switch (lsm->cmd_type) {
+	case LTTNG_LIST_SESSIONS:
+	case LTTNG_LIST_DOMAINS:
+	case LTTNG_LIST_CHANNELS:
+	case LTTNG_LIST_EVENTS:
+	case LTTNG_LIST_TRACEPOINTS:
+	case LTTNG_LIST_TRACEPOINT_FIELDS:
+	case LTTNG_LIST_SYSCALLS:
+	case LTTNG_LIST_TRACKER_PIDS:
+	case LTTNG_SNAPSHOT_LIST_OUTPUT:
+	case LTTNG_ROTATION_GET_INFO:
+	case LTTNG_SESSION_LIST_ROTATION_SCHEDULES:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Commands which only use the session they target once it is found. The
+ * session list lock is released once their session is looked up and locked,
+ * the reference held on the session guaranteeing its lifetime, so that the
+ * long-running ones (stop, snapshot record, data pending) don't block every
+ * other command needing the session list.
+ *
+ * LTTNG_LIST_CHANNELS is not part of them: the counters of the per-PID
+ * channels of the applications that exited are only accumulated with the
+ * session list lock held.
+ */
+static bool command_releases_session_list(const struct lttcomm_session_msg *lsm)
+{
+	switch (lsm->cmd_type) {
+	case LTTNG_LIST_DOMAINS:
+	case LTTNG_LIST_EVENTS:
+	case LTTNG_LIST_TRACKER_PIDS:
+	case LTTNG_SNAPSHOT_LIST_OUTPUT:
+	case LTTNG_ROTATION_GET_INFO:
+	case LTTNG_SESSION_LIST_ROTATION_SCHEDULES:
+	case LTTNG_STOP_TRACE:
+	case LTTNG_SNAPSHOT_RECORD:
+	case LTTNG_DATA_PENDING:
+	case LTTNG_DATA_PENDING_WAIT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /*
  * Process the command requested by the lttng client within the command
  * context structure. This function make sure that the return structure (llm)
@@ -718,6 +1007,8 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	int ret = LTTNG_OK;
 	int need_tracing_session = 1;
 	int need_domain;
+	bool session_list_released = false;
+	const bool read_only = command_is_read_only(cmd_ctx->lsm);
 
 	DBG("Processing client command %d", cmd_ctx->lsm->cmd_type);
 
@@ -733,6 +1024,7 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	case LTTNG_START_TRACE:
 	case LTTNG_STOP_TRACE:
 	case LTTNG_DATA_PENDING:
+	case LTTNG_DATA_PENDING_WAIT:
 	case LTTNG_SNAPSHOT_ADD_OUTPUT:
 	case LTTNG_SNAPSHOT_DEL_OUTPUT:
 	case LTTNG_SNAPSHOT_LIST_OUTPUT:
@@ -789,6 +1081,7 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	case LTTNG_LIST_SYSCALLS:
 	case LTTNG_LIST_TRACKER_PIDS:
 	case LTTNG_DATA_PENDING:
+	case LTTNG_DATA_PENDING_WAIT:
 	case LTTNG_ROTATE_SESSION:
 	case LTTNG_ROTATION_GET_INFO:
 	case LTTNG_SESSION_LIST_ROTATION_SCHEDULES:
@@ -881,13 +1174,16 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 		}
 
 		/* Kernel tracer check */
+		pthread_mutex_lock(&kernel_tracer_init_lock);
 		if (!kernel_tracer_is_initialized()) {
 			/* Basically, load kernel tracer modules */
 			ret = init_kernel_tracer();
 			if (ret != 0) {
+				pthread_mutex_unlock(&kernel_tracer_init_lock);
 				goto error;
 			}
 		}
+		pthread_mutex_unlock(&kernel_tracer_init_lock);
 
 		/* Consumer is in an ERROR state. Report back to client */
 		if (uatomic_read(&kernel_consumerd_state) == CONSUMER_ERROR) {
@@ -895,8 +1191,12 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 			goto error;
 		}
 
-		/* Need a session for kernel command */
-		if (need_tracing_session) {
+		/*
+		 * Need a session for kernel command. Read-only commands report
+		 * the state of the session as is: they neither create its
+		 * domain session nor spawn a consumer daemon.
+		 */
+		if (need_tracing_session && !read_only) {
 			if (cmd_ctx->session->kernel_session == NULL) {
 				ret = create_kernel_session(cmd_ctx->session);
 				if (ret != LTTNG_OK) {
@@ -947,7 +1247,8 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 			goto error;
 		}
 
-		if (need_tracing_session) {
+		/* Read-only commands don't set up the domain, as above. */
+		if (need_tracing_session && !read_only) {
 			/* Create UST session if none exist. */
 			if (cmd_ctx->session->ust_session == NULL) {
 				ret = create_ust_session(cmd_ctx->session,
@@ -1062,13 +1363,19 @@ skip_domain:
 			ret = LTTNG_ERR_EPERM;
 			goto error;
 		}
+
+		if (command_releases_session_list(cmd_ctx->lsm)) {
+			/* Re-acquired before the session is released. */
+			session_unlock_list();
+			session_list_released = true;
+		}
 	}
 
 	/*
 	 * Send relayd information to consumer as soon as we have a domain and a
 	 * session defined.
 	 */
-	if (cmd_ctx->session && need_domain) {
+	if (cmd_ctx->session && need_domain && !read_only) {
 		/*
 		 * Setup relayd if not done yet. If the relayd information was already
 		 * sent to the consumer, this call will gracefully return.
@@ -1354,6 +1661,11 @@ error_add_context:
 		lttng_event_destroy(ev);
 		break;
 	}
+	case LTTNG_ENABLE_EVENT_BATCH:
+	{
+		ret = enable_event_batch(cmd_ctx, *sock, sock_error);
+		break;
+	}
 	case LTTNG_LIST_TRACEPOINTS:
 	{
 		struct lttng_event *events;
@@ -1671,6 +1983,7 @@ error_add_context:
 		break;
 	}
 	case LTTNG_DATA_PENDING:
+	case LTTNG_DATA_PENDING_WAIT:
 	{
 		int pending_ret;
 		uint8_t pending_ret_byte;
@@ -1951,6 +2264,10 @@ error:
 setup_error:
 	if (cmd_ctx->session) {
 		session_unlock(cmd_ctx->session);
+		if (session_list_released) {
+			/* session_put() requires the session list lock. */
+			session_lock_list();
+		}
 		session_put(cmd_ctx->session);
 		cmd_ctx->session = NULL;
 	}
@@ -2012,20 +2329,401 @@ static void thread_init_cleanup(void *data)
 	set_thread_status(false);
 }
 
+/*
+ * Return true if the reply to a data pending command reports pending data.
+ */
+static bool reply_reports_data_pending(const struct command_ctx *cmd_ctx)
+{
+	const struct lttcomm_lttng_msg *llm = cmd_ctx->llm;
+
+	if (!llm || llm->ret_code != LTTNG_OK || llm->data_size != 1) {
+		return false;
+	}
+	return ((const uint8_t *) llm)[sizeof(*llm) + llm->cmd_header_size];
+}
+
+/* Client of a LTTNG_DATA_PENDING_WAIT command parked on data pending. */
+struct data_pending_client {
+	struct data_pending_waiter waiter;
+	struct command_ctx *cmd_ctx;
+	int sock;
+};
+
+static void release_data_pending_client(struct data_pending_waiter *waiter)
+{
+	int ret;
+	struct data_pending_client *client = caa_container_of(waiter,
+			struct data_pending_client, waiter);
+
+	if (client->sock >= 0) {
+		ret = close(client->sock);
+		if (ret) {
+			PERROR("close");
+		}
+	}
+	clean_command_ctx(&client->cmd_ctx);
+	free(client);
+}
+
+/*
+ * Check the session of a parked data pending client again. Reply once the
+ * data is no longer pending or once the deadline of the client is reached.
+ */
+static bool check_data_pending_client(struct data_pending_waiter *waiter,
+		bool expired)
+{
+	int ret, sock_error;
+	struct data_pending_client *client = caa_container_of(waiter,
+			struct data_pending_client, waiter);
+	struct command_ctx *cmd_ctx = client->cmd_ctx;
+
+	/* Serialized with the other commands, as on the command workers. */
+	pthread_mutex_lock(&client_cmd_lock);
+	ret = process_client_msg(cmd_ctx, &client->sock, &sock_error);
+	pthread_mutex_unlock(&client_cmd_lock);
+	if (ret >= 0 && reply_reports_data_pending(cmd_ctx)) {
+		if (!expired) {
+			return false;
+		}
+		DBG("Data still pending for session %s on timeout",
+				cmd_ctx->lsm->session.name);
+	}
+
+	if (ret >= 0 && client->sock >= 0) {
+		ret = send_unix_sock(client->sock, cmd_ctx->llm,
+				cmd_ctx->lttng_msg_size);
+		if (ret < 0) {
+			ERR("Failed to send data back to client");
+		}
+	}
+	release_data_pending_client(waiter);
+	return true;
+}
+
+/*
+ * Process a LTTNG_DATA_PENDING_WAIT command. Data pending is checked as for
+ * LTTNG_DATA_PENDING and, while some is, the client is parked on the data
+ * pending thread: its session is checked again every time a consumer reports
+ * a drained stream, until its timeout expires. The command workers are thus
+ * never held by waiting clients. The timeout is capped so that a client
+ * can't keep its connection parked indefinitely; the clients check again on
+ * timeout anyway.
+ *
+ * Data that is only pending on the relay daemon side is not signaled: it is
+ * checked again when the timeout expires, on the client's next call.
+ *
+ * On return, '*cmd_ctx' is NULL and '*sock' is -1 if the client is parked:
+ * the data pending thread replies to it.
+ */
+static int process_data_pending_wait(struct command_ctx **cmd_ctx, int *sock,
+		int *sock_error)
+{
+	int ret;
+	uint32_t timeout_ms;
+	uint64_t generation;
+	struct data_pending_client *client;
+	struct timespec deadline;
+
+	timeout_ms = min_t(uint32_t, (*cmd_ctx)->lsm->u.data_pending.timeout_ms,
+			DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US / USEC_PER_MSEC);
+
+	/* Sampled before the check so that no hint is missed. */
+	generation = data_pending_get_generation();
+	ret = process_client_msg(*cmd_ctx, sock, sock_error);
+	if (ret < 0 || !reply_reports_data_pending(*cmd_ctx) || !timeout_ms ||
+			*sock < 0) {
+		goto end;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (ret) {
+		PERROR("lttng_clock_gettime");
+		/* Reply that data is pending right away. */
+		ret = 0;
+		goto end;
+	}
+	deadline.tv_sec += timeout_ms / MSEC_PER_SEC;
+	deadline.tv_nsec += (timeout_ms % MSEC_PER_SEC) * NSEC_PER_MSEC;
+	if (deadline.tv_nsec >= NSEC_PER_SEC) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= NSEC_PER_SEC;
+	}
+
+	client = zmalloc(sizeof(*client));
+	if (!client) {
+		PERROR("zmalloc data pending client");
+		goto end;
+	}
+	client->waiter.deadline = deadline;
+	client->waiter.generation = generation;
+	client->waiter.check = check_data_pending_client;
+	client->waiter.release = release_data_pending_client;
+	client->cmd_ctx = *cmd_ctx;
+	client->sock = *sock;
+	if (!data_pending_park(&client->waiter)) {
+		free(client);
+		goto end;
+	}
+	*cmd_ctx = NULL;
+	*sock = -1;
+end:
+	return ret;
+}
+
+/*
+ * Receive the command of a client, process it and send the reply.
+ *
+ * The socket is closed before returning.
+ */
+static void handle_client_connection(int sock)
+{
+	int ret, sock_error;
+	bool read_only;
+	struct command_ctx *cmd_ctx = NULL;
+	const struct cmd_completion_handler *cmd_completion_handler;
+
+	/* Allocate context command to process the client request */
+	cmd_ctx = zmalloc(sizeof(struct command_ctx));
+	if (cmd_ctx == NULL) {
+		PERROR("zmalloc cmd_ctx");
+		goto end;
+	}
+
+	/* Allocate data buffer for reception */
+	cmd_ctx->lsm = zmalloc(sizeof(struct lttcomm_session_msg));
+	if (cmd_ctx->lsm == NULL) {
+		PERROR("zmalloc cmd_ctx->lsm");
+		goto end;
+	}
+
+	cmd_ctx->llm = NULL;
+	cmd_ctx->session = NULL;
+
+	health_code_update();
+
+	/*
+	 * Data is received from the lttng client. The struct
+	 * lttcomm_session_msg (lsm) contains the command and data request of
+	 * the client.
+	 */
+	DBG("Receiving data from client ...");
+	ret = lttcomm_recv_creds_unix_sock(sock, cmd_ctx->lsm,
+			sizeof(struct lttcomm_session_msg), &cmd_ctx->creds);
+	if (ret <= 0) {
+		DBG("Nothing recv() from client... continuing");
+		goto end;
+	}
+
+	health_code_update();
+
+	// TODO: Validate cmd_ctx including sanity check for
+	// security purpose.
+
+	read_only = command_is_read_only(cmd_ctx->lsm);
+	if (!read_only) {
+		pthread_mutex_lock(&client_cmd_lock);
+	}
+
+	rcu_thread_online();
+	/*
+	 * This function dispatch the work to the kernel or userspace tracer
+	 * libs and fill the lttcomm_lttng_msg data structure of all the needed
+	 * informations for the client. The command context struct contains
+	 * everything this function may needs.
+	 */
+	if (cmd_ctx->lsm->cmd_type == LTTNG_DATA_PENDING_WAIT) {
+		ret = process_data_pending_wait(&cmd_ctx, &sock, &sock_error);
+	} else {
+		ret = process_client_msg(cmd_ctx, &sock, &sock_error);
+	}
+	rcu_thread_offline();
+	if (!cmd_ctx) {
+		/* Parked, the data pending thread replies to the client. */
+		goto end_unlock;
+	}
+	if (ret < 0) {
+		/*
+		 * TODO: Inform client somehow of the fatal error. At
+		 * this point, ret < 0 means that a zmalloc failed
+		 * (ENOMEM). Error detected but still accept
+		 * command, unless a socket error has been
+		 * detected.
+		 */
+		goto end_unlock;
+	}
+
+	/*
+	 * Completion handlers are only set by commands that are serialized by
+	 * client_cmd_lock; read-only commands must not pop the handler of a
+	 * command processed concurrently.
+	 */
+	cmd_completion_handler = read_only ? NULL :
+			cmd_pop_completion_handler();
+	if (cmd_completion_handler) {
+		enum lttng_error_code completion_code;
+
+		completion_code = cmd_completion_handler->run(
+				cmd_completion_handler->data);
+		if (completion_code != LTTNG_OK) {
+			goto end_unlock;
+		}
+	}
+
+	health_code_update();
+
+	if (sock >= 0) {
+		DBG("Sending response (size: %d, retcode: %s (%d))",
+				cmd_ctx->lttng_msg_size,
+				lttng_strerror(-cmd_ctx->llm->ret_code),
+				cmd_ctx->llm->ret_code);
+		ret = send_unix_sock(sock, cmd_ctx->llm,
+				cmd_ctx->lttng_msg_size);
+		if (ret < 0) {
+			ERR("Failed to send data back to client");
+		}
+	}
+
+end_unlock:
+	if (!read_only) {
+		pthread_mutex_unlock(&client_cmd_lock);
+	}
+end:
+	/* End of transmission */
+	if (sock >= 0) {
+		ret = close(sock);
+		if (ret) {
+			PERROR("close");
+		}
+	}
+	clean_command_ctx(&cmd_ctx);
+}
+
+/*
+ * Queue a client connection for the command workers.
+ *
+ * Return 0 on success, negative value on error.
+ */
+static int enqueue_client_connection(int sock)
+{
+	struct client_connection *connection;
+
+	connection = zmalloc(sizeof(*connection));
+	if (!connection) {
+		PERROR("zmalloc client connection");
+		return -1;
+	}
+	connection->sock = sock;
+
+	pthread_mutex_lock(&connection_queue.lock);
+	cds_list_add_tail(&connection->node, &connection_queue.list);
+	pthread_cond_signal(&connection_queue.cond);
+	pthread_mutex_unlock(&connection_queue.lock);
+	return 0;
+}
+
+/*
+ * Wait for a client connection to serve.
+ *
+ * Returns NULL once the client thread is shutting down.
+ */
+static struct client_connection *dequeue_client_connection(void)
+{
+	struct client_connection *connection = NULL;
+
+	pthread_mutex_lock(&connection_queue.lock);
+	while (cds_list_empty(&connection_queue.list) &&
+			!connection_queue.quit) {
+		health_poll_entry();
+		pthread_cond_wait(&connection_queue.cond,
+				&connection_queue.lock);
+		health_poll_exit();
+	}
+	if (!connection_queue.quit) {
+		connection = cds_list_first_entry(&connection_queue.list,
+				struct client_connection, node);
+		cds_list_del(&connection->node);
+	}
+	pthread_mutex_unlock(&connection_queue.lock);
+	return connection;
+}
+
+/*
+ * Stop the command workers and close the connections they did not serve.
+ */
+static void stop_client_workers(pthread_t *workers, unsigned int nr_workers)
+{
+	int ret;
+	unsigned int i;
+	struct client_connection *connection, *tmp;
+
+	pthread_mutex_lock(&connection_queue.lock);
+	connection_queue.quit = true;
+	pthread_cond_broadcast(&connection_queue.cond);
+	pthread_mutex_unlock(&connection_queue.lock);
+
+	for (i = 0; i < nr_workers; i++) {
+		ret = pthread_join(workers[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join client command worker");
+		}
+	}
+
+	cds_list_for_each_entry_safe(connection, tmp, &connection_queue.list,
+			node) {
+		cds_list_del(&connection->node);
+		ret = close(connection->sock);
+		if (ret) {
+			PERROR("close");
+		}
+		free(connection);
+	}
+}
+
+/*
+ * Command worker thread: serves the client connections queued by the client
+ * thread. Several workers run at once so that a long command, e.g. a
+ * snapshot record, does not delay the read-only commands of other clients.
+ */
+static void *thread_client_worker(void *data)
+{
+	struct client_connection *connection;
+
+	DBG("[thread] Client command worker started");
+
+	rcu_register_thread();
+
+	health_register(health_sessiond, HEALTH_SESSIOND_TYPE_CMD);
+
+	while ((connection = dequeue_client_connection())) {
+		handle_client_connection(connection->sock);
+		free(connection);
+		health_code_update();
+	}
+
+	health_unregister(health_sessiond);
+
+	DBG("Client command worker dying");
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
 /*
  * This thread manage all clients request using the unix client socket for
- * communication.
+ * communication. Client connections are accepted here and served by the
+ * command worker threads.
  */
 static void *thread_manage_clients(void *data)
 {
 	int sock = -1, ret, i, pollfd, err = -1;
-	int sock_error;
 	uint32_t revents, nb_fd;
-	struct command_ctx *cmd_ctx = NULL;
 	struct lttng_poll_event events;
 	const int client_sock = thread_state.client_sock;
 	struct lttng_pipe *quit_pipe = data;
 	const int thread_quit_pipe_fd = lttng_pipe_get_readfd(quit_pipe);
+	pthread_t *workers = NULL;
+	unsigned int nr_workers = 0;
 
 	DBG("[thread] Manage client started");
 
@@ -2065,6 +2763,23 @@ static void *thread_manage_clients(void *data)
 		goto error;
 	}
 
+	workers = zmalloc(sizeof(*workers) * config.client_cmd_threads);
+	if (!workers) {
+		PERROR("zmalloc client command workers");
+		goto error;
+	}
+	for (nr_workers = 0; nr_workers < config.client_cmd_threads;
+			nr_workers++) {
+		ret = pthread_create(&workers[nr_workers],
+				default_pthread_attr(), thread_client_worker,
+				NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create client command worker");
+			goto error;
+		}
+	}
+
 	/* Set state as running. */
         set_thread_status(true);
 	pthread_cleanup_pop(0);
@@ -2081,8 +2796,6 @@ static void *thread_manage_clients(void *data)
 	health_code_update();
 
 	while (1) {
-		const struct cmd_completion_handler *cmd_completion_handler;
-
 		DBG("Accepting client command ...");
 
 		/* Inifinite blocking call, waiting for transmission */
@@ -2146,111 +2859,12 @@ static void *thread_manage_clients(void *data)
 			goto error;
 		}
 
-		/* Allocate context command to process the client request */
-		cmd_ctx = zmalloc(sizeof(struct command_ctx));
-		if (cmd_ctx == NULL) {
-			PERROR("zmalloc cmd_ctx");
-			goto error;
-		}
-
-		/* Allocate data buffer for reception */
-		cmd_ctx->lsm = zmalloc(sizeof(struct lttcomm_session_msg));
-		if (cmd_ctx->lsm == NULL) {
-			PERROR("zmalloc cmd_ctx->lsm");
-			goto error;
-		}
-
-		cmd_ctx->llm = NULL;
-		cmd_ctx->session = NULL;
-
-		health_code_update();
-
-		/*
-		 * Data is received from the lttng client. The struct
-		 * lttcomm_session_msg (lsm) contains the command and data request of
-		 * the client.
-		 */
-		DBG("Receiving data from client ...");
-		ret = lttcomm_recv_creds_unix_sock(sock, cmd_ctx->lsm,
-				sizeof(struct lttcomm_session_msg), &cmd_ctx->creds);
-		if (ret <= 0) {
-			DBG("Nothing recv() from client... continuing");
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
-			}
-			sock = -1;
-			clean_command_ctx(&cmd_ctx);
-			continue;
-		}
-
-		health_code_update();
-
-		// TODO: Validate cmd_ctx including sanity check for
-		// security purpose.
-
-		rcu_thread_online();
-		/*
-		 * This function dispatch the work to the kernel or userspace tracer
-		 * libs and fill the lttcomm_lttng_msg data structure of all the needed
-		 * informations for the client. The command context struct contains
-		 * everything this function may needs.
-		 */
-		ret = process_client_msg(cmd_ctx, &sock, &sock_error);
-		rcu_thread_offline();
+		/* The command is received and processed by a worker. */
+		ret = enqueue_client_connection(sock);
 		if (ret < 0) {
-			if (sock >= 0) {
-				ret = close(sock);
-				if (ret) {
-					PERROR("close");
-				}
-                        }
-                        sock = -1;
-			/*
-			 * TODO: Inform client somehow of the fatal error. At
-			 * this point, ret < 0 means that a zmalloc failed
-			 * (ENOMEM). Error detected but still accept
-			 * command, unless a socket error has been
-			 * detected.
-			 */
-			clean_command_ctx(&cmd_ctx);
-			continue;
-		}
-
-		cmd_completion_handler = cmd_pop_completion_handler();
-		if (cmd_completion_handler) {
-			enum lttng_error_code completion_code;
-
-			completion_code = cmd_completion_handler->run(
-					cmd_completion_handler->data);
-			if (completion_code != LTTNG_OK) {
-				clean_command_ctx(&cmd_ctx);
-				continue;
-			}
+			goto error;
 		}
-
-		health_code_update();
-
-		if (sock >= 0) {
-			DBG("Sending response (size: %d, retcode: %s (%d))",
-					cmd_ctx->lttng_msg_size,
-					lttng_strerror(-cmd_ctx->llm->ret_code),
-					cmd_ctx->llm->ret_code);
-			ret = send_unix_sock(sock, cmd_ctx->llm,
-					cmd_ctx->lttng_msg_size);
-			if (ret < 0) {
-				ERR("Failed to send data back to client");
-			}
-
-			/* End of transmission */
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
-			}
-                }
-                sock = -1;
-
-		clean_command_ctx(&cmd_ctx);
+		sock = -1;
 
 		health_code_update();
 	}
@@ -2264,8 +2878,10 @@ error:
 		}
 	}
 
+	stop_client_workers(workers, nr_workers);
+	free(workers);
+
 	lttng_poll_clean(&events);
-	clean_command_ctx(&cmd_ctx);
 
 error_listen:
 error_create_poll:
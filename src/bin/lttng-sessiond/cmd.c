@@ -2510,6 +2510,20 @@ ssize_t cmd_list_syscalls(struct lttng_event **events)
 	return syscall_table_list(events);
 }
 
+/*
+ * List the PID tracker of a domain which has no session yet: like a new one,
+ * it tracks all PIDs, which is reported as a single -1 entry.
+ */
+static ssize_t list_tracker_pids_no_domain_session(int32_t **pids)
+{
+	*pids = zmalloc(sizeof(**pids));
+	if (!*pids) {
+		return -1;
+	}
+	(*pids)[0] = -1;
+	return 1;
+}
+
 /*
  * Command LTTNG_LIST_TRACKER_PIDS processed by the client thread.
  *
@@ -2527,7 +2541,11 @@ ssize_t cmd_list_tracker_pids(struct ltt_session *session,
 		struct ltt_kernel_session *ksess;
 
 		ksess = session->kernel_session;
-		nr_pids = kernel_list_tracker_pids(ksess, pids);
+		if (ksess) {
+			nr_pids = kernel_list_tracker_pids(ksess, pids);
+		} else {
+			nr_pids = list_tracker_pids_no_domain_session(pids);
+		}
 		if (nr_pids < 0) {
 			ret = LTTNG_ERR_KERN_LIST_FAIL;
 			goto error;
@@ -2539,7 +2557,11 @@ ssize_t cmd_list_tracker_pids(struct ltt_session *session,
 		struct ltt_ust_session *usess;
 
 		usess = session->ust_session;
-		nr_pids = trace_ust_list_tracker_pids(usess, pids);
+		if (usess) {
+			nr_pids = trace_ust_list_tracker_pids(usess, pids);
+		} else {
+			nr_pids = list_tracker_pids_no_domain_session(pids);
+		}
 		if (nr_pids < 0) {
 			ret = LTTNG_ERR_UST_LIST_FAIL;
 			goto error;
@@ -4100,9 +4122,13 @@ int ust_regenerate_metadata(struct ltt_ust_session *usess)
 		registry = session_reg->reg.ust;
 
 		pthread_mutex_lock(&registry->lock);
-		registry->metadata_len_sent = 0;
-		memset(registry->metadata, 0, registry->metadata_alloc_len);
-		registry->metadata_len = 0;
+		ret = ust_metadata_clear(registry);
+		if (ret) {
+			pthread_mutex_unlock(&registry->lock);
+			ERR("Failed to clear session metadata (err = %d)",
+					ret);
+			goto end;
+		}
 		registry->metadata_version++;
 		if (registry->metadata_fd > 0) {
 			/* Clear the metadata file's content. */
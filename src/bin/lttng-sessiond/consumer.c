@@ -1215,6 +1215,10 @@ int consumer_send_pipe(struct consumer_socket *consumer_sock,
 		pipe_name = "channel monitor";
 		command_name = "SET_CHANNEL_MONITOR_PIPE";
 		break;
+	case LTTNG_CONSUMER_SET_DATA_PENDING_PIPE:
+		pipe_name = "data pending";
+		command_name = "SET_DATA_PENDING_PIPE";
+		break;
 	default:
 		ERR("Unexpected command received in %s (cmd = %d)", __func__,
 				(int) cmd);
@@ -1254,6 +1258,13 @@ int consumer_send_channel_monitor_pipe(struct consumer_socket *consumer_sock,
 			LTTNG_CONSUMER_SET_CHANNEL_MONITOR_PIPE, pipe);
 }
 
+int consumer_send_data_pending_pipe(struct consumer_socket *consumer_sock,
+		int pipe)
+{
+	return consumer_send_pipe(consumer_sock,
+			LTTNG_CONSUMER_SET_DATA_PENDING_PIPE, pipe);
+}
+
 /*
  * Ask the consumer if the data is pending for the specific session id.
  * Returns 1 if data is pending, 0 otherwise, or < 0 on error.
@@ -85,6 +85,11 @@ struct consumer_data {
 	 * consumer.
 	 */
 	int channel_monitor_pipe;
+	/*
+	 * Write-end of the data pending pipe, shared by all the consumers,
+	 * to be passed to the consumer.
+	 */
+	int data_pending_pipe;
 	/*
 	 * The metadata socket object is handled differently and only created
 	 * locally in this object thus it's the only reference available in the
@@ -224,6 +229,8 @@ int consumer_send_relayd_socket(struct consumer_socket *consumer_sock,
 		bool session_name_contains_creation_time);
 int consumer_send_channel_monitor_pipe(struct consumer_socket *consumer_sock,
 		int pipe);
+int consumer_send_data_pending_pipe(struct consumer_socket *consumer_sock,
+		int pipe);
 int consumer_send_destroy_relayd(struct consumer_socket *sock,
 		struct consumer_output *consumer);
 int consumer_recv_status_reply(struct consumer_socket *sock);
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _LGPL_SOURCE
+#include <pthread.h>
+#include <urcu.h>
+
+#include <common/common.h>
+#include <common/compat/poll.h>
+#include <common/compat/time.h>
+#include <common/defaults.h>
+#include <common/pipe.h>
+#include <common/time.h>
+
+#include "data-pending.h"
+#include "thread.h"
+#include "utils.h"
+
+/* Number of session ids read from the data pending pipe at once. */
+#define DATA_PENDING_HINT_BATCH	64
+
+struct thread_notifiers {
+	struct lttng_pipe *quit_pipe;
+	struct lttng_pipe *data_pending_pipe;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	/* Incremented on every hint, protected by 'lock'. */
+	uint64_t generation;
+	/* List of parked struct data_pending_waiter, protected by 'lock'. */
+	struct cds_list_head list;
+	/*
+	 * Wakes the data pending thread up when a waiter is parked or
+	 * signaled, NULL while the thread is not running. Protected by 'lock'.
+	 */
+	struct lttng_pipe *wakeup_pipe;
+	/* Set while a wake-up is unread, protected by 'lock'. */
+	bool wakeup_pending;
+} waiters = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.list = CDS_LIST_HEAD_INIT(waiters.list),
+};
+
+/* Must be called with the waiters lock held. */
+static void wake_up_thread(void)
+{
+	if (!waiters.wakeup_pipe || waiters.wakeup_pending) {
+		return;
+	}
+	if (notify_thread_pipe(lttng_pipe_get_writefd(
+			waiters.wakeup_pipe)) == 1) {
+		waiters.wakeup_pending = true;
+	}
+}
+
+uint64_t data_pending_get_generation(void)
+{
+	uint64_t generation;
+
+	pthread_mutex_lock(&waiters.lock);
+	generation = waiters.generation;
+	pthread_mutex_unlock(&waiters.lock);
+	return generation;
+}
+
+bool data_pending_park(struct data_pending_waiter *waiter)
+{
+	bool parked = false;
+
+	assert(waiter);
+	assert(waiter->check);
+	assert(waiter->release);
+
+	pthread_mutex_lock(&waiters.lock);
+	if (!waiters.wakeup_pipe) {
+		goto end;
+	}
+	cds_list_add_tail(&waiter->node, &waiters.list);
+	/* The thread computes its timeout from the deadlines. */
+	wake_up_thread();
+	parked = true;
+end:
+	pthread_mutex_unlock(&waiters.lock);
+	return parked;
+}
+
+void data_pending_signal(void)
+{
+	pthread_mutex_lock(&waiters.lock);
+	waiters.generation++;
+	wake_up_thread();
+	pthread_mutex_unlock(&waiters.lock);
+}
+
+static int timespec_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec) {
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	}
+	if (a->tv_nsec != b->tv_nsec) {
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Return the time, in ms, until the earliest deadline of the parked waiters,
+ * or -1 if none is parked.
+ */
+static int get_poll_timeout(void)
+{
+	int ret, timeout = -1;
+	struct timespec now;
+	struct data_pending_waiter *waiter, *first = NULL;
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret) {
+		PERROR("lttng_clock_gettime");
+		/* Check the waiters again soon. */
+		return DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US / USEC_PER_MSEC;
+	}
+
+	pthread_mutex_lock(&waiters.lock);
+	cds_list_for_each_entry(waiter, &waiters.list, node) {
+		if (!first || timespec_cmp(&waiter->deadline,
+				&first->deadline) < 0) {
+			first = waiter;
+		}
+	}
+	if (first) {
+		int64_t delta_ns;
+
+		delta_ns = (int64_t) (first->deadline.tv_sec - now.tv_sec) *
+				NSEC_PER_SEC +
+				(first->deadline.tv_nsec - now.tv_nsec);
+		/* Round up so that the deadline is reached on wake-up. */
+		timeout = delta_ns <= 0 ? 0 :
+				(int) ((delta_ns + NSEC_PER_MSEC - 1) /
+					NSEC_PER_MSEC);
+	}
+	pthread_mutex_unlock(&waiters.lock);
+	return timeout;
+}
+
+/*
+ * Check the waiters which were signaled since their last check, or whose
+ * deadline is reached. The waiters lock is not held during the checks, which
+ * take the session locks and query the consumers.
+ */
+static void check_waiters(void)
+{
+	int ret;
+	uint64_t generation;
+	struct timespec now;
+	struct data_pending_waiter *waiter, *tmp;
+	struct cds_list_head ready = CDS_LIST_HEAD_INIT(ready);
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret) {
+		PERROR("lttng_clock_gettime");
+		return;
+	}
+
+	pthread_mutex_lock(&waiters.lock);
+	generation = waiters.generation;
+	cds_list_for_each_entry_safe(waiter, tmp, &waiters.list, node) {
+		if (waiter->generation == generation &&
+				timespec_cmp(&now, &waiter->deadline) < 0) {
+			continue;
+		}
+		cds_list_del(&waiter->node);
+		cds_list_add_tail(&waiter->node, &ready);
+	}
+	pthread_mutex_unlock(&waiters.lock);
+
+	cds_list_for_each_entry_safe(waiter, tmp, &ready, node) {
+		const bool expired = timespec_cmp(&now, &waiter->deadline) >= 0;
+
+		cds_list_del(&waiter->node);
+		/* Sampled before the check so that no hint is missed. */
+		waiter->generation = generation;
+		rcu_thread_online();
+		ret = waiter->check(waiter, expired);
+		rcu_thread_offline();
+		if (ret) {
+			continue;
+		}
+
+		pthread_mutex_lock(&waiters.lock);
+		cds_list_add_tail(&waiter->node, &waiters.list);
+		pthread_mutex_unlock(&waiters.lock);
+	}
+}
+
+/*
+ * Consume the hints available on the data pending pipe.
+ *
+ * Return 0 on success, -1 if the pipe was closed or on error.
+ */
+static int handle_hints(int fd)
+{
+	ssize_t ret;
+	uint64_t ids[DATA_PENDING_HINT_BATCH];
+
+	do {
+		ret = read(fd, ids, sizeof(ids));
+	} while (ret < 0 && errno == EINTR);
+	if (ret <= 0) {
+		if (ret < 0) {
+			PERROR("read data pending pipe");
+		}
+		return -1;
+	}
+
+	/*
+	 * The waiters check their own session again; checking them all is
+	 * cheaper than tracking which consumer session ids each one covers.
+	 */
+	DBG3("[data-pending-thread] Received %zd drained hints",
+			ret / (ssize_t) sizeof(ids[0]));
+	pthread_mutex_lock(&waiters.lock);
+	waiters.generation++;
+	pthread_mutex_unlock(&waiters.lock);
+	return 0;
+}
+
+/*
+ * Consume the wake-up of the waiters pipe.
+ *
+ * Return 0 on success, -1 on error.
+ */
+static int handle_wakeup(int fd)
+{
+	ssize_t ret;
+	char buf;
+
+	pthread_mutex_lock(&waiters.lock);
+	do {
+		ret = read(fd, &buf, sizeof(buf));
+	} while (ret < 0 && errno == EINTR);
+	waiters.wakeup_pending = false;
+	pthread_mutex_unlock(&waiters.lock);
+	if (ret <= 0) {
+		if (ret < 0) {
+			PERROR("read data pending wake-up pipe");
+		}
+		return -1;
+	}
+	return 0;
+}
+
+static void *thread_data_pending(void *data)
+{
+	int ret;
+	struct lttng_poll_event events;
+	struct thread_notifiers *notifiers = data;
+	const int quit_pipe_read_fd = lttng_pipe_get_readfd(
+			notifiers->quit_pipe);
+	const int hint_fd = lttng_pipe_get_readfd(
+			notifiers->data_pending_pipe);
+	const int wakeup_fd = lttng_pipe_get_readfd(waiters.wakeup_pipe);
+
+	DBG("[data-pending-thread] Started");
+
+	rcu_register_thread();
+	rcu_thread_offline();
+
+	ret = lttng_poll_create(&events, 3, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		goto error_poll_create;
+	}
+
+	ret = lttng_poll_add(&events, hint_fd, LPOLLIN | LPOLLERR);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = lttng_poll_add(&events, wakeup_fd, LPOLLIN | LPOLLERR);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = lttng_poll_add(&events, quit_pipe_read_fd, LPOLLIN | LPOLLERR);
+	if (ret < 0) {
+		goto error;
+	}
+
+	for (;;) {
+		int i, nb_fd;
+
+		ret = lttng_poll_wait(&events, get_poll_timeout());
+		if (ret < 0) {
+			/* Restart interrupted system call. */
+			if (errno == EINTR) {
+				continue;
+			}
+			goto error;
+		}
+
+		nb_fd = ret;
+		for (i = 0; i < nb_fd; i++) {
+			const uint32_t revents = LTTNG_POLL_GETEV(&events, i);
+			const int pollfd = LTTNG_POLL_GETFD(&events, i);
+
+			if (!revents) {
+				/* No activity for this FD (poll implementation). */
+				continue;
+			}
+
+			if (pollfd == quit_pipe_read_fd) {
+				goto exit;
+			}
+
+			if (revents & LPOLLIN) {
+				if (pollfd == wakeup_fd) {
+					ret = handle_wakeup(pollfd);
+				} else {
+					ret = handle_hints(pollfd);
+				}
+				if (ret) {
+					goto error;
+				}
+			} else if (revents & LPOLLERR) {
+				ERR("[data-pending-thread] Data pending pipe error");
+				goto error;
+			}
+		}
+
+		check_waiters();
+	}
+
+exit:
+error:
+	lttng_poll_clean(&events);
+error_poll_create:
+	rcu_thread_online();
+	rcu_unregister_thread();
+	DBG("[data-pending-thread] Exiting");
+	return NULL;
+}
+
+static bool shutdown_data_pending_thread(void *data)
+{
+	struct thread_notifiers *notifiers = data;
+	const int write_fd = lttng_pipe_get_writefd(notifiers->quit_pipe);
+
+	return notify_thread_pipe(write_fd) == 1;
+}
+
+static void cleanup_data_pending_thread(void *data)
+{
+	struct thread_notifiers *notifiers = data;
+	struct data_pending_waiter *waiter, *tmp;
+	struct cds_list_head parked = CDS_LIST_HEAD_INIT(parked);
+
+	pthread_mutex_lock(&waiters.lock);
+	cds_list_splice(&waiters.list, &parked);
+	CDS_INIT_LIST_HEAD(&waiters.list);
+	lttng_pipe_destroy(waiters.wakeup_pipe);
+	waiters.wakeup_pipe = NULL;
+	waiters.wakeup_pending = false;
+	pthread_mutex_unlock(&waiters.lock);
+
+	/* The clients of the remaining waiters see their connection closed. */
+	cds_list_for_each_entry_safe(waiter, tmp, &parked, node) {
+		cds_list_del(&waiter->node);
+		waiter->release(waiter);
+	}
+
+	lttng_pipe_destroy(notifiers->quit_pipe);
+	free(notifiers);
+}
+
+bool launch_data_pending_thread(struct lttng_pipe *data_pending_pipe)
+{
+	struct lttng_thread *thread;
+	struct thread_notifiers *notifiers;
+	struct lttng_pipe *wakeup_pipe;
+
+	notifiers = zmalloc(sizeof(*notifiers));
+	if (!notifiers) {
+		goto error_alloc;
+	}
+	notifiers->data_pending_pipe = data_pending_pipe;
+
+	notifiers->quit_pipe = lttng_pipe_open(FD_CLOEXEC);
+	if (!notifiers->quit_pipe) {
+		goto error;
+	}
+
+	wakeup_pipe = lttng_pipe_open(FD_CLOEXEC);
+	if (!wakeup_pipe) {
+		goto error;
+	}
+	pthread_mutex_lock(&waiters.lock);
+	waiters.wakeup_pipe = wakeup_pipe;
+	pthread_mutex_unlock(&waiters.lock);
+
+	thread = lttng_thread_create("Data pending",
+			thread_data_pending,
+			shutdown_data_pending_thread,
+			cleanup_data_pending_thread,
+			notifiers);
+	if (!thread) {
+		goto error;
+	}
+	lttng_thread_put(thread);
+	return true;
+error:
+	cleanup_data_pending_thread(notifiers);
+error_alloc:
+	return false;
+}
@@ -0,0 +1,79 @@
+#ifndef _LTTNG_SESSIOND_DATA_PENDING_H
+#define _LTTNG_SESSIOND_DATA_PENDING_H
+
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <common/pipe.h>
+#include <urcu/list.h>
+
+/*
+ * Client waiting for the data of a session to stop being pending, parked on
+ * the data pending thread rather than occupying a client command worker.
+ */
+struct data_pending_waiter {
+	/* CLOCK_MONOTONIC time at which the wait times out. */
+	struct timespec deadline;
+	/* Generation sampled before the last check of the waiter. */
+	uint64_t generation;
+	/*
+	 * Check the session of the waiter again, 'expired' being set once its
+	 * deadline is reached. Return true if the waiter replied to its client
+	 * and released itself, false to keep waiting.
+	 */
+	bool (*check)(struct data_pending_waiter *waiter, bool expired);
+	/* Release the waiter without replying, on shutdown. */
+	void (*release)(struct data_pending_waiter *waiter);
+	/* Node of the list of parked waiters. */
+	struct cds_list_head node;
+};
+
+/*
+ * The consumer daemons write the id of a session on the data pending pipe
+ * when a stream they found holding data for a data pending check is drained.
+ * The data pending thread turns those hints into a check of the parked
+ * waiters, and checks them again when their deadline is reached.
+ */
+bool launch_data_pending_thread(struct lttng_pipe *data_pending_pipe);
+
+/*
+ * Return the current data pending generation. Sample it before checking
+ * whether data is pending, then store it in the waiter to park.
+ */
+uint64_t data_pending_get_generation(void);
+
+/*
+ * Hand a waiter over to the data pending thread, which checks it again on
+ * every hint received after its generation was sampled, and when its deadline
+ * is reached.
+ *
+ * Return true if the waiter is parked, false if the data pending thread is
+ * not running, in which case the caller keeps its ownership.
+ */
+bool data_pending_park(struct data_pending_waiter *waiter);
+
+/*
+ * Check the parked waiters again, e.g. when a rotation which kept the data of
+ * a session pending completes.
+ */
+void data_pending_signal(void);
+
+#endif /* _LTTNG_SESSIOND_DATA_PENDING_H */
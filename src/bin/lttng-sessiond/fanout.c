@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _LGPL_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <urcu.h>
+#include <urcu/uatomic.h>
+
+#include <common/common.h>
+#include <common/defaults.h>
+
+#include "fanout.h"
+
+struct fanout {
+	void * const *items;
+	size_t count;
+	fanout_cb cb;
+	void *data;
+	int *results;
+	/* Index of the next item to process, shared by all the threads. */
+	unsigned long next;
+};
+
+static void fanout_process(struct fanout *fanout)
+{
+	for (;;) {
+		const unsigned long i = uatomic_add_return(&fanout->next, 1) - 1;
+
+		if (i >= fanout->count) {
+			break;
+		}
+
+		rcu_read_lock();
+		fanout->results[i] = fanout->cb(fanout->items[i], fanout->data);
+		rcu_read_unlock();
+	}
+}
+
+static void *fanout_thread(void *data)
+{
+	rcu_register_thread();
+	fanout_process(data);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+size_t fanout_run(void * const *items, size_t count, fanout_cb cb, void *data,
+		int *results, unsigned int max_threads)
+{
+	int ret;
+	size_t i, nr_errors = 0;
+	unsigned int nr_threads = 0, max_workers;
+	pthread_t *threads = NULL;
+	struct fanout fanout = {
+		.items = items,
+		.count = count,
+		.cb = cb,
+		.data = data,
+		.results = results,
+		.next = 0,
+	};
+
+	if (!count) {
+		goto end;
+	}
+
+	/* The calling thread is one of the workers. */
+	max_workers = min_t(size_t, count, max_threads ? max_threads : 1) - 1;
+	if (max_workers) {
+		threads = zmalloc(sizeof(*threads) * max_workers);
+		if (!threads) {
+			PERROR("zmalloc fan-out threads");
+			max_workers = 0;
+		}
+	}
+
+	for (nr_threads = 0; nr_threads < max_workers; nr_threads++) {
+		ret = pthread_create(&threads[nr_threads], default_pthread_attr(),
+				fanout_thread, &fanout);
+		if (ret) {
+			/* Carry on with the threads that could be launched. */
+			errno = ret;
+			PERROR("pthread_create fan-out thread");
+			break;
+		}
+	}
+
+	fanout_process(&fanout);
+
+	for (i = 0; i < nr_threads; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join fan-out thread");
+		}
+	}
+	free(threads);
+
+	for (i = 0; i < count; i++) {
+		if (results[i] < 0) {
+			nr_errors++;
+		}
+	}
+end:
+	return nr_errors;
+}
@@ -0,0 +1,43 @@
+#ifndef _LTTNG_SESSIOND_FANOUT_H
+#define _LTTNG_SESSIOND_FANOUT_H
+
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+
+typedef int (*fanout_cb)(void *item, void *data);
+
+/*
+ * Call 'cb' on each of the 'count' items, spreading the calls over at most
+ * 'max_threads' threads, the calling thread included. The calls are made in
+ * no particular order and the value returned by the call made on items[i] is
+ * stored in results[i]. The function returns once all the calls are done.
+ *
+ * This is meant to issue blocking requests to many peers (e.g. applications)
+ * at once, so that a slow peer only holds up the thread talking to it.
+ *
+ * The calls are made within an RCU read-side critical section. The caller
+ * must guarantee that the items remain valid until the function returns,
+ * e.g. by holding the RCU read-side lock itself.
+ *
+ * Returns the number of calls which returned a negative value.
+ */
+size_t fanout_run(void * const *items, size_t count, fanout_cb cb, void *data,
+		int *results, unsigned int max_threads);
+
+#endif /* _LTTNG_SESSIOND_FANOUT_H */
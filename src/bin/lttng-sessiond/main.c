@@ -84,6 +84,8 @@
 #include "register.h"
 #include "manage-apps.h"
 #include "manage-kernel.h"
+#include "data-pending.h"
+#include "metadata-push.h"
 
 static const char *help_msg =
 #ifdef LTTNG_EMBED_HELP
@@ -1302,6 +1304,7 @@ int main(int argc, char **argv)
 	struct lttng_pipe *ust32_channel_monitor_pipe = NULL,
 			*ust64_channel_monitor_pipe = NULL,
 			*kernel_channel_monitor_pipe = NULL;
+	struct lttng_pipe *data_pending_pipe = NULL;
 	struct lttng_thread *ht_cleanup_thread = NULL;
 	struct timer_thread_parameters timer_thread_parameters;
 	/* Rotation thread handle. */
@@ -1528,6 +1531,20 @@ int main(int argc, char **argv)
 		goto stop_threads;
 	}
 
+	/* The data pending pipe is shared by all the consumer daemons. */
+	data_pending_pipe = lttng_pipe_open(FD_CLOEXEC);
+	if (!data_pending_pipe) {
+		ERR("Failed to create consumer data pending pipe");
+		retval = -1;
+		goto stop_threads;
+	}
+	kconsumer_data.data_pending_pipe =
+			lttng_pipe_get_writefd(data_pending_pipe);
+	ustconsumer32_data.data_pending_pipe =
+			lttng_pipe_get_writefd(data_pending_pipe);
+	ustconsumer64_data.data_pending_pipe =
+			lttng_pipe_get_writefd(data_pending_pipe);
+
 	/*
 	 * Init UST app hash table. Alloc hash table before this point since
 	 * cleanup() can get called after that point.
@@ -1683,6 +1700,18 @@ int main(int argc, char **argv)
 		goto stop_threads;
 	}
 
+	/* Create thread waking up the clients waiting on data pending. */
+	if (!launch_data_pending_thread(data_pending_pipe)) {
+		retval = -1;
+		goto stop_threads;
+	}
+
+	/* Create thread pushing the metadata deferred by the coalescing window. */
+	if (!launch_metadata_push_thread()) {
+		retval = -1;
+		goto stop_threads;
+	}
+
 	/* Create thread to manage the client socket */
 	client_thread = launch_client_thread();
 	if (!client_thread) {
@@ -1828,6 +1857,7 @@ stop_threads:
 	lttng_pipe_destroy(ust32_channel_monitor_pipe);
 	lttng_pipe_destroy(ust64_channel_monitor_pipe);
 	lttng_pipe_destroy(kernel_channel_monitor_pipe);
+	lttng_pipe_destroy(data_pending_pipe);
 
 	if (health_sessiond) {
 		health_app_destroy(health_sessiond);
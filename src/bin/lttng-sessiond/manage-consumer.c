@@ -269,6 +269,17 @@ void *thread_consumer_management(void *data)
 		goto error;
 	}
 
+	/*
+	 * Transfer the write-end of the data pending pipe so that the consumer
+	 * signals the streams it drains.
+	 */
+	ret = consumer_send_data_pending_pipe(cmd_socket_wrapper,
+			consumer_data->data_pending_pipe);
+	if (ret) {
+		mark_thread_intialization_as_failed(notifiers);
+		goto error;
+	}
+
 	/* Discard the socket wrapper as it is no longer needed. */
 	consumer_destroy_socket(cmd_socket_wrapper);
 	cmd_socket_wrapper = NULL;
@@ -338,7 +349,7 @@ void *thread_consumer_management(void *data)
 				}
 				/* UST metadata requests */
 				ret = ust_consumer_metadata_request(
-						&consumer_data->metadata_sock);
+						consumer_data);
 				if (ret < 0) {
 					ERR("Handling metadata request");
 					goto error;
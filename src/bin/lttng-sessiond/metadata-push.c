@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _LGPL_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <urcu.h>
+#include <urcu/list.h>
+
+#include <common/common.h>
+#include <common/compat/time.h>
+#include <common/time.h>
+
+#include "metadata-push.h"
+#include "thread.h"
+#include "ust-consumer.h"
+
+/* Metadata push deferred to the end of the coalescing window. */
+struct deferred_push {
+	struct consumer_data *consumer_data;
+	struct lttcomm_metadata_request_msg request;
+	/* Monotonic time at which the push is due. */
+	struct timespec deadline;
+	struct cds_list_head node;
+};
+
+static struct {
+	pthread_once_t init;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* List of struct deferred_push, protected by 'lock'. */
+	struct cds_list_head list;
+	/* Set on shutdown, protected by 'lock'. */
+	bool quit;
+} pushes = {
+	.init = PTHREAD_ONCE_INIT,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.list = CDS_LIST_HEAD_INIT(pushes.list),
+};
+
+static void init_pushes(void)
+{
+	int ret;
+	pthread_condattr_t attr;
+
+	ret = pthread_condattr_init(&attr);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_condattr_init");
+		abort();
+	}
+	/* The deadlines are expressed on the monotonic clock. */
+	ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_condattr_setclock");
+		abort();
+	}
+	ret = pthread_cond_init(&pushes.cond, &attr);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_cond_init");
+		abort();
+	}
+	(void) pthread_condattr_destroy(&attr);
+}
+
+static int timespec_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec) {
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	}
+	if (a->tv_nsec != b->tv_nsec) {
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	}
+	return 0;
+}
+
+static bool same_registry(const struct deferred_push *push,
+		struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request)
+{
+	return push->consumer_data == consumer_data &&
+			push->request.session_id == request->session_id &&
+			push->request.session_id_per_pid ==
+				request->session_id_per_pid &&
+			push->request.bits_per_long == request->bits_per_long &&
+			push->request.uid == request->uid &&
+			push->request.key == request->key;
+}
+
+/* Must be called with the pushes lock held. */
+static struct deferred_push *first_due_push(void)
+{
+	struct deferred_push *push, *first = NULL;
+
+	cds_list_for_each_entry(push, &pushes.list, node) {
+		if (!first || timespec_cmp(&push->deadline,
+				&first->deadline) < 0) {
+			first = push;
+		}
+	}
+	return first;
+}
+
+int metadata_push_defer(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request,
+		uint64_t delay_us)
+{
+	int ret = 0;
+	struct timespec deadline;
+	struct deferred_push *push;
+
+	assert(consumer_data);
+	assert(request);
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (ret) {
+		PERROR("clock_gettime");
+		goto end;
+	}
+	deadline.tv_sec += delay_us / USEC_PER_SEC;
+	deadline.tv_nsec += (delay_us % USEC_PER_SEC) * NSEC_PER_USEC;
+	if (deadline.tv_nsec >= NSEC_PER_SEC) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= NSEC_PER_SEC;
+	}
+
+	pthread_once(&pushes.init, init_pushes);
+	pthread_mutex_lock(&pushes.lock);
+	if (pushes.quit) {
+		ret = -1;
+		goto end_unlock;
+	}
+	cds_list_for_each_entry(push, &pushes.list, node) {
+		if (!same_registry(push, consumer_data, request)) {
+			continue;
+		}
+		if (timespec_cmp(&deadline, &push->deadline) < 0) {
+			push->deadline = deadline;
+			pthread_cond_signal(&pushes.cond);
+		}
+		goto end_unlock;
+	}
+
+	push = zmalloc(sizeof(*push));
+	if (!push) {
+		PERROR("zmalloc deferred metadata push");
+		ret = -1;
+		goto end_unlock;
+	}
+	push->consumer_data = consumer_data;
+	push->request = *request;
+	push->deadline = deadline;
+	cds_list_add_tail(&push->node, &pushes.list);
+	pthread_cond_signal(&pushes.cond);
+	DBG3("Metadata push of session id %" PRIu64 " deferred by %" PRIu64 " us",
+			request->session_id, delay_us);
+end_unlock:
+	pthread_mutex_unlock(&pushes.lock);
+end:
+	return ret;
+}
+
+static void *thread_metadata_push(void *data)
+{
+	DBG("[metadata-push-thread] Started");
+
+	rcu_register_thread();
+	/* Only online while pushing, the waits can be long. */
+	rcu_thread_offline();
+
+	pthread_mutex_lock(&pushes.lock);
+	while (!pushes.quit) {
+		int ret;
+		struct timespec now;
+		struct deferred_push *push;
+
+		push = first_due_push();
+		if (!push) {
+			(void) pthread_cond_wait(&pushes.cond, &pushes.lock);
+			continue;
+		}
+
+		ret = lttng_clock_gettime(CLOCK_MONOTONIC, &now);
+		if (ret) {
+			PERROR("clock_gettime");
+			break;
+		}
+		if (timespec_cmp(&now, &push->deadline) < 0) {
+			(void) pthread_cond_timedwait(&pushes.cond,
+					&pushes.lock, &push->deadline);
+			continue;
+		}
+
+		cds_list_del(&push->node);
+		pthread_mutex_unlock(&pushes.lock);
+
+		rcu_thread_online();
+		(void) ust_consumer_push_deferred_metadata(push->consumer_data,
+				&push->request);
+		rcu_thread_offline();
+		free(push);
+
+		pthread_mutex_lock(&pushes.lock);
+	}
+	pthread_mutex_unlock(&pushes.lock);
+
+	rcu_thread_online();
+	rcu_unregister_thread();
+	DBG("[metadata-push-thread] Exiting");
+	return NULL;
+}
+
+static bool shutdown_metadata_push_thread(void *data)
+{
+	pthread_mutex_lock(&pushes.lock);
+	pushes.quit = true;
+	pthread_cond_broadcast(&pushes.cond);
+	pthread_mutex_unlock(&pushes.lock);
+	return true;
+}
+
+static void cleanup_metadata_push_thread(void *data)
+{
+	struct deferred_push *push, *tmp;
+
+	/* The remaining metadata is pushed on session teardown. */
+	pthread_mutex_lock(&pushes.lock);
+	cds_list_for_each_entry_safe(push, tmp, &pushes.list, node) {
+		cds_list_del(&push->node);
+		free(push);
+	}
+	pthread_mutex_unlock(&pushes.lock);
+}
+
+bool launch_metadata_push_thread(void)
+{
+	struct lttng_thread *thread;
+
+	pthread_once(&pushes.init, init_pushes);
+	thread = lttng_thread_create("Metadata push",
+			thread_metadata_push,
+			shutdown_metadata_push_thread,
+			cleanup_metadata_push_thread,
+			NULL);
+	if (!thread) {
+		return false;
+	}
+	lttng_thread_put(thread);
+	return true;
+}
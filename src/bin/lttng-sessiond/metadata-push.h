@@ -0,0 +1,67 @@
+#ifndef _LTTNG_SESSIOND_METADATA_PUSH_H
+#define _LTTNG_SESSIOND_METADATA_PUSH_H
+
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <common/sessiond-comm/sessiond-comm.h>
+
+struct consumer_data;
+
+#ifdef HAVE_LIBLTTNG_UST_CTL
+
+/*
+ * The metadata push thread pushes the UST metadata of the consumer metadata
+ * requests whose push was deferred to the end of the coalescing window of
+ * their registry.
+ */
+bool launch_metadata_push_thread(void);
+
+/*
+ * Push the metadata targeted by a metadata request of the consumer of
+ * 'consumer_data' in 'delay_us'. A request already deferred for the same
+ * registry is pushed once, at the earliest of both deadlines.
+ *
+ * Return 0 on success, a negative value if the push could not be deferred.
+ */
+int metadata_push_defer(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request,
+		uint64_t delay_us);
+
+#else /* HAVE_LIBLTTNG_UST_CTL */
+
+static inline
+bool launch_metadata_push_thread(void)
+{
+	return true;
+}
+
+static inline
+int metadata_push_defer(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request,
+		uint64_t delay_us)
+{
+	return -ENOSYS;
+}
+
+#endif /* HAVE_LIBLTTNG_UST_CTL */
+
+#endif /* _LTTNG_SESSIOND_METADATA_PUSH_H */
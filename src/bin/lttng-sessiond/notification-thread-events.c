@@ -51,6 +51,9 @@
 #define CLIENT_POLL_MASK_IN (LPOLLIN | LPOLLERR | LPOLLHUP | LPOLLRDHUP)
 #define CLIENT_POLL_MASK_IN_OUT (CLIENT_POLL_MASK_IN | LPOLLOUT)
 
+/* Largest number of channel samples read at once from a monitoring pipe. */
+#define CHANNEL_MONITOR_READ_BATCH_MAX 128
+
 enum lttng_object_type {
 	LTTNG_OBJECT_TYPE_UNKNOWN,
 	LTTNG_OBJECT_TYPE_NONE,
@@ -64,10 +67,40 @@ struct lttng_trigger_list_element {
 	struct cds_list_head node;
 };
 
+/*
+ * Entry of the index of the triggers applying to a channel. The threshold,
+ * in bytes, of the trigger's condition is computed once for the channel.
+ */
+struct lttng_trigger_threshold {
+	uint64_t threshold;
+	const struct lttng_trigger *trigger;
+};
+
+/*
+ * List of triggers applying to a given channel.
+ *
+ * See:
+ *   - lttng_channel_trigger_list_create()
+ *   - lttng_channel_trigger_list_destroy()
+ *   - lttng_channel_trigger_list_add()
+ *   - lttng_channel_trigger_list_remove()
+ */
 struct lttng_channel_trigger_list {
 	struct channel_key channel_key;
+	/* Capacity of the channel's buffers, in bytes. */
+	uint64_t channel_capacity;
 	/* List of struct lttng_trigger_list_element. */
 	struct cds_list_head list;
+	/*
+	 * The triggers of the list, indexed by condition type. Each index is
+	 * an array of struct lttng_trigger_threshold sorted by increasing
+	 * threshold so that a sample only visits the conditions whose
+	 * evaluation changes, i.e. those whose threshold lies between the
+	 * previous and the latest sampled values.
+	 */
+	struct lttng_dynamic_buffer buffer_usage_low_index;
+	struct lttng_dynamic_buffer buffer_usage_high_index;
+	struct lttng_dynamic_buffer session_consumed_size_index;
 	/* Node in the channel_triggers_ht */
 	struct cds_lfht_node channel_triggers_ht_node;
 	/* call_rcu delayed reclaim. */
@@ -254,6 +287,20 @@ static
 void session_info_remove_channel(struct session_info *session_info,
 		struct channel_info *channel_info);
 
+/* lttng_channel_trigger_list API */
+static
+struct lttng_channel_trigger_list *lttng_channel_trigger_list_create(
+		const struct channel_info *channel_info);
+static
+void lttng_channel_trigger_list_destroy(
+		struct lttng_channel_trigger_list *list);
+static
+int lttng_channel_trigger_list_add(struct lttng_channel_trigger_list *list,
+		const struct lttng_trigger *trigger);
+static
+void lttng_channel_trigger_list_remove(struct lttng_channel_trigger_list *list,
+		struct lttng_trigger_list_element *element);
+
 /* lttng_session_trigger_list API */
 static
 struct lttng_session_trigger_list *lttng_session_trigger_list_create(
@@ -1402,6 +1449,237 @@ end:
 	return ret;
 }
 
+/*
+ * Threshold, in bytes, of a buffer usage condition for a channel of a given
+ * capacity.
+ */
+static
+uint64_t buffer_usage_condition_get_threshold(
+		const struct lttng_condition *condition,
+		uint64_t buffer_capacity)
+{
+	const struct lttng_condition_buffer_usage *use_condition = container_of(
+			condition, struct lttng_condition_buffer_usage,
+			parent);
+
+	if (use_condition->threshold_bytes.set) {
+		return use_condition->threshold_bytes.value;
+	}
+
+	/*
+	 * Threshold was expressed as a ratio.
+	 *
+	 * The triggers of a channel cache this value (see
+	 * lttng_channel_trigger_list_add()) since it depends on the size
+	 * of the channel: a condition can apply to multiple channels
+	 * (i.e. my_chann*) which don't all have the same size.
+	 */
+	return (uint64_t) (use_condition->threshold_ratio.value *
+			(double) buffer_capacity);
+}
+
+/* Index of a channel's triggers in which a condition is kept. */
+static
+struct lttng_dynamic_buffer *channel_trigger_list_get_index(
+		struct lttng_channel_trigger_list *list,
+		const struct lttng_condition *condition)
+{
+	switch (lttng_condition_get_type(condition)) {
+	case LTTNG_CONDITION_TYPE_BUFFER_USAGE_LOW:
+		return &list->buffer_usage_low_index;
+	case LTTNG_CONDITION_TYPE_BUFFER_USAGE_HIGH:
+		return &list->buffer_usage_high_index;
+	case LTTNG_CONDITION_TYPE_SESSION_CONSUMED_SIZE:
+		return &list->session_consumed_size_index;
+	default:
+		/* Unknown condition type; internal error. */
+		abort();
+	}
+}
+
+static
+size_t trigger_threshold_index_get_count(
+		const struct lttng_dynamic_buffer *index)
+{
+	return index->size / sizeof(struct lttng_trigger_threshold);
+}
+
+/*
+ * Position of the first entry of an index of which the threshold is greater
+ * than or equal to 'value', or the number of entries if there is none.
+ */
+static
+size_t trigger_threshold_index_lower_bound(
+		const struct lttng_dynamic_buffer *index, uint64_t value)
+{
+	const struct lttng_trigger_threshold *entries =
+			(const struct lttng_trigger_threshold *) index->data;
+	size_t low = 0, high = trigger_threshold_index_get_count(index);
+
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+
+		if (entries[mid].threshold < value) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/*
+ * Position of the first entry of an index of which the threshold is greater
+ * than 'value', or the number of entries if there is none.
+ */
+static
+size_t trigger_threshold_index_upper_bound(
+		const struct lttng_dynamic_buffer *index, uint64_t value)
+{
+	if (value == UINT64_MAX) {
+		return trigger_threshold_index_get_count(index);
+	}
+	return trigger_threshold_index_lower_bound(index, value + 1);
+}
+
+static
+struct lttng_channel_trigger_list *lttng_channel_trigger_list_create(
+		const struct channel_info *channel_info)
+{
+	struct lttng_channel_trigger_list *list;
+
+	list = zmalloc(sizeof(*list));
+	if (!list) {
+		goto end;
+	}
+	list->channel_key = channel_info->key;
+	list->channel_capacity = channel_info->capacity;
+	CDS_INIT_LIST_HEAD(&list->list);
+	lttng_dynamic_buffer_init(&list->buffer_usage_low_index);
+	lttng_dynamic_buffer_init(&list->buffer_usage_high_index);
+	lttng_dynamic_buffer_init(&list->session_consumed_size_index);
+	cds_lfht_node_init(&list->channel_triggers_ht_node);
+end:
+	return list;
+}
+
+static
+void free_channel_trigger_list_rcu(struct rcu_head *node)
+{
+	free(caa_container_of(node, struct lttng_channel_trigger_list,
+			rcu_node));
+}
+
+/*
+ * Free the triggers of a channel. The list must have been unpublished from
+ * the channel_triggers_ht, if it was published.
+ */
+static
+void lttng_channel_trigger_list_destroy(struct lttng_channel_trigger_list *list)
+{
+	struct lttng_trigger_list_element *trigger_list_element, *tmp;
+
+	if (!list) {
+		return;
+	}
+
+	cds_list_for_each_entry_safe(trigger_list_element, tmp,
+			&list->list, node) {
+		cds_list_del(&trigger_list_element->node);
+		free(trigger_list_element);
+	}
+	lttng_dynamic_buffer_reset(&list->buffer_usage_low_index);
+	lttng_dynamic_buffer_reset(&list->buffer_usage_high_index);
+	lttng_dynamic_buffer_reset(&list->session_consumed_size_index);
+	call_rcu(&list->rcu_node, free_channel_trigger_list_rcu);
+}
+
+static
+int lttng_channel_trigger_list_add(struct lttng_channel_trigger_list *list,
+		const struct lttng_trigger *trigger)
+{
+	int ret;
+	size_t pos, count;
+	struct lttng_dynamic_buffer *index;
+	struct lttng_trigger_threshold *entries;
+	struct lttng_trigger_threshold new_entry = { .trigger = trigger };
+	struct lttng_trigger_list_element *new_element;
+	const struct lttng_condition *condition =
+			lttng_trigger_get_const_condition(trigger);
+
+	assert(condition);
+
+	switch (lttng_condition_get_type(condition)) {
+	case LTTNG_CONDITION_TYPE_BUFFER_USAGE_LOW:
+	case LTTNG_CONDITION_TYPE_BUFFER_USAGE_HIGH:
+		new_entry.threshold = buffer_usage_condition_get_threshold(
+				condition, list->channel_capacity);
+		break;
+	case LTTNG_CONDITION_TYPE_SESSION_CONSUMED_SIZE:
+		new_entry.threshold = container_of(condition,
+				struct lttng_condition_session_consumed_size,
+				parent)->consumed_threshold_bytes.value;
+		break;
+	default:
+		abort();
+	}
+
+	new_element = zmalloc(sizeof(*new_element));
+	if (!new_element) {
+		ret = -1;
+		goto end;
+	}
+
+	/* Insert the trigger after those of equal threshold. */
+	index = channel_trigger_list_get_index(list, condition);
+	pos = trigger_threshold_index_upper_bound(index, new_entry.threshold);
+	count = trigger_threshold_index_get_count(index);
+	ret = lttng_dynamic_buffer_set_size(index,
+			index->size + sizeof(new_entry));
+	if (ret) {
+		free(new_element);
+		goto end;
+	}
+	entries = (struct lttng_trigger_threshold *) index->data;
+	memmove(&entries[pos + 1], &entries[pos],
+			(count - pos) * sizeof(new_entry));
+	entries[pos] = new_entry;
+
+	CDS_INIT_LIST_HEAD(&new_element->node);
+	new_element->trigger = trigger;
+	cds_list_add(&new_element->node, &list->list);
+end:
+	return ret;
+}
+
+static
+void lttng_channel_trigger_list_remove(struct lttng_channel_trigger_list *list,
+		struct lttng_trigger_list_element *element)
+{
+	size_t pos, count;
+	struct lttng_dynamic_buffer *index;
+	struct lttng_trigger_threshold *entries;
+
+	index = channel_trigger_list_get_index(list,
+			lttng_trigger_get_const_condition(element->trigger));
+	entries = (struct lttng_trigger_threshold *) index->data;
+	count = trigger_threshold_index_get_count(index);
+	for (pos = 0; pos < count; pos++) {
+		if (entries[pos].trigger == element->trigger) {
+			break;
+		}
+	}
+	assert(pos < count);
+	memmove(&entries[pos], &entries[pos + 1],
+			(count - pos - 1) * sizeof(*entries));
+	/* Shrinking the index doesn't fail. */
+	(void) lttng_dynamic_buffer_set_size(index,
+			index->size - sizeof(*entries));
+
+	cds_list_del(&element->node);
+	free(element);
+}
+
 static
 bool trigger_applies_to_session(const struct lttng_trigger *trigger,
 		const char *session_name)
@@ -1545,7 +1823,6 @@ int handle_notification_thread_command_add_channel(
 		uint64_t channel_key_int, uint64_t channel_capacity,
 		enum lttng_error_code *cmd_result)
 {
-	struct cds_list_head trigger_list;
 	struct channel_info *new_channel_info = NULL;
 	struct channel_key channel_key = {
 		.key = channel_key_int,
@@ -1561,8 +1838,6 @@ int handle_notification_thread_command_add_channel(
 			channel_name, session_name, channel_key_int,
 			channel_domain == LTTNG_DOMAIN_KERNEL ? "kernel" : "user space");
 
-	CDS_INIT_LIST_HEAD(&trigger_list);
-
 	session_info = find_or_create_session_info(state, session_name,
 			session_uid, session_gid);
 	if (!session_info) {
@@ -1576,39 +1851,32 @@ int handle_notification_thread_command_add_channel(
 		goto error;
 	}
 
+	channel_trigger_list = lttng_channel_trigger_list_create(
+			new_channel_info);
+	if (!channel_trigger_list) {
+		goto error;
+	}
+
 	rcu_read_lock();
 	/* Build a list of all triggers applying to the new channel. */
 	cds_lfht_for_each_entry(state->triggers_ht, &iter, trigger_ht_element,
 			node) {
-		struct lttng_trigger_list_element *new_element;
-
 		if (!trigger_applies_to_channel(trigger_ht_element->trigger,
 				new_channel_info)) {
 			continue;
 		}
 
-		new_element = zmalloc(sizeof(*new_element));
-		if (!new_element) {
+		if (lttng_channel_trigger_list_add(channel_trigger_list,
+				trigger_ht_element->trigger)) {
 			rcu_read_unlock();
 			goto error;
 		}
-		CDS_INIT_LIST_HEAD(&new_element->node);
-		new_element->trigger = trigger_ht_element->trigger;
-		cds_list_add(&new_element->node, &trigger_list);
 		trigger_count++;
 	}
 	rcu_read_unlock();
 
 	DBG("[notification-thread] Found %i triggers that apply to newly added channel",
 			trigger_count);
-	channel_trigger_list = zmalloc(sizeof(*channel_trigger_list));
-	if (!channel_trigger_list) {
-		goto error;
-	}
-	channel_trigger_list->channel_key = new_channel_info->key;
-	CDS_INIT_LIST_HEAD(&channel_trigger_list->list);
-	cds_lfht_node_init(&channel_trigger_list->channel_triggers_ht_node);
-	cds_list_splice(&trigger_list, &channel_trigger_list->list);
 
 	rcu_read_lock();
 	/* Add channel to the channel_ht which owns the channel_infos. */
@@ -1627,18 +1895,12 @@ int handle_notification_thread_command_add_channel(
 	*cmd_result = LTTNG_OK;
 	return 0;
 error:
+	lttng_channel_trigger_list_destroy(channel_trigger_list);
 	channel_info_destroy(new_channel_info);
 	session_info_put(session_info);
 	return 1;
 }
 
-static
-void free_channel_trigger_list_rcu(struct rcu_head *node)
-{
-	free(caa_container_of(node, struct lttng_channel_trigger_list,
-			rcu_node));
-}
-
 static
 void free_channel_state_sample_rcu(struct rcu_head *node)
 {
@@ -1655,7 +1917,6 @@ int handle_notification_thread_command_remove_channel(
 	struct cds_lfht_node *node;
 	struct cds_lfht_iter iter;
 	struct lttng_channel_trigger_list *trigger_list;
-	struct lttng_trigger_list_element *trigger_list_element, *tmp;
 	struct channel_key key = { .key = channel_key, .domain = domain };
 	struct channel_info *channel_info;
 
@@ -1682,13 +1943,8 @@ int handle_notification_thread_command_remove_channel(
 	/* Free the list of triggers associated with this channel. */
 	trigger_list = caa_container_of(node, struct lttng_channel_trigger_list,
 			channel_triggers_ht_node);
-	cds_list_for_each_entry_safe(trigger_list_element, tmp,
-			&trigger_list->list, node) {
-		cds_list_del(&trigger_list_element->node);
-		free(trigger_list_element);
-	}
 	cds_lfht_del(state->channel_triggers_ht, node);
-	call_rcu(&trigger_list->rcu_node, free_channel_trigger_list_rcu);
+	lttng_channel_trigger_list_destroy(trigger_list);
 
 	/* Free sampled channel state. */
 	cds_lfht_lookup(state->channel_state_ht,
@@ -1931,7 +2187,6 @@ int bind_trigger_to_matching_channels(const struct lttng_trigger *trigger,
 
 	cds_lfht_for_each_entry(state->channels_ht, &iter, channel,
 			channels_ht_node) {
-		struct lttng_trigger_list_element *trigger_list_element;
 		struct lttng_channel_trigger_list *trigger_list;
 		struct cds_lfht_iter lookup_iter;
 
@@ -1950,14 +2205,10 @@ int bind_trigger_to_matching_channels(const struct lttng_trigger *trigger,
 				struct lttng_channel_trigger_list,
 				channel_triggers_ht_node);
 
-		trigger_list_element = zmalloc(sizeof(*trigger_list_element));
-		if (!trigger_list_element) {
-			ret = -1;
+		ret = lttng_channel_trigger_list_add(trigger_list, trigger);
+		if (ret) {
 			goto end;
 		}
-		CDS_INIT_LIST_HEAD(&trigger_list_element->node);
-		trigger_list_element->trigger = trigger;
-		cds_list_add(&trigger_list_element->node, &trigger_list->list);
 		DBG("[notification-thread] Newly registered trigger bound to channel \"%s\"",
 				channel->name);
 	}
@@ -2230,7 +2481,8 @@ int handle_notification_thread_command_unregister_trigger(
 			}
 
 			DBG("[notification-thread] Removed trigger from channel_triggers_ht");
-			cds_list_del(&trigger_element->node);
+			lttng_channel_trigger_list_remove(trigger_list,
+					trigger_element);
 			/* A trigger can only appear once per channel */
 			break;
 		}
@@ -2944,28 +3196,9 @@ bool evaluate_buffer_usage_condition(const struct lttng_condition *condition,
 	bool result = false;
 	uint64_t threshold;
 	enum lttng_condition_type condition_type;
-	const struct lttng_condition_buffer_usage *use_condition = container_of(
-			condition, struct lttng_condition_buffer_usage,
-			parent);
 
-	if (use_condition->threshold_bytes.set) {
-		threshold = use_condition->threshold_bytes.value;
-	} else {
-		/*
-		 * Threshold was expressed as a ratio.
-		 *
-		 * TODO the threshold (in bytes) of conditions expressed
-		 * as a ratio of total buffer size could be cached to
-		 * forego this double-multiplication or it could be performed
-		 * as fixed-point math.
-		 *
-		 * Note that caching should accomodate the case where the
-		 * condition applies to multiple channels (i.e. don't assume
-		 * that all channels matching my_chann* have the same size...)
-		 */
-		threshold = (uint64_t) (use_condition->threshold_ratio.value *
-				(double) buffer_capacity);
-	}
+	threshold = buffer_usage_condition_get_threshold(condition,
+			buffer_capacity);
 
 	condition_type = lttng_condition_get_type(condition);
 	if (condition_type == LTTNG_CONDITION_TYPE_BUFFER_USAGE_LOW) {
@@ -3204,39 +3437,110 @@ end:
 	return ret;
 }
 
-int handle_notification_thread_channel_sample(
-		struct notification_thread_state *state, int pipe,
+/*
+ * Notify the clients subscribed to the conditions of the entries [begin, end)
+ * of an index of a channel's triggers, which became true with the latest
+ * sample of the channel.
+ */
+static
+int notify_channel_triggers(struct notification_thread_state *state,
+		const struct lttng_dynamic_buffer *index, size_t begin,
+		size_t end, const struct channel_state_sample *latest_sample,
+		uint64_t latest_session_consumed_total,
+		const struct channel_info *channel_info)
+{
+	int ret = 0;
+	size_t i;
+	const struct lttng_trigger_threshold *entries =
+			(const struct lttng_trigger_threshold *) index->data;
+
+	for (i = begin; i < end; i++) {
+		const struct lttng_condition *condition;
+		const struct lttng_action *action;
+		const struct lttng_trigger *trigger;
+		struct notification_client_list *client_list;
+		struct lttng_evaluation *evaluation = NULL;
+		enum lttng_condition_type condition_type;
+
+		trigger = entries[i].trigger;
+		condition = lttng_trigger_get_const_condition(trigger);
+		assert(condition);
+		action = lttng_trigger_get_const_action(trigger);
+
+		/* Notify actions are the only type currently supported. */
+		assert(lttng_action_get_type_const(action) ==
+				LTTNG_ACTION_TYPE_NOTIFY);
+
+		/*
+		 * Check if any client is subscribed to the result of this
+		 * evaluation.
+		 */
+		client_list = get_client_list_from_condition(state, condition);
+		assert(client_list);
+		if (cds_list_empty(&client_list->list)) {
+			/*
+			 * No clients interested in the evaluation's result,
+			 * skip it.
+			 */
+			continue;
+		}
+
+		condition_type = lttng_condition_get_type(condition);
+		switch (condition_type) {
+		case LTTNG_CONDITION_TYPE_BUFFER_USAGE_LOW:
+		case LTTNG_CONDITION_TYPE_BUFFER_USAGE_HIGH:
+			evaluation = lttng_evaluation_buffer_usage_create(
+					condition_type,
+					latest_sample->highest_usage,
+					channel_info->capacity);
+			break;
+		case LTTNG_CONDITION_TYPE_SESSION_CONSUMED_SIZE:
+			evaluation = lttng_evaluation_session_consumed_size_create(
+					latest_session_consumed_total);
+			break;
+		default:
+			abort();
+		}
+		if (!evaluation) {
+			ret = -1;
+			goto end;
+		}
+
+		/* Dispatch evaluation result to all clients. */
+		ret = send_evaluation_to_clients(trigger, evaluation,
+				client_list, state,
+				channel_info->session_info->uid,
+				channel_info->session_info->gid);
+		lttng_evaluation_destroy(evaluation);
+		if (caa_unlikely(ret)) {
+			goto end;
+		}
+	}
+end:
+	return ret;
+}
+
+static
+int handle_channel_sample(struct notification_thread_state *state,
+		const struct lttcomm_consumer_channel_monitor_msg *sample_msg,
 		enum lttng_domain_type domain)
 {
 	int ret = 0;
-	struct lttcomm_consumer_channel_monitor_msg sample_msg;
 	struct channel_info *channel_info;
 	struct cds_lfht_node *node;
 	struct cds_lfht_iter iter;
 	struct lttng_channel_trigger_list *trigger_list;
-	struct lttng_trigger_list_element *trigger_list_element;
+	const struct lttng_dynamic_buffer *index;
+	size_t begin, end;
 	bool previous_sample_available = false;
 	struct channel_state_sample previous_sample, latest_sample;
 	uint64_t previous_session_consumed_total, latest_session_consumed_total;
 
-	/*
-	 * The monitoring pipe only holds messages smaller than PIPE_BUF,
-	 * ensuring that read/write of sampling messages are atomic.
-	 */
-	ret = lttng_read(pipe, &sample_msg, sizeof(sample_msg));
-	if (ret != sizeof(sample_msg)) {
-		ERR("[notification-thread] Failed to read from monitoring pipe (fd = %i)",
-				pipe);
-		ret = -1;
-		goto end;
-	}
-
-	ret = 0;
-	latest_sample.key.key = sample_msg.key;
+	latest_sample.key.key = sample_msg->key;
 	latest_sample.key.domain = domain;
-	latest_sample.highest_usage = sample_msg.highest;
-	latest_sample.lowest_usage = sample_msg.lowest;
-	latest_sample.channel_total_consumed = sample_msg.total_consumed;
+	latest_sample.highest_usage = sample_msg->highest;
+	latest_sample.lowest_usage = sample_msg->lowest;
+	latest_sample.channel_total_consumed = sample_msg->total_consumed;
 
 	rcu_read_lock();
 
@@ -3338,63 +3642,115 @@ int handle_notification_thread_channel_sample(
 
 	trigger_list = caa_container_of(node, struct lttng_channel_trigger_list,
 			channel_triggers_ht_node);
-	cds_list_for_each_entry(trigger_list_element, &trigger_list->list,
-		        node) {
-		const struct lttng_condition *condition;
-		const struct lttng_action *action;
-		const struct lttng_trigger *trigger;
-		struct notification_client_list *client_list;
-		struct lttng_evaluation *evaluation = NULL;
 
-		trigger = trigger_list_element->trigger;
-		condition = lttng_trigger_get_const_condition(trigger);
-		assert(condition);
-		action = lttng_trigger_get_const_action(trigger);
+	/*
+	 * Only notify on a condition evaluation transition: the high
+	 * buffer usage conditions which became true are those of which the
+	 * threshold is in (previous highest usage, latest highest usage].
+	 */
+	index = &trigger_list->buffer_usage_high_index;
+	begin = previous_sample_available ?
+			trigger_threshold_index_upper_bound(index,
+				previous_sample.highest_usage) : 0;
+	end = trigger_threshold_index_upper_bound(index,
+			latest_sample.highest_usage);
+	ret = notify_channel_triggers(state, index, begin, end,
+			&latest_sample, latest_session_consumed_total,
+			channel_info);
+	if (caa_unlikely(ret)) {
+		goto end_unlock;
+	}
 
-		/* Notify actions are the only type currently supported. */
-		assert(lttng_action_get_type_const(action) ==
-				LTTNG_ACTION_TYPE_NOTIFY);
+	/*
+	 * The low buffer usage conditions which became true are those of
+	 * which the threshold is in [latest highest usage, previous highest
+	 * usage).
+	 */
+	index = &trigger_list->buffer_usage_low_index;
+	begin = trigger_threshold_index_lower_bound(index,
+			latest_sample.highest_usage);
+	end = previous_sample_available ?
+			trigger_threshold_index_lower_bound(index,
+				previous_sample.highest_usage) :
+			trigger_threshold_index_get_count(index);
+	ret = notify_channel_triggers(state, index, begin, end,
+			&latest_sample, latest_session_consumed_total,
+			channel_info);
+	if (caa_unlikely(ret)) {
+		goto end_unlock;
+	}
 
-		/*
-		 * Check if any client is subscribed to the result of this
-		 * evaluation.
-		 */
-		client_list = get_client_list_from_condition(state, condition);
-		assert(client_list);
-		if (cds_list_empty(&client_list->list)) {
-			/*
-			 * No clients interested in the evaluation's result,
-			 * skip it.
-			 */
-			continue;
-		}
+	/*
+	 * The session consumed size conditions which became true are those
+	 * of which the threshold is in (previous total, latest total].
+	 */
+	index = &trigger_list->session_consumed_size_index;
+	begin = previous_sample_available ?
+			trigger_threshold_index_upper_bound(index,
+				previous_session_consumed_total) : 0;
+	end = trigger_threshold_index_upper_bound(index,
+			latest_session_consumed_total);
+	ret = notify_channel_triggers(state, index, begin, end,
+			&latest_sample, latest_session_consumed_total,
+			channel_info);
+	if (caa_unlikely(ret)) {
+		goto end_unlock;
+	}
+end_unlock:
+	rcu_read_unlock();
+	return ret;
+}
 
-		ret = evaluate_buffer_condition(condition, &evaluation, state,
-				previous_sample_available ? &previous_sample : NULL,
-				&latest_sample,
-				previous_session_consumed_total,
-				latest_session_consumed_total,
-				channel_info);
-		if (caa_unlikely(ret)) {
-			goto end_unlock;
-		}
+int handle_notification_thread_channel_sample(
+		struct notification_thread_state *state, int pipe,
+		enum lttng_domain_type domain)
+{
+	int ret = 0;
+	ssize_t len;
+	size_t i, count;
+	struct lttcomm_consumer_channel_monitor_msg
+			sample_msgs[CHANNEL_MONITOR_READ_BATCH_MAX];
 
-		if (caa_likely(!evaluation)) {
-			continue;
+	/*
+	 * The consumers write batches of samples smaller than PIPE_BUF,
+	 * ensuring that writes of sampling messages are atomic. Drain as
+	 * many samples as are available, which does not block since the
+	 * pipe is readable.
+	 */
+	do {
+		len = read(pipe, sample_msgs, sizeof(sample_msgs));
+	} while (len < 0 && errno == EINTR);
+	if (len <= 0) {
+		ERR("[notification-thread] Failed to read from monitoring pipe (fd = %i)",
+				pipe);
+		ret = -1;
+		goto end;
+	}
+
+	if (len % sizeof(sample_msgs[0])) {
+		/* Complete the last sample, written atomically by the consumer. */
+		const size_t missing = sizeof(sample_msgs[0]) -
+				len % sizeof(sample_msgs[0]);
+
+		if (lttng_read(pipe, (char *) sample_msgs + len, missing) !=
+				(ssize_t) missing) {
+			ERR("[notification-thread] Failed to read from monitoring pipe (fd = %i)",
+					pipe);
+			ret = -1;
+			goto end;
 		}
+		len += missing;
+	}
 
-		/* Dispatch evaluation result to all clients. */
-		ret = send_evaluation_to_clients(trigger_list_element->trigger,
-				evaluation, client_list, state,
-				channel_info->session_info->uid,
-				channel_info->session_info->gid);
-		lttng_evaluation_destroy(evaluation);
-		if (caa_unlikely(ret)) {
-			goto end_unlock;
+	count = len / sizeof(sample_msgs[0]);
+	DBG("[notification-thread] Read %zu channel samples from monitoring pipe (fd = %i)",
+			count, pipe);
+	for (i = 0; i < count; i++) {
+		ret = handle_channel_sample(state, &sample_msgs[i], domain);
+		if (ret) {
+			goto end;
 		}
 	}
-end_unlock:
-	rcu_read_unlock();
 end:
 	return ret;
 }
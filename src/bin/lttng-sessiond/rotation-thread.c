@@ -46,6 +46,7 @@
 #include "notification-thread-commands.h"
 #include "utils.h"
 #include "thread.h"
+#include "data-pending.h"
 
 #include <urcu.h>
 #include <urcu/list.h>
@@ -512,6 +513,8 @@ int check_session_rotation_pending(struct ltt_session *session,
 		PERROR("Failed to duplicate archived chunk name");
 	}
 	session_reset_rotation_state(session, LTTNG_ROTATION_STATE_COMPLETED);
+	/* An ongoing rotation keeps the data of the session pending. */
+	data_pending_signal();
 
 	if (!session->quiet_rotation) {
 		location = session_get_trace_archive_location(session);
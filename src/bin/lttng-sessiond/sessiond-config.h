@@ -41,6 +41,10 @@ struct sessiond_config {
 	struct config_int_range agent_tcp_port;
 	/* Socket timeout for receiving and sending (in seconds). */
 	int app_socket_timeout;
+	/* Maximal number of threads sending a command to all applications. */
+	unsigned int app_cmd_threads;
+	/* Number of threads processing the commands of clients. */
+	unsigned int client_cmd_threads;
 
 	bool quiet;
 	bool no_kernel;
@@ -30,6 +30,7 @@
 #include <signal.h>
 
 #include <common/common.h>
+#include <common/compat/time.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 
 #include "buffer-registry.h"
@@ -44,6 +45,7 @@
 #include "lttng-sessiond.h"
 #include "notification-thread-commands.h"
 #include "rotate.h"
+#include "fanout.h"
 
 static
 int ust_app_flush_app_session(struct ust_app *app, struct ust_app_session *ua_sess);
@@ -56,6 +58,14 @@ static pthread_mutex_t next_channel_key_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint64_t _next_session_id;
 static pthread_mutex_t next_session_id_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Serializes the lookup and creation of the per UID buffer registries and of
+ * their channels, since the global commands set up the applications of a
+ * session concurrently (see ust_app_fanout()). Nests inside the session lock
+ * and outside of the registry and consumer socket locks.
+ */
+static pthread_mutex_t per_uid_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Return the incremented value of next_channel_key.
  */
@@ -548,6 +558,50 @@ int ust_app_release_object(struct ust_app *app, struct lttng_ust_object_data *da
 	return ret;
 }
 
+/* Monotonic time, in ns, used to space out the metadata pushes. */
+static uint64_t metadata_push_time(void)
+{
+	struct timespec now;
+
+	if (lttng_clock_gettime(CLOCK_MONOTONIC, &now)) {
+		PERROR("lttng_clock_gettime");
+		return 0;
+	}
+	return (uint64_t) now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * Return the time, in usec, remaining before DEFAULT_METADATA_PUSH_COALESCE_WINDOW_US
+ * have elapsed since the last metadata push of a registry, or 0 if its
+ * metadata can be pushed right away (or if it has nothing to push). The
+ * consumer asks for metadata as soon as it has consumed the previous push:
+ * while applications register events, deferring the push to the end of the
+ * window sends the metadata of all the events registered during the window at
+ * once rather than one push per event.
+ *
+ * Must be called with the registry lock held.
+ */
+uint64_t ust_app_metadata_push_delay(struct ust_registry_session *registry)
+{
+	uint64_t now, window_end;
+
+	assert(registry);
+
+	if (!registry->metadata_last_push ||
+			registry->metadata_len == registry->metadata_len_sent) {
+		return 0;
+	}
+
+	now = metadata_push_time();
+	window_end = registry->metadata_last_push +
+			DEFAULT_METADATA_PUSH_COALESCE_WINDOW_US * NSEC_PER_USEC;
+	if (!now || now >= window_end) {
+		return 0;
+	}
+
+	return (window_end - now + NSEC_PER_USEC - 1) / NSEC_PER_USEC;
+}
+
 /*
  * Push metadata to consumer socket.
  *
@@ -597,15 +651,11 @@ ssize_t ust_app_push_metadata(struct ust_registry_session *registry,
 		goto end;
 	}
 
-	/* Allocate only what we have to send. */
-	metadata_str = zmalloc(len);
-	if (!metadata_str) {
-		PERROR("zmalloc ust app metadata string");
-		ret_val = -ENOMEM;
-		goto error;
-	}
-	/* Copy what we haven't sent out. */
-	memcpy(metadata_str, registry->metadata + offset, len);
+	/*
+	 * Send what we haven't sent out straight from the metadata array,
+	 * which stays in place until it is unpinned.
+	 */
+	metadata_str = ust_metadata_pin(registry) + offset;
 
 push_data:
 	pthread_mutex_unlock(&registry->lock);
@@ -624,6 +674,9 @@ push_data:
 	ret = consumer_push_metadata(socket, metadata_key,
 			metadata_str, len, offset, metadata_version);
 	pthread_mutex_lock(&registry->lock);
+	if (metadata_str) {
+		ust_metadata_unpin(registry);
+	}
 	if (ret < 0) {
 		/*
 		 * There is an acceptable race here between the registry
@@ -663,12 +716,13 @@ push_data:
 		registry->metadata_len_sent =
 			max_t(size_t, registry->metadata_len_sent,
 				new_metadata_len_sent);
+		if (len) {
+			registry->metadata_last_push = metadata_push_time();
+		}
 	}
-	free(metadata_str);
 	return len;
 
 end:
-error:
 	if (ret_val) {
 		/*
 		 * On error, flag the registry that the metadata is
@@ -680,7 +734,6 @@ error:
 		registry->metadata_closed = 1;
 	}
 error_push:
-	free(metadata_str);
 	return ret_val;
 }
 
@@ -893,6 +946,52 @@ void delete_ust_app_session(int sock, struct ust_app_session *ua_sess,
 	call_rcu(&ua_sess->rcu_head, delete_ust_app_session_rcu);
 }
 
+/*
+ * Return true if a cached listing can be reused.
+ */
+static bool list_cache_is_fresh(const struct ust_app_list_cache *cache)
+{
+	struct timespec now;
+
+	if (!cache->valid) {
+		return false;
+	}
+
+	if (lttng_clock_gettime(CLOCK_MONOTONIC, &now)) {
+		PERROR("clock_gettime");
+		return false;
+	}
+
+	return now.tv_sec - cache->time < DEFAULT_APP_LIST_CACHE_TTL;
+}
+
+/*
+ * Replace a cached listing by the 'count' entries of 'entries', which are
+ * owned by the cache from now on.
+ */
+static void list_cache_set(struct ust_app_list_cache *cache, void *entries,
+		size_t count)
+{
+	struct timespec now = {};
+
+	if (lttng_clock_gettime(CLOCK_MONOTONIC, &now)) {
+		/* The listing expires right away. */
+		PERROR("clock_gettime");
+	}
+
+	free(cache->entries);
+	cache->entries = entries;
+	cache->count = count;
+	cache->time = now.tv_sec;
+	cache->valid = true;
+}
+
+static void list_cache_reset(struct ust_app_list_cache *cache)
+{
+	free(cache->entries);
+	memset(cache, 0, sizeof(*cache));
+}
+
 /*
  * Delete a traceable application structure from the global list. Never call
  * this function outside of a call_rcu call.
@@ -946,6 +1045,10 @@ void delete_ust_app(struct ust_app *app)
 	}
 	lttng_fd_put(LTTNG_FD_APPS, 1);
 
+	list_cache_reset(&app->events_cache);
+	list_cache_reset(&app->fields_cache);
+	pthread_mutex_destroy(&app->list_cache_lock);
+
 	DBG2("UST app pid %d deleted", app->pid);
 	free(app);
 	session_unlock_list();
@@ -2046,6 +2149,7 @@ static int setup_buffer_reg_uid(struct ltt_ust_session *usess,
 	assert(app);
 
 	rcu_read_lock();
+	pthread_mutex_lock(&per_uid_buffers_lock);
 
 	reg_uid = buffer_reg_uid_find(usess->id, app->bits_per_long, app->uid);
 	if (!reg_uid) {
@@ -2093,6 +2197,7 @@ end:
 		*regp = reg_uid;
 	}
 error:
+	pthread_mutex_unlock(&per_uid_buffers_lock);
 	rcu_read_unlock();
 	return ret;
 }
@@ -2823,6 +2928,7 @@ static int create_channel_per_uid(struct ust_app *app,
 
 	DBG("UST app creating channel %s with per UID buffers", ua_chan->name);
 
+	pthread_mutex_lock(&per_uid_buffers_lock);
 	reg_uid = buffer_reg_uid_find(usess->id, app->bits_per_long, app->uid);
 	/*
 	 * The session creation handles the creation of this global registry
@@ -2834,6 +2940,7 @@ static int create_channel_per_uid(struct ust_app *app,
 	reg_chan = buffer_reg_channel_find(ua_chan->tracing_channel_id,
 			reg_uid);
 	if (reg_chan) {
+		pthread_mutex_unlock(&per_uid_buffers_lock);
 		goto send_channel;
 	}
 
@@ -2842,7 +2949,7 @@ static int create_channel_per_uid(struct ust_app *app,
 	if (ret < 0) {
 		ERR("Error creating the UST channel \"%s\" registry instance",
 				ua_chan->name);
-		goto error;
+		goto error_unlock;
 	}
 
 	session = session_find_by_id(ua_sess->tracing_id);
@@ -2869,7 +2976,7 @@ static int create_channel_per_uid(struct ust_app *app,
 				ua_chan->tracing_channel_id, false);
 		buffer_reg_channel_remove(reg_uid->registry, reg_chan);
 		buffer_reg_channel_destroy(reg_chan, LTTNG_DOMAIN_UST);
-		goto error;
+		goto error_unlock;
 	}
 
 	/*
@@ -2879,7 +2986,7 @@ static int create_channel_per_uid(struct ust_app *app,
 			ua_chan, reg_chan, app);
 	if (ret < 0) {
 		ERR("Error setting up UST channel \"%s\"", ua_chan->name);
-		goto error;
+		goto error_unlock;
 	}
 
 	/* Notify the notification subsystem of the channel's creation. */
@@ -2900,8 +3007,9 @@ static int create_channel_per_uid(struct ust_app *app,
 	if (notification_ret != LTTNG_OK) {
 		ret = - (int) notification_ret;
 		ERR("Failed to add channel to notification thread");
-		goto error;
+		goto error_unlock;
 	}
+	pthread_mutex_unlock(&per_uid_buffers_lock);
 
 send_channel:
 	/* Send buffers to the application. */
@@ -2918,6 +3026,10 @@ error:
 		session_put(session);
 	}
 	return ret;
+
+error_unlock:
+	pthread_mutex_unlock(&per_uid_buffers_lock);
+	goto error;
 }
 
 /*
@@ -3381,6 +3493,7 @@ struct ust_app *ust_app_create(struct ust_register_msg *msg, int sock)
 	lttng_ht_node_init_ulong(&lta->pid_n, (unsigned long) lta->pid);
 	lta->sock = sock;
 	pthread_mutex_init(&lta->sock_lock, NULL);
+	pthread_mutex_init(&lta->list_cache_lock, NULL);
 	lttng_ht_node_init_ulong(&lta->sock_n, (unsigned long) lta->sock);
 
 	CDS_INIT_LIST_HEAD(&lta->teardown_head);
@@ -3572,360 +3685,584 @@ void ust_app_unregister(int sock)
 }
 
 /*
- * Fill events array with all events name of all registered apps.
+ * Call 'cb' with each registered application and 'data', spreading the calls
+ * over at most config.app_cmd_threads threads so that an application slow to
+ * reply only holds up the thread talking to it.
+ *
+ * As with a plain iteration of the application hash table, applications
+ * registering concurrently may be missed; they are set up by their own
+ * registration.
+ *
+ * Returns the first error, in iteration order of the applications, returned
+ * by 'cb' or 0 if all the calls succeeded.
  */
-int ust_app_list_events(struct lttng_event **events)
+static int ust_app_fanout(fanout_cb cb, void *data)
 {
-	int ret, handle;
-	size_t nbmem, count = 0;
+	int ret = 0;
+	size_t i, nr_apps = 0, max_apps = 0;
 	struct lttng_ht_iter iter;
 	struct ust_app *app;
-	struct lttng_event *tmp_event;
-
-	nbmem = UST_APP_EVENT_LIST_SIZE;
-	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event));
-	if (tmp_event == NULL) {
-		PERROR("zmalloc ust app events");
-		ret = -ENOMEM;
-		goto error;
-	}
+	struct ust_app **apps = NULL;
+	int *results = NULL;
 
 	rcu_read_lock();
 
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		struct lttng_ust_tracepoint_iter uiter;
+		max_apps++;
+	}
+	if (!max_apps) {
+		goto end;
+	}
 
-		health_code_update();
+	apps = zmalloc(sizeof(*apps) * max_apps);
+	results = zmalloc(sizeof(*results) * max_apps);
+	if (!apps || !results) {
+		PERROR("zmalloc UST app fan-out");
+		ret = -ENOMEM;
+		goto end;
+	}
 
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		pthread_mutex_lock(&app->sock_lock);
-		handle = ustctl_tracepoint_list(app->sock);
-		if (handle < 0) {
-			if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
-				ERR("UST app list events getting handle failed for app pid %d",
-						app->pid);
-			}
-			pthread_mutex_unlock(&app->sock_lock);
-			continue;
+	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+		if (nr_apps == max_apps) {
+			break;
 		}
+		apps[nr_apps++] = app;
+	}
 
-		while ((ret = ustctl_tracepoint_list_get(app->sock, handle,
-					&uiter)) != -LTTNG_UST_ERR_NOENT) {
-			/* Handle ustctl error. */
-			if (ret < 0) {
-				int release_ret;
-
-				if (ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
-					ERR("UST app tp list get failed for app %d with ret %d",
-							app->sock, ret);
-				} else {
-					DBG3("UST app tp list get failed. Application is dead");
-					/*
-					 * This is normal behavior, an application can die during the
-					 * creation process. Don't report an error so the execution can
-					 * continue normally. Continue normal execution.
-					 */
-					break;
-				}
-				free(tmp_event);
-				release_ret = ustctl_release_handle(app->sock, handle);
-				if (release_ret < 0 &&
-						release_ret != -LTTNG_UST_ERR_EXITING &&
-						release_ret != -EPIPE) {
-					ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
-				}
-				pthread_mutex_unlock(&app->sock_lock);
-				goto rcu_error;
-			}
+	DBG3("UST app fan-out of %zu application(s) over at most %u thread(s)",
+			nr_apps, config.app_cmd_threads);
+	if (fanout_run((void * const *) apps, nr_apps, cb, data, results,
+			config.app_cmd_threads) == 0) {
+		goto end;
+	}
 
-			health_code_update();
-			if (count >= nbmem) {
-				/* In case the realloc fails, we free the memory */
-				struct lttng_event *new_tmp_event;
-				size_t new_nbmem;
-
-				new_nbmem = nbmem << 1;
-				DBG2("Reallocating event list from %zu to %zu entries",
-						nbmem, new_nbmem);
-				new_tmp_event = realloc(tmp_event,
-					new_nbmem * sizeof(struct lttng_event));
-				if (new_tmp_event == NULL) {
-					int release_ret;
-
-					PERROR("realloc ust app events");
-					free(tmp_event);
-					ret = -ENOMEM;
-					release_ret = ustctl_release_handle(app->sock, handle);
-					if (release_ret < 0 &&
-							release_ret != -LTTNG_UST_ERR_EXITING &&
-							release_ret != -EPIPE) {
-						ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
-					}
-					pthread_mutex_unlock(&app->sock_lock);
-					goto rcu_error;
-				}
-				/* Zero the new memory */
-				memset(new_tmp_event + nbmem, 0,
-					(new_nbmem - nbmem) * sizeof(struct lttng_event));
-				nbmem = new_nbmem;
-				tmp_event = new_tmp_event;
-			}
-			memcpy(tmp_event[count].name, uiter.name, LTTNG_UST_SYM_NAME_LEN);
-			tmp_event[count].loglevel = uiter.loglevel;
-			tmp_event[count].type = (enum lttng_event_type) LTTNG_UST_TRACEPOINT;
-			tmp_event[count].pid = app->pid;
-			tmp_event[count].enabled = -1;
-			count++;
-		}
-		ret = ustctl_release_handle(app->sock, handle);
-		pthread_mutex_unlock(&app->sock_lock);
-		if (ret < 0 && ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
-			ERR("Error releasing app handle for app %d with ret %d", app->sock, ret);
+	for (i = 0; i < nr_apps; i++) {
+		if (results[i] < 0) {
+			ret = results[i];
+			break;
 		}
 	}
-
-	ret = count;
-	*events = tmp_event;
-
-	DBG2("UST app list events done (%zu events)", count);
-
-rcu_error:
+end:
 	rcu_read_unlock();
-error:
-	health_code_update();
+	free(results);
+	free(apps);
 	return ret;
 }
 
 /*
- * Fill events array with all events name of all registered apps.
+ * Append the cached listings of all the registered applications to a newly
+ * allocated array of 'entry_size' bytes entries, either the events or the
+ * event fields.
+ *
+ * Return the number of entries or else a negative value.
  */
-int ust_app_list_event_fields(struct lttng_event_field **fields)
+static int list_cache_collect(bool fields, size_t entry_size, void **entries)
 {
-	int ret, handle;
+	int ret;
 	size_t nbmem, count = 0;
 	struct lttng_ht_iter iter;
 	struct ust_app *app;
-	struct lttng_event_field *tmp_event;
+	char *tmp_entries;
 
 	nbmem = UST_APP_EVENT_LIST_SIZE;
-	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event_field));
-	if (tmp_event == NULL) {
-		PERROR("zmalloc ust app event fields");
+	tmp_entries = zmalloc(nbmem * entry_size);
+	if (tmp_entries == NULL) {
+		PERROR("zmalloc ust app list");
 		ret = -ENOMEM;
 		goto error;
 	}
 
 	rcu_read_lock();
-
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		struct lttng_ust_field_iter uiter;
-
-		health_code_update();
+		struct ust_app_list_cache *cache = fields ?
+				&app->fields_cache : &app->events_cache;
 
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		pthread_mutex_lock(&app->sock_lock);
-		handle = ustctl_tracepoint_field_list(app->sock);
-		if (handle < 0) {
-			if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
-				ERR("UST app list field getting handle failed for app pid %d",
-						app->pid);
-			}
-			pthread_mutex_unlock(&app->sock_lock);
+		pthread_mutex_lock(&app->list_cache_lock);
+		if (!cache->valid) {
+			/* Incompatible, dead or newly registered application. */
+			pthread_mutex_unlock(&app->list_cache_lock);
 			continue;
 		}
 
-		while ((ret = ustctl_tracepoint_field_list_get(app->sock, handle,
-					&uiter)) != -LTTNG_UST_ERR_NOENT) {
-			/* Handle ustctl error. */
-			if (ret < 0) {
-				int release_ret;
+		if (count + cache->count > nbmem) {
+			char *new_tmp_entries;
+			size_t new_nbmem = nbmem;
 
-				if (ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
-					ERR("UST app tp list field failed for app %d with ret %d",
-							app->sock, ret);
-				} else {
-					DBG3("UST app tp list field failed. Application is dead");
-					/*
-					 * This is normal behavior, an application can die during the
-					 * creation process. Don't report an error so the execution can
-					 * continue normally. Reset list and count for next app.
-					 */
-					break;
-				}
-				free(tmp_event);
-				release_ret = ustctl_release_handle(app->sock, handle);
-				pthread_mutex_unlock(&app->sock_lock);
-				if (release_ret < 0 &&
-						release_ret != -LTTNG_UST_ERR_EXITING &&
-						release_ret != -EPIPE) {
-					ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
-				}
-				goto rcu_error;
+			while (count + cache->count > new_nbmem) {
+				new_nbmem <<= 1;
 			}
-
-			health_code_update();
-			if (count >= nbmem) {
-				/* In case the realloc fails, we free the memory */
-				struct lttng_event_field *new_tmp_event;
-				size_t new_nbmem;
-
-				new_nbmem = nbmem << 1;
-				DBG2("Reallocating event field list from %zu to %zu entries",
-						nbmem, new_nbmem);
-				new_tmp_event = realloc(tmp_event,
-					new_nbmem * sizeof(struct lttng_event_field));
-				if (new_tmp_event == NULL) {
-					int release_ret;
-
-					PERROR("realloc ust app event fields");
-					free(tmp_event);
-					ret = -ENOMEM;
-					release_ret = ustctl_release_handle(app->sock, handle);
-					pthread_mutex_unlock(&app->sock_lock);
-					if (release_ret &&
-							release_ret != -LTTNG_UST_ERR_EXITING &&
-							release_ret != -EPIPE) {
-						ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
-					}
-					goto rcu_error;
-				}
-				/* Zero the new memory */
-				memset(new_tmp_event + nbmem, 0,
-					(new_nbmem - nbmem) * sizeof(struct lttng_event_field));
-				nbmem = new_nbmem;
-				tmp_event = new_tmp_event;
+			DBG2("Reallocating list from %zu to %zu entries",
+					nbmem, new_nbmem);
+			new_tmp_entries = realloc(tmp_entries,
+					new_nbmem * entry_size);
+			if (new_tmp_entries == NULL) {
+				PERROR("realloc ust app list");
+				pthread_mutex_unlock(&app->list_cache_lock);
+				free(tmp_entries);
+				ret = -ENOMEM;
+				goto rcu_error;
 			}
-
-			memcpy(tmp_event[count].field_name, uiter.field_name, LTTNG_UST_SYM_NAME_LEN);
-			/* Mapping between these enums matches 1 to 1. */
-			tmp_event[count].type = (enum lttng_event_field_type) uiter.type;
-			tmp_event[count].nowrite = uiter.nowrite;
-
-			memcpy(tmp_event[count].event.name, uiter.event_name, LTTNG_UST_SYM_NAME_LEN);
-			tmp_event[count].event.loglevel = uiter.loglevel;
-			tmp_event[count].event.type = LTTNG_EVENT_TRACEPOINT;
-			tmp_event[count].event.pid = app->pid;
-			tmp_event[count].event.enabled = -1;
-			count++;
-		}
-		ret = ustctl_release_handle(app->sock, handle);
-		pthread_mutex_unlock(&app->sock_lock);
-		if (ret < 0 &&
-				ret != -LTTNG_UST_ERR_EXITING &&
-				ret != -EPIPE) {
-			ERR("Error releasing app handle for app %d with ret %d", app->sock, ret);
+			nbmem = new_nbmem;
+			tmp_entries = new_tmp_entries;
 		}
+
+		memcpy(tmp_entries + count * entry_size, cache->entries,
+				cache->count * entry_size);
+		count += cache->count;
+		pthread_mutex_unlock(&app->list_cache_lock);
 	}
 
 	ret = count;
-	*fields = tmp_event;
-
-	DBG2("UST app list event fields done (%zu events)", count);
+	*entries = tmp_entries;
 
 rcu_error:
 	rcu_read_unlock();
 error:
-	health_code_update();
 	return ret;
 }
 
 /*
- * Free and clean all traceable apps of the global list.
+ * Query the tracepoints of an application.
  *
- * Should _NOT_ be called with RCU read-side lock held.
+ * On success, *events is set to a newly allocated array of *count events.
+ *
+ * Return 0 on success, -EPIPE if the application is dead or else a negative
+ * value.
  */
-void ust_app_clean_list(void)
+static int fetch_app_events(struct ust_app *app, struct lttng_event **events,
+		size_t *count)
 {
-	int ret;
-	struct ust_app *app;
-	struct lttng_ht_iter iter;
-
-	DBG2("UST app cleaning registered apps hash table");
-
-	rcu_read_lock();
-
-	/* Cleanup notify socket hash table */
-	if (ust_app_ht_by_notify_sock) {
-		cds_lfht_for_each_entry(ust_app_ht_by_notify_sock->ht, &iter.iter, app,
-				notify_sock_n.node) {
-			struct cds_lfht_node *node;
-			struct ust_app *app;
+	int ret, handle, release_ret;
+	size_t nbmem, nb_events = 0;
+	struct lttng_event *tmp_event;
+	struct lttng_ust_tracepoint_iter uiter;
 
-			node = cds_lfht_iter_get_node(&iter.iter);
-			if (!node) {
-				continue;
-			}
+	nbmem = UST_APP_EVENT_LIST_SIZE;
+	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event));
+	if (tmp_event == NULL) {
+		PERROR("zmalloc ust app events");
+		ret = -ENOMEM;
+		goto end;
+	}
 
-			app = container_of(node, struct ust_app,
-					notify_sock_n.node);
-			ust_app_notify_sock_unregister(app->notify_sock);
-		}
+	pthread_mutex_lock(&app->sock_lock);
+	handle = ustctl_tracepoint_list(app->sock);
+	if (handle < 0) {
+		if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
+			ERR("UST app list events getting handle failed for app pid %d",
+					app->pid);
+		}
+		/* The application is skipped. */
+		ret = -EPIPE;
+		goto end_unlock;
 	}
 
-	if (ust_app_ht) {
-		cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-			ret = lttng_ht_del(ust_app_ht, &iter);
-			assert(!ret);
-			call_rcu(&app->pid_n.head, delete_ust_app_rcu);
+	while ((ret = ustctl_tracepoint_list_get(app->sock, handle,
+				&uiter)) != -LTTNG_UST_ERR_NOENT) {
+		/* Handle ustctl error. */
+		if (ret < 0) {
+			if (ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
+				ERR("UST app tp list get failed for app %d with ret %d",
+						app->sock, ret);
+			} else {
+				DBG3("UST app tp list get failed. Application is dead");
+				/*
+				 * This is normal behavior, an application can die during the
+				 * creation process. Don't report an error so the execution can
+				 * continue normally.
+				 */
+				ret = -EPIPE;
+			}
+			goto end_release;
 		}
-	}
 
-	/* Cleanup socket hash table */
-	if (ust_app_ht_by_sock) {
-		cds_lfht_for_each_entry(ust_app_ht_by_sock->ht, &iter.iter, app,
-				sock_n.node) {
-			ret = lttng_ht_del(ust_app_ht_by_sock, &iter);
-			assert(!ret);
+		health_code_update();
+		if (nb_events >= nbmem) {
+			/* In case the realloc fails, we free the memory */
+			struct lttng_event *new_tmp_event;
+			size_t new_nbmem;
+
+			new_nbmem = nbmem << 1;
+			DBG2("Reallocating event list from %zu to %zu entries",
+					nbmem, new_nbmem);
+			new_tmp_event = realloc(tmp_event,
+				new_nbmem * sizeof(struct lttng_event));
+			if (new_tmp_event == NULL) {
+				PERROR("realloc ust app events");
+				ret = -ENOMEM;
+				goto end_release;
+			}
+			/* Zero the new memory */
+			memset(new_tmp_event + nbmem, 0,
+				(new_nbmem - nbmem) * sizeof(struct lttng_event));
+			nbmem = new_nbmem;
+			tmp_event = new_tmp_event;
 		}
+		memcpy(tmp_event[nb_events].name, uiter.name, LTTNG_UST_SYM_NAME_LEN);
+		tmp_event[nb_events].loglevel = uiter.loglevel;
+		tmp_event[nb_events].type = (enum lttng_event_type) LTTNG_UST_TRACEPOINT;
+		tmp_event[nb_events].pid = app->pid;
+		tmp_event[nb_events].enabled = -1;
+		nb_events++;
 	}
 
-	rcu_read_unlock();
+	ret = 0;
+	*events = tmp_event;
+	*count = nb_events;
+	tmp_event = NULL;
 
-	/* Destroy is done only when the ht is empty */
-	if (ust_app_ht) {
-		ht_cleanup_push(ust_app_ht);
-	}
-	if (ust_app_ht_by_sock) {
-		ht_cleanup_push(ust_app_ht_by_sock);
-	}
-	if (ust_app_ht_by_notify_sock) {
-		ht_cleanup_push(ust_app_ht_by_notify_sock);
+end_release:
+	release_ret = ustctl_release_handle(app->sock, handle);
+	if (release_ret < 0 &&
+			release_ret != -LTTNG_UST_ERR_EXITING &&
+			release_ret != -EPIPE) {
+		ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
 	}
+end_unlock:
+	pthread_mutex_unlock(&app->sock_lock);
+end:
+	free(tmp_event);
+	return ret;
 }
 
 /*
- * Init UST app hash table.
+ * Query the tracepoint fields of an application.
+ *
+ * On success, *fields is set to a newly allocated array of *count fields.
+ *
+ * Return 0 on success, -EPIPE if the application is dead or else a negative
+ * value.
  */
-int ust_app_ht_alloc(void)
+static int fetch_app_event_fields(struct ust_app *app,
+		struct lttng_event_field **fields, size_t *count)
 {
-	ust_app_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
-	if (!ust_app_ht) {
-		return -1;
-	}
-	ust_app_ht_by_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
-	if (!ust_app_ht_by_sock) {
-		return -1;
-	}
-	ust_app_ht_by_notify_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
-	if (!ust_app_ht_by_notify_sock) {
-		return -1;
-	}
-	return 0;
-}
+	int ret, handle, release_ret;
+	size_t nbmem, nb_fields = 0;
+	struct lttng_event_field *tmp_event;
+	struct lttng_ust_field_iter uiter;
 
-/*
+	nbmem = UST_APP_EVENT_LIST_SIZE;
+	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event_field));
+	if (tmp_event == NULL) {
+		PERROR("zmalloc ust app event fields");
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	pthread_mutex_lock(&app->sock_lock);
+	handle = ustctl_tracepoint_field_list(app->sock);
+	if (handle < 0) {
+		if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
+			ERR("UST app list field getting handle failed for app pid %d",
+					app->pid);
+		}
+		/* The application is skipped. */
+		ret = -EPIPE;
+		goto end_unlock;
+	}
+
+	while ((ret = ustctl_tracepoint_field_list_get(app->sock, handle,
+				&uiter)) != -LTTNG_UST_ERR_NOENT) {
+		/* Handle ustctl error. */
+		if (ret < 0) {
+			if (ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
+				ERR("UST app tp list field failed for app %d with ret %d",
+						app->sock, ret);
+			} else {
+				DBG3("UST app tp list field failed. Application is dead");
+				/*
+				 * This is normal behavior, an application can die during the
+				 * creation process. Don't report an error so the execution can
+				 * continue normally.
+				 */
+				ret = -EPIPE;
+			}
+			goto end_release;
+		}
+
+		health_code_update();
+		if (nb_fields >= nbmem) {
+			/* In case the realloc fails, we free the memory */
+			struct lttng_event_field *new_tmp_event;
+			size_t new_nbmem;
+
+			new_nbmem = nbmem << 1;
+			DBG2("Reallocating event field list from %zu to %zu entries",
+					nbmem, new_nbmem);
+			new_tmp_event = realloc(tmp_event,
+				new_nbmem * sizeof(struct lttng_event_field));
+			if (new_tmp_event == NULL) {
+				PERROR("realloc ust app event fields");
+				ret = -ENOMEM;
+				goto end_release;
+			}
+			/* Zero the new memory */
+			memset(new_tmp_event + nbmem, 0,
+				(new_nbmem - nbmem) * sizeof(struct lttng_event_field));
+			nbmem = new_nbmem;
+			tmp_event = new_tmp_event;
+		}
+
+		memcpy(tmp_event[nb_fields].field_name, uiter.field_name, LTTNG_UST_SYM_NAME_LEN);
+		/* Mapping between these enums matches 1 to 1. */
+		tmp_event[nb_fields].type = (enum lttng_event_field_type) uiter.type;
+		tmp_event[nb_fields].nowrite = uiter.nowrite;
+
+		memcpy(tmp_event[nb_fields].event.name, uiter.event_name, LTTNG_UST_SYM_NAME_LEN);
+		tmp_event[nb_fields].event.loglevel = uiter.loglevel;
+		tmp_event[nb_fields].event.type = LTTNG_EVENT_TRACEPOINT;
+		tmp_event[nb_fields].event.pid = app->pid;
+		tmp_event[nb_fields].event.enabled = -1;
+		nb_fields++;
+	}
+
+	ret = 0;
+	*fields = tmp_event;
+	*count = nb_fields;
+	tmp_event = NULL;
+
+end_release:
+	release_ret = ustctl_release_handle(app->sock, handle);
+	if (release_ret < 0 &&
+			release_ret != -LTTNG_UST_ERR_EXITING &&
+			release_ret != -EPIPE) {
+		ERR("Error releasing app handle for app %d with ret %d", app->sock, release_ret);
+	}
+end_unlock:
+	pthread_mutex_unlock(&app->sock_lock);
+end:
+	free(tmp_event);
+	return ret;
+}
+
+/*
+ * Refresh the cached tracepoint list of one application, unless it is recent
+ * enough.
+ *
+ * Called with RCU read side lock held.
+ */
+static int list_app_events(void *item, void *data)
+{
+	int ret = 0;
+	size_t count;
+	struct ust_app *app = item;
+	struct lttng_event *events;
+
+	if (!app->compatible) {
+		/*
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
+		 */
+		goto end;
+	}
+
+	pthread_mutex_lock(&app->list_cache_lock);
+	if (list_cache_is_fresh(&app->events_cache)) {
+		DBG3("UST app list events of app pid %d served from cache",
+				app->pid);
+		goto end_unlock;
+	}
+
+	ret = fetch_app_events(app, &events, &count);
+	if (ret < 0) {
+		list_cache_reset(&app->events_cache);
+		if (ret == -EPIPE) {
+			ret = 0;
+		}
+		goto end_unlock;
+	}
+	list_cache_set(&app->events_cache, events, count);
+
+end_unlock:
+	pthread_mutex_unlock(&app->list_cache_lock);
+end:
+	return ret;
+}
+
+/*
+ * Refresh the cached tracepoint field list of one application, unless it is
+ * recent enough.
+ *
+ * Called with RCU read side lock held.
+ */
+static int list_app_event_fields(void *item, void *data)
+{
+	int ret = 0;
+	size_t count;
+	struct ust_app *app = item;
+	struct lttng_event_field *fields;
+
+	if (!app->compatible) {
+		/*
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
+		 */
+		goto end;
+	}
+
+	pthread_mutex_lock(&app->list_cache_lock);
+	if (list_cache_is_fresh(&app->fields_cache)) {
+		DBG3("UST app list event fields of app pid %d served from cache",
+				app->pid);
+		goto end_unlock;
+	}
+
+	ret = fetch_app_event_fields(app, &fields, &count);
+	if (ret < 0) {
+		list_cache_reset(&app->fields_cache);
+		if (ret == -EPIPE) {
+			ret = 0;
+		}
+		goto end_unlock;
+	}
+	list_cache_set(&app->fields_cache, fields, count);
+
+end_unlock:
+	pthread_mutex_unlock(&app->list_cache_lock);
+end:
+	return ret;
+}
+
+/*
+ * Fill events array with all events name of all registered apps.
+ *
+ * The applications are queried concurrently and the tracepoint list of each
+ * of them is reused for DEFAULT_APP_LIST_CACHE_TTL seconds, which bounds the
+ * time after which the tracepoints of a provider loaded later appear.
+ */
+int ust_app_list_events(struct lttng_event **events)
+{
+	int ret;
+
+	ret = ust_app_fanout(list_app_events, NULL);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = list_cache_collect(false, sizeof(struct lttng_event),
+			(void **) events);
+	if (ret < 0) {
+		goto end;
+	}
+
+	DBG2("UST app list events done (%d events)", ret);
+end:
+	health_code_update();
+	return ret;
+}
+
+/*
+ * Fill events array with all events name of all registered apps.
+ *
+ * As for ust_app_list_events(), the applications are queried concurrently and
+ * their field lists are cached.
+ */
+int ust_app_list_event_fields(struct lttng_event_field **fields)
+{
+	int ret;
+
+	ret = ust_app_fanout(list_app_event_fields, NULL);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = list_cache_collect(true, sizeof(struct lttng_event_field),
+			(void **) fields);
+	if (ret < 0) {
+		goto end;
+	}
+
+	DBG2("UST app list event fields done (%d events)", ret);
+end:
+	health_code_update();
+	return ret;
+}
+
+/*
+ * Free and clean all traceable apps of the global list.
+ *
+ * Should _NOT_ be called with RCU read-side lock held.
+ */
+void ust_app_clean_list(void)
+{
+	int ret;
+	struct ust_app *app;
+	struct lttng_ht_iter iter;
+
+	DBG2("UST app cleaning registered apps hash table");
+
+	rcu_read_lock();
+
+	/* Cleanup notify socket hash table */
+	if (ust_app_ht_by_notify_sock) {
+		cds_lfht_for_each_entry(ust_app_ht_by_notify_sock->ht, &iter.iter, app,
+				notify_sock_n.node) {
+			struct cds_lfht_node *node;
+			struct ust_app *app;
+
+			node = cds_lfht_iter_get_node(&iter.iter);
+			if (!node) {
+				continue;
+			}
+
+			app = container_of(node, struct ust_app,
+					notify_sock_n.node);
+			ust_app_notify_sock_unregister(app->notify_sock);
+		}
+	}
+
+	if (ust_app_ht) {
+		cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+			ret = lttng_ht_del(ust_app_ht, &iter);
+			assert(!ret);
+			call_rcu(&app->pid_n.head, delete_ust_app_rcu);
+		}
+	}
+
+	/* Cleanup socket hash table */
+	if (ust_app_ht_by_sock) {
+		cds_lfht_for_each_entry(ust_app_ht_by_sock->ht, &iter.iter, app,
+				sock_n.node) {
+			ret = lttng_ht_del(ust_app_ht_by_sock, &iter);
+			assert(!ret);
+		}
+	}
+
+	rcu_read_unlock();
+
+	/* Destroy is done only when the ht is empty */
+	if (ust_app_ht) {
+		ht_cleanup_push(ust_app_ht);
+	}
+	if (ust_app_ht_by_sock) {
+		ht_cleanup_push(ust_app_ht_by_sock);
+	}
+	if (ust_app_ht_by_notify_sock) {
+		ht_cleanup_push(ust_app_ht_by_notify_sock);
+	}
+}
+
+/*
+ * Init UST app hash table.
+ */
+int ust_app_ht_alloc(void)
+{
+	ust_app_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!ust_app_ht) {
+		return -1;
+	}
+	ust_app_ht_by_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!ust_app_ht_by_sock) {
+		return -1;
+	}
+	ust_app_ht_by_notify_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!ust_app_ht_by_notify_sock) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
  * For a specific UST session, disable the channel for all registered apps.
  */
 int ust_app_disable_channel_glb(struct ltt_ust_session *usess,
@@ -4230,20 +4567,92 @@ error_rcu_unlock:
 	return ret;
 }
 
+/* Arguments of the global event commands issued to each application. */
+struct ust_app_event_glb_args {
+	struct ltt_ust_session *usess;
+	struct ltt_ust_channel *uchan;
+	struct ltt_ust_event *uevent;
+};
+
 /*
- * Enable event for a specific session and channel on the tracer.
+ * Enable an event of a session's channel on the tracer of one application.
+ *
+ * Called with RCU read side lock held.
  */
-int ust_app_enable_event_glb(struct ltt_ust_session *usess,
-		struct ltt_ust_channel *uchan, struct ltt_ust_event *uevent)
+static int enable_event_app(void *item, void *data)
 {
 	int ret = 0;
-	struct lttng_ht_iter iter, uiter;
+	struct ust_app *app = item;
+	struct ust_app_event_glb_args *args = data;
+	struct lttng_ht_iter uiter;
 	struct lttng_ht_node_str *ua_chan_node;
-	struct ust_app *app;
 	struct ust_app_session *ua_sess;
 	struct ust_app_channel *ua_chan;
 	struct ust_app_event *ua_event;
 
+	if (!app->compatible) {
+		/*
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
+		 */
+		goto end;
+	}
+	ua_sess = lookup_session_by_app(args->usess, app);
+	if (!ua_sess) {
+		/* The application has problem or is probably dead. */
+		goto end;
+	}
+
+	pthread_mutex_lock(&ua_sess->lock);
+
+	if (ua_sess->deleted) {
+		goto end_unlock;
+	}
+
+	/* Lookup channel in the ust app session */
+	lttng_ht_lookup(ua_sess->channels, (void *) args->uchan->name, &uiter);
+	ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
+	/*
+	 * It is possible that the channel cannot be found is
+	 * the channel/event creation occurs concurrently with
+	 * an application exit.
+	 */
+	if (!ua_chan_node) {
+		goto end_unlock;
+	}
+
+	ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
+
+	/* Get event node */
+	ua_event = find_ust_app_event(ua_chan->events, args->uevent->attr.name,
+			args->uevent->filter, args->uevent->attr.loglevel,
+			args->uevent->exclusion);
+	if (ua_event == NULL) {
+		DBG3("UST app enable event %s not found for app PID %d."
+				"Skipping app", args->uevent->attr.name, app->pid);
+		goto end_unlock;
+	}
+
+	ret = enable_ust_app_event(ua_sess, ua_event, app);
+
+end_unlock:
+	pthread_mutex_unlock(&ua_sess->lock);
+end:
+	return ret;
+}
+
+/*
+ * Enable event for a specific session and channel on the tracer.
+ */
+int ust_app_enable_event_glb(struct ltt_ust_session *usess,
+		struct ltt_ust_channel *uchan, struct ltt_ust_event *uevent)
+{
+	struct ust_app_event_glb_args args = {
+		.usess = usess,
+		.uchan = uchan,
+		.uevent = uevent,
+	};
+
 	assert(usess->active);
 	DBG("UST app enabling event %s for all apps for session id %" PRIu64,
 			uevent->attr.name, usess->id);
@@ -4254,65 +4663,60 @@ int ust_app_enable_event_glb(struct ltt_ust_session *usess,
 	 * tracer also.
 	 */
 
-	rcu_read_lock();
-
-	/* For all registered applications */
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		ua_sess = lookup_session_by_app(usess, app);
-		if (!ua_sess) {
-			/* The application has problem or is probably dead. */
-			continue;
-		}
-
-		pthread_mutex_lock(&ua_sess->lock);
+	return ust_app_fanout(enable_event_app, &args);
+}
 
-		if (ua_sess->deleted) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
-		}
+/*
+ * Create an event of a session's channel on the tracer of one application.
+ *
+ * Called with RCU read side lock held.
+ */
+static int create_event_app(void *item, void *data)
+{
+	int ret = 0;
+	struct ust_app *app = item;
+	struct ust_app_event_glb_args *args = data;
+	struct lttng_ht_iter uiter;
+	struct lttng_ht_node_str *ua_chan_node;
+	struct ust_app_session *ua_sess;
+	struct ust_app_channel *ua_chan;
 
-		/* Lookup channel in the ust app session */
-		lttng_ht_lookup(ua_sess->channels, (void *)uchan->name, &uiter);
-		ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
+	if (!app->compatible) {
 		/*
-		 * It is possible that the channel cannot be found is
-		 * the channel/event creation occurs concurrently with
-		 * an application exit.
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
 		 */
-		if (!ua_chan_node) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
-		}
-
-		ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
+		goto end;
+	}
+	ua_sess = lookup_session_by_app(args->usess, app);
+	if (!ua_sess) {
+		/* The application has problem or is probably dead. */
+		goto end;
+	}
 
-		/* Get event node */
-		ua_event = find_ust_app_event(ua_chan->events, uevent->attr.name,
-				uevent->filter, uevent->attr.loglevel, uevent->exclusion);
-		if (ua_event == NULL) {
-			DBG3("UST app enable event %s not found for app PID %d."
-					"Skipping app", uevent->attr.name, app->pid);
-			goto next_app;
-		}
+	pthread_mutex_lock(&ua_sess->lock);
 
-		ret = enable_ust_app_event(ua_sess, ua_event, app);
-		if (ret < 0) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			goto error;
-		}
-	next_app:
+	if (ua_sess->deleted) {
 		pthread_mutex_unlock(&ua_sess->lock);
+		goto end;
 	}
 
-error:
-	rcu_read_unlock();
+	/* Lookup channel in the ust app session */
+	lttng_ht_lookup(ua_sess->channels, (void *) args->uchan->name, &uiter);
+	ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
+	/* If the channel is not found, there is a code flow error */
+	assert(ua_chan_node);
+
+	ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
+
+	ret = create_ust_app_event(ua_sess, ua_chan, args->uevent, app);
+	pthread_mutex_unlock(&ua_sess->lock);
+	if (ret == -LTTNG_UST_ERR_EXIST) {
+		DBG2("UST app event %s already exist on app PID %d",
+				args->uevent->attr.name, app->pid);
+		ret = 0;
+	}
+end:
 	return ret;
 }
 
@@ -4323,64 +4727,18 @@ error:
 int ust_app_create_event_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan, struct ltt_ust_event *uevent)
 {
-	int ret = 0;
-	struct lttng_ht_iter iter, uiter;
-	struct lttng_ht_node_str *ua_chan_node;
-	struct ust_app *app;
-	struct ust_app_session *ua_sess;
-	struct ust_app_channel *ua_chan;
+	struct ust_app_event_glb_args args = {
+		.usess = usess,
+		.uchan = uchan,
+		.uevent = uevent,
+	};
 
 	assert(usess->active);
 	DBG("UST app creating event %s for all apps for session id %" PRIu64,
 			uevent->attr.name, usess->id);
 
-	rcu_read_lock();
-
-	/* For all registered applications */
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		ua_sess = lookup_session_by_app(usess, app);
-		if (!ua_sess) {
-			/* The application has problem or is probably dead. */
-			continue;
-		}
-
-		pthread_mutex_lock(&ua_sess->lock);
-
-		if (ua_sess->deleted) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
-		}
-
-		/* Lookup channel in the ust app session */
-		lttng_ht_lookup(ua_sess->channels, (void *)uchan->name, &uiter);
-		ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
-		/* If the channel is not found, there is a code flow error */
-		assert(ua_chan_node);
-
-		ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
-
-		ret = create_ust_app_event(ua_sess, ua_chan, uevent, app);
-		pthread_mutex_unlock(&ua_sess->lock);
-		if (ret < 0) {
-			if (ret != -LTTNG_UST_ERR_EXIST) {
-				/* Possible value at this point: -ENOMEM. If so, we stop! */
-				break;
-			}
-			DBG2("UST app event %s already exist on app PID %d",
-					uevent->attr.name, app->pid);
-			continue;
-		}
-	}
-
-	rcu_read_unlock();
-	return ret;
+	/* Possible error at this point: -ENOMEM. */
+	return ust_app_fanout(create_event_app, &args);
 }
 
 /*
@@ -4639,6 +4997,26 @@ end_not_compatible:
 	return retval;
 }
 
+/*
+ * Flush the per PID buffers of a session for one application.
+ *
+ * Called with RCU read side lock held.
+ */
+static int flush_session_app(void *item, void *data)
+{
+	struct ust_app *app = item;
+	struct ltt_ust_session *usess = data;
+	struct ust_app_session *ua_sess;
+
+	ua_sess = lookup_session_by_app(usess, app);
+	if (ua_sess == NULL) {
+		goto end;
+	}
+	(void) ust_app_flush_app_session(app, ua_sess);
+end:
+	return 0;
+}
+
 /*
  * Flush buffers for all applications for a specific UST session.
  * Called with UST session lock held.
@@ -4691,20 +5069,8 @@ int ust_app_flush_session(struct ltt_ust_session *usess)
 		break;
 	}
 	case LTTNG_BUFFER_PER_PID:
-	{
-		struct ust_app_session *ua_sess;
-		struct lttng_ht_iter iter;
-		struct ust_app *app;
-
-		cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-			ua_sess = lookup_session_by_app(usess, app);
-			if (ua_sess == NULL) {
-				continue;
-			}
-			(void) ust_app_flush_app_session(app, ua_sess);
-		}
+		(void) ust_app_fanout(flush_session_app, usess);
 		break;
-	}
 	default:
 		ret = -1;
 		assert(0);
@@ -4910,14 +5276,32 @@ end:
 	return 0;
 }
 
+/*
+ * Synchronize and start or stop tracing the session on one application.
+ *
+ * Called with RCU read side lock held.
+ */
+static int global_update_app(void *item, void *data)
+{
+	ust_app_global_update(data, item);
+	return 0;
+}
+
+/*
+ * Stop tracing the session on one application.
+ *
+ * Called with RCU read side lock held.
+ */
+static int stop_trace_app(void *item, void *data)
+{
+	return ust_app_stop_trace(data, item);
+}
+
 /*
  * Start tracing for the UST session.
  */
 int ust_app_start_trace_all(struct ltt_ust_session *usess)
 {
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
 	DBG("Starting all UST traces");
 
 	/*
@@ -4936,9 +5320,7 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
 	 */
 	(void) ust_app_clear_quiescent_session(usess);
 
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ust_app_global_update(usess, app);
-	}
+	(void) ust_app_fanout(global_update_app, usess);
 
 	rcu_read_unlock();
 
@@ -4951,10 +5333,6 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
  */
 int ust_app_stop_trace_all(struct ltt_ust_session *usess)
 {
-	int ret = 0;
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
 	DBG("Stopping all UST traces");
 
 	/*
@@ -4965,13 +5343,8 @@ int ust_app_stop_trace_all(struct ltt_ust_session *usess)
 
 	rcu_read_lock();
 
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ret = ust_app_stop_trace(usess, app);
-		if (ret < 0) {
-			/* Continue to next apps even on error */
-			continue;
-		}
-	}
+	/* Errors are logged per application; all the applications are stopped. */
+	(void) ust_app_fanout(stop_trace_app, usess);
 
 	(void) ust_app_flush_session(usess);
 
@@ -5201,14 +5574,7 @@ void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
  */
 void ust_app_global_update_all(struct ltt_ust_session *usess)
 {
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
-	rcu_read_lock();
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ust_app_global_update(usess, app);
-	}
-	rcu_read_unlock();
+	(void) ust_app_fanout(global_update_app, usess);
 }
 
 /*
@@ -5542,6 +5908,19 @@ static int add_event_ust_registry(int sock, int sobjd, int cobjd, char *name,
 		chan_reg_key = ua_chan->key;
 	}
 
+	/*
+	 * With per UID buffers, the applications sharing the registry mostly
+	 * register the same events: reply right away for a known event without
+	 * serializing on the registry lock.
+	 */
+	if (ua_sess->buffer_type == LTTNG_BUFFER_PER_UID &&
+			!ust_registry_lookup_event_id(registry, chan_reg_key,
+				name, nr_fields, fields, loglevel_value,
+				model_emf_uri, &event_id)) {
+		ret_code = 0;
+		goto reply;
+	}
+
 	pthread_mutex_lock(&registry->lock);
 
 	/*
@@ -5557,6 +5936,9 @@ static int add_event_ust_registry(int sock, int sobjd, int cobjd, char *name,
 	fields = NULL;
 	model_emf_uri = NULL;
 
+	pthread_mutex_unlock(&registry->lock);
+
+reply:
 	/*
 	 * The return value is returned to ustctl so in case of an error, the
 	 * application can be notified. In case of an error, it's important not to
@@ -5573,14 +5955,12 @@ static int add_event_ust_registry(int sock, int sobjd, int cobjd, char *name,
 		 * No need to wipe the create event since the application socket will
 		 * get close on error hence cleaning up everything by itself.
 		 */
-		goto error;
+		goto error_rcu_unlock;
 	}
 
 	DBG3("UST registry event %s with id %" PRId32 " added successfully",
 			name, event_id);
 
-error:
-	pthread_mutex_unlock(&registry->lock);
 error_rcu_unlock:
 	rcu_read_unlock();
 	free(sig);
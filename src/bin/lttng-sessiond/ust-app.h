@@ -19,6 +19,7 @@
 #ifndef _LTT_UST_APP_H
 #define _LTT_UST_APP_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <common/compat/uuid.h>
@@ -234,6 +235,19 @@ struct ust_app_session {
 	char shm_path[PATH_MAX];
 };
 
+/*
+ * Tracepoints or tracepoint fields of an application as last listed, reused
+ * by the following listings for DEFAULT_APP_LIST_CACHE_TTL seconds.
+ */
+struct ust_app_list_cache {
+	/* Array of struct lttng_event or struct lttng_event_field. */
+	void *entries;
+	size_t count;
+	/* CLOCK_MONOTONIC time of the listing. */
+	time_t time;
+	bool valid;
+};
+
 /*
  * Registered traceable applications. Libust registers to the session daemon
  * and a linked list is kept of all running traceable app.
@@ -302,6 +316,13 @@ struct ust_app {
 	 * Used for path creation
 	 */
 	time_t registration_time;
+	/*
+	 * Tracepoints and tracepoint fields of the application, dropped with
+	 * the application on unregistration. Protected by list_cache_lock.
+	 */
+	pthread_mutex_t list_cache_lock;
+	struct ust_app_list_cache events_cache;
+	struct ust_app_list_cache fields_cache;
 };
 
 #ifdef HAVE_LIBLTTNG_UST_CTL
@@ -343,6 +364,7 @@ struct ust_app *ust_app_create(struct ust_register_msg *msg, int sock);
 void ust_app_notify_sock_unregister(int sock);
 ssize_t ust_app_push_metadata(struct ust_registry_session *registry,
 		struct consumer_socket *socket, int send_zero_data);
+uint64_t ust_app_metadata_push_delay(struct ust_registry_session *registry);
 void ust_app_destroy(struct ust_app *app);
 enum lttng_error_code ust_app_snapshot_record(
 		const struct ltt_ust_session *usess,
@@ -532,6 +554,11 @@ ssize_t ust_app_push_metadata(struct ust_registry_session *registry,
 	return 0;
 }
 static inline
+uint64_t ust_app_metadata_push_delay(struct ust_registry_session *registry)
+{
+	return 0;
+}
+static inline
 void ust_app_destroy(struct ust_app *app)
 {
 	return;
@@ -34,6 +34,7 @@
 #include "buffer-registry.h"
 #include "session.h"
 #include "lttng-sessiond.h"
+#include "metadata-push.h"
 
 /*
  * Send a single channel to the consumer using command ASK_CHANNEL_CREATION.
@@ -431,21 +432,74 @@ error:
 	return ret;
 }
 
+/*
+ * Find the registry targeted by a metadata request of the consumer.
+ *
+ * RCU read-side lock must be held to guarantee existence of the registry.
+ */
+static struct ust_registry_session *find_request_registry(
+		const struct lttcomm_metadata_request_msg *request)
+{
+	struct buffer_reg_uid *reg_uid;
+	struct buffer_reg_pid *reg_pid;
+
+	reg_uid = buffer_reg_uid_find(request->session_id,
+			request->bits_per_long, request->uid);
+	if (reg_uid) {
+		return reg_uid->registry->reg.ust;
+	}
+
+	reg_pid = buffer_reg_pid_find(request->session_id_per_pid);
+	if (reg_pid) {
+		return reg_pid->registry->reg.ust;
+	}
+	return NULL;
+}
+
+/*
+ * Reply to a metadata request of the consumer without pushing the metadata
+ * of the registry yet.
+ *
+ * Must be called with the registry lock held, which is released while
+ * communicating with the consumer (see ust_app_push_metadata()).
+ */
+static int push_no_metadata(struct ust_registry_session *registry,
+		struct consumer_socket *socket)
+{
+	int ret;
+	const uint64_t metadata_key = registry->metadata_key;
+	const size_t offset = registry->metadata_len_sent;
+	const uint64_t metadata_version = registry->metadata_version;
+
+	pthread_mutex_unlock(&registry->lock);
+	ret = consumer_push_metadata(socket, metadata_key, NULL, 0, offset,
+			metadata_version);
+	pthread_mutex_lock(&registry->lock);
+	return ret;
+}
+
 /*
  * Handle the metadata requests from the UST consumer
  *
+ * While the metadata push of the registry is within its coalescing window,
+ * the consumer is answered right away without new metadata, and the push is
+ * deferred to the end of the window (see metadata-push.h) rather than
+ * keeping the consumer, and this thread, waiting.
+ *
  * Return 0 on success else a negative value.
  */
-int ust_consumer_metadata_request(struct consumer_socket *socket)
+int ust_consumer_metadata_request(struct consumer_data *consumer_data)
 {
 	int ret;
 	ssize_t ret_push;
+	uint64_t delay_us;
 	struct lttcomm_metadata_request_msg request;
-	struct buffer_reg_uid *reg_uid;
 	struct ust_registry_session *ust_reg;
 	struct lttcomm_consumer_msg msg;
+	struct consumer_socket *socket;
 
-	assert(socket);
+	assert(consumer_data);
+	socket = &consumer_data->metadata_sock;
 
 	rcu_read_lock();
 	health_code_update();
@@ -461,37 +515,34 @@ int ust_consumer_metadata_request(struct consumer_socket *socket)
 	DBG("Metadata request received for session %" PRIu64 ", key %" PRIu64,
 			request.session_id, request.key);
 
-	reg_uid = buffer_reg_uid_find(request.session_id,
-			request.bits_per_long, request.uid);
-	if (reg_uid) {
-		ust_reg = reg_uid->registry->reg.ust;
-	} else {
-		struct buffer_reg_pid *reg_pid =
-			buffer_reg_pid_find(request.session_id_per_pid);
-		if (!reg_pid) {
-			DBG("PID registry not found for session id %" PRIu64,
-					request.session_id_per_pid);
-
-			memset(&msg, 0, sizeof(msg));
-			msg.cmd_type = LTTNG_ERR_UND;
-			pthread_mutex_lock(socket->lock);
-			(void) consumer_send_msg(socket, &msg);
-			pthread_mutex_unlock(socket->lock);
-			/*
-			 * This is possible since the session might have been destroyed
-			 * during a consumer metadata request. So here, return gracefully
-			 * because the destroy session will push the remaining metadata to
-			 * the consumer.
-			 */
-			ret = 0;
-			goto end;
-		}
-		ust_reg = reg_pid->registry->reg.ust;
+	ust_reg = find_request_registry(&request);
+	if (!ust_reg) {
+		DBG("PID registry not found for session id %" PRIu64,
+				request.session_id_per_pid);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.cmd_type = LTTNG_ERR_UND;
+		pthread_mutex_lock(socket->lock);
+		(void) consumer_send_msg(socket, &msg);
+		pthread_mutex_unlock(socket->lock);
+		/*
+		 * This is possible since the session might have been destroyed
+		 * during a consumer metadata request. So here, return gracefully
+		 * because the destroy session will push the remaining metadata to
+		 * the consumer.
+		 */
+		ret = 0;
+		goto end;
 	}
-	assert(ust_reg);
 
 	pthread_mutex_lock(&ust_reg->lock);
-	ret_push = ust_app_push_metadata(ust_reg, socket, 1);
+	delay_us = ust_app_metadata_push_delay(ust_reg);
+	if (delay_us && !metadata_push_defer(consumer_data, &request,
+			delay_us)) {
+		ret_push = push_no_metadata(ust_reg, socket);
+	} else {
+		ret_push = ust_app_push_metadata(ust_reg, socket, 1);
+	}
 	pthread_mutex_unlock(&ust_reg->lock);
 	if (ret_push == -EPIPE) {
 		DBG("Application or relay closed while pushing metadata");
@@ -508,3 +559,51 @@ end:
 	rcu_read_unlock();
 	return ret;
 }
+
+/*
+ * Push the metadata of a deferred metadata request of the consumer on its
+ * command socket.
+ *
+ * Must not be called from the consumer management thread, which must remain
+ * available to answer the metadata requests the consumer may issue while
+ * handling the push.
+ *
+ * Return 0 on success else a negative value.
+ */
+int ust_consumer_push_deferred_metadata(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request)
+{
+	int ret = 0;
+	ssize_t ret_push;
+	struct ust_registry_session *ust_reg;
+	struct consumer_socket socket;
+
+	assert(consumer_data);
+	assert(request);
+
+	memset(&socket, 0, sizeof(socket));
+	socket.fd_ptr = &consumer_data->cmd_sock;
+	socket.lock = &consumer_data->lock;
+
+	rcu_read_lock();
+	ust_reg = find_request_registry(request);
+	if (!ust_reg) {
+		/* The remaining metadata is pushed on session teardown. */
+		DBG("Registry of deferred metadata push not found for session id %" PRIu64,
+				request->session_id);
+		goto end;
+	}
+
+	pthread_mutex_lock(&ust_reg->lock);
+	ret_push = ust_app_push_metadata(ust_reg, &socket, 0);
+	pthread_mutex_unlock(&ust_reg->lock);
+	if (ret_push == -EPIPE) {
+		DBG("Application or relay closed while pushing deferred metadata");
+	} else if (ret_push < 0) {
+		ERR("Pushing deferred metadata");
+		ret = -1;
+	}
+end:
+	rcu_read_unlock();
+	return ret;
+}
@@ -43,10 +43,18 @@ int ust_consumer_send_channel_to_ust(struct ust_app *app,
 		struct ust_app_session *ua_sess, struct ust_app_channel *channel);
 
 #if HAVE_LIBLTTNG_UST_CTL
-int ust_consumer_metadata_request(struct consumer_socket *sock);
+int ust_consumer_metadata_request(struct consumer_data *consumer_data);
+int ust_consumer_push_deferred_metadata(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request);
 #else
 static inline
-int ust_consumer_metadata_request(struct consumer_socket *sock)
+int ust_consumer_metadata_request(struct consumer_data *consumer_data)
+{
+	return -ENOSYS;
+}
+static inline
+int ust_consumer_push_deferred_metadata(struct consumer_data *consumer_data,
+		const struct lttcomm_metadata_request_msg *request)
 {
 	return -ENOSYS;
 }
@@ -93,53 +93,173 @@ int get_count_order(unsigned int count)
 }
 
 /*
- * Returns offset where to write in metadata array, or negative error value on error.
+ * Set the metadata array aside until the pushes sending from it complete. The
+ * caller must replace it.
+ *
+ * Returns 0 on success, or negative error value on error.
  */
 static
-ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
+int metadata_retire(struct ust_registry_session *session)
+{
+	struct ust_registry_retired_metadata *retired;
+
+	retired = zmalloc(sizeof(*retired));
+	if (!retired)
+		return -ENOMEM;
+	retired->metadata = session->metadata;
+	retired->next = session->metadata_retired;
+	session->metadata_retired = retired;
+	session->metadata = NULL;
+	session->metadata_alloc_len = 0;
+	return 0;
+}
+
+/*
+ * Make room for at least 'len' more bytes at the end of the metadata array.
+ *
+ * Returns 0 on success, or negative error value on error.
+ */
+static
+int metadata_grow(struct ust_registry_session *session, size_t len)
 {
-	size_t new_len = session->metadata_len + len;
-	size_t new_alloc_len = new_len;
+	size_t new_alloc_len = session->metadata_len + len;
 	size_t old_alloc_len = session->metadata_alloc_len;
-	ssize_t ret;
+	char *newptr;
+	int ret;
 
+	if (new_alloc_len <= old_alloc_len)
+		return 0;
 	if (new_alloc_len > (UINT32_MAX >> 1))
 		return -EINVAL;
 	if ((old_alloc_len << 1) > (UINT32_MAX >> 1))
 		return -EINVAL;
 
-	if (new_alloc_len > old_alloc_len) {
-		char *newptr;
-
-		new_alloc_len =
-			max_t(size_t, 1U << get_count_order(new_alloc_len), old_alloc_len << 1);
+	new_alloc_len =
+		max_t(size_t, 1U << get_count_order(new_alloc_len), old_alloc_len << 1);
+	if (session->metadata_pin_count) {
+		/* A push is sending from the array: copy it instead of moving it. */
+		newptr = zmalloc(new_alloc_len);
+		if (!newptr)
+			return -ENOMEM;
+		memcpy(newptr, session->metadata, old_alloc_len);
+		ret = metadata_retire(session);
+		if (ret) {
+			free(newptr);
+			return ret;
+		}
+	} else {
 		newptr = realloc(session->metadata, new_alloc_len);
 		if (!newptr)
 			return -ENOMEM;
-		session->metadata = newptr;
 		/* We zero directly the memory from start of allocation. */
-		memset(&session->metadata[old_alloc_len], 0, new_alloc_len - old_alloc_len);
-		session->metadata_alloc_len = new_alloc_len;
+		memset(&newptr[old_alloc_len], 0, new_alloc_len - old_alloc_len);
+	}
+	session->metadata = newptr;
+	session->metadata_alloc_len = new_alloc_len;
+	return 0;
+}
+
+/*
+ * Pin the metadata array so that it can be sent to the consumer with the
+ * registry lock released. The metadata already generated is never modified
+ * in place and the array stays valid until ust_metadata_unpin() is called.
+ *
+ * Called with session registry mutex held.
+ */
+char *ust_metadata_pin(struct ust_registry_session *session)
+{
+	session->metadata_pin_count++;
+	return session->metadata;
+}
+
+/*
+ * Release a pin taken by ust_metadata_pin(). The arrays replaced while the
+ * metadata was pinned are freed with the last pin.
+ *
+ * Called with session registry mutex held.
+ */
+void ust_metadata_unpin(struct ust_registry_session *session)
+{
+	struct ust_registry_retired_metadata *retired, *next;
+
+	assert(session->metadata_pin_count > 0);
+	if (--session->metadata_pin_count) {
+		return;
+	}
+	for (retired = session->metadata_retired; retired; retired = next) {
+		next = retired->next;
+		free(retired->metadata);
+		free(retired);
+	}
+	session->metadata_retired = NULL;
+}
+
+/*
+ * Discard the generated metadata so that it can be generated again, e.g. on
+ * metadata regeneration.
+ *
+ * Called with session registry mutex held.
+ *
+ * Returns 0 on success, or negative error value on error.
+ */
+int ust_metadata_clear(struct ust_registry_session *session)
+{
+	int ret;
+
+	if (session->metadata_pin_count) {
+		ret = metadata_retire(session);
+		if (ret)
+			return ret;
+	} else {
+		memset(session->metadata, 0, session->metadata_alloc_len);
 	}
+	session->metadata_len = 0;
+	session->metadata_len_sent = 0;
+	session->metadata_len_written = 0;
+	return 0;
+}
+
+/*
+ * Returns offset where to write in metadata array, or negative error value on error.
+ */
+static
+ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
+{
+	ssize_t ret;
+
+	ret = metadata_grow(session, len);
+	if (ret)
+		return ret;
 	ret = session->metadata_len;
 	session->metadata_len += len;
 	return ret;
 }
 
+/*
+ * Write the metadata generated since the last flush to the metadata file, if
+ * any. The metadata is appended to the file once per statedump rather than
+ * once per fragment.
+ */
 static
-int metadata_file_append(struct ust_registry_session *session,
-		const char *str, size_t len)
+int metadata_file_flush(struct ust_registry_session *session)
 {
 	ssize_t written;
+	size_t len;
 
-	if (session->metadata_fd < 0) {
-		return 0;
+	assert(session->metadata_len >= session->metadata_len_written);
+	len = session->metadata_len - session->metadata_len_written;
+	if (session->metadata_fd < 0 || !len) {
+		goto end;
 	}
 	/* Write to metadata file */
-	written = lttng_write(session->metadata_fd, str, len);
+	written = lttng_write(session->metadata_fd,
+			&session->metadata[session->metadata_len_written], len);
 	if (written != len) {
+		PERROR("Error appending to metadata file");
 		return -1;
 	}
+end:
+	session->metadata_len_written = session->metadata_len;
 	return 0;
 }
 
@@ -148,56 +268,57 @@ int metadata_file_append(struct ust_registry_session *session,
  * ust_lock), so we can do racy operations such as looking for
  * remaining space left in packet and write, since mutual exclusion
  * protects us from concurrent writes.
+ *
+ * The fragment is formatted directly at the end of the metadata array, which
+ * is only grown when the fragment does not fit in the space left.
  */
 static
 int lttng_metadata_printf(struct ust_registry_session *session,
 		const char *fmt, ...)
 {
-	char *str = NULL;
-	size_t len;
+	size_t avail;
 	va_list ap;
-	ssize_t offset;
-	int ret;
+	int len, ret;
 
+	avail = session->metadata_alloc_len - session->metadata_len;
 	va_start(ap, fmt);
-	ret = vasprintf(&str, fmt, ap);
+	len = vsnprintf(avail ? &session->metadata[session->metadata_len] : NULL,
+			avail, fmt, ap);
 	va_end(ap);
-	if (ret < 0)
-		return -ENOMEM;
+	if (len < 0)
+		return -EINVAL;
 
-	len = strlen(str);
-	offset = metadata_reserve(session, len);
-	if (offset < 0) {
-		ret = offset;
-		goto end;
-	}
-	memcpy(&session->metadata[offset], str, len);
-	ret = metadata_file_append(session, str, len);
-	if (ret) {
-		PERROR("Error appending to metadata file");
-		goto end;
+	/* vsnprintf() also needs room for the terminating NULL byte. */
+	if ((size_t) len >= avail) {
+		ret = metadata_grow(session, (size_t) len + 1);
+		if (ret)
+			return ret;
+		va_start(ap, fmt);
+		(void) vsnprintf(&session->metadata[session->metadata_len],
+				(size_t) len + 1, fmt, ap);
+		va_end(ap);
 	}
-	DBG3("Append to metadata: \"%s\"", str);
-	ret = 0;
 
-end:
-	free(str);
-	return ret;
+	DBG3("Append to metadata: \"%.*s\"", len,
+			&session->metadata[session->metadata_len]);
+	/* The NULL byte is left past the end of the metadata, which is zeroed. */
+	session->metadata_len += len;
+	return 0;
 }
 
 static
 int print_tabs(struct ust_registry_session *session, size_t nesting)
 {
-	size_t i;
-
-	for (i = 0; i < nesting; i++) {
-		int ret;
+	ssize_t offset;
 
-		ret = lttng_metadata_printf(session, "	");
-		if (ret) {
-			return ret;
-		}
+	if (!nesting) {
+		return 0;
+	}
+	offset = metadata_reserve(session, nesting);
+	if (offset < 0) {
+		return offset;
 	}
+	memset(&session->metadata[offset], '\t', nesting);
 	return 0;
 }
 
@@ -222,38 +343,47 @@ void sanitize_ctf_identifier(char *out, const char *in)
 static
 int print_escaped_ctf_string(struct ust_registry_session *session, const char *string)
 {
-	int ret = 0;
-	size_t i;
-	char cur;
+	size_t i, len = 0;
+	ssize_t offset;
+	char *out;
 
-	i = 0;
-	cur = string[i];
-	while (cur != '\0') {
-		switch (cur) {
+	/* Reserve the escaped string at once. */
+	for (i = 0; string[i] != '\0'; i++) {
+		switch (string[i]) {
 		case '\n':
-			ret = lttng_metadata_printf(session, "%s", "\\n");
+		case '\\':
+		case '"':
+			len += 2;
+			break;
+		default:
+			len++;
+			break;
+		}
+	}
+
+	offset = metadata_reserve(session, len);
+	if (offset < 0) {
+		return offset;
+	}
+
+	out = &session->metadata[offset];
+	for (i = 0; string[i] != '\0'; i++) {
+		switch (string[i]) {
+		case '\n':
+			*out++ = '\\';
+			*out++ = 'n';
 			break;
 		case '\\':
 		case '"':
-			ret = lttng_metadata_printf(session, "%c", '\\');
-			if (ret) {
-				goto error;
-			}
+			*out++ = '\\';
 			/* We still print the current char */
 			/* Fallthrough */
 		default:
-			ret = lttng_metadata_printf(session, "%c", cur);
+			*out++ = string[i];
 			break;
 		}
-
-		if (ret) {
-			goto error;
-		}
-
-		cur = string[++i];
 	}
-error:
-	return ret;
+	return 0;
 }
 
 /* Called with session registry mutex held. */
@@ -728,7 +858,12 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 		"};\n\n");
 	if (ret)
 		goto end;
-	event->metadata_dumped = 1;
+	ret = metadata_file_flush(session);
+	if (ret)
+		goto end;
+	/* Publish the event id to ust_registry_lookup_event_id(). */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(event->metadata_dumped, 1);
 
 end:
 	return ret;
@@ -781,6 +916,8 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 
 	ret = lttng_metadata_printf(session,
 		"};\n\n");
+	if (!ret)
+		ret = metadata_file_flush(session);
 	/* Flag success of metadata dump. */
 	chan->metadata_dumped = 1;
 
@@ -1161,6 +1298,7 @@ int ust_metadata_session_statedump(struct ust_registry_session *session,
 	if (ret)
 		goto end;
 
+	ret = metadata_file_flush(session);
 end:
 	return ret;
 }
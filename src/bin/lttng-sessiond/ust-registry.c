@@ -31,6 +31,62 @@
 #include "notification-thread-commands.h"
 
 
+/* 64-bit FNV-1a parameters. */
+#define FINGERPRINT_INIT	0xcbf29ce484222325ULL
+#define FINGERPRINT_PRIME	0x100000001b3ULL
+
+static uint64_t fingerprint_add(uint64_t fingerprint, const void *buf,
+		size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		fingerprint ^= p[i];
+		fingerprint *= FINGERPRINT_PRIME;
+	}
+	return fingerprint;
+}
+
+static uint64_t fingerprint_add_str(uint64_t fingerprint, const char *str,
+		size_t max_len)
+{
+	/* Include the NULL byte to delimit consecutive strings. */
+	return fingerprint_add(fingerprint, str, strnlen(str, max_len) + 1);
+}
+
+/*
+ * Compute the fingerprint of an event from everything ht_match_event()
+ * compares, so that events which match always have the same fingerprint.
+ */
+static uint64_t event_fingerprint(const char *name, int loglevel_value,
+		size_t nr_fields, const struct ustctl_field *fields,
+		const char *model_emf_uri)
+{
+	uint64_t fingerprint = FINGERPRINT_INIT;
+	size_t i;
+
+	fingerprint = fingerprint_add_str(fingerprint, name,
+			LTTNG_UST_SYM_NAME_LEN);
+	fingerprint = fingerprint_add(fingerprint, &loglevel_value,
+			sizeof(loglevel_value));
+	fingerprint = fingerprint_add(fingerprint, &nr_fields,
+			sizeof(nr_fields));
+	for (i = 0; i < nr_fields; i++) {
+		const enum ustctl_abstract_types atype = fields[i].type.atype;
+
+		fingerprint = fingerprint_add_str(fingerprint, fields[i].name,
+				LTTNG_UST_SYM_NAME_LEN);
+		fingerprint = fingerprint_add(fingerprint, &atype,
+				sizeof(atype));
+	}
+	if (model_emf_uri) {
+		fingerprint = fingerprint_add_str(fingerprint, model_emf_uri,
+				SIZE_MAX);
+	}
+	return fingerprint;
+}
+
 /*
  * Hash table match function for event in the registry.
  */
@@ -47,6 +103,14 @@ static int ht_match_event(struct cds_lfht_node *node, const void *_key)
 	assert(event);
 	key = _key;
 
+	/*
+	 * Events with different fingerprints never match. Since distinct
+	 * events can share a fingerprint, a perfect match is still verified.
+	 */
+	if (event->fingerprint != key->fingerprint) {
+		goto no_match;
+	}
+
 	/* It has to be a perfect match. First, compare the event names. */
 	if (strncmp(event->name, key->name, sizeof(event->name))) {
 		goto no_match;
@@ -89,14 +153,11 @@ no_match:
 
 static unsigned long ht_hash_event(const void *_key, unsigned long seed)
 {
-	uint64_t hashed_key;
 	const struct ust_registry_event *key = _key;
 
 	assert(key);
 
-	hashed_key = (uint64_t) hash_key_str(key->name, seed);
-
-	return hash_key_u64(&hashed_key, seed);
+	return hash_key_u64(&key->fingerprint, seed);
 }
 
 static int compare_enums(const struct ust_registry_enum *reg_enum_a,
@@ -315,6 +376,8 @@ static struct ust_registry_event *alloc_event(int session_objd,
 		strncpy(event->name, name, sizeof(event->name));
 		event->name[sizeof(event->name) - 1] = '\0';
 	}
+	event->fingerprint = event_fingerprint(event->name, loglevel_value,
+			nr_fields, fields, model_emf_uri);
 	cds_lfht_node_init(&event->node.node);
 
 error:
@@ -352,39 +415,69 @@ static void destroy_event_rcu(struct rcu_head *head)
 }
 
 /*
- * Find an event using the name and signature in the given registry. RCU read
- * side lock MUST be acquired before calling this function and as long as the
- * event reference is kept by the caller.
+ * Look up the id of an event of a channel which is already registered and
+ * described in the metadata, without acquiring the session registry lock.
  *
- * On success, the event pointer is returned else NULL.
+ * This lets the applications sharing per UID buffers register the events
+ * known to the registry concurrently; unknown events must be created with
+ * ust_registry_create_event().
+ *
+ * Return 0 and set event_id_p if the event is found, else -ENOENT.
  */
-struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig)
+int ust_registry_lookup_event_id(struct ust_registry_session *session,
+		uint64_t chan_key, const char *name, size_t nr_fields,
+		struct ustctl_field *fields, int loglevel_value,
+		char *model_emf_uri, uint32_t *event_id_p)
 {
-	struct lttng_ht_node_u64 *node;
-	struct lttng_ht_iter iter;
-	struct ust_registry_event *event = NULL;
+	int ret = -ENOENT;
+	struct cds_lfht_node *node;
+	struct cds_lfht_iter iter;
+	struct ust_registry_channel *chan;
+	struct ust_registry_event *event;
 	struct ust_registry_event key;
 
-	assert(chan);
+	assert(session);
 	assert(name);
-	assert(sig);
+	assert(event_id_p);
+
+	rcu_read_lock();
+
+	chan = ust_registry_channel_find(session, chan_key);
+	if (!chan) {
+		goto end;
+	}
 
 	/* Setup key for the match function. */
 	strncpy(key.name, name, sizeof(key.name));
 	key.name[sizeof(key.name) - 1] = '\0';
-	key.signature = sig;
+	key.loglevel_value = loglevel_value;
+	key.nr_fields = nr_fields;
+	key.fields = fields;
+	key.model_emf_uri = model_emf_uri;
+	key.fingerprint = event_fingerprint(key.name, loglevel_value,
+			nr_fields, fields, model_emf_uri);
 
 	cds_lfht_lookup(chan->ht->ht, chan->ht->hash_fct(&key, lttng_ht_seed),
-			chan->ht->match_fct, &key, &iter.iter);
-	node = lttng_ht_iter_get_node_u64(&iter);
+			chan->ht->match_fct, &key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
 	if (!node) {
 		goto end;
 	}
-	event = caa_container_of(node, struct ust_registry_event, node);
+	event = caa_container_of(node, struct ust_registry_event, node.node);
 
+	/*
+	 * The event id is set before the event is described in the metadata,
+	 * under the registry lock (see ust_metadata_event_statedump()).
+	 */
+	if (!CMM_LOAD_SHARED(event->metadata_dumped)) {
+		goto end;
+	}
+	cmm_smp_rmb();
+	*event_id_p = event->id;
+	ret = 0;
 end:
-	return event;
+	rcu_read_unlock();
+	return ret;
 }
 
 /*
@@ -1019,6 +1112,8 @@ void ust_registry_session_destroy(struct ust_registry_session *reg)
 		ht_cleanup_push(reg->channels);
 	}
 
+	/* The metadata is only pinned while it is being pushed. */
+	assert(!reg->metadata_pin_count && !reg->metadata_retired);
 	free(reg->metadata);
 	if (reg->metadata_fd >= 0) {
 		ret = close(reg->metadata_fd);
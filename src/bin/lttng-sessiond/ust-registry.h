@@ -18,6 +18,7 @@
 #ifndef LTTNG_UST_REGISTRY_H
 #define LTTNG_UST_REGISTRY_H
 
+#include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
 
@@ -31,6 +32,12 @@
 
 struct ust_app;
 
+/* Metadata array replaced while a push was sending from it. */
+struct ust_registry_retired_metadata {
+	char *metadata;
+	struct ust_registry_retired_metadata *next;
+};
+
 struct ust_registry_session {
 	/*
 	 * With multiple writers and readers, use this lock to access
@@ -68,6 +75,18 @@ struct ust_registry_session {
 	size_t metadata_len, metadata_alloc_len;
 	/* Length of bytes sent to the consumer. */
 	size_t metadata_len_sent;
+	/* Length of bytes written to the metadata file (see metadata_fd). */
+	size_t metadata_len_written;
+	/*
+	 * Number of pushes sending the metadata to the consumer straight from
+	 * the metadata array, with the registry lock released. While it is not
+	 * zero, the array is neither reallocated nor overwritten: it is
+	 * replaced and kept in metadata_retired until the last push completes.
+	 */
+	unsigned int metadata_pin_count;
+	struct ust_registry_retired_metadata *metadata_retired;
+	/* Monotonic time of the last push of metadata to the consumer (ns). */
+	uint64_t metadata_last_push;
 	/* Current version of the metadata. */
 	uint64_t metadata_version;
 
@@ -188,14 +207,20 @@ struct ust_registry_event {
 	size_t nr_fields;
 	struct ustctl_field *fields;
 	char *model_emf_uri;
+	/*
+	 * Hash of the name, log level, fields and model URI of the event,
+	 * compared first when looking up an event.
+	 */
+	uint64_t fingerprint;
 	/*
 	 * Flag for this channel if the metadata was dumped once during
-	 * registration. 0 means no, 1 yes.
+	 * registration. 0 means no, 1 yes. Once set, the id is valid and can
+	 * be read without the session registry lock.
 	 */
 	unsigned int metadata_dumped;
 	/*
-	 * Node in the ust-registry hash table. The event name is used to
-	 * initialize the node and the event_name/signature for the match function.
+	 * Node in the ust-registry hash table. The fingerprint is used to
+	 * hash the node and the event description for the match function.
 	 */
 	struct lttng_ht_node_u64 node;
 };
@@ -305,8 +330,10 @@ int ust_registry_create_event(struct ust_registry_session *session,
 		char *sig, size_t nr_fields, struct ustctl_field *fields,
 		int loglevel_value, char *model_emf_uri, int buffer_type,
 		uint32_t *event_id_p, struct ust_app *app);
-struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig);
+int ust_registry_lookup_event_id(struct ust_registry_session *session,
+		uint64_t chan_key, const char *name, size_t nr_fields,
+		struct ustctl_field *fields, int loglevel_value,
+		char *model_emf_uri, uint32_t *event_id_p);
 void ust_registry_destroy_event(struct ust_registry_channel *chan,
 		struct ust_registry_event *event);
 
@@ -318,6 +345,9 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 int ust_metadata_event_statedump(struct ust_registry_session *session,
 		struct ust_registry_channel *chan,
 		struct ust_registry_event *event);
+char *ust_metadata_pin(struct ust_registry_session *session);
+void ust_metadata_unpin(struct ust_registry_session *session);
+int ust_metadata_clear(struct ust_registry_session *session);
 int ust_registry_create_or_find_enum(struct ust_registry_session *session,
 		int session_objd, char *name,
 		struct ustctl_enum_entry *entries, size_t nr_entries,
@@ -382,10 +412,12 @@ int ust_registry_create_event(struct ust_registry_session *session,
 	return 0;
 }
 static inline
-struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig)
+int ust_registry_lookup_event_id(struct ust_registry_session *session,
+		uint64_t chan_key, const char *name, size_t nr_fields,
+		struct ustctl_field *fields, int loglevel_value,
+		char *model_emf_uri, uint32_t *event_id_p)
 {
-	return NULL;
+	return -ENOENT;
 }
 static inline
 void ust_registry_destroy_event(struct ust_registry_channel *chan,
@@ -413,6 +445,19 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	return 0;
 }
 static inline
+char *ust_metadata_pin(struct ust_registry_session *session)
+{
+	return NULL;
+}
+static inline
+void ust_metadata_unpin(struct ust_registry_session *session)
+{}
+static inline
+int ust_metadata_clear(struct ust_registry_session *session)
+{
+	return 0;
+}
+static inline
 int ust_registry_create_or_find_enum(struct ust_registry_session *session,
 		int session_objd, char *name,
 		struct ustctl_enum_entry *entries, size_t nr_entries,
@@ -83,16 +83,18 @@ static int destroy_session(struct lttng_session *session)
 	session_was_stopped = ret == -LTTNG_ERR_TRACE_ALREADY_STOPPED;
 	if (!opt_no_wait) {
 		do {
-			ret = lttng_data_pending(session->name);
+			/*
+			 * Returns as soon as the data is available, or once the
+			 * wait period has elapsed (in msec).
+			 */
+			ret = lttng_data_pending_wait(session->name,
+					DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US /
+						USEC_PER_MSEC);
 			if (ret < 0) {
 				/* Return the data available call error. */
 				goto error;
 			}
 
-			/*
-			 * Data sleep time before retrying (in usec). Don't sleep if the call
-			 * returned value indicates availability.
-			 */
 			if (ret) {
 				if (!printed_wait_msg) {
 					_MSG("Waiting for destruction of session \"%s\"",
@@ -101,7 +103,6 @@ static int destroy_session(struct lttng_session *session)
 					fflush(stdout);
 				}
 
-				usleep(DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US);
 				_MSG(".");
 				fflush(stdout);
 			}
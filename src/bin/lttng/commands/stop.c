@@ -124,18 +124,19 @@ static int stop_tracing(void)
 		_MSG("Waiting for data availability");
 		fflush(stdout);
 		do {
-			ret = lttng_data_pending(session_name);
+			/*
+			 * Returns as soon as the data is available, or once the
+			 * wait period has elapsed (in msec).
+			 */
+			ret = lttng_data_pending_wait(session_name,
+					DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US /
+						USEC_PER_MSEC);
 			if (ret < 0) {
 				/* Return the data available call error. */
 				goto free_name;
 			}
 
-			/*
-			 * Data sleep time before retrying (in usec). Don't sleep if the call
-			 * returned value indicates availability.
-			 */
 			if (ret) {
-				usleep(DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US);
 				_MSG(".");
 				fflush(stdout);
 			}
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _LGPL_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <common/error.h>
+#include <common/macros.h>
+
+#include "io-uring.h"
+
+#if defined(HAVE_USABLE_IO_URING) && defined(__NR_io_uring_setup)
+
+#include <linux/io_uring.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+struct lttng_io_uring {
+	int fd;
+
+	/* Submission queue ring, shared with the kernel. */
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned int *sq_khead;
+	unsigned int *sq_ktail;
+	unsigned int *sq_array;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	/* Tail of the entries queued but not yet made visible to the kernel. */
+	unsigned int sqe_tail;
+
+	/* Completion queue ring, shared with the kernel. */
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned int *cq_khead;
+	unsigned int *cq_ktail;
+	unsigned int cq_mask;
+	unsigned int cq_entries;
+	struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned int entries,
+		struct io_uring_params *params)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg,
+		unsigned int nr_args)
+{
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Check that the running kernel supports all the operations used by this
+ * interface.
+ */
+static bool ops_supported(int fd)
+{
+	int ret;
+	unsigned int i;
+	bool supported = false;
+	struct io_uring_probe *probe;
+	const unsigned int nr_ops = 256;
+	const uint8_t required_ops[] = {
+		IORING_OP_WRITE,
+		IORING_OP_SYNC_FILE_RANGE,
+		IORING_OP_FADVISE,
+	};
+
+	probe = zmalloc(sizeof(*probe) + nr_ops * sizeof(probe->ops[0]));
+	if (!probe) {
+		goto end;
+	}
+
+	/* Probing is supported since the IORING_OP_WRITE operation. */
+	ret = sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, nr_ops);
+	if (ret < 0) {
+		goto end;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(required_ops); i++) {
+		const uint8_t op = required_ops[i];
+
+		if (op > probe->last_op ||
+				!(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+			DBG("io_uring operation %u is not supported", op);
+			goto end;
+		}
+	}
+	supported = true;
+end:
+	free(probe);
+	return supported;
+}
+
+static void unmap_rings(struct lttng_io_uring *ring)
+{
+	if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+		(void) munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if (ring->cq_ring && ring->cq_ring != MAP_FAILED) {
+		(void) munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sqes && ring->sqes != MAP_FAILED) {
+		(void) munmap(ring->sqes, ring->sqes_size);
+	}
+}
+
+static int map_rings(struct lttng_io_uring *ring,
+		const struct io_uring_params *params)
+{
+	unsigned int i;
+
+	ring->sq_ring_size = params->sq_off.array +
+			params->sq_entries * sizeof(unsigned int);
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		PERROR("Failed to map io_uring submission queue");
+		goto error;
+	}
+
+	ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		PERROR("Failed to map io_uring submission queue entries");
+		goto error;
+	}
+
+	ring->cq_ring_size = params->cq_off.cqes +
+			params->cq_entries * sizeof(struct io_uring_cqe);
+	ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	if (ring->cq_ring == MAP_FAILED) {
+		PERROR("Failed to map io_uring completion queue");
+		goto error;
+	}
+
+	ring->sq_khead = ring->sq_ring + params->sq_off.head;
+	ring->sq_ktail = ring->sq_ring + params->sq_off.tail;
+	ring->sq_array = ring->sq_ring + params->sq_off.array;
+	ring->sq_mask = *(unsigned int *) (ring->sq_ring +
+			params->sq_off.ring_mask);
+	ring->sq_entries = params->sq_entries;
+	ring->sqe_tail = *ring->sq_ktail;
+
+	ring->cq_khead = ring->cq_ring + params->cq_off.head;
+	ring->cq_ktail = ring->cq_ring + params->cq_off.tail;
+	ring->cq_mask = *(unsigned int *) (ring->cq_ring +
+			params->cq_off.ring_mask);
+	ring->cq_entries = params->cq_entries;
+	ring->cqes = ring->cq_ring + params->cq_off.cqes;
+
+	/* Submission queue entries are always used in order. */
+	for (i = 0; i < ring->sq_entries; i++) {
+		ring->sq_array[i] = i;
+	}
+
+	return 0;
+error:
+	return -1;
+}
+
+LTTNG_HIDDEN
+struct lttng_io_uring *lttng_io_uring_create(unsigned int entries)
+{
+	int ret;
+	struct lttng_io_uring *ring;
+	struct io_uring_params params;
+
+	ring = zmalloc(sizeof(*ring));
+	if (!ring) {
+		PERROR("zmalloc io_uring");
+		goto error;
+	}
+
+	memset(&params, 0, sizeof(params));
+	ring->fd = sys_io_uring_setup(entries, &params);
+	if (ring->fd < 0) {
+		DBG("io_uring_setup failed: %s", strerror(errno));
+		if (errno == EINVAL || errno == EPERM) {
+			errno = ENOSYS;
+		}
+		goto error_free;
+	}
+
+	/* Writes must be able to use, and update, the file position. */
+	if (!(params.features & IORING_FEAT_RW_CUR_POS) ||
+			!ops_supported(ring->fd)) {
+		errno = ENOSYS;
+		goto error_close;
+	}
+
+	ret = map_rings(ring, &params);
+	if (ret) {
+		goto error_unmap;
+	}
+
+	DBG("io_uring instance created (fd: %d, sq entries: %u, cq entries: %u)",
+			ring->fd, ring->sq_entries, ring->cq_entries);
+	return ring;
+
+error_unmap:
+	unmap_rings(ring);
+error_close:
+	ret = close(ring->fd);
+	if (ret) {
+		PERROR("close io_uring fd");
+	}
+error_free:
+	free(ring);
+error:
+	return NULL;
+}
+
+LTTNG_HIDDEN
+void lttng_io_uring_destroy(struct lttng_io_uring *ring)
+{
+	int ret;
+
+	if (!ring) {
+		return;
+	}
+
+	unmap_rings(ring);
+	ret = close(ring->fd);
+	if (ret) {
+		PERROR("close io_uring fd");
+	}
+	free(ring);
+}
+
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_cq_entries(const struct lttng_io_uring *ring)
+{
+	return ring->cq_entries;
+}
+
+/*
+ * Return a zeroed submission queue entry or NULL if the queue is full.
+ */
+static struct io_uring_sqe *get_sqe(struct lttng_io_uring *ring, bool link)
+{
+	struct io_uring_sqe *sqe;
+	const unsigned int head = CMM_LOAD_SHARED(*ring->sq_khead);
+
+	cmm_smp_rmb();
+	if (ring->sqe_tail - head >= ring->sq_entries) {
+		return NULL;
+	}
+
+	sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+	ring->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->flags = link ? IOSQE_IO_LINK : 0;
+	return sqe;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_write(struct lttng_io_uring *ring, int fd,
+		const void *buf, size_t len, uint64_t user_data, bool link)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(len <= UINT32_MAX);
+
+	sqe = get_sqe(ring, link);
+	if (!sqe) {
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fd;
+	/* Use the current file position. */
+	sqe->off = (uint64_t) -1ULL;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = (uint32_t) len;
+	sqe->user_data = user_data;
+	return 0;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_sync_file_range(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t nbytes, unsigned int flags,
+		uint64_t user_data, bool link)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(nbytes >= 0 && nbytes <= UINT32_MAX);
+
+	sqe = get_sqe(ring, link);
+	if (!sqe) {
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) offset;
+	sqe->len = (uint32_t) nbytes;
+	sqe->sync_range_flags = flags;
+	sqe->user_data = user_data;
+	return 0;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_fadvise(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t len, int advice, uint64_t user_data,
+		bool link)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(len >= 0 && len <= UINT32_MAX);
+
+	sqe = get_sqe(ring, link);
+	if (!sqe) {
+		return -EBUSY;
+	}
+
+	sqe->opcode = IORING_OP_FADVISE;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) offset;
+	sqe->len = (uint32_t) len;
+	sqe->fadvise_advice = (uint32_t) advice;
+	sqe->user_data = user_data;
+	return 0;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_submit(struct lttng_io_uring *ring, unsigned int wait_nr)
+{
+	int ret;
+	unsigned int to_submit;
+
+	/* Publish the queued entries before entering the kernel. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(*ring->sq_ktail, ring->sqe_tail);
+	cmm_smp_mb();
+	to_submit = ring->sqe_tail - CMM_LOAD_SHARED(*ring->sq_khead);
+
+	if (!to_submit && !wait_nr) {
+		return 0;
+	}
+
+	do {
+		ret = sys_io_uring_enter(ring->fd, to_submit, wait_nr,
+				wait_nr ? IORING_ENTER_GETEVENTS : 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		ret = -errno;
+		PERROR("io_uring_enter");
+	}
+	return ret;
+}
+
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_reap(struct lttng_io_uring *ring,
+		lttng_io_uring_complete_cb complete, void *data)
+{
+	unsigned int head, tail, nr = 0;
+
+	head = *ring->cq_khead;
+	tail = CMM_LOAD_SHARED(*ring->cq_ktail);
+	/* Read the completion entries after the tail. */
+	cmm_smp_rmb();
+
+	for (; head != tail; head++, nr++) {
+		const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+		complete(cqe->user_data, cqe->res, data);
+	}
+
+	if (nr) {
+		/* Release the entries once they have been read. */
+		cmm_smp_mb();
+		CMM_STORE_SHARED(*ring->cq_khead, head);
+	}
+	return nr;
+}
+
+#else /* HAVE_USABLE_IO_URING && __NR_io_uring_setup */
+
+LTTNG_HIDDEN
+struct lttng_io_uring *lttng_io_uring_create(unsigned int entries)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+LTTNG_HIDDEN
+void lttng_io_uring_destroy(struct lttng_io_uring *ring)
+{
+}
+
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_cq_entries(const struct lttng_io_uring *ring)
+{
+	return 0;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_write(struct lttng_io_uring *ring, int fd,
+		const void *buf, size_t len, uint64_t user_data, bool link)
+{
+	return -ENOSYS;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_sync_file_range(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t nbytes, unsigned int flags,
+		uint64_t user_data, bool link)
+{
+	return -ENOSYS;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_queue_fadvise(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t len, int advice, uint64_t user_data,
+		bool link)
+{
+	return -ENOSYS;
+}
+
+LTTNG_HIDDEN
+int lttng_io_uring_submit(struct lttng_io_uring *ring, unsigned int wait_nr)
+{
+	return -ENOSYS;
+}
+
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_reap(struct lttng_io_uring *ring,
+		lttng_io_uring_complete_cb complete, void *data)
+{
+	return 0;
+}
+
+#endif /* HAVE_USABLE_IO_URING && __NR_io_uring_setup */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _COMPAT_IO_URING_H
+#define _COMPAT_IO_URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <common/compat/fcntl.h>
+#include <common/macros.h>
+
+/*
+ * Minimal io_uring(7) instance used to submit file writes and writeback
+ * hints asynchronously.
+ *
+ * Operations are queued in the submission queue and handed to the kernel by
+ * lttng_io_uring_submit(). Their completions are consumed with
+ * lttng_io_uring_reap(). When an operation is queued with 'link' set, the
+ * operation queued right after it only starts once it has completed
+ * successfully; it is cancelled (-ECANCELED) otherwise.
+ *
+ * An instance is not thread-safe.
+ */
+struct lttng_io_uring;
+
+typedef void (*lttng_io_uring_complete_cb)(uint64_t user_data, int32_t res,
+		void *data);
+
+/*
+ * Create an instance with a submission queue of at least 'entries' entries.
+ *
+ * Return NULL and set errno on error. errno is set to ENOSYS if io_uring, or
+ * one of the operations used by this interface, is not supported.
+ */
+LTTNG_HIDDEN
+struct lttng_io_uring *lttng_io_uring_create(unsigned int entries);
+
+LTTNG_HIDDEN
+void lttng_io_uring_destroy(struct lttng_io_uring *ring);
+
+/* Number of completions the instance can hold before overflowing. */
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_cq_entries(const struct lttng_io_uring *ring);
+
+/*
+ * Queue a write of 'len' bytes of 'buf' at the current file position of 'fd',
+ * which is advanced once the write completes.
+ *
+ * Return 0 on success or -EBUSY if the submission queue is full.
+ */
+LTTNG_HIDDEN
+int lttng_io_uring_queue_write(struct lttng_io_uring *ring, int fd,
+		const void *buf, size_t len, uint64_t user_data, bool link);
+
+/*
+ * Queue a sync_file_range(2) of 'fd'.
+ *
+ * Return 0 on success or -EBUSY if the submission queue is full.
+ */
+LTTNG_HIDDEN
+int lttng_io_uring_queue_sync_file_range(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t nbytes, unsigned int flags,
+		uint64_t user_data, bool link);
+
+/*
+ * Queue a posix_fadvise(2) of 'fd'.
+ *
+ * Return 0 on success or -EBUSY if the submission queue is full.
+ */
+LTTNG_HIDDEN
+int lttng_io_uring_queue_fadvise(struct lttng_io_uring *ring, int fd,
+		off64_t offset, off64_t len, int advice, uint64_t user_data,
+		bool link);
+
+/*
+ * Submit the queued operations and wait until at least 'wait_nr' completions
+ * are available.
+ *
+ * Return the number of operations submitted or a negative errno value.
+ */
+LTTNG_HIDDEN
+int lttng_io_uring_submit(struct lttng_io_uring *ring, unsigned int wait_nr);
+
+/*
+ * Consume the available completions, calling 'complete' for each of them.
+ *
+ * Return the number of completions consumed.
+ */
+LTTNG_HIDDEN
+unsigned int lttng_io_uring_reap(struct lttng_io_uring *ring,
+		lttng_io_uring_complete_cb complete, void *data);
+
+#endif /* _COMPAT_IO_URING_H */
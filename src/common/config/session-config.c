@@ -1802,7 +1802,8 @@ end:
 
 static
 int process_event_node(xmlNodePtr event_node, struct lttng_handle *handle,
-	const char *channel_name, const enum process_event_node_phase phase)
+	const char *channel_name, const enum process_event_node_phase phase,
+	struct lttng_event_batch *batch)
 {
 	int ret = 0, i;
 	xmlNodePtr node;
@@ -1814,6 +1815,7 @@ int process_event_node(xmlNodePtr event_node, struct lttng_handle *handle,
 	assert(event_node);
 	assert(handle);
 	assert(channel_name);
+	assert(batch);
 
 	event = lttng_event_create();
 	if (!event) {
@@ -2115,8 +2117,16 @@ int process_event_node(xmlNodePtr event_node, struct lttng_handle *handle,
 	}
 
 	if ((event->enabled && phase == ENABLE) || phase == CREATION) {
-		ret = lttng_enable_event_with_exclusions(handle, event, channel_name,
-				filter_expression, exclusion_count, exclusions);
+		if (lttng_event_get_userspace_probe_location(event)) {
+			/* Userspace probes can't be batched. */
+			ret = lttng_enable_event_with_exclusions(handle, event,
+					channel_name, filter_expression,
+					exclusion_count, exclusions);
+		} else {
+			ret = lttng_event_batch_add(batch, event,
+					filter_expression, exclusion_count,
+					exclusions);
+		}
 		if (ret < 0) {
 			WARN("Enabling event (name:%s) on load failed.", event->name);
 			ret = -LTTNG_ERR_LOAD_INVALID_CONFIG;
@@ -2135,26 +2145,64 @@ end:
 	return ret;
 }
 
+/*
+ * Enable the events of a channel for the given phase. The events are sent to
+ * the session daemon as a single batch rather than one request per event.
+ */
 static
-int process_events_node(xmlNodePtr events_node, struct lttng_handle *handle,
-	const char *channel_name)
+int process_events_node_phase(xmlNodePtr events_node,
+	struct lttng_handle *handle, const char *channel_name,
+	const enum process_event_node_phase phase)
 {
 	int ret = 0;
-	struct lttng_event event;
 	xmlNodePtr node;
+	struct lttng_event_batch *batch;
 
-	assert(events_node);
-	assert(handle);
-	assert(channel_name);
+	batch = lttng_event_batch_create();
+	if (!batch) {
+		ret = -LTTNG_ERR_NOMEM;
+		goto end;
+	}
 
 	for (node = xmlFirstElementChild(events_node); node;
 		node = xmlNextElementSibling(node)) {
-		ret = process_event_node(node, handle, channel_name, CREATION);
+		ret = process_event_node(node, handle, channel_name, phase,
+				batch);
 		if (ret) {
 			goto end;
 		}
 	}
 
+	ret = lttng_enable_event_batch(handle, channel_name, batch);
+	if (ret < 0) {
+		WARN("Enabling events of channel %s on load failed.",
+				channel_name);
+		ret = -LTTNG_ERR_LOAD_INVALID_CONFIG;
+		goto end;
+	}
+	ret = 0;
+end:
+	lttng_event_batch_destroy(batch);
+	return ret;
+}
+
+static
+int process_events_node(xmlNodePtr events_node, struct lttng_handle *handle,
+	const char *channel_name)
+{
+	int ret = 0;
+	struct lttng_event event;
+
+	assert(events_node);
+	assert(handle);
+	assert(channel_name);
+
+	ret = process_events_node_phase(events_node, handle, channel_name,
+			CREATION);
+	if (ret) {
+		goto end;
+	}
+
 	/*
 	 * Disable all events to enable only the necessary events.
 	 * Limitations regarding lttng_disable_events and tuple descriptor
@@ -2168,13 +2216,8 @@ int process_events_node(xmlNodePtr events_node, struct lttng_handle *handle,
 		goto end;
 	}
 
-	for (node = xmlFirstElementChild(events_node); node;
-			node = xmlNextElementSibling(node)) {
-		ret = process_event_node(node, handle, channel_name, ENABLE);
-		if (ret) {
-			goto end;
-		}
-	}
+	ret = process_events_node_phase(events_node, handle, channel_name,
+			ENABLE);
 
 end:
 	return ret;
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _LGPL_SOURCE
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/common.h>
+#include <common/compat/fcntl.h>
+#include <common/defaults.h>
+
+#include "consumer-io-uring.h"
+
+/* The lowest bit of an operation's user data is set for writes. */
+#define IO_URING_OP_WRITE	1ULL
+
+static uint64_t op_user_data(struct lttng_consumer_stream *stream, bool write)
+{
+	return (uint64_t) (uintptr_t) stream | (write ? IO_URING_OP_WRITE : 0);
+}
+
+static void complete_op(uint64_t user_data, int32_t res, void *data)
+{
+	struct consumer_io_uring *io_uring = data;
+	struct lttng_consumer_stream *stream =
+			(void *) (uintptr_t) (user_data & ~IO_URING_OP_WRITE);
+
+	assert(stream->io_uring_inflight > 0);
+	assert(io_uring->inflight > 0);
+	stream->io_uring_inflight--;
+	io_uring->inflight--;
+
+	if (user_data & IO_URING_OP_WRITE) {
+		stream->io_uring_write_res = res;
+		stream->io_uring_write_done = true;
+	} else if (res < 0 && res != -ECANCELED) {
+		/* Writeback hints, errors can be ignored. */
+		DBG("io_uring writeback hint of stream %" PRIu64 " failed: %s",
+				stream->key, strerror(-res));
+	}
+}
+
+/*
+ * Submit the queued operations, wait for at least one completion and
+ * process all the available ones.
+ *
+ * The io_uring lock MUST be acquired and operations MUST be in flight.
+ *
+ * Return 0 on success or a negative errno value.
+ */
+static int wait_completions(struct consumer_io_uring *io_uring)
+{
+	int ret;
+
+	assert(io_uring->inflight > 0);
+
+	do {
+		ret = lttng_io_uring_submit(io_uring->ring, 1);
+	} while (ret == -EAGAIN || ret == -EBUSY);
+	if (ret < 0) {
+		goto end;
+	}
+
+	(void) lttng_io_uring_reap(io_uring->ring, complete_op, io_uring);
+	ret = 0;
+end:
+	return ret;
+}
+
+struct consumer_io_uring *consumer_io_uring_create(void)
+{
+	struct consumer_io_uring *io_uring;
+
+	io_uring = zmalloc(sizeof(*io_uring));
+	if (!io_uring) {
+		PERROR("zmalloc consumer io_uring");
+		goto error;
+	}
+
+	io_uring->ring = lttng_io_uring_create(DEFAULT_CONSUMERD_IO_URING_ENTRIES);
+	if (!io_uring->ring) {
+		if (errno == ENOSYS) {
+			DBG("io_uring is not supported by this kernel");
+		} else {
+			PERROR("Failed to create io_uring instance");
+		}
+		goto error_free;
+	}
+
+	/*
+	 * Bounding the operations in flight to the requested submission queue
+	 * size ensures that the submission queue can never be full and that the
+	 * completion queue, twice as large, never overflows.
+	 */
+	io_uring->max_inflight = DEFAULT_CONSUMERD_IO_URING_ENTRIES;
+	assert(io_uring->max_inflight <=
+			lttng_io_uring_cq_entries(io_uring->ring));
+	pthread_mutex_init(&io_uring->lock, NULL);
+	return io_uring;
+
+error_free:
+	free(io_uring);
+error:
+	return NULL;
+}
+
+void consumer_io_uring_destroy(struct consumer_io_uring *io_uring)
+{
+	if (!io_uring) {
+		return;
+	}
+
+	assert(io_uring->inflight == 0);
+	lttng_io_uring_destroy(io_uring->ring);
+	pthread_mutex_destroy(&io_uring->lock);
+	free(io_uring);
+}
+
+ssize_t consumer_io_uring_write(struct lttng_consumer_stream *stream,
+		const char *buf, size_t len)
+{
+	int ret;
+	ssize_t written = -1;
+	struct consumer_io_uring *io_uring = stream->io_uring;
+	const int fd = stream->out_fd;
+	const off_t offset = stream->out_fd_offset;
+	const bool release_prev = offset >= (off_t) stream->max_sb_size;
+	const unsigned int nr_ops = release_prev ? 4 : 2;
+
+	assert(io_uring);
+	ASSERT_LOCKED(stream->lock);
+
+	pthread_mutex_lock(&io_uring->lock);
+	while (io_uring->inflight + nr_ops > io_uring->max_inflight) {
+		ret = wait_completions(io_uring);
+		if (ret < 0) {
+			errno = -ret;
+			goto end;
+		}
+	}
+
+	/* Start the writeback of the written range once it is written. */
+	ret = lttng_io_uring_queue_write(io_uring->ring, fd, buf, len,
+			op_user_data(stream, true), true);
+	assert(!ret);
+	ret = lttng_io_uring_queue_sync_file_range(io_uring->ring, fd, offset,
+			len, SYNC_FILE_RANGE_WRITE, op_user_data(stream, false),
+			false);
+	assert(!ret);
+	if (release_prev) {
+		/*
+		 * Wait for the writeback of the previous sub-buffer and drop it
+		 * from the page cache, as lttng_consumer_sync_trace_file() does,
+		 * without blocking the consumption of this stream.
+		 */
+		ret = lttng_io_uring_queue_sync_file_range(io_uring->ring, fd,
+				offset - stream->max_sb_size, stream->max_sb_size,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER,
+				op_user_data(stream, false), true);
+		assert(!ret);
+		ret = lttng_io_uring_queue_fadvise(io_uring->ring, fd,
+				offset - stream->max_sb_size, stream->max_sb_size,
+				POSIX_FADV_DONTNEED, op_user_data(stream, false),
+				false);
+		assert(!ret);
+	}
+	stream->io_uring_inflight += nr_ops;
+	io_uring->inflight += nr_ops;
+	stream->io_uring_write_done = false;
+
+	/* The sub-buffer can only be released once it is written. */
+	while (!stream->io_uring_write_done) {
+		ret = wait_completions(io_uring);
+		if (ret < 0) {
+			errno = -ret;
+			goto end;
+		}
+	}
+
+	if (stream->io_uring_write_res < 0) {
+		errno = -stream->io_uring_write_res;
+		goto end;
+	}
+
+	written = stream->io_uring_write_res;
+	if ((size_t) written < len) {
+		ssize_t ret_write;
+
+		/* Complete a short write synchronously. */
+		ret_write = lttng_write(fd, buf + written, len - written);
+		if (ret_write < 0) {
+			written = -1;
+			goto end;
+		}
+		written += ret_write;
+	}
+end:
+	pthread_mutex_unlock(&io_uring->lock);
+	return written;
+}
+
+void consumer_io_uring_drain_stream(struct lttng_consumer_stream *stream)
+{
+	int ret;
+	struct consumer_io_uring *io_uring = stream->io_uring;
+
+	if (!io_uring) {
+		return;
+	}
+
+	pthread_mutex_lock(&io_uring->lock);
+	while (stream->io_uring_inflight > 0) {
+		ret = wait_completions(io_uring);
+		if (ret < 0) {
+			ERR("Failed to wait for the io_uring operations of stream %" PRIu64,
+					stream->key);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&io_uring->lock);
+}
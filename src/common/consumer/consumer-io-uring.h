@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_CONSUMER_IO_URING_H
+#define LTTNG_CONSUMER_IO_URING_H
+
+#include <pthread.h>
+
+#include <common/compat/io-uring.h>
+
+#include "consumer.h"
+
+/*
+ * io_uring output backend of the local trace files of the data streams.
+ *
+ * A sub-buffer is written with a single io_uring submission which also
+ * starts the writeback of the written range and queues the wait for the
+ * writeback of the previous sub-buffer followed by the page cache release
+ * of that range. Only the write is waited for; the sub-buffer can be
+ * returned to the ring buffer as soon as this function returns, while the
+ * writeback of several sub-buffers of a stream can be in flight.
+ *
+ * The operations in flight for a stream reference its out_fd. They must be
+ * drained with consumer_io_uring_drain_stream() before it is closed.
+ */
+struct consumer_io_uring {
+	struct lttng_io_uring *ring;
+	/*
+	 * Protects the ring and the in-flight operation count of the streams
+	 * using it.
+	 *
+	 * This is nested INSIDE the stream lock.
+	 */
+	pthread_mutex_t lock;
+	/* Number of operations queued and not yet completed. */
+	unsigned int inflight;
+	/* Maximal number of operations in flight, bounded by the ring size. */
+	unsigned int max_inflight;
+};
+
+/*
+ * Create an io_uring output backend instance.
+ *
+ * Return NULL if io_uring is not available, in which case the blocking
+ * write path must be used.
+ */
+struct consumer_io_uring *consumer_io_uring_create(void);
+
+/*
+ * Destroy an instance. No stream may be using it anymore.
+ */
+void consumer_io_uring_destroy(struct consumer_io_uring *io_uring);
+
+/*
+ * Write 'len' bytes of 'buf' at the current position of the stream's output
+ * file and submit the writeback hints of the written range and of the
+ * previous sub-buffer.
+ *
+ * The stream lock MUST be acquired.
+ *
+ * Return the number of bytes written or -1 with errno set, like lttng_write().
+ */
+ssize_t consumer_io_uring_write(struct lttng_consumer_stream *stream,
+		const char *buf, size_t len);
+
+/*
+ * Wait for the completion of all the operations in flight for a stream.
+ * Does nothing if the stream does not use io_uring.
+ *
+ * The stream lock MUST be acquired.
+ */
+void consumer_io_uring_drain_stream(struct lttng_consumer_stream *stream);
+
+#endif /* LTTNG_CONSUMER_IO_URING_H */
@@ -37,7 +37,7 @@ extern struct lttng_consumer_global_data consumer_data;
 
 /*
  * Extend the allocated size of the metadata cache. Called only from
- * lttng_ustconsumer_write_metadata_cache.
+ * consumer_metadata_cache_reserve().
  *
  * Return 0 on success, a negative value on error.
  */
@@ -56,8 +56,8 @@ static int extend_metadata_cache(struct lttng_consumer_channel *channel,
 	DBG("Extending metadata cache to %u", new_size);
 	tmp_data_ptr = realloc(channel->metadata_cache->data, new_size);
 	if (!tmp_data_ptr) {
+		/* The cache is left untouched. */
 		ERR("Reallocating metadata cache");
-		free(channel->metadata_cache->data);
 		ret = -1;
 		goto end;
 	}
@@ -141,18 +141,19 @@ end:
 }
 
 /*
- * Write metadata to the cache, extend the cache if necessary. We support
- * overlapping updates, but they need to be contiguous. Send the
- * contiguous metadata in cache to the ring buffer. The metadata cache
- * lock MUST be acquired to write in the cache.
+ * Make room in the cache for 'len' bytes of metadata at 'offset', extending
+ * it if necessary, so that they can be written in place before being
+ * committed with consumer_metadata_cache_commit(). The cache is only
+ * reallocated when it has to grow, and it at least doubles in size each
+ * time. The metadata cache lock MUST be acquired and held until the commit.
  *
- * Return 0 on success, a negative value on error.
+ * Return the address where to write the metadata, NULL on error.
  */
-int consumer_metadata_cache_write(struct lttng_consumer_channel *channel,
-		unsigned int offset, unsigned int len, uint64_t version,
-		char *data)
+char *consumer_metadata_cache_reserve(struct lttng_consumer_channel *channel,
+		uint64_t offset, uint64_t len, uint64_t version)
 {
-	int ret = 0;
+	int ret;
+	char *data = NULL;
 	struct consumer_metadata_cache *cache;
 
 	assert(channel);
@@ -165,8 +166,6 @@ int consumer_metadata_cache_write(struct lttng_consumer_channel *channel,
 		goto end;
 	}
 
-	DBG("Writing %u bytes from offset %u in metadata cache", len, offset);
-
 	if (offset + len > cache->cache_alloc_size) {
 		ret = extend_metadata_cache(channel,
 				len - cache->cache_alloc_size + offset);
@@ -176,13 +175,37 @@ int consumer_metadata_cache_write(struct lttng_consumer_channel *channel,
 		}
 	}
 
-	memcpy(cache->data + offset, data, len);
+	data = cache->data + offset;
+end:
+	return data;
+}
+
+/*
+ * Make the 'len' bytes of metadata written at 'offset' in the cache
+ * available. We support overlapping updates, but they need to be
+ * contiguous. Send the contiguous metadata in cache to the ring buffer. The
+ * metadata cache lock MUST be acquired.
+ *
+ * Return 0 on success, a negative value on error.
+ */
+int consumer_metadata_cache_commit(struct lttng_consumer_channel *channel,
+		uint64_t offset, uint64_t len)
+{
+	int ret = 0;
+	struct consumer_metadata_cache *cache;
+
+	assert(channel);
+	assert(channel->metadata_cache);
+
+	cache = channel->metadata_cache;
+
+	DBG("Writing %" PRIu64 " bytes from offset %" PRIu64 " in metadata cache",
+			len, offset);
+
 	if (offset + len > cache->max_offset) {
 		cache->max_offset = offset + len;
 		ret = consumer_metadata_wakeup_pipe(channel);
 	}
-
-end:
 	return ret;
 }
 
@@ -209,6 +232,12 @@ int consumer_metadata_cache_allocate(struct lttng_consumer_channel *channel)
 		PERROR("mutex init");
 		goto end_free_cache;
 	}
+	ret = pthread_mutex_init(&channel->metadata_cache->recv_lock, NULL);
+	if (ret != 0) {
+		PERROR("mutex init");
+		goto end_free_mutex;
+	}
+	lttng_dynamic_buffer_init(&channel->metadata_cache->recv_buffer);
 
 	channel->metadata_cache->cache_alloc_size = DEFAULT_METADATA_CACHE_SIZE;
 	channel->metadata_cache->data = zmalloc(
@@ -216,7 +245,7 @@ int consumer_metadata_cache_allocate(struct lttng_consumer_channel *channel)
 	if (!channel->metadata_cache->data) {
 		PERROR("zmalloc metadata cache data");
 		ret = -1;
-		goto end_free_mutex;
+		goto end_free_recv_mutex;
 	}
 	DBG("Allocated metadata cache of %" PRIu64 " bytes",
 			channel->metadata_cache->cache_alloc_size);
@@ -224,6 +253,8 @@ int consumer_metadata_cache_allocate(struct lttng_consumer_channel *channel)
 	ret = 0;
 	goto end;
 
+end_free_recv_mutex:
+	pthread_mutex_destroy(&channel->metadata_cache->recv_lock);
 end_free_mutex:
 	pthread_mutex_destroy(&channel->metadata_cache->lock);
 end_free_cache:
@@ -244,6 +275,8 @@ void consumer_metadata_cache_destroy(struct lttng_consumer_channel *channel)
 	DBG("Destroying metadata cache");
 
 	pthread_mutex_destroy(&channel->metadata_cache->lock);
+	pthread_mutex_destroy(&channel->metadata_cache->recv_lock);
+	lttng_dynamic_buffer_reset(&channel->metadata_cache->recv_buffer);
 	free(channel->metadata_cache->data);
 	free(channel->metadata_cache);
 }
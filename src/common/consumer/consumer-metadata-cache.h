@@ -20,6 +20,7 @@
 #define CONSUMER_METADATA_CACHE_H
 
 #include <common/consumer/consumer.h>
+#include <common/dynamic-buffer.h>
 
 struct consumer_metadata_cache {
 	char *data;
@@ -43,11 +44,24 @@ struct consumer_metadata_cache {
 	 * This is nested INSIDE the consumer_data lock.
 	 */
 	pthread_mutex_t lock;
+	/*
+	 * Metadata received from the session daemon before it is copied in
+	 * the cache. Reused by every push to the channel; only its capacity
+	 * is used, its size remains 0.
+	 */
+	struct lttng_dynamic_buffer recv_buffer;
+	/*
+	 * Serializes the receptions of metadata in recv_buffer.
+	 *
+	 * The cache lock is nested INSIDE it.
+	 */
+	pthread_mutex_t recv_lock;
 };
 
-int consumer_metadata_cache_write(struct lttng_consumer_channel *channel,
-		unsigned int offset, unsigned int len, uint64_t version,
-		char *data);
+char *consumer_metadata_cache_reserve(struct lttng_consumer_channel *channel,
+		uint64_t offset, uint64_t len, uint64_t version);
+int consumer_metadata_cache_commit(struct lttng_consumer_channel *channel,
+		uint64_t offset, uint64_t len);
 int consumer_metadata_cache_allocate(struct lttng_consumer_channel *channel);
 void consumer_metadata_cache_destroy(struct lttng_consumer_channel *channel);
 int consumer_metadata_cache_flushed(struct lttng_consumer_channel *channel,
@@ -30,6 +30,7 @@
 #include <common/ust-consumer/ust-consumer.h>
 #include <common/utils.h>
 
+#include "consumer-io-uring.h"
 #include "consumer-stream.h"
 
 /*
@@ -68,6 +69,7 @@ void consumer_stream_relayd_close(struct lttng_consumer_stream *stream,
 
 	/* Closing streams requires to lock the control socket. */
 	pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+	consumer_relayd_sync_indexes(relayd);
 	ret = relayd_send_close_stream(&relayd->control_sock,
 			stream->relayd_stream_id,
 			stream->next_net_seq_num - 1);
@@ -152,6 +154,7 @@ void consumer_stream_close(struct lttng_consumer_stream *stream)
 
 	/* Close output fd. Could be a socket or local file at this point. */
 	if (stream->out_fd >= 0) {
+		consumer_io_uring_drain_stream(stream);
 		ret = close(stream->out_fd);
 		if (ret) {
 			PERROR("close");
@@ -217,6 +220,8 @@ void consumer_stream_delete(struct lttng_consumer_stream *stream,
 
 	rcu_read_unlock();
 
+	consumer_stream_data_pending_drained(stream);
+
 	if (!stream->metadata_flag) {
 		/* Decrement the stream count of the global consumer data. */
 		assert(consumer_data.stream_count > 0);
@@ -324,9 +329,6 @@ void consumer_stream_destroy(struct lttng_consumer_stream *stream,
 			/* Update channel's refcount of the stream. */
 			free_chan = unref_channel(stream);
 
-			/* Indicates that the consumer data state MUST be updated after this. */
-			consumer_data.need_update = 1;
-
 			pthread_mutex_unlock(&stream->lock);
 			pthread_mutex_unlock(&stream->chan->lock);
 			pthread_mutex_unlock(&consumer_data.lock);
@@ -369,9 +371,24 @@ int consumer_stream_write_index(struct lttng_consumer_stream *stream,
 		struct consumer_relayd_sock_pair *relayd;
 		relayd = consumer_find_relayd(stream->net_seq_idx);
 		if (relayd) {
+			const bool batch = relayd_supports_index_batch(
+					&relayd->control_sock);
+
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
-			ret = relayd_send_index(&relayd->control_sock, element,
-				stream->relayd_stream_id, stream->next_net_seq_num - 1);
+			if (batch) {
+				/*
+				 * Sent by the data thread once it is done with
+				 * its current pass on the streams.
+				 */
+				ret = relayd_index_batch_add(&relayd->control_sock,
+						&relayd->index_batch, element,
+						stream->relayd_stream_id,
+						stream->next_net_seq_num - 1);
+			} else {
+				ret = relayd_send_index(&relayd->control_sock,
+						element, stream->relayd_stream_id,
+						stream->next_net_seq_num - 1);
+			}
 			if (ret < 0) {
 				/*
 				 * Communication error with lttng-relayd,
@@ -379,6 +396,13 @@ int consumer_stream_write_index(struct lttng_consumer_stream *stream,
 				 */
 				ERR("Relayd send index failed. Cleaning up relayd %" PRIu64 ".", relayd->net_seq_idx);
 				lttng_consumer_cleanup_relayd(relayd);
+				if (batch) {
+					/*
+					 * Replies to the batched indexes can't
+					 * be matched anymore.
+					 */
+					(void) relayd_close(&relayd->control_sock);
+				}
 				ret = -1;
 			}
 			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
@@ -403,6 +427,44 @@ error:
 	return ret;
 }
 
+/*
+ * Send the indexes of a stream's relayd that are still batched without waiting
+ * for the data thread to do so.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int consumer_stream_flush_indexes(struct lttng_consumer_stream *stream)
+{
+	int ret = 0;
+	struct consumer_relayd_sock_pair *relayd;
+
+	assert(stream);
+
+	if (stream->net_seq_idx == (uint64_t) -1ULL) {
+		goto end;
+	}
+
+	rcu_read_lock();
+	relayd = consumer_find_relayd(stream->net_seq_idx);
+	if (relayd) {
+		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		ret = relayd_index_batch_flush(&relayd->control_sock,
+				&relayd->index_batch);
+		if (ret < 0) {
+			ERR("Relayd send indexes failed. Cleaning up relayd %" PRIu64 ".",
+					relayd->net_seq_idx);
+			lttng_consumer_cleanup_relayd(relayd);
+			/* Replies to the batched indexes can't be matched anymore. */
+			(void) relayd_close(&relayd->control_sock);
+			ret = -1;
+		}
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	}
+	rcu_read_unlock();
+end:
+	return ret;
+}
+
 /*
  * Actually do the metadata sync using the given metadata stream.
  *
@@ -583,6 +645,7 @@ int consumer_stream_create_output_files(struct lttng_consumer_stream *stream,
 	}
 
 	if (stream->out_fd >= 0) {
+		consumer_io_uring_drain_stream(stream);
 		ret = close(stream->out_fd);
 		if (ret < 0) {
 			PERROR("Failed to close stream file \"%s\"",
@@ -74,6 +74,11 @@ void consumer_stream_destroy_buffers(struct lttng_consumer_stream *stream);
 int consumer_stream_write_index(struct lttng_consumer_stream *stream,
 		struct ctf_packet_index *index);
 
+/*
+ * Send the indexes batched for the relayd of a specific stream.
+ */
+int consumer_stream_flush_indexes(struct lttng_consumer_stream *stream);
+
 int consumer_stream_sync_metadata(struct lttng_consumer_local_data *ctx,
 		uint64_t session_id);
 
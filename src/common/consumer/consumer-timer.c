@@ -24,6 +24,7 @@
 #include <bin/lttng-consumerd/health-consumerd.h>
 #include <common/common.h>
 #include <common/compat/endian.h>
+#include <common/compat/time.h>
 #include <common/kernel-ctl/kernel-ctl.h>
 #include <common/kernel-consumer/kernel-consumer.h>
 #include <common/consumer/consumer-stream.h>
@@ -142,6 +143,11 @@ static int send_empty_index(struct lttng_consumer_stream *stream, uint64_t ts,
 	if (ret < 0) {
 		goto error;
 	}
+	/* Live beacons are not delayed until the data thread's next pass. */
+	ret = consumer_stream_flush_indexes(stream);
+	if (ret < 0) {
+		goto error;
+	}
 
 error:
 	return ret;
@@ -630,16 +636,114 @@ int consumer_signal_init(void)
 	return 0;
 }
 
+/*
+ * Sample the positions of a stream and publish its usage for the monitor
+ * timer.
+ *
+ * Called with the stream lock held.
+ */
+int consumer_timer_monitor_sample_stream(struct lttng_consumer_stream *stream)
+{
+	int ret;
+	unsigned long produced, consumed;
+	sample_positions_cb sample;
+	get_consumed_cb get_consumed;
+	get_produced_cb get_produced;
+
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		sample = lttng_kconsumer_sample_snapshot_positions;
+		get_consumed = lttng_kconsumer_get_consumed_snapshot;
+		get_produced = lttng_kconsumer_get_produced_snapshot;
+		break;
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		sample = lttng_ustconsumer_sample_snapshot_positions;
+		get_consumed = lttng_ustconsumer_get_consumed_snapshot;
+		get_produced = lttng_ustconsumer_get_produced_snapshot;
+		break;
+	default:
+		abort();
+	}
+
+	uatomic_set(&stream->monitor_sample.sample_requested, 0);
+
+	ret = sample(stream);
+	if (ret) {
+		ERR("Failed to take buffer position snapshot in monitor timer (ret = %d)", ret);
+		goto end;
+	}
+	ret = get_consumed(stream, &consumed);
+	if (ret) {
+		ERR("Failed to get buffer consumed position in monitor timer");
+		goto end;
+	}
+	ret = get_produced(stream, &produced);
+	if (ret) {
+		ERR("Failed to get buffer produced position in monitor timer");
+		goto end;
+	}
+
+	/* Only writer: the stream lock is held. */
+	CMM_STORE_SHARED(stream->monitor_sample.seq, stream->monitor_sample.seq + 1);
+	cmm_smp_wmb();
+	stream->monitor_sample.usage = produced - consumed;
+	/*
+	 * We don't use consumed here for 2 reasons:
+	 *  - output_written takes into account the padding written in the
+	 *    tracefiles when we stop the session;
+	 *  - the consumed position is not the accurate representation of what
+	 *    was extracted from a buffer in overwrite mode.
+	 */
+	stream->monitor_sample.output_written = stream->output_written;
+	stream->monitor_sample.valid = true;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(stream->monitor_sample.seq, stream->monitor_sample.seq + 1);
+end:
+	return ret;
+}
+
+/*
+ * Read the usage last published for a stream without taking its lock.
+ *
+ * Returns false if no sample was published yet.
+ */
+static
+bool read_stream_monitor_sample(struct lttng_consumer_stream *stream,
+		uint64_t *usage, uint64_t *output_written)
+{
+	unsigned long seq;
+	bool valid;
+
+	do {
+		seq = CMM_LOAD_SHARED(stream->monitor_sample.seq);
+		cmm_smp_rmb();
+		valid = stream->monitor_sample.valid;
+		*usage = stream->monitor_sample.usage;
+		*output_written = stream->monitor_sample.output_written;
+		cmm_smp_rmb();
+	} while ((seq & 1) || seq != CMM_LOAD_SHARED(stream->monitor_sample.seq));
+
+	return valid;
+}
+
+/*
+ * Sample the usage of the streams of a channel.
+ *
+ * A stream is only sampled if its lock is free: when the data thread holds
+ * it, e.g. while writing a sub-buffer to the network, the usage last
+ * published for the stream is used and the data thread is asked to publish
+ * a fresh one once it releases the lock. The monitor timer thus never waits
+ * for the I/O of the data threads.
+ */
 static
 int sample_channel_positions(struct lttng_consumer_channel *channel,
-		uint64_t *_highest_use, uint64_t *_lowest_use, uint64_t *_total_consumed,
-		sample_positions_cb sample, get_consumed_cb get_consumed,
-		get_produced_cb get_produced)
+		uint64_t *_highest_use, uint64_t *_lowest_use, uint64_t *_total_consumed)
 {
 	int ret = 0;
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_stream *stream;
-	bool empty_channel = true;
+	bool sampled_channel = false;
 	uint64_t high = 0, low = UINT64_MAX;
 	struct lttng_ht *ht = consumer_data.stream_per_chan_id_ht;
 
@@ -651,62 +755,155 @@ int sample_channel_positions(struct lttng_consumer_channel *channel,
 			ht->hash_fct(&channel->key, lttng_ht_seed),
 			ht->match_fct, &channel->key,
 			&iter.iter, stream, node_channel_id.node) {
-		unsigned long produced, consumed, usage;
-
-		empty_channel = false;
+		uint64_t usage, output_written;
 
-		pthread_mutex_lock(&stream->lock);
 		if (cds_lfht_is_node_deleted(&stream->node.node)) {
-			goto next;
+			continue;
 		}
 
-		ret = sample(stream);
-		if (ret) {
-			ERR("Failed to take buffer position snapshot in monitor timer (ret = %d)", ret);
-			pthread_mutex_unlock(&stream->lock);
-			goto end;
-		}
-		ret = get_consumed(stream, &consumed);
-		if (ret) {
-			ERR("Failed to get buffer consumed position in monitor timer");
+		if (!pthread_mutex_trylock(&stream->lock)) {
+			if (!cds_lfht_is_node_deleted(&stream->node.node)) {
+				ret = consumer_timer_monitor_sample_stream(stream);
+			}
 			pthread_mutex_unlock(&stream->lock);
-			goto end;
+			if (ret) {
+				goto end;
+			}
+		} else {
+			DBG("Stream %" PRIu64 " is busy; using its last published usage",
+					stream->key);
+			uatomic_set(&stream->monitor_sample.sample_requested, 1);
 		}
-		ret = get_produced(stream, &produced);
-		if (ret) {
-			ERR("Failed to get buffer produced position in monitor timer");
-			pthread_mutex_unlock(&stream->lock);
-			goto end;
+
+		if (!read_stream_monitor_sample(stream, &usage, &output_written)) {
+			continue;
 		}
 
-		usage = produced - consumed;
+		sampled_channel = true;
 		high = (usage > high) ? usage : high;
 		low = (usage < low) ? usage : low;
-
-		/*
-		 * We don't use consumed here for 2 reasons:
-		 *  - output_written takes into account the padding written in the
-		 *    tracefiles when we stop the session;
-		 *  - the consumed position is not the accurate representation of what
-		 *    was extracted from a buffer in overwrite mode.
-		 */
-		*_total_consumed += stream->output_written;
-	next:
-		pthread_mutex_unlock(&stream->lock);
+		*_total_consumed += output_written;
 	}
 
 	*_highest_use = high;
 	*_lowest_use = low;
 end:
 	rcu_read_unlock();
-	if (empty_channel) {
+	if (!sampled_channel) {
 		ret = -1;
 	}
 	return ret;
 }
 
+/*
+ * Largest number of channel samples sent in a single write to the channel
+ * monitor pipe. Writes performed to the pipe are assumed to be atomic, which
+ * is only guaranteed for sizes <= PIPE_BUF.
+ */
+#define CHANNEL_MONITOR_BATCH_MAX \
+	(PIPE_BUF / sizeof(struct lttcomm_consumer_channel_monitor_msg))
+
+/*
+ * Samples of the monitor timers which expired together, sent at once by
+ * channel_monitor_batch_flush(). Only used by the timer thread.
+ */
+static struct {
+	struct lttcomm_consumer_channel_monitor_msg msgs[CHANNEL_MONITOR_BATCH_MAX];
+	unsigned int count;
+} channel_monitor_batch;
+
+/* Number of channel samples dropped since the launch of the consumer. */
+static uint64_t channel_monitor_dropped_samples;
+
+/*
+ * Minimal time, in seconds, between two warnings about dropped channel
+ * samples.
+ */
+#define CHANNEL_MONITOR_DROP_WARN_INTERVAL_S	10
+
+/* Rate limiting of the dropped samples warning, only used by the timer thread. */
+static struct {
+	/* CLOCK_MONOTONIC time of the last warning, 0 if none was emitted. */
+	time_t last_warn_s;
+	/* Number of dropped samples at the time of the last warning. */
+	uint64_t last_warn_dropped;
+} channel_monitor_drop_warn;
+
+/*
+ * Warn that channel samples were dropped, at most once every
+ * CHANNEL_MONITOR_DROP_WARN_INTERVAL_S: the session daemon's view of the
+ * buffer usage of the channels, and thus the notifications it emits, lags
+ * behind when it does not keep up with the samples.
+ */
+static
+void channel_monitor_warn_dropped(void)
+{
+	struct timespec now;
+	const uint64_t dropped = uatomic_read(&channel_monitor_dropped_samples);
+
+	if (lttng_clock_gettime(CLOCK_MONOTONIC, &now)) {
+		PERROR("clock_gettime");
+		return;
+	}
+	if (channel_monitor_drop_warn.last_warn_s &&
+			now.tv_sec - channel_monitor_drop_warn.last_warn_s <
+				CHANNEL_MONITOR_DROP_WARN_INTERVAL_S) {
+		return;
+	}
+
+	WARN("The session daemon is not keeping up with the channel monitor samples: %" PRIu64 " dropped since the last warning (%" PRIu64 " in total)",
+			dropped - channel_monitor_drop_warn.last_warn_dropped,
+			dropped);
+	/* A zero timestamp means no warning was emitted. */
+	channel_monitor_drop_warn.last_warn_s = now.tv_sec ? now.tv_sec : 1;
+	channel_monitor_drop_warn.last_warn_dropped = dropped;
+}
+
+/*
+ * Send the batched channel samples to the session daemon in a single write.
+ * When the pipe is full, the whole batch is dropped.
+ */
+static
+void channel_monitor_batch_flush(void)
+{
+	ssize_t ret;
+	const int channel_monitor_pipe =
+			consumer_timer_thread_get_channel_monitor_pipe();
+	const size_t len = channel_monitor_batch.count *
+			sizeof(channel_monitor_batch.msgs[0]);
+
+	if (!channel_monitor_batch.count) {
+		return;
+	}
+
+	assert(len <= PIPE_BUF);
+	do {
+		ret = write(channel_monitor_pipe, channel_monitor_batch.msgs, len);
+	} while (ret == -1 && errno == EINTR);
+	if (ret == -1) {
+		uatomic_add(&channel_monitor_dropped_samples,
+				channel_monitor_batch.count);
+		if (errno == EAGAIN) {
+			/* Not an error, the samples are merely dropped. */
+			DBG("Channel monitor pipe is full; dropping %u samples (%" PRIu64 " dropped in total)",
+					channel_monitor_batch.count,
+					uatomic_read(&channel_monitor_dropped_samples));
+			channel_monitor_warn_dropped();
+		} else {
+			PERROR("write to the channel monitor pipe");
+		}
+	} else {
+		DBG("Sent %u channel monitoring samples",
+				channel_monitor_batch.count);
+	}
+	channel_monitor_batch.count = 0;
+}
+
 /*
  * Execute action on a monitor timer.
+ *
+ * The channel's sample is added to the current batch, which must not be
+ * full.
  */
 static
 void monitor_timer(struct lttng_consumer_channel *channel)
@@ -714,12 +911,7 @@ void monitor_timer(struct lttng_consumer_channel *channel)
 	int ret;
 	int channel_monitor_pipe =
 			consumer_timer_thread_get_channel_monitor_pipe();
-	struct lttcomm_consumer_channel_monitor_msg msg = {
-		.key = channel->key,
-	};
-	sample_positions_cb sample;
-	get_consumed_cb get_consumed;
-	get_produced_cb get_produced;
+	struct lttcomm_consumer_channel_monitor_msg *msg;
 	uint64_t lowest = 0, highest = 0, total_consumed = 0;
 
 	assert(channel);
@@ -728,55 +920,57 @@ void monitor_timer(struct lttng_consumer_channel *channel)
 		return;
 	}
 
-	switch (consumer_data.type) {
-	case LTTNG_CONSUMER_KERNEL:
-		sample = lttng_kconsumer_sample_snapshot_positions;
-		get_consumed = lttng_kconsumer_get_consumed_snapshot;
-		get_produced = lttng_kconsumer_get_produced_snapshot;
-		break;
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
-		sample = lttng_ustconsumer_sample_snapshot_positions;
-		get_consumed = lttng_ustconsumer_get_consumed_snapshot;
-		get_produced = lttng_ustconsumer_get_produced_snapshot;
-		break;
-	default:
-		abort();
-	}
-
 	ret = sample_channel_positions(channel, &highest, &lowest,
-			&total_consumed, sample, get_consumed, get_produced);
+			&total_consumed);
 	if (ret) {
 		return;
 	}
-	msg.highest = highest;
-	msg.lowest = lowest;
-	msg.total_consumed = total_consumed;
 
-	/*
-	 * Writes performed here are assumed to be atomic which is only
-	 * guaranteed for sizes < than PIPE_BUF.
-	 */
-	assert(sizeof(msg) <= PIPE_BUF);
+	assert(channel_monitor_batch.count < CHANNEL_MONITOR_BATCH_MAX);
+	msg = &channel_monitor_batch.msgs[channel_monitor_batch.count++];
+	msg->key = channel->key;
+	msg->highest = highest;
+	msg->lowest = lowest;
+	msg->total_consumed = total_consumed;
+	DBG("Batched channel monitoring sample for channel key %" PRIu64
+			", (highest = %" PRIu64 ", lowest = %"PRIu64")",
+			channel->key, highest, lowest);
+}
 
-	do {
-		ret = write(channel_monitor_pipe, &msg, sizeof(msg));
-	} while (ret == -1 && errno == EINTR);
-	if (ret == -1) {
-		if (errno == EAGAIN) {
-			/* Not an error, the sample is merely dropped. */
-			DBG("Channel monitor pipe is full; dropping sample for channel key = %"PRIu64,
-					channel->key);
-		} else {
-			PERROR("write to the channel monitor pipe");
+/*
+ * Sample the channels of which the monitor timer expired while the timer
+ * thread was busy, so that their samples are sent with the current batch.
+ * Stops once the batch is full to let the other signals be handled.
+ */
+static
+void monitor_timer_drain_pending(void)
+{
+	int signr;
+	sigset_t mask;
+	siginfo_t info;
+	const struct timespec timeout = { 0, 0 };
+
+	sigemptyset(&mask);
+	sigaddset(&mask, LTTNG_CONSUMER_SIG_MONITOR);
+
+	while (channel_monitor_batch.count < CHANNEL_MONITOR_BATCH_MAX) {
+		signr = sigtimedwait(&mask, &info, &timeout);
+		if (signr == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* EAGAIN: no monitor timer expiration is pending. */
+			break;
 		}
-	} else {
-		DBG("Sent channel monitoring sample for channel key %" PRIu64
-				", (highest = %" PRIu64 ", lowest = %"PRIu64")",
-				channel->key, msg.highest, msg.lowest);
+		monitor_timer(info.si_value.sival_ptr);
 	}
 }
 
+uint64_t consumer_timer_thread_get_dropped_monitor_samples(void)
+{
+	return uatomic_read(&channel_monitor_dropped_samples);
+}
+
 int consumer_timer_thread_get_channel_monitor_pipe(void)
 {
 	return uatomic_read(&channel_monitor_pipe);
@@ -853,6 +1047,8 @@ void *consumer_timer_thread(void *data)
 
 			channel = info.si_value.sival_ptr;
 			monitor_timer(channel);
+			monitor_timer_drain_pending();
+			channel_monitor_batch_flush();
 		} else if (signr == LTTNG_CONSUMER_SIG_EXIT) {
 			assert(CMM_LOAD_SHARED(consumer_quit));
 			goto end;
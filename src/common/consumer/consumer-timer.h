@@ -54,6 +54,7 @@ void consumer_timer_live_stop(struct lttng_consumer_channel *channel);
 int consumer_timer_monitor_start(struct lttng_consumer_channel *channel,
 		unsigned int monitor_timer_interval_us);
 int consumer_timer_monitor_stop(struct lttng_consumer_channel *channel);
+int consumer_timer_monitor_sample_stream(struct lttng_consumer_stream *stream);
 void *consumer_timer_thread(void *data);
 int consumer_signal_init(void);
 
@@ -62,5 +63,6 @@ int consumer_flush_ust_index(struct lttng_consumer_stream *stream);
 
 int consumer_timer_thread_get_channel_monitor_pipe(void);
 int consumer_timer_thread_set_channel_monitor_pipe(int fd);
+uint64_t consumer_timer_thread_get_dropped_monitor_samples(void);
 
 #endif /* CONSUMER_TIMER_H */
@@ -19,6 +19,7 @@
 
 #define _LGPL_SOURCE
 #include <assert.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -47,6 +48,7 @@
 #include <common/consumer/consumer.h>
 #include <common/consumer/consumer-stream.h>
 #include <common/consumer/consumer-testpoint.h>
+#include <common/consumer/consumer-io-uring.h>
 #include <common/align.h>
 #include <common/consumer/consumer-metadata-cache.h>
 #include <common/trace-chunk.h>
@@ -56,7 +58,6 @@
 
 struct lttng_consumer_global_data consumer_data = {
 	.stream_count = 0,
-	.need_update = 1,
 	.type = LTTNG_CONSUMER_UNKNOWN,
 };
 
@@ -91,6 +92,13 @@ int consumer_quit;
 static struct lttng_ht *metadata_ht;
 static struct lttng_ht *data_ht;
 
+/*
+ * Write end of the session daemon's data pending pipe, on which the id of a
+ * session is written when one of its streams is drained. Set once by the
+ * SET_DATA_PENDING_PIPE command.
+ */
+static int data_pending_pipe = -1;
+
 /*
  * Notify a thread lttng pipe to poll back again. This usually means that some
  * global state has changed so we just send back the thread in a poll wait
@@ -105,6 +113,18 @@ static void notify_thread_lttng_pipe(struct lttng_pipe *pipe)
 	(void) lttng_pipe_write(pipe, &null_stream, sizeof(null_stream));
 }
 
+/*
+ * Notify all the data threads to poll back again.
+ */
+static void notify_data_threads(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_data_shards; i++) {
+		notify_thread_lttng_pipe(ctx->data_shards[i].data_pipe);
+	}
+}
+
 static void notify_health_quit_pipe(int *pipe)
 {
 	ssize_t ret;
@@ -327,8 +347,11 @@ static void free_relayd_rcu(struct rcu_head *head)
 	 */
 	(void) relayd_close(&relayd->control_sock);
 	(void) relayd_close(&relayd->data_sock);
+	relayd_index_batch_fini(&relayd->index_batch);
 
 	pthread_mutex_destroy(&relayd->ctrl_sock_mutex);
+	pthread_mutex_destroy(&relayd->data_sock_mutex);
+	pthread_mutex_destroy(&relayd->data_zerocopy.reap_lock);
 	free(relayd);
 }
 
@@ -508,10 +531,65 @@ void lttng_consumer_cleanup_relayd(struct consumer_relayd_sock_pair *relayd)
 	 * memory barrier ordering the updates of the end point status from the
 	 * read of this status which happens AFTER receiving this notify.
 	 */
-	notify_thread_lttng_pipe(relayd->ctx->consumer_data_pipe);
+	notify_data_threads(relayd->ctx);
 	notify_thread_lttng_pipe(relayd->ctx->consumer_metadata_pipe);
 }
 
+/*
+ * Send the indexes batched for a relayd and wait until all of them are
+ * acknowledged.
+ *
+ * This MUST be called with the relayd's ctrl_sock_mutex held before any
+ * command expecting a reply is sent on the control socket. Otherwise, the
+ * command would be processed by the relayd before the indexes that precede
+ * it and its reply would be confused with those of the batched indexes.
+ *
+ * On error, the relayd is cleaned up and its control socket is closed so that
+ * the caller's next command fails.
+ */
+void consumer_relayd_sync_indexes(struct consumer_relayd_sock_pair *relayd)
+{
+	int ret;
+
+	assert(relayd);
+
+	ret = relayd_index_batch_sync(&relayd->control_sock,
+			&relayd->index_batch);
+	if (ret < 0) {
+		ERR("Relayd batched indexes synchronization failed. Cleaning up relayd %" PRIu64 ".",
+				relayd->net_seq_idx);
+		lttng_consumer_cleanup_relayd(relayd);
+		(void) relayd_close(&relayd->control_sock);
+	}
+}
+
+/*
+ * Send the indexes batched for every relayd without waiting for their
+ * acknowledgement.
+ */
+void consumer_flush_relayd_indexes(void)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+	struct consumer_relayd_sock_pair *relayd;
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(consumer_data.relayd_ht->ht, &iter.iter,
+			relayd, node.node) {
+		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		ret = relayd_index_batch_flush(&relayd->control_sock,
+				&relayd->index_batch);
+		if (ret < 0) {
+			ERR("Relayd batched indexes flush failed. Cleaning up relayd %" PRIu64 ".",
+					relayd->net_seq_idx);
+			lttng_consumer_cleanup_relayd(relayd);
+			(void) relayd_close(&relayd->control_sock);
+		}
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	}
+	rcu_read_unlock();
+}
+
 /*
  * Flag a relayd socket pair for destruction. Destroy it if the refcount
  * reaches zero.
@@ -700,7 +778,6 @@ void consumer_add_data_stream(struct lttng_consumer_stream *stream)
 
 	/* Update consumer data once the node is inserted. */
 	consumer_data.stream_count++;
-	consumer_data.need_update = 1;
 
 	rcu_read_unlock();
 	pthread_mutex_unlock(&stream->lock);
@@ -764,6 +841,9 @@ static struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
 	obj->data_sock.sock.fd = -1;
 	lttng_ht_node_init_u64(&obj->node, obj->net_seq_idx);
 	pthread_mutex_init(&obj->ctrl_sock_mutex, NULL);
+	pthread_mutex_init(&obj->data_sock_mutex, NULL);
+	pthread_mutex_init(&obj->data_zerocopy.reap_lock, NULL);
+	relayd_index_batch_init(&obj->index_batch);
 
 error:
 	return obj;
@@ -819,6 +899,7 @@ int consumer_send_relayd_stream(struct lttng_consumer_stream *stream,
 	if (relayd != NULL) {
 		/* Add stream on the relayd */
 		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		consumer_relayd_sync_indexes(relayd);
 		ret = relayd_add_stream(&relayd->control_sock, stream->name,
 				path, &stream->relayd_stream_id,
 				stream->chan->tracefile_size,
@@ -866,6 +947,7 @@ int consumer_send_relayd_streams_sent(uint64_t net_seq_idx)
 	if (relayd != NULL) {
 		/* Add stream on the relayd */
 		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		consumer_relayd_sync_indexes(relayd);
 		ret = relayd_streams_sent(&relayd->control_sock);
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 		if (ret < 0) {
@@ -904,6 +986,31 @@ void close_relayd_stream(struct lttng_consumer_stream *stream)
 	rcu_read_unlock();
 }
 
+/*
+ * Set the header of the next data packet of a stream sent to the relayd.
+ */
+static void init_relayd_data_hdr(struct lttng_consumer_stream *stream,
+		size_t data_size, unsigned long padding,
+		struct lttcomm_relayd_data_hdr *data_hdr)
+{
+	memset(data_hdr, 0, sizeof(*data_hdr));
+
+	/* Set header with stream information */
+	data_hdr->stream_id = htobe64(stream->relayd_stream_id);
+	data_hdr->data_size = htobe32(data_size);
+	data_hdr->padding_size = htobe32(padding);
+
+	/*
+	 * Note that net_seq_num below is assigned with the *current* value of
+	 * next_net_seq_num and only after that the next_net_seq_num will be
+	 * increment. This is why when issuing a command on the relayd using
+	 * this next value, 1 should always be substracted in order to compare
+	 * the last seen sequence number on the relayd side to the last sent.
+	 */
+	data_hdr->net_seq_num = htobe64(stream->next_net_seq_num);
+	/* Other fields are zeroed previously */
+}
+
 /*
  * Handle stream for relayd transmission if the stream applies for network
  * streaming where the net sequence index is set.
@@ -921,9 +1028,6 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 	assert(stream);
 	assert(relayd);
 
-	/* Reset data header */
-	memset(&data_hdr, 0, sizeof(data_hdr));
-
 	if (stream->metadata_flag) {
 		/* Caller MUST acquire the relayd control socket lock */
 		ret = relayd_send_metadata(&relayd->control_sock, data_size);
@@ -934,20 +1038,7 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 		/* Metadata are always sent on the control socket. */
 		outfd = relayd->control_sock.sock.fd;
 	} else {
-		/* Set header with stream information */
-		data_hdr.stream_id = htobe64(stream->relayd_stream_id);
-		data_hdr.data_size = htobe32(data_size);
-		data_hdr.padding_size = htobe32(padding);
-
-		/*
-		 * Note that net_seq_num below is assigned with the *current* value of
-		 * next_net_seq_num and only after that the next_net_seq_num will be
-		 * increment. This is why when issuing a command on the relayd using
-		 * this next value, 1 should always be substracted in order to compare
-		 * the last seen sequence number on the relayd side to the last sent.
-		 */
-		data_hdr.net_seq_num = htobe64(stream->next_net_seq_num);
-		/* Other fields are zeroed previously */
+		init_relayd_data_hdr(stream, data_size, padding, &data_hdr);
 
 		ret = relayd_send_data_hdr(&relayd->data_sock, &data_hdr,
 				sizeof(data_hdr));
@@ -1202,70 +1293,6 @@ int consumer_add_channel(struct lttng_consumer_channel *channel,
 	return 0;
 }
 
-/*
- * Allocate the pollfd structure and the local view of the out fds to avoid
- * doing a lookup in the linked list and concurrency issues when writing is
- * needed. Called with consumer_data.lock held.
- *
- * Returns the number of fds in the structures.
- */
-static int update_poll_array(struct lttng_consumer_local_data *ctx,
-		struct pollfd **pollfd, struct lttng_consumer_stream **local_stream,
-		struct lttng_ht *ht, int *nb_inactive_fd)
-{
-	int i = 0;
-	struct lttng_ht_iter iter;
-	struct lttng_consumer_stream *stream;
-
-	assert(ctx);
-	assert(ht);
-	assert(pollfd);
-	assert(local_stream);
-
-	DBG("Updating poll fd array");
-	*nb_inactive_fd = 0;
-	rcu_read_lock();
-	cds_lfht_for_each_entry(ht->ht, &iter.iter, stream, node.node) {
-		/*
-		 * Only active streams with an active end point can be added to the
-		 * poll set and local stream storage of the thread.
-		 *
-		 * There is a potential race here for endpoint_status to be updated
-		 * just after the check. However, this is OK since the stream(s) will
-		 * be deleted once the thread is notified that the end point state has
-		 * changed where this function will be called back again.
-		 *
-		 * We track the number of inactive FDs because they still need to be
-		 * closed by the polling thread after a wakeup on the data_pipe or
-		 * metadata_pipe.
-		 */
-		if (stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
-			(*nb_inactive_fd)++;
-			continue;
-		}
-		/*
-		 * This clobbers way too much the debug output. Uncomment that if you
-		 * need it for debugging purposes.
-		 */
-		(*pollfd)[i].fd = stream->wait_fd;
-		(*pollfd)[i].events = POLLIN | POLLPRI;
-		local_stream[i] = stream;
-		i++;
-	}
-	rcu_read_unlock();
-
-	/*
-	 * Insert the consumer_data_pipe at the end of the array and don't
-	 * increment i so nb_fd is the number of real FD.
-	 */
-	(*pollfd)[i].fd = lttng_pipe_get_readfd(ctx->consumer_data_pipe);
-	(*pollfd)[i].events = POLLIN | POLLPRI;
-
-	(*pollfd)[i + 1].fd = lttng_pipe_get_readfd(ctx->consumer_wakeup_pipe);
-	(*pollfd)[i + 1].events = POLLIN | POLLPRI;
-	return i;
-}
-
 /*
  * Poll on the should_quit pipe and the command socket return -1 on
  * error, 1 if should exit, 0 if data is available on the command socket
@@ -1445,10 +1472,91 @@ void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
 	}
 }
 
+static void destroy_data_shards(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	if (!ctx->data_shards) {
+		return;
+	}
+
+	for (i = 0; i < ctx->nb_data_shards; i++) {
+		lttng_pipe_destroy(ctx->data_shards[i].data_pipe);
+		lttng_pipe_destroy(ctx->data_shards[i].wakeup_pipe);
+		consumer_io_uring_destroy(ctx->data_shards[i].io_uring);
+	}
+	free(ctx->data_shards);
+	ctx->data_shards = NULL;
+	ctx->nb_data_shards = 0;
+}
+
+/*
+ * Allocate the data shards of a context along with their pipes.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int create_data_shards(struct lttng_consumer_local_data *ctx,
+		unsigned int nb_data_shards)
+{
+	int ret = -1;
+	unsigned int i;
+
+	assert(nb_data_shards > 0);
+
+	ctx->data_shards = zmalloc(sizeof(*ctx->data_shards) * nb_data_shards);
+	if (!ctx->data_shards) {
+		PERROR("zmalloc data shards");
+		goto end;
+	}
+	ctx->nb_data_shards = nb_data_shards;
+	ctx->nb_data_threads_running = nb_data_shards;
+
+	for (i = 0; i < nb_data_shards; i++) {
+		struct lttng_consumer_data_shard *shard = &ctx->data_shards[i];
+
+		shard->id = i;
+		shard->ctx = ctx;
+		shard->data_pipe = lttng_pipe_open(0);
+		if (!shard->data_pipe) {
+			goto error;
+		}
+		shard->wakeup_pipe = lttng_pipe_open(0);
+		if (!shard->wakeup_pipe) {
+			goto error;
+		}
+	}
+
+	ret = 0;
+end:
+	return ret;
+error:
+	destroy_data_shards(ctx);
+	goto end;
+}
+
+/*
+ * Return the data shard owning the data streams of a channel.
+ *
+ * The streams of a channel are consumed with the channel lock held. Hence,
+ * spreading them across data threads would only make those threads contend
+ * on that lock. Channels are placed in a shard according to their key, so
+ * a single channel (e.g. a per-CPU kernel channel) is always drained by one
+ * data thread, whatever the number of threads.
+ */
+struct lttng_consumer_data_shard *consumer_get_data_shard(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_channel *channel)
+{
+	assert(ctx);
+	assert(channel);
+
+	return &ctx->data_shards[channel->key % ctx->nb_data_shards];
+}
+
 /*
  * Initialise the necessary environnement :
  * - create a new context
- * - create the poll_pipe
+ * - create the data and wakeup pipes of the nb_data_shards data shards
  * - create the should_quit pipe (for signal handler)
  * - create the thread pipe (for splice)
  *
@@ -1465,7 +1573,8 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 			struct lttng_consumer_local_data *ctx),
 		int (*recv_channel)(struct lttng_consumer_channel *channel),
 		int (*recv_stream)(struct lttng_consumer_stream *stream),
-		int (*update_stream)(uint64_t stream_key, uint32_t state))
+		int (*update_stream)(uint64_t stream_key, uint32_t state),
+		unsigned int nb_data_shards)
 {
 	int ret;
 	struct lttng_consumer_local_data *ctx;
@@ -1488,15 +1597,11 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 	ctx->on_recv_channel = recv_channel;
 	ctx->on_recv_stream = recv_stream;
 	ctx->on_update_stream = update_stream;
+	ctx->nb_snapshot_threads = DEFAULT_CONSUMERD_SNAPSHOT_THREADS;
 
-	ctx->consumer_data_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_data_pipe) {
-		goto error_poll_pipe;
-	}
-
-	ctx->consumer_wakeup_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_wakeup_pipe) {
-		goto error_wakeup_pipe;
+	ret = create_data_shards(ctx, nb_data_shards);
+	if (ret < 0) {
+		goto error_data_shards;
 	}
 
 	ret = pipe(ctx->consumer_should_quit);
@@ -1525,10 +1630,8 @@ error_metadata_pipe:
 error_channel_pipe:
 	utils_close_pipe(ctx->consumer_should_quit);
 error_quit_pipe:
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
-error_wakeup_pipe:
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
-error_poll_pipe:
+	destroy_data_shards(ctx);
+error_data_shards:
 	free(ctx);
 error:
 	return NULL;
@@ -1610,9 +1713,8 @@ void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 		PERROR("close");
 	}
 	utils_close_pipe(ctx->consumer_channel_pipe);
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
+	destroy_data_shards(ctx);
 	lttng_pipe_destroy(ctx->consumer_metadata_pipe);
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
 	utils_close_pipe(ctx->consumer_should_quit);
 
 	unlink(ctx->consumer_command_sock_path);
@@ -1657,6 +1759,45 @@ end:
 	return (int) ret;
 }
 
+/*
+ * Send a sub-buffer of a stream to the relayd, along with its header and, for
+ * metadata, its stream id, with a single sendmsg call.
+ *
+ * The caller MUST acquire the relayd control socket lock for a metadata stream
+ * and the data socket lock otherwise. If 'zerocopy_send' is marked pending, the
+ * caller MUST reap it with relayd_zerocopy_reap() before releasing 'buf' or
+ * 'zerocopy_send', which holds the header of the packet.
+ *
+ * Return len on success or else -1 with errno set, like lttng_write().
+ */
+static ssize_t write_relayd_packet(struct lttng_consumer_stream *stream,
+		struct consumer_relayd_sock_pair *relayd, const char *buf,
+		unsigned long len, unsigned long padding,
+		struct relayd_zerocopy_send *zerocopy_send)
+{
+	int ret;
+
+	if (stream->metadata_flag) {
+		ret = relayd_send_metadata_packet(&relayd->control_sock,
+				stream->relayd_stream_id, padding, buf, len);
+	} else {
+		struct lttcomm_relayd_data_hdr data_hdr;
+
+		init_relayd_data_hdr(stream, len, padding, &data_hdr);
+		ret = relayd_send_data(&relayd->data_sock, &data_hdr, buf, len,
+				&relayd->data_zerocopy, zerocopy_send);
+		if (!ret) {
+			++stream->next_net_seq_num;
+		}
+	}
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return len;
+}
+
 /*
  * Mmap the ring buffer, read it and write the data to the tracefile. This is a
  * core function for writing trace buffers to either the local filesystem or
@@ -1682,6 +1823,8 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	int outfd = stream->out_fd;
 	struct consumer_relayd_sock_pair *relayd = NULL;
 	unsigned int relayd_hang_up = 0;
+	bool data_sock_locked = false;
+	struct relayd_zerocopy_send zerocopy_send = { .pending = false };
 
 	/* RCU lock for the relayd pointer */
 	rcu_read_lock();
@@ -1729,8 +1872,6 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 
 	/* Handle stream on the relayd if the output is on the network */
 	if (relayd) {
-		unsigned long netlen = len;
-
 		/*
 		 * Lock the control socket for the complete duration of the function
 		 * since from this point on we will use the socket.
@@ -1739,6 +1880,7 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 			/* Metadata requires the control socket. */
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
 			if (stream->reset_metadata_flag) {
+				consumer_relayd_sync_indexes(relayd);
 				ret = relayd_reset_metadata(&relayd->control_sock,
 						stream->relayd_stream_id,
 						stream->metadata_version);
@@ -1748,24 +1890,13 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 				}
 				stream->reset_metadata_flag = 0;
 			}
-			netlen += sizeof(struct lttcomm_relayd_metadata_payload);
-		}
-
-		ret = write_relayd_stream_header(stream, netlen, padding, relayd);
-		if (ret < 0) {
-			relayd_hang_up = 1;
-			goto write_error;
-		}
-		/* Use the returned socket. */
-		outfd = ret;
-
-		/* Write metadata stream id before payload */
-		if (stream->metadata_flag) {
-			ret = write_relayd_metadata_id(outfd, stream, padding);
-			if (ret < 0) {
-				relayd_hang_up = 1;
-				goto write_error;
-			}
+		} else {
+			/*
+			 * The packet's sequence number must match its order on
+			 * the data socket shared with other data threads.
+			 */
+			pthread_mutex_lock(&relayd->data_sock_mutex);
+			data_sock_locked = true;
 		}
 	} else {
 		/* No streaming, we have to set the len with the full padding */
@@ -1803,7 +1934,14 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	 * This call guarantee that len or less is returned. It's impossible to
 	 * receive a ret value that is bigger than len.
 	 */
-	ret = lttng_write(outfd, mmap_base + mmap_offset, len);
+	if (relayd) {
+		ret = write_relayd_packet(stream, relayd, mmap_base + mmap_offset,
+				len, padding, &zerocopy_send);
+	} else if (stream->io_uring) {
+		ret = consumer_io_uring_write(stream, mmap_base + mmap_offset, len);
+	} else {
+		ret = lttng_write(outfd, mmap_base + mmap_offset, len);
+	}
 	DBG("Consumer mmap write() ret %zd (len %lu)", ret, len);
 	if (ret < 0 || ((size_t) ret != len)) {
 		/*
@@ -1833,7 +1971,10 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	stream->output_written += ret;
 
 	/* This call is useless on a socket so better save a syscall. */
-	if (!relayd) {
+	if (!relayd && stream->io_uring) {
+		/* The writeback hints were submitted along with the write. */
+		stream->out_fd_offset += len;
+	} else if (!relayd) {
 		/* This won't block, but will start writeout asynchronously */
 		lttng_sync_file_range(outfd, stream->out_fd_offset, len,
 				SYNC_FILE_RANGE_WRITE);
@@ -1856,6 +1997,28 @@ end:
 	if (relayd && stream->metadata_flag) {
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 	}
+	if (data_sock_locked) {
+		pthread_mutex_unlock(&relayd->data_sock_mutex);
+	}
+
+	/*
+	 * Wait for the kernel to release the pages of a zero-copy send once the
+	 * other data threads can use the data socket again. The sub-buffer is
+	 * only returned to the ring buffer by the caller, after this, and the
+	 * socket is kept open by the RCU read-side lock.
+	 */
+	if (zerocopy_send.pending) {
+		int reap_ret;
+
+		reap_ret = relayd_zerocopy_reap(&relayd->data_sock,
+				&relayd->data_zerocopy, &zerocopy_send);
+		if (reap_ret < 0) {
+			DBG("Consumer failed to reap relayd zero-copy send (ret: %d)",
+					reap_ret);
+			lttng_consumer_cleanup_relayd(relayd);
+			ret = reap_ret;
+		}
+	}
 
 	rcu_read_unlock();
 	return ret;
@@ -1883,6 +2046,7 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 	struct consumer_relayd_sock_pair *relayd = NULL;
 	int *splice_pipe;
 	unsigned int relayd_hang_up = 0;
+	bool data_sock_locked = false;
 
 	switch (consumer_data.type) {
 	case LTTNG_CONSUMER_KERNEL:
@@ -1921,6 +2085,7 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
 
 			if (stream->reset_metadata_flag) {
+				consumer_relayd_sync_indexes(relayd);
 				ret = relayd_reset_metadata(&relayd->control_sock,
 						stream->relayd_stream_id,
 						stream->metadata_version);
@@ -1939,6 +2104,13 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			}
 
 			total_len += sizeof(struct lttcomm_relayd_metadata_payload);
+		} else {
+			/*
+			 * Other data threads may send packets on the data socket
+			 * between the header and the payload.
+			 */
+			pthread_mutex_lock(&relayd->data_sock_mutex);
+			data_sock_locked = true;
 		}
 
 		ret = write_relayd_stream_header(stream, total_len, padding, relayd);
@@ -2077,6 +2249,9 @@ end:
 	if (relayd && stream->metadata_flag) {
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 	}
+	if (data_sock_locked) {
+		pthread_mutex_unlock(&relayd->data_sock_mutex);
+	}
 
 	rcu_read_unlock();
 	return written;
@@ -2344,28 +2519,6 @@ void consumer_add_metadata_stream(struct lttng_consumer_stream *stream)
 	pthread_mutex_unlock(&consumer_data.lock);
 }
 
-/*
- * Delete data stream that are flagged for deletion (endpoint_status).
- */
-static void validate_endpoint_status_data_stream(void)
-{
-	struct lttng_ht_iter iter;
-	struct lttng_consumer_stream *stream;
-
-	DBG("Consumer delete flagged data stream");
-
-	rcu_read_lock();
-	cds_lfht_for_each_entry(data_ht->ht, &iter.iter, stream, node.node) {
-		/* Validate delete flag of the stream */
-		if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
-			continue;
-		}
-		/* Delete it right now */
-		consumer_del_stream(stream, data_ht);
-	}
-	rcu_read_unlock();
-}
-
 /*
  * Delete metadata stream that are flagged for deletion (endpoint_status).
  */
@@ -2613,115 +2766,370 @@ error_testpoint:
 }
 
 /*
- * This thread polls the fds in the set to consume the data and write
- * it to tracefile if necessary.
+ * Data stream monitored by the data thread, indexed by its wait fd.
  */
-void *consumer_thread_data_poll(void *data)
-{
-	int num_rdy, num_hup, high_prio, ret, i, err = -1;
-	struct pollfd *pollfd = NULL;
-	/* local view of the streams */
-	struct lttng_consumer_stream **local_stream = NULL, *new_stream = NULL;
-	/* local view of consumer_data.fds_count */
-	int nb_fd = 0;
-	/* 2 for the consumer_data_pipe and wake up pipe */
-	const int nb_pipes_fd = 2;
-	/* Number of FDs with CONSUMER_ENDPOINT_INACTIVE but still open. */
-	int nb_inactive_fd = 0;
-	struct lttng_consumer_local_data *ctx = data;
-	ssize_t len;
+struct data_poll_entry {
+	struct lttng_consumer_stream *stream;
+	/* Events reported for the stream's wait fd during the current pass. */
+	uint32_t revents;
+	/* The stream's wait fd is part of the poll set. */
+	bool polled;
+	/* The stream is part of the current pass' ready list. */
+	bool queued;
+};
 
-	rcu_register_thread();
+/*
+ * Set of data streams monitored by the data thread.
+ *
+ * Streams are added to and removed from the poll set one at a time as they
+ * are received and destroyed by the data thread. Each pass only considers the
+ * streams that are reported ready by the poll set or that still have data to
+ * consume from a previous pass.
+ *
+ * Only accessed by the data thread.
+ */
+struct data_poll_set {
+	struct lttng_poll_event events;
+	/* Entries indexed by wait fd. */
+	struct data_poll_entry *entries;
+	unsigned int nb_entries;
+	/* Number of streams in the set, including the inactive ones. */
+	unsigned int nb_streams;
+	/* Wait fds of the streams to consider during the current pass. */
+	int *ready;
+	unsigned int nb_ready;
+	/*
+	 * Wait fds of the streams to consider during the next pass even if
+	 * no event is reported for them.
+	 */
+	int *pending;
+	unsigned int nb_pending;
+	/* Allocated length of the ready and pending arrays. */
+	unsigned int fds_len;
+};
 
-	health_register(health_consumerd, HEALTH_CONSUMERD_TYPE_DATA);
+static int data_poll_set_init(struct data_poll_set *set,
+		struct lttng_consumer_data_shard *shard)
+{
+	int ret;
 
-	if (testpoint(consumerd_thread_data)) {
-		goto error_testpoint;
-	}
+	memset(set, 0, sizeof(*set));
+	lttng_poll_init(&set->events);
 
-	health_code_update();
+	/* 2 for the shard's data pipe and wake up pipe */
+	ret = lttng_poll_create(&set->events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		ERR("Poll set creation failed");
+		goto end;
+	}
 
-	local_stream = zmalloc(sizeof(struct lttng_consumer_stream *));
-	if (local_stream == NULL) {
-		PERROR("local_stream malloc");
+	ret = lttng_poll_add(&set->events,
+			lttng_pipe_get_readfd(shard->data_pipe),
+			LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
 		goto end;
 	}
 
-	while (1) {
-		health_code_update();
+	ret = lttng_poll_add(&set->events,
+			lttng_pipe_get_readfd(shard->wakeup_pipe),
+			LPOLLIN | LPOLLPRI);
+end:
+	return ret;
+}
 
-		high_prio = 0;
-		num_hup = 0;
+static void data_poll_set_fini(struct data_poll_set *set)
+{
+	lttng_poll_clean(&set->events);
+	free(set->entries);
+	free(set->ready);
+	free(set->pending);
+}
 
-		/*
-		 * the fds set has been updated, we need to update our
-		 * local array as well
-		 */
-		pthread_mutex_lock(&consumer_data.lock);
-		if (consumer_data.need_update) {
-			free(pollfd);
-			pollfd = NULL;
-
-			free(local_stream);
-			local_stream = NULL;
-
-			/* Allocate for all fds */
-			pollfd = zmalloc((consumer_data.stream_count + nb_pipes_fd) * sizeof(struct pollfd));
-			if (pollfd == NULL) {
-				PERROR("pollfd malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
+/*
+ * Add a stream received by the data thread to the poll set.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int data_poll_set_add_stream(struct data_poll_set *set,
+		struct lttng_consumer_stream *stream)
+{
+	int ret;
+	const int fd = stream->wait_fd;
+	struct data_poll_entry *entry;
 
-			local_stream = zmalloc((consumer_data.stream_count + nb_pipes_fd) *
-					sizeof(struct lttng_consumer_stream *));
-			if (local_stream == NULL) {
-				PERROR("local_stream malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			ret = update_poll_array(ctx, &pollfd, local_stream,
-					data_ht, &nb_inactive_fd);
-			if (ret < 0) {
-				ERR("Error in allocating pollfd or local_outfds");
-				lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			nb_fd = ret;
-			consumer_data.need_update = 0;
-		}
-		pthread_mutex_unlock(&consumer_data.lock);
+	assert(fd >= 0);
 
-		/* No FDs and consumer_quit, consumer_cleanup the thread */
-		if (nb_fd == 0 && nb_inactive_fd == 0 &&
-				CMM_LOAD_SHARED(consumer_quit) == 1) {
+	if (fd >= set->nb_entries) {
+		const unsigned int new_nb_entries = max_t(unsigned int,
+				fd + 1, set->nb_entries * 2);
+		struct data_poll_entry *new_entries;
+
+		new_entries = realloc(set->entries,
+				new_nb_entries * sizeof(*new_entries));
+		if (!new_entries) {
+			PERROR("realloc data poll set entries");
+			ret = -1;
+			goto end;
+		}
+		memset(new_entries + set->nb_entries, 0,
+				(new_nb_entries - set->nb_entries) *
+				sizeof(*new_entries));
+		set->entries = new_entries;
+		set->nb_entries = new_nb_entries;
+	}
+
+	if (set->nb_streams + 1 > set->fds_len) {
+		const unsigned int new_fds_len = max_t(unsigned int,
+				16, set->fds_len * 2);
+		int *new_fds;
+
+		new_fds = realloc(set->ready, new_fds_len * sizeof(int));
+		if (!new_fds) {
+			PERROR("realloc data poll set ready fds");
+			ret = -1;
+			goto end;
+		}
+		set->ready = new_fds;
+
+		new_fds = realloc(set->pending, new_fds_len * sizeof(int));
+		if (!new_fds) {
+			PERROR("realloc data poll set pending fds");
+			ret = -1;
+			goto end;
+		}
+		set->pending = new_fds;
+		set->fds_len = new_fds_len;
+	}
+
+	entry = &set->entries[fd];
+	assert(!entry->stream);
+	memset(entry, 0, sizeof(*entry));
+
+	/*
+	 * Streams with an inactive end point are not polled; they are kept
+	 * until the thread is notified that the end point state has changed
+	 * and they are destroyed.
+	 */
+	if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
+		ret = lttng_poll_add(&set->events, fd, LPOLLIN | LPOLLPRI);
+		if (ret < 0) {
+			goto end;
+		}
+		entry->polled = true;
+	}
+
+	entry->stream = stream;
+	set->nb_streams++;
+	DBG("Data stream %d added to poll set (%u streams)", fd,
+			set->nb_streams);
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Stop polling a stream's wait fd without removing it from the set.
+ */
+static void data_poll_set_unpoll_stream(struct data_poll_set *set,
+		struct data_poll_entry *entry)
+{
+	if (!entry->polled) {
+		return;
+	}
+
+	(void) lttng_poll_del(&set->events, entry->stream->wait_fd);
+	entry->polled = false;
+}
+
+/*
+ * Remove a stream from the poll set and destroy it. This must be done before
+ * the stream's wait fd is closed.
+ */
+static void data_poll_set_del_stream(struct data_poll_set *set,
+		struct lttng_consumer_stream *stream)
+{
+	struct data_poll_entry *entry = &set->entries[stream->wait_fd];
+
+	assert(entry->stream == stream);
+
+	data_poll_set_unpoll_stream(set, entry);
+	entry->stream = NULL;
+	assert(set->nb_streams > 0);
+	set->nb_streams--;
+
+	consumer_del_stream(stream, data_ht);
+}
+
+/*
+ * Add a stream to the list of streams considered during the current pass.
+ */
+static void data_poll_set_queue(struct data_poll_set *set, int fd,
+		uint32_t revents)
+{
+	struct data_poll_entry *entry;
+
+	if (fd < 0 || fd >= set->nb_entries || !set->entries[fd].stream) {
+		/* Stale pending fd of a stream destroyed since. */
+		return;
+	}
+
+	entry = &set->entries[fd];
+	entry->revents |= revents;
+	if (!entry->queued) {
+		entry->queued = true;
+		set->ready[set->nb_ready++] = fd;
+	}
+}
+
+/*
+ * Prepare the list of streams considered during the current pass from the
+ * `nb_events` events reported by the poll set and the pending streams of the
+ * previous pass.
+ */
+static void data_poll_set_begin_pass(struct data_poll_set *set, int nb_events,
+		int data_pipe_fd, int wakeup_pipe_fd)
+{
+	int i;
+	unsigned int j;
+
+	for (i = 0; i < nb_events; i++) {
+		const int fd = LTTNG_POLL_GETFD(&set->events, i);
+
+		if (fd == data_pipe_fd || fd == wakeup_pipe_fd) {
+			continue;
+		}
+		data_poll_set_queue(set, fd, LTTNG_POLL_GETEV(&set->events, i));
+	}
+
+	for (j = 0; j < set->nb_pending; j++) {
+		data_poll_set_queue(set, set->pending[j], 0);
+	}
+	set->nb_pending = 0;
+}
+
+/*
+ * Reset the current pass' ready list. The streams which still have data to
+ * consume, or which were flushed after a hang up, are kept for the next pass
+ * since no event is necessarily reported for them.
+ */
+static void data_poll_set_end_pass(struct data_poll_set *set)
+{
+	unsigned int i;
+
+	for (i = 0; i < set->nb_ready; i++) {
+		const int fd = set->ready[i];
+		struct data_poll_entry *entry = &set->entries[fd];
+
+		entry->revents = 0;
+		entry->queued = false;
+		if (entry->stream && entry->polled &&
+				(entry->stream->has_data ||
+				entry->stream->hangup_flush_done)) {
+			set->pending[set->nb_pending++] = fd;
+		}
+	}
+	set->nb_ready = 0;
+}
+
+/*
+ * Delete data stream that are flagged for deletion (endpoint_status).
+ */
+static void validate_endpoint_status_data_stream(struct data_poll_set *set)
+{
+	unsigned int fd;
+
+	DBG("Consumer delete flagged data stream");
+
+	for (fd = 0; fd < set->nb_entries; fd++) {
+		struct lttng_consumer_stream *stream = set->entries[fd].stream;
+
+		/* Validate delete flag of the stream */
+		if (!stream ||
+				stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
+			continue;
+		}
+		/* Delete it right now */
+		data_poll_set_del_stream(set, stream);
+	}
+}
+
+/*
+ * This thread polls the fds of the streams of its data shard to consume the
+ * data and write it to tracefile if necessary.
+ */
+void *consumer_thread_data_poll(void *data)
+{
+	int num_rdy, high_prio, ret, i, err = -1;
+	unsigned int j;
+	int data_pipe_fd, wakeup_pipe_fd;
+	struct lttng_consumer_stream *new_stream = NULL;
+	struct data_poll_set set;
+	struct lttng_consumer_data_shard *shard = data;
+	struct lttng_consumer_local_data *ctx = shard->ctx;
+	ssize_t len;
+
+	rcu_register_thread();
+
+	health_register(health_consumerd, HEALTH_CONSUMERD_TYPE_DATA);
+
+	if (testpoint(consumerd_thread_data)) {
+		goto error_testpoint;
+	}
+
+	health_code_update();
+
+	DBG("Data thread of shard %u started", shard->id);
+
+	data_pipe_fd = lttng_pipe_get_readfd(shard->data_pipe);
+	wakeup_pipe_fd = lttng_pipe_get_readfd(shard->wakeup_pipe);
+
+	ret = data_poll_set_init(&set, shard);
+	if (ret < 0) {
+		goto end;
+	}
+
+	if (ctx->use_io_uring && !shard->io_uring) {
+		shard->io_uring = consumer_io_uring_create();
+		if (!shard->io_uring) {
+			WARN("io_uring output backend unavailable, writing the trace files of shard %u synchronously",
+					shard->id);
+		}
+	}
+
+	while (1) {
+		bool data_pipe_ready = false, wakeup_pipe_ready = false;
+
+		health_code_update();
+
+		high_prio = 0;
+
+		/* No FDs and consumer_quit, consumer_cleanup the thread */
+		if (set.nb_streams == 0 &&
+				CMM_LOAD_SHARED(consumer_quit) == 1) {
 			err = 0;	/* All is OK */
 			goto end;
 		}
-		/* poll on the array of fds */
+		/*
+		 * Send the indexes batched during the previous pass before
+		 * potentially waiting for a long time.
+		 */
+		consumer_flush_relayd_indexes();
+
+		/* poll on the set of fds */
 	restart:
-		DBG("polling on %d fd", nb_fd + nb_pipes_fd);
+		DBG("polling on %u fd", LTTNG_POLL_GETNB(&set.events));
 		if (testpoint(consumerd_thread_data_poll)) {
 			goto end;
 		}
 		health_poll_entry();
-		num_rdy = poll(pollfd, nb_fd + nb_pipes_fd, -1);
+		/* Don't wait if streams are known to have data to consume. */
+		num_rdy = lttng_poll_wait(&set.events, set.nb_pending ? 0 : -1);
 		health_poll_exit();
 		DBG("poll num_rdy : %d", num_rdy);
-		if (num_rdy == -1) {
-			/*
-			 * Restart interrupted system call.
-			 */
-			if (errno == EINTR) {
-				goto restart;
-			}
+		if (num_rdy < 0) {
 			PERROR("Poll error");
 			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
 			goto end;
-		} else if (num_rdy == 0) {
-			DBG("Polling thread timed out");
-			goto end;
 		}
 
 		if (caa_unlikely(data_consumption_paused)) {
@@ -2730,16 +3138,27 @@ void *consumer_thread_data_poll(void *data)
 			goto restart;
 		}
 
+		for (i = 0; i < num_rdy; i++) {
+			const int pollfd = LTTNG_POLL_GETFD(&set.events, i);
+			const uint32_t revents = LTTNG_POLL_GETEV(&set.events, i);
+
+			if (pollfd == data_pipe_fd) {
+				data_pipe_ready = revents & (LPOLLIN | LPOLLPRI);
+			} else if (pollfd == wakeup_pipe_fd) {
+				wakeup_pipe_ready = revents & (LPOLLIN | LPOLLPRI);
+			}
+		}
+
 		/*
-		 * If the consumer_data_pipe triggered poll go directly to the
-		 * beginning of the loop to update the array. We want to prioritize
-		 * array update over low-priority reads.
+		 * If the shard's data pipe triggered poll go directly to the
+		 * beginning of the loop to update the poll set. We want to
+		 * prioritize poll set updates over low-priority reads.
 		 */
-		if (pollfd[nb_fd].revents & (POLLIN | POLLPRI)) {
+		if (data_pipe_ready) {
 			ssize_t pipe_readlen;
 
-			DBG("consumer_data_pipe wake up");
-			pipe_readlen = lttng_pipe_read(ctx->consumer_data_pipe,
+			DBG("Data pipe of shard %u wake up", shard->id);
+			pipe_readlen = lttng_pipe_read(shard->data_pipe,
 					&new_stream, sizeof(new_stream));
 			if (pipe_readlen < sizeof(new_stream)) {
 				PERROR("Consumer data pipe");
@@ -2753,46 +3172,80 @@ void *consumer_thread_data_poll(void *data)
 			 * waking us up to test it.
 			 */
 			if (new_stream == NULL) {
-				validate_endpoint_status_data_stream();
+				validate_endpoint_status_data_stream(&set);
+				continue;
+			}
+
+			/*
+			 * The end point of the stream may have become inactive
+			 * while it was in transit.
+			 */
+			if (new_stream->endpoint_status != CONSUMER_ENDPOINT_ACTIVE) {
+				consumer_del_stream(new_stream, data_ht);
 				continue;
 			}
 
+			if (new_stream->net_seq_idx == (uint64_t) -1ULL) {
+				pthread_mutex_lock(&new_stream->lock);
+				new_stream->io_uring = shard->io_uring;
+				pthread_mutex_unlock(&new_stream->lock);
+			}
+
+			ret = data_poll_set_add_stream(&set, new_stream);
+			if (ret < 0) {
+				ERR("Failed to add data stream %d to poll set",
+						new_stream->wait_fd);
+				lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
+				consumer_del_stream(new_stream, data_ht);
+				goto end;
+			}
+
 			/* Continue to update the local streams and handle prio ones */
 			continue;
 		}
 
 		/* Handle wakeup pipe. */
-		if (pollfd[nb_fd + 1].revents & (POLLIN | POLLPRI)) {
+		if (wakeup_pipe_ready) {
 			char dummy;
 			ssize_t pipe_readlen;
 
-			pipe_readlen = lttng_pipe_read(ctx->consumer_wakeup_pipe, &dummy,
+			pipe_readlen = lttng_pipe_read(shard->wakeup_pipe, &dummy,
 					sizeof(dummy));
 			if (pipe_readlen < 0) {
 				PERROR("Consumer data wakeup pipe");
 			}
 			/* We've been awakened to handle stream(s). */
-			ctx->has_wakeup = 0;
+			shard->has_wakeup = 0;
 		}
 
+		data_poll_set_begin_pass(&set, num_rdy, data_pipe_fd,
+				wakeup_pipe_fd);
+
 		/* Take care of high priority channels first. */
-		for (i = 0; i < nb_fd; i++) {
+		for (j = 0; j < set.nb_ready; j++) {
+			struct data_poll_entry *entry = &set.entries[set.ready[j]];
+			struct lttng_consumer_stream *stream = entry->stream;
+
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			if (stream == NULL) {
+				continue;
+			}
+			if (stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
+				/* Destroyed once the thread is notified. */
+				data_poll_set_unpoll_stream(&set, entry);
 				continue;
 			}
-			if (pollfd[i].revents & POLLPRI) {
-				DBG("Urgent read on fd %d", pollfd[i].fd);
+			if (entry->revents & LPOLLPRI) {
+				DBG("Urgent read on fd %d", stream->wait_fd);
 				high_prio = 1;
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
+				len = ctx->on_buffer_ready(stream, ctx);
 				/* it's ok to have an unavailable sub-buffer */
 				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
 					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
+					data_poll_set_del_stream(&set, stream);
 				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
+					stream->data_read = 1;
 				}
 			}
 		}
@@ -2802,97 +3255,95 @@ void *consumer_thread_data_poll(void *data)
 		 * for more high prio data.
 		 */
 		if (high_prio) {
+			data_poll_set_end_pass(&set);
 			continue;
 		}
 
 		/* Take care of low priority channels. */
-		for (i = 0; i < nb_fd; i++) {
+		for (j = 0; j < set.nb_ready; j++) {
+			struct data_poll_entry *entry = &set.entries[set.ready[j]];
+			struct lttng_consumer_stream *stream = entry->stream;
+
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			if (stream == NULL || !entry->polled) {
 				continue;
 			}
-			if ((pollfd[i].revents & POLLIN) ||
-					local_stream[i]->hangup_flush_done ||
-					local_stream[i]->has_data) {
-				DBG("Normal read on fd %d", pollfd[i].fd);
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
+			if ((entry->revents & LPOLLIN) ||
+					stream->hangup_flush_done ||
+					stream->has_data) {
+				DBG("Normal read on fd %d", stream->wait_fd);
+				len = ctx->on_buffer_ready(stream, ctx);
 				/* it's ok to have an unavailable sub-buffer */
 				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
 					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
+					data_poll_set_del_stream(&set, stream);
 				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
+					stream->data_read = 1;
 				}
 			}
 		}
 
 		/* Handle hangup and errors */
-		for (i = 0; i < nb_fd; i++) {
+		for (j = 0; j < set.nb_ready; j++) {
+			struct data_poll_entry *entry = &set.entries[set.ready[j]];
+			struct lttng_consumer_stream *stream = entry->stream;
+
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			if (stream == NULL || !entry->polled) {
 				continue;
 			}
-			if (!local_stream[i]->hangup_flush_done
-					&& (pollfd[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			if (!stream->hangup_flush_done
+					&& (entry->revents & (LPOLLHUP | LPOLLERR))
 					&& (consumer_data.type == LTTNG_CONSUMER32_UST
 						|| consumer_data.type == LTTNG_CONSUMER64_UST)) {
-				DBG("fd %d is hup|err|nval. Attempting flush and read.",
-						pollfd[i].fd);
-				lttng_ustconsumer_on_stream_hangup(local_stream[i]);
+				DBG("fd %d is hup|err. Attempting flush and read.",
+						stream->wait_fd);
+				lttng_ustconsumer_on_stream_hangup(stream);
 				/* Attempt read again, for the data we just flushed. */
-				local_stream[i]->data_read = 1;
+				stream->data_read = 1;
 			}
 			/*
-			 * If the poll flag is HUP/ERR/NVAL and we have
-			 * read no data in this pass, we can remove the
-			 * stream from its hash table.
+			 * If the poll flag is HUP/ERR and we have read no data
+			 * in this pass, we can remove the stream from its hash
+			 * table.
 			 */
-			if ((pollfd[i].revents & POLLHUP)) {
-				DBG("Polling fd %d tells it has hung up.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
-				}
-			} else if (pollfd[i].revents & POLLERR) {
-				ERR("Error returned in polling fd %d.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			if (entry->revents & LPOLLHUP) {
+				DBG("Polling fd %d tells it has hung up.", stream->wait_fd);
+				if (!stream->data_read) {
+					data_poll_set_del_stream(&set, stream);
+					continue;
 				}
-			} else if (pollfd[i].revents & POLLNVAL) {
-				ERR("Polling fd %d tells fd is not open.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			} else if (entry->revents & LPOLLERR) {
+				ERR("Error returned in polling fd %d.", stream->wait_fd);
+				if (!stream->data_read) {
+					data_poll_set_del_stream(&set, stream);
+					continue;
 				}
 			}
-			if (local_stream[i] != NULL) {
-				local_stream[i]->data_read = 0;
-			}
+			stream->data_read = 0;
 		}
+
+		data_poll_set_end_pass(&set);
 	}
 	/* All is OK */
 	err = 0;
 end:
-	DBG("polling thread exiting");
-	free(pollfd);
-	free(local_stream);
+	DBG("polling thread of shard %u exiting", shard->id);
+	data_poll_set_fini(&set);
 
 	/*
-	 * Close the write side of the pipe so epoll_wait() in
-	 * consumer_thread_metadata_poll can catch it. The thread is monitoring the
-	 * read side of the pipe. If we close them both, epoll_wait strangely does
-	 * not return and could create a endless wait period if the pipe is the
-	 * only tracked fd in the poll set. The thread will take care of closing
-	 * the read side.
+	 * Once the last data thread is done, close the write side of the pipe so
+	 * epoll_wait() in consumer_thread_metadata_poll can catch it. The thread
+	 * is monitoring the read side of the pipe. If we close them both,
+	 * epoll_wait strangely does not return and could create a endless wait
+	 * period if the pipe is the only tracked fd in the poll set. The thread
+	 * will take care of closing the read side.
 	 */
-	(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	if (uatomic_sub_return(&ctx->nb_data_threads_running, 1) == 0) {
+		(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	}
 
 error_testpoint:
 	if (err) {
@@ -3395,10 +3846,10 @@ end:
 	CMM_STORE_SHARED(consumer_quit, 1);
 
 	/*
-	 * Notify the data poll thread to poll back again and test the
+	 * Notify the data poll threads to poll back again and test the
 	 * consumer_quit state that we just set so to quit gracefully.
 	 */
-	notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+	notify_data_threads(ctx);
 
 	notify_channel_pipe(ctx, NULL, -1, CONSUMER_CHANNEL_QUIT);
 
@@ -3459,6 +3910,13 @@ ssize_t lttng_consumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		pthread_cond_broadcast(&stream->metadata_rdv);
 		pthread_mutex_unlock(&stream->metadata_rdv_lock);
 	}
+	/* The monitor timer found the stream busy: publish its usage. */
+	if (caa_unlikely(uatomic_read(&stream->monitor_sample.sample_requested))) {
+		(void) consumer_timer_monitor_sample_stream(stream);
+	}
+	if (caa_unlikely(stream->data_pending_watch)) {
+		consumer_stream_data_pending_drained(stream);
+	}
 	pthread_mutex_unlock(&stream->lock);
 	pthread_mutex_unlock(&stream->chan->lock);
 
@@ -3666,6 +4124,10 @@ error:
 		/* Assign version values. */
 		relayd->data_sock.major = relayd_sock->major;
 		relayd->data_sock.minor = relayd_sock->minor;
+		if (ctx->use_relayd_zerocopy) {
+			relayd_zerocopy_init(&relayd->data_sock,
+					&relayd->data_zerocopy);
+		}
 		break;
 	default:
 		ERR("Unknown relayd socket type (%d)", sock_type);
@@ -3748,6 +4210,147 @@ found:
 	return relayd;
 }
 
+int consumer_get_data_pending_pipe(void)
+{
+	return uatomic_read(&data_pending_pipe);
+}
+
+/*
+ * Set the write end of the session daemon's data pending pipe. The pipe is
+ * made non-blocking: a hint which does not fit in the pipe is dropped and
+ * the session daemon finds out on its next periodic check.
+ *
+ * Return 0 on success, -1 if the pipe was already set or on error.
+ */
+int consumer_set_data_pending_pipe(int fd)
+{
+	int ret, flags;
+
+	ret = fcntl(fd, F_GETFL, 0);
+	if (ret == -1) {
+		PERROR("fcntl get flags of the data pending pipe");
+		goto end;
+	}
+	flags = ret;
+
+	ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	if (ret == -1) {
+		PERROR("fcntl set O_NONBLOCK flag of the data pending pipe");
+		goto end;
+	}
+
+	ret = uatomic_cmpxchg(&data_pending_pipe, -1, fd);
+	if (ret != -1) {
+		ret = -1;
+		goto end;
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Tell the session daemon that a stream found holding data by a data pending
+ * check no longer does, if it is the case.
+ *
+ * The stream lock MUST be acquired.
+ */
+void consumer_stream_data_pending_drained(struct lttng_consumer_stream *stream)
+{
+	ssize_t ret;
+	const int pipe = consumer_get_data_pending_pipe();
+
+	if (!stream->data_pending_watch) {
+		return;
+	}
+
+	/* A stream removed from the session's stream list is drained. */
+	if (!cds_lfht_is_node_deleted(&stream->node_session_id.node)) {
+		switch (consumer_data.type) {
+		case LTTNG_CONSUMER_KERNEL:
+			ret = lttng_kconsumer_data_pending(stream);
+			break;
+		case LTTNG_CONSUMER32_UST:
+		case LTTNG_CONSUMER64_UST:
+			ret = lttng_ustconsumer_data_pending(stream);
+			break;
+		default:
+			ERR("Unknown consumer data type");
+			assert(0);
+			return;
+		}
+		if (ret != 0) {
+			return;
+		}
+	}
+
+	stream->data_pending_watch = false;
+	if (pipe < 0) {
+		return;
+	}
+
+	DBG("Data of session %" PRIu64 " drained from stream %" PRIu64,
+			stream->session_id, stream->key);
+	ret = lttng_write(pipe, &stream->session_id,
+			sizeof(stream->session_id));
+	if (ret != sizeof(stream->session_id)) {
+		if (errno == EAGAIN) {
+			DBG("Data pending pipe full, dropping drained hint");
+		} else {
+			PERROR("write to the data pending pipe");
+		}
+	}
+}
+
+/*
+ * Check, with a single command, whether data of the session 'id' is pending
+ * on the relayd side for any of the session's streams listed in 'ht'.
+ *
+ * The relayd control socket lock MUST be acquired.
+ *
+ * Return 1 if data is pending, 0 if not, -ENOMEM if the command could not be
+ * built or another negative value on relayd communication error.
+ */
+static int relayd_session_data_pending_check(
+		struct consumer_relayd_sock_pair *relayd, struct lttng_ht *ht,
+		uint64_t id)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+	struct lttng_consumer_stream *stream;
+	struct lttng_dynamic_array streams;
+
+	lttng_dynamic_array_init(&streams,
+			sizeof(struct relayd_data_pending_stream), NULL);
+
+	cds_lfht_for_each_entry_duplicate(ht->ht,
+			ht->hash_fct(&id, lttng_ht_seed),
+			ht->match_fct, &id,
+			&iter.iter, stream, node_session_id.node) {
+		const struct relayd_data_pending_stream entry = {
+			.stream_id = stream->relayd_stream_id,
+			.last_net_seq_num = stream->next_net_seq_num - 1,
+			.metadata = stream->metadata_flag,
+		};
+
+		ret = lttng_dynamic_array_add_element(&streams, &entry);
+		if (ret) {
+			ERR("Failed to allocate relayd data pending stream");
+			ret = -ENOMEM;
+			goto end;
+		}
+	}
+
+	ret = relayd_session_data_pending(&relayd->control_sock,
+			relayd->relayd_session_id,
+			lttng_dynamic_array_get_count(&streams),
+			(const struct relayd_data_pending_stream *)
+					streams.buffer.data);
+end:
+	lttng_dynamic_array_reset(&streams);
+	return ret;
+}
+
 /*
  * Check if for a given session id there is still data needed to be extract
  * from the buffers.
@@ -3801,6 +4404,8 @@ int consumer_data_pending(uint64_t id)
 			/* Check the stream if there is data in the buffers. */
 			ret = data_pending(stream);
 			if (ret == 1) {
+				/* Signal the session daemon once drained. */
+				stream->data_pending_watch = true;
 				pthread_mutex_unlock(&stream->lock);
 				goto data_pending;
 			}
@@ -3813,8 +4418,28 @@ int consumer_data_pending(uint64_t id)
 	if (relayd) {
 		unsigned int is_data_inflight = 0;
 
-		/* Send init command for data pending. */
 		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		consumer_relayd_sync_indexes(relayd);
+		if (relayd_supports_session_data_pending(&relayd->control_sock)) {
+			ret = relayd_session_data_pending_check(relayd, ht, id);
+			if (ret == -ENOMEM) {
+				/* Check again on the next data pending command. */
+				pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+				goto data_pending;
+			} else if (ret < 0) {
+				ERR("Relayd session data pending failed. Cleaning up relayd %" PRIu64".", relayd->net_seq_idx);
+				lttng_consumer_cleanup_relayd(relayd);
+				pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+				goto data_not_pending;
+			}
+			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+			if (ret == 1) {
+				goto data_pending;
+			}
+			goto data_not_pending;
+		}
+
+		/* Send init command for data pending. */
 		ret = relayd_begin_data_pending(&relayd->control_sock,
 				relayd->relayd_session_id);
 		if (ret < 0) {
@@ -3936,6 +4561,114 @@ unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 	return start_pos;
 }
 
+struct snapshot_copy {
+	struct lttng_consumer_snapshot_stream *streams;
+	size_t count;
+	lttng_consumer_snapshot_copy_cb copy;
+	struct lttng_consumer_local_data *ctx;
+	/* Index of the next stream to copy, shared by all the threads. */
+	unsigned long next;
+};
+
+static void snapshot_copy_process(struct snapshot_copy *copy)
+{
+	for (;;) {
+		const unsigned long i = uatomic_add_return(&copy->next, 1) - 1;
+
+		if (i >= copy->count) {
+			break;
+		}
+
+		rcu_read_lock();
+		copy->streams[i].ret = copy->copy(&copy->streams[i], copy->ctx);
+		rcu_read_unlock();
+	}
+}
+
+static void *snapshot_copy_thread(void *data)
+{
+	rcu_register_thread();
+	snapshot_copy_process(data);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Copy the data of the streams of a snapshot, spreading the streams over up
+ * to ctx->nb_snapshot_threads threads, the calling thread included.
+ *
+ * The positions of the streams must have been sampled and the streams are
+ * only accessed by the copy callback until this function returns.
+ *
+ * Returns 0 on success or the error of the first stream which could not be
+ * copied.
+ */
+int lttng_consumer_snapshot_copy_streams(
+		struct lttng_consumer_snapshot_stream *streams, size_t count,
+		lttng_consumer_snapshot_copy_cb copy,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	size_t i;
+	unsigned int nb_threads = 0, max_workers;
+	pthread_t *threads = NULL;
+	struct snapshot_copy snapshot_copy = {
+		.streams = streams,
+		.count = count,
+		.copy = copy,
+		.ctx = ctx,
+		.next = 0,
+	};
+
+	if (!count) {
+		ret = 0;
+		goto end;
+	}
+
+	/* The calling thread is one of the workers. */
+	max_workers = min_t(size_t, count,
+			ctx->nb_snapshot_threads ? ctx->nb_snapshot_threads : 1) - 1;
+	if (max_workers) {
+		threads = zmalloc(sizeof(*threads) * max_workers);
+		if (!threads) {
+			PERROR("zmalloc snapshot copy threads");
+			max_workers = 0;
+		}
+	}
+
+	for (nb_threads = 0; nb_threads < max_workers; nb_threads++) {
+		ret = pthread_create(&threads[nb_threads], default_pthread_attr(),
+				snapshot_copy_thread, &snapshot_copy);
+		if (ret) {
+			/* Carry on with the threads that could be launched. */
+			errno = ret;
+			PERROR("pthread_create snapshot copy thread");
+			break;
+		}
+	}
+
+	snapshot_copy_process(&snapshot_copy);
+
+	for (i = 0; i < nb_threads; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join snapshot copy thread");
+		}
+	}
+	free(threads);
+
+	ret = 0;
+	for (i = 0; i < count; i++) {
+		if (streams[i].ret < 0) {
+			ret = streams[i].ret;
+			break;
+		}
+	}
+end:
+	return ret;
+}
+
 static
 int consumer_flush_buffer(struct lttng_consumer_stream *stream, int producer_active)
 {
@@ -4107,6 +4840,7 @@ int lttng_consumer_rotate_channel(struct lttng_consumer_channel *channel,
 	}
 
 	pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+	consumer_relayd_sync_indexes(relayd);
 	ret = relayd_rotate_streams(&relayd->control_sock, stream_count,
 			rotating_to_new_chunk ? &next_chunk_id : NULL,
 			(const struct relayd_stream_rotation_position *)
@@ -4205,6 +4939,7 @@ int rotate_local_stream(struct lttng_consumer_local_data *ctx,
 	stream->tracefile_count_current = 0;
 
 	if (stream->out_fd >= 0) {
+		consumer_io_uring_drain_stream(stream);
 		ret = close(stream->out_fd);
 		if (ret) {
 			PERROR("Failed to close stream out_fd of channel \"%s\"",
@@ -4528,6 +5263,7 @@ enum lttcomm_return_code lttng_consumer_create_trace_chunk(
 		relayd = consumer_find_relayd(*relayd_id);
 		if (relayd) {
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+			consumer_relayd_sync_indexes(relayd);
 			ret = relayd_create_trace_chunk(
 					&relayd->control_sock, published_chunk);
 			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
@@ -4664,6 +5400,7 @@ enum lttcomm_return_code lttng_consumer_close_trace_chunk(
 		relayd = consumer_find_relayd(*relayd_id);
 		if (relayd) {
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+			consumer_relayd_sync_indexes(relayd);
 			ret = relayd_close_trace_chunk(
 					&relayd->control_sock, chunk,
 					path);
@@ -4747,6 +5484,7 @@ enum lttcomm_return_code lttng_consumer_trace_chunk_exists(
 	}
 	DBG("Looking up existence of trace chunk on relay daemon");
 	pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+	consumer_relayd_sync_indexes(relayd);
 	ret = relayd_trace_chunk_exists(&relayd->control_sock, chunk_id,
 			&chunk_exists_remote);
 	pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
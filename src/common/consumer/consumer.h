@@ -33,6 +33,7 @@
 #include <common/compat/uuid.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/pipe.h>
+#include <common/relayd/relayd.h>
 #include <common/index/ctf-index.h>
 #include <common/trace-chunk-registry.h>
 #include <common/credentials.h>
@@ -70,6 +71,7 @@ enum lttng_consumer_command {
 	LTTNG_CONSUMER_CREATE_TRACE_CHUNK,
 	LTTNG_CONSUMER_CLOSE_TRACE_CHUNK,
 	LTTNG_CONSUMER_TRACE_CHUNK_EXISTS,
+	LTTNG_CONSUMER_SET_DATA_PENDING_PIPE,
 };
 
 enum lttng_consumer_type {
@@ -103,6 +105,7 @@ struct stream_list {
 
 /* Stub. */
 struct consumer_metadata_cache;
+struct consumer_io_uring;
 
 struct lttng_consumer_channel {
 	/* Is the channel published in the channel hash tables? */
@@ -281,6 +284,19 @@ struct lttng_consumer_stream {
 	off_t out_fd_offset;
 	/* Amount of bytes written to the output */
 	uint64_t output_written;
+	/*
+	 * io_uring instance of the data thread consuming this stream. NULL if
+	 * the stream's output file is written with blocking system calls.
+	 */
+	struct consumer_io_uring *io_uring;
+	/*
+	 * Number of operations on out_fd submitted to io_uring and not yet
+	 * completed. Protected by the io_uring instance's lock.
+	 */
+	unsigned int io_uring_inflight;
+	/* Completion of the last write submitted to io_uring. */
+	bool io_uring_write_done;
+	int32_t io_uring_write_res;
 	int shm_fd_is_copy;
 	int data_read;
 	int hangup_flush_done;
@@ -304,6 +320,33 @@ struct lttng_consumer_stream {
 	 */
 	bool quiescent;
 
+	/*
+	 * Buffer usage and output size last sampled for the channel monitor
+	 * timer, which reads them without taking the stream lock so that it
+	 * never waits behind the I/O of the data thread. Updated with the
+	 * stream lock held, either by the monitor timer when the lock is
+	 * free or, on its request, by the data thread once done with its
+	 * sub-buffer. 'seq' is odd while an update is in progress.
+	 */
+	struct {
+		unsigned long seq;
+		bool valid;
+		uint64_t usage;
+		uint64_t output_written;
+		/* Set by the monitor timer when the stream lock is held. */
+		int sample_requested;
+	} monitor_sample;
+
+	/*
+	 * Set when a data pending check found data in this stream. Once the
+	 * stream is drained or deleted, the session id is written on the data
+	 * pending pipe so that the session daemon checks the session again
+	 * instead of waiting for its next poll.
+	 *
+	 * NOTE: Update and read are protected by the stream lock.
+	 */
+	bool data_pending_watch;
+
 	/*
 	 * metadata_timer_lock protects flags waiting_on_metadata and
 	 * missed_metadata_flush.
@@ -499,13 +542,29 @@ struct consumer_relayd_sock_pair {
 
 	/* Control socket. Command and metadata are passed over it */
 	struct lttcomm_relayd_sock control_sock;
+	/*
+	 * Indexes waiting to be sent, or acknowledged, on the control socket
+	 * when the relayd supports batched indexes. Protected by the
+	 * ctrl_sock_mutex.
+	 */
+	struct relayd_index_batch index_batch;
 
 	/*
-	 * We don't need a mutex at this point since we only splice or write single
-	 * large chunk of data with a header appended at the begining. Moreover,
-	 * this socket is for now only used in a single thread.
+	 * Mutex protecting the data socket. The streams of a relayd session can
+	 * be consumed by different data threads and a spliced packet is sent
+	 * over that socket with two calls (header + payload) which must not be
+	 * interleaved with another thread's packet. It also serializes the
+	 * assignment of the packets' sequence numbers and the MSG_ZEROCOPY
+	 * completions of the socket.
+	 *
+	 * This is nested INSIDE the stream lock.
 	 */
+	pthread_mutex_t data_sock_mutex;
+
+	/* Data socket. Trace packets are sent over it. */
 	struct lttcomm_relayd_sock data_sock;
+	/* Zero-copy state of the data socket. Protected by data_sock_mutex. */
+	struct relayd_zerocopy data_zerocopy;
 	struct lttng_ht_node_u64 node;
 
 	/* Session id on both sides for the sockets. */
@@ -514,6 +573,36 @@ struct consumer_relayd_sock_pair {
 	struct lttng_consumer_local_data *ctx;
 };
 
+/*
+ * Shard of the data streams of a consumer, consumed by its own data thread.
+ *
+ * All the streams of a channel are placed in the same shard since they are
+ * consumed under the channel lock; see consumer_get_data_shard().
+ */
+struct lttng_consumer_data_shard {
+	unsigned int id;
+	/* Data stream poll thread pipe. To transfer data stream to the thread */
+	struct lttng_pipe *data_pipe;
+
+	/*
+	 * Data thread use that pipe to catch wakeup from read subbuffer that
+	 * detects that there is still data to be read for the stream encountered.
+	 * Before doing so, the stream is flagged to indicate that there is still
+	 * data to be read.
+	 *
+	 * Both pipes (read/write) are owned and used inside the data thread.
+	 */
+	struct lttng_pipe *wakeup_pipe;
+	/* Indicate if the wakeup thread has been notified. */
+	unsigned int has_wakeup:1;
+	/*
+	 * Used to write the local trace files of the shard's streams when the
+	 * io_uring output backend is enabled and supported, NULL otherwise.
+	 */
+	struct consumer_io_uring *io_uring;
+	struct lttng_consumer_local_data *ctx;
+};
+
 /*
  * UST consumer local data to the program. One or more instance per
  * process.
@@ -577,20 +666,23 @@ struct lttng_consumer_local_data {
 	char *consumer_command_sock_path;
 	/* communication with splice */
 	int consumer_channel_pipe[2];
-	/* Data stream poll thread pipe. To transfer data stream to the thread */
-	struct lttng_pipe *consumer_data_pipe;
-
 	/*
-	 * Data thread use that pipe to catch wakeup from read subbuffer that
-	 * detects that there is still data to be read for the stream encountered.
-	 * Before doing so, the stream is flagged to indicate that there is still
-	 * data to be read.
-	 *
-	 * Both pipes (read/write) are owned and used inside the data thread.
+	 * Data streams are consumed by nb_data_shards data threads, each one
+	 * owning the streams of the channels placed in its shard.
 	 */
-	struct lttng_pipe *consumer_wakeup_pipe;
-	/* Indicate if the wakeup thread has been notified. */
-	unsigned int has_wakeup:1;
+	struct lttng_consumer_data_shard *data_shards;
+	unsigned int nb_data_shards;
+	/*
+	 * Number of data threads still running. The last one to exit notifies
+	 * the metadata thread. Accessed atomically.
+	 */
+	unsigned int nb_data_threads_running;
+	/* Write the local trace files of data streams using io_uring. */
+	bool use_io_uring;
+	/* Send the data packets to the relayd with MSG_ZEROCOPY. */
+	bool use_relayd_zerocopy;
+	/* Maximal number of threads copying the streams of a snapshot. */
+	unsigned int nb_snapshot_threads;
 
 	/* to let the signal handler wake up the fd receiver thread */
 	int consumer_should_quit[2];
@@ -604,6 +696,30 @@ struct lttng_consumer_local_data {
 	LTTNG_OPTIONAL(lttng_uuid) sessiond_uuid;
 };
 
+/*
+ * Stream of a channel snapshot. Its positions are sampled on all the streams
+ * of the channel before any of them is copied.
+ */
+struct lttng_consumer_snapshot_stream {
+	struct lttng_consumer_stream *stream;
+	/* Positions delimiting the data to copy. */
+	unsigned long consumed_pos;
+	unsigned long produced_pos;
+	/* Sub-buffers overwritten by the tracer before they were copied. */
+	uint64_t lost_packets;
+	/* Result of the copy. */
+	int ret;
+};
+
+/*
+ * Copy the sub-buffers of a snapshot stream between its sampled positions.
+ *
+ * Returns 0 on success, < 0 on error.
+ */
+typedef int (*lttng_consumer_snapshot_copy_cb)(
+		struct lttng_consumer_snapshot_stream *snapshot_stream,
+		struct lttng_consumer_local_data *ctx);
+
 /*
  * Library-level data. One instance per process.
  */
@@ -628,11 +744,6 @@ struct lttng_consumer_global_data {
 	struct lttng_ht *channel_ht;
 	/* Channel hash table indexed by session id. */
 	struct lttng_ht *channels_by_session_id_ht;
-	/*
-	 * Flag specifying if the local array of FDs needs update in the
-	 * poll function. Protected by consumer_data.lock.
-	 */
-	unsigned int need_update;
 	enum lttng_consumer_type type;
 
 	/*
@@ -791,8 +902,12 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 			struct lttng_consumer_local_data *ctx),
 		int (*recv_channel)(struct lttng_consumer_channel *channel),
 		int (*recv_stream)(struct lttng_consumer_stream *stream),
-		int (*update_stream)(uint64_t sessiond_key, uint32_t state));
+		int (*update_stream)(uint64_t sessiond_key, uint32_t state),
+		unsigned int nb_data_shards);
 void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx);
+struct lttng_consumer_data_shard *consumer_get_data_shard(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_channel *channel);
 ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		struct lttng_consumer_local_data *ctx,
 		struct lttng_consumer_stream *stream, unsigned long len,
@@ -828,15 +943,24 @@ void consumer_add_relayd_socket(uint64_t net_seq_idx, int sock_type,
 void consumer_flag_relayd_for_destroy(
 		struct consumer_relayd_sock_pair *relayd);
 int consumer_data_pending(uint64_t id);
+int consumer_set_data_pending_pipe(int fd);
+int consumer_get_data_pending_pipe(void);
+void consumer_stream_data_pending_drained(struct lttng_consumer_stream *stream);
 int consumer_send_status_msg(int sock, int ret_code);
 int consumer_send_status_channel(int sock,
 		struct lttng_consumer_channel *channel);
 void notify_thread_del_channel(struct lttng_consumer_local_data *ctx,
 		uint64_t key);
 void consumer_destroy_relayd(struct consumer_relayd_sock_pair *relayd);
+void consumer_relayd_sync_indexes(struct consumer_relayd_sock_pair *relayd);
+void consumer_flush_relayd_indexes(void);
 unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 		unsigned long produced_pos, uint64_t nb_packets_per_stream,
 		uint64_t max_sb_size);
+int lttng_consumer_snapshot_copy_streams(
+		struct lttng_consumer_snapshot_stream *streams, size_t count,
+		lttng_consumer_snapshot_copy_cb copy,
+		struct lttng_consumer_local_data *ctx);
 void consumer_add_data_stream(struct lttng_consumer_stream *stream);
 void consumer_del_stream_for_data(struct lttng_consumer_stream *stream);
 void consumer_add_metadata_stream(struct lttng_consumer_stream *stream);
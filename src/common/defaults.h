@@ -299,6 +299,61 @@
  */
 #define DEFAULT_INET_TCP_TIMEOUT			180	/* sec */
 
+/* Default number of relay daemon connection worker threads. */
+#define DEFAULT_RELAYD_WORKER_THREADS			1
+
+/* Default number of relay daemon live viewer worker threads. */
+#define DEFAULT_RELAYD_LIVE_WORKER_THREADS		1
+
+/*
+ * Default number of consumer daemon data threads and environment variable
+ * used to override it.
+ */
+#define DEFAULT_CONSUMERD_DATA_THREADS			1
+#define DEFAULT_CONSUMERD_DATA_THREADS_ENV		"LTTNG_CONSUMERD_DATA_THREADS"
+
+/*
+ * Default number of threads copying the streams of a snapshot and environment
+ * variable used to override it.
+ */
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS		4
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV		"LTTNG_CONSUMERD_SNAPSHOT_THREADS"
+
+/*
+ * Environment variable used to enable the io_uring output backend of the
+ * consumer daemon and size of the io_uring instance of each data thread.
+ */
+#define DEFAULT_CONSUMERD_IO_URING_ENV			"LTTNG_CONSUMERD_IO_URING"
+#define DEFAULT_CONSUMERD_IO_URING_ENTRIES		64
+
+/*
+ * Environment variable used to make the consumer daemon send the data packets
+ * to the relay daemon with MSG_ZEROCOPY, and minimal size of a packet for it
+ * to be sent that way. Pinning the pages of smaller packets costs more than
+ * copying them.
+ */
+#define DEFAULT_CONSUMERD_RELAYD_ZEROCOPY_ENV		"LTTNG_CONSUMERD_RELAYD_ZEROCOPY"
+#define DEFAULT_RELAYD_ZEROCOPY_MIN_SIZE		16384	/* bytes */
+
+/* Size of the pipes used by the relay daemon to splice received data. */
+#define DEFAULT_RELAYD_SPLICE_PIPE_SIZE			1048576	/* bytes */
+
+/*
+ * Maximal number of packet indexes sent to a relay daemon in a single
+ * batched index command and maximal number of batched index commands that
+ * can be awaiting an acknowledgement from the relay daemon.
+ */
+#define DEFAULT_RELAYD_INDEX_BATCH_SIZE			64
+#define DEFAULT_RELAYD_INDEX_BATCH_WINDOW		16
+
+/*
+ * Maximal number of indexes sent to a live viewer in reply to a single
+ * batched index command and maximal number of packets a live viewer can
+ * request with a single batched packet command.
+ */
+#define DEFAULT_LIVE_MAX_INDEXES_PER_REPLY		1024
+#define DEFAULT_LIVE_MAX_PACKETS_PER_REQUEST		64
+
 /* Maximum payload size for a control connection */
 
 #define DEFAULT_NETWORK_RELAYD_CTRL_MAX_PAYLOAD_SIZE CONFIG_DEFAULT_NETWORK_RELAYD_CTRL_MAX_PAYLOAD_SIZE
@@ -309,6 +364,33 @@
 #define DEFAULT_APP_SOCKET_RW_TIMEOUT       CONFIG_DEFAULT_APP_SOCKET_RW_TIMEOUT
 #define DEFAULT_APP_SOCKET_TIMEOUT_ENV      "LTTNG_APP_SOCKET_TIMEOUT"
 
+/*
+ * Default maximal number of threads used to send a command to all the
+ * applications at once, and environment variable used to override it.
+ */
+#define DEFAULT_APP_CMD_THREADS             16
+#define DEFAULT_APP_CMD_THREADS_ENV         "LTTNG_APP_CMD_THREADS"
+
+/*
+ * Default number of threads processing the commands of clients, and
+ * environment variable used to override it.
+ */
+#define DEFAULT_CLIENT_CMD_THREADS          4
+#define DEFAULT_CLIENT_CMD_THREADS_ENV      "LTTNG_CLIENT_CMD_THREADS"
+
+/*
+ * Time, in seconds, during which the tracepoint and tracepoint field lists of
+ * an application are reused instead of being queried again.
+ */
+#define DEFAULT_APP_LIST_CACHE_TTL          10
+
+/*
+ * Minimal time, in usec, between two pushes of the metadata of a session
+ * requested by the consumer. The metadata generated in the meantime is sent
+ * in a single push.
+ */
+#define DEFAULT_METADATA_PUSH_COALESCE_WINDOW_US 5000
+
 #define DEFAULT_UST_STREAM_FD_NUM			2 /* Number of fd per UST stream. */
 
 #define DEFAULT_SNAPSHOT_NAME				"snapshot"
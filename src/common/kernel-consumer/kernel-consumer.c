@@ -123,11 +123,120 @@ int lttng_kconsumer_get_consumed_snapshot(struct lttng_consumer_stream *stream,
 	return ret;
 }
 
+/*
+ * Copy the sub-buffers of a stream of a channel snapshot.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int lttng_kconsumer_snapshot_copy_stream(
+		struct lttng_consumer_snapshot_stream *snapshot_stream,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret = 0;
+	struct lttng_consumer_stream *stream = snapshot_stream->stream;
+	unsigned long consumed_pos = snapshot_stream->consumed_pos;
+	const unsigned long produced_pos = snapshot_stream->produced_pos;
+
+	while ((long) (consumed_pos - produced_pos) < 0) {
+		ssize_t read_len;
+		unsigned long len, padded_len;
+
+		health_code_update();
+
+		DBG("Kernel consumer taking snapshot at pos %lu", consumed_pos);
+
+		ret = kernctl_get_subbuf(stream->wait_fd, &consumed_pos);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				PERROR("kernctl_get_subbuf snapshot");
+				goto end;
+			}
+			DBG("Kernel consumer get subbuf failed. Skipping it.");
+			consumed_pos += stream->max_sb_size;
+			snapshot_stream->lost_packets++;
+			ret = 0;
+			continue;
+		}
+
+		ret = kernctl_get_subbuf_size(stream->wait_fd, &len);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_get_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		ret = kernctl_get_padded_subbuf_size(stream->wait_fd, &padded_len);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_get_padded_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
+				padded_len - len, NULL);
+		/*
+		 * We write the padded len in local tracefiles but the data len
+		 * when using a relay. Display the error but continue processing
+		 * to try to release the subbuffer.
+		 */
+		if (stream->net_seq_idx != (uint64_t) -1ULL) {
+			if (read_len != len) {
+				ERR("Error sending to the relay (ret: %zd != len: %lu)",
+						read_len, len);
+			}
+		} else {
+			if (read_len != padded_len) {
+				ERR("Error writing to tracefile (ret: %zd != len: %lu)",
+						read_len, padded_len);
+			}
+		}
+
+		ret = kernctl_put_subbuf(stream->wait_fd);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_put_subbuf");
+			goto end;
+		}
+		consumed_pos += stream->max_sb_size;
+	}
+end:
+	return ret;
+
+error_put_subbuf:
+	if (kernctl_put_subbuf(stream->wait_fd) < 0) {
+		ERR("Snapshot kernctl_put_subbuf error path");
+	}
+	return ret;
+}
+
+/*
+ * Close the output of a snapshot stream and unlock it.
+ */
+static void lttng_kconsumer_snapshot_release_stream(
+		struct lttng_consumer_stream *stream, uint64_t relayd_id)
+{
+	if (relayd_id == (uint64_t) -1ULL) {
+		if (stream->out_fd >= 0) {
+			if (close(stream->out_fd) < 0) {
+				PERROR("Kernel consumer snapshot close out_fd");
+			}
+			stream->out_fd = -1;
+		}
+	} else {
+		close_relayd_stream(stream);
+		stream->net_seq_idx = (uint64_t) -1ULL;
+	}
+	lttng_trace_chunk_put(stream->trace_chunk);
+	stream->trace_chunk = NULL;
+	pthread_mutex_unlock(&stream->lock);
+}
+
 /*
  * Take a snapshot of all the stream of a channel
  * RCU read-side lock must be held across this function to ensure existence of
  * channel. The channel lock must be held by the caller.
  *
+ * The snapshot is taken in two phases. The positions of all the streams are
+ * sampled in a single pass, so that the snapshots of the streams end at the
+ * same time, before their data is copied by multiple threads.
+ *
  * Returns 0 on success, < 0 on error
  */
 static int lttng_kconsumer_snapshot_channel(
@@ -136,8 +245,10 @@ static int lttng_kconsumer_snapshot_channel(
 		uint64_t nb_packets_per_stream,
 		struct lttng_consumer_local_data *ctx)
 {
-	int ret;
+	int ret = 0;
+	size_t i, nb_streams = 0, nb_locked_streams = 0;
 	struct lttng_consumer_stream *stream;
+	struct lttng_consumer_snapshot_stream *snapshot_streams = NULL;
 
 	DBG("Kernel consumer snapshot channel %" PRIu64, key);
 
@@ -152,14 +263,28 @@ static int lttng_kconsumer_snapshot_channel(
 	}
 
 	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
-		unsigned long consumed_pos, produced_pos;
+		nb_streams++;
+	}
+	if (!nb_streams) {
+		goto end;
+	}
+
+	snapshot_streams = zmalloc(sizeof(*snapshot_streams) * nb_streams);
+	if (!snapshot_streams) {
+		PERROR("zmalloc snapshot streams");
+		ret = -ENOMEM;
+		goto end;
+	}
 
+	/* Prepare the output of every stream. */
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
 		health_code_update();
 
 		/*
 		 * Lock stream because we are about to change its state.
 		 */
 		pthread_mutex_lock(&stream->lock);
+		snapshot_streams[nb_locked_streams++].stream = stream;
 
 		assert(channel->trace_chunk);
 		if (!lttng_trace_chunk_get(channel->trace_chunk)) {
@@ -169,7 +294,7 @@ static int lttng_kconsumer_snapshot_channel(
 			 */
 			ERR("Failed to acquire reference to channel's trace chunk");
 			ret = -1;
-			goto end_unlock;
+			goto end_release_streams;
 		}
 		assert(!stream->trace_chunk);
 		stream->trace_chunk = channel->trace_chunk;
@@ -184,17 +309,25 @@ static int lttng_kconsumer_snapshot_channel(
 			ret = consumer_send_relayd_stream(stream, path);
 			if (ret < 0) {
 				ERR("sending stream to relayd");
-				goto end_unlock;
+				goto end_release_streams;
 			}
 		} else {
 			ret = consumer_stream_create_output_files(stream,
 					false);
 			if (ret < 0) {
-				goto end_unlock;
+				goto end_release_streams;
 			}
 			DBG("Kernel consumer snapshot stream (%" PRIu64 ")",
 					stream->key);
 		}
+	}
+
+	/* Flush every stream and sample its positions. */
+	for (i = 0; i < nb_streams; i++) {
+		struct lttng_consumer_snapshot_stream *snapshot_stream =
+				&snapshot_streams[i];
+
+		stream = snapshot_stream->stream;
 
 		ret = kernctl_buffer_flush_empty(stream->wait_fd);
 		if (ret < 0) {
@@ -208,122 +341,49 @@ static int lttng_kconsumer_snapshot_channel(
 			ret = kernctl_buffer_flush(stream->wait_fd);
 			if (ret < 0) {
 				ERR("Failed to flush kernel stream");
-				goto end_unlock;
+				goto end_release_streams;
 			}
-			goto end_unlock;
 		}
 
 		ret = lttng_kconsumer_take_snapshot(stream);
 		if (ret < 0) {
 			ERR("Taking kernel snapshot");
-			goto end_unlock;
+			goto end_release_streams;
 		}
 
-		ret = lttng_kconsumer_get_produced_snapshot(stream, &produced_pos);
+		ret = lttng_kconsumer_get_produced_snapshot(stream,
+				&snapshot_stream->produced_pos);
 		if (ret < 0) {
 			ERR("Produced kernel snapshot position");
-			goto end_unlock;
+			goto end_release_streams;
 		}
 
-		ret = lttng_kconsumer_get_consumed_snapshot(stream, &consumed_pos);
+		ret = lttng_kconsumer_get_consumed_snapshot(stream,
+				&snapshot_stream->consumed_pos);
 		if (ret < 0) {
 			ERR("Consumerd kernel snapshot position");
-			goto end_unlock;
-		}
-
-		consumed_pos = consumer_get_consume_start_pos(consumed_pos,
-				produced_pos, nb_packets_per_stream,
-				stream->max_sb_size);
-
-		while ((long) (consumed_pos - produced_pos) < 0) {
-			ssize_t read_len;
-			unsigned long len, padded_len;
-
-			health_code_update();
-
-			DBG("Kernel consumer taking snapshot at pos %lu", consumed_pos);
-
-			ret = kernctl_get_subbuf(stream->wait_fd, &consumed_pos);
-			if (ret < 0) {
-				if (ret != -EAGAIN) {
-					PERROR("kernctl_get_subbuf snapshot");
-					goto end_unlock;
-				}
-				DBG("Kernel consumer get subbuf failed. Skipping it.");
-				consumed_pos += stream->max_sb_size;
-				stream->chan->lost_packets++;
-				continue;
-			}
-
-			ret = kernctl_get_subbuf_size(stream->wait_fd, &len);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_get_subbuf_size");
-				goto error_put_subbuf;
-			}
-
-			ret = kernctl_get_padded_subbuf_size(stream->wait_fd, &padded_len);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_get_padded_subbuf_size");
-				goto error_put_subbuf;
-			}
-
-			read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
-					padded_len - len, NULL);
-			/*
-			 * We write the padded len in local tracefiles but the data len
-			 * when using a relay. Display the error but continue processing
-			 * to try to release the subbuffer.
-			 */
-			if (relayd_id != (uint64_t) -1ULL) {
-				if (read_len != len) {
-					ERR("Error sending to the relay (ret: %zd != len: %lu)",
-							read_len, len);
-				}
-			} else {
-				if (read_len != padded_len) {
-					ERR("Error writing to tracefile (ret: %zd != len: %lu)",
-							read_len, padded_len);
-				}
-			}
-
-			ret = kernctl_put_subbuf(stream->wait_fd);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_put_subbuf");
-				goto end_unlock;
-			}
-			consumed_pos += stream->max_sb_size;
+			goto end_release_streams;
 		}
 
-		if (relayd_id == (uint64_t) -1ULL) {
-			if (stream->out_fd >= 0) {
-				ret = close(stream->out_fd);
-				if (ret < 0) {
-					PERROR("Kernel consumer snapshot close out_fd");
-					goto end_unlock;
-				}
-				stream->out_fd = -1;
-			}
-		} else {
-			close_relayd_stream(stream);
-			stream->net_seq_idx = (uint64_t) -1ULL;
-		}
-		lttng_trace_chunk_put(stream->trace_chunk);
-		stream->trace_chunk = NULL;
-		pthread_mutex_unlock(&stream->lock);
+		snapshot_stream->consumed_pos = consumer_get_consume_start_pos(
+				snapshot_stream->consumed_pos,
+				snapshot_stream->produced_pos,
+				nb_packets_per_stream, stream->max_sb_size);
 	}
 
-	/* All good! */
-	ret = 0;
-	goto end;
+	ret = lttng_consumer_snapshot_copy_streams(snapshot_streams, nb_streams,
+			lttng_kconsumer_snapshot_copy_stream, ctx);
+	for (i = 0; i < nb_streams; i++) {
+		channel->lost_packets += snapshot_streams[i].lost_packets;
+	}
 
-error_put_subbuf:
-	ret = kernctl_put_subbuf(stream->wait_fd);
-	if (ret < 0) {
-		ERR("Snapshot kernctl_put_subbuf error path");
+end_release_streams:
+	for (i = 0; i < nb_locked_streams; i++) {
+		lttng_kconsumer_snapshot_release_stream(
+				snapshot_streams[i].stream, relayd_id);
 	}
-end_unlock:
-	pthread_mutex_unlock(&stream->lock);
 end:
+	free(snapshot_streams);
 	rcu_read_unlock();
 	return ret;
 }
@@ -770,7 +830,8 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			stream_pipe = ctx->consumer_metadata_pipe;
 		} else {
 			consumer_add_data_stream(new_stream);
-			stream_pipe = ctx->consumer_data_pipe;
+			stream_pipe = consumer_get_data_shard(ctx,
+					channel)->data_pipe;
 		}
 
 		/* Visible to other threads */
@@ -1116,6 +1177,34 @@ end_destroy_channel:
 		}
 		break;
 	}
+	case LTTNG_CONSUMER_SET_DATA_PENDING_PIPE:
+	{
+		int data_pending_pipe;
+
+		ret_code = LTTCOMM_CONSUMERD_SUCCESS;
+		/* Successfully received the command's type. */
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0) {
+			goto error_fatal;
+		}
+
+		ret = lttcomm_recv_fds_unix_sock(sock, &data_pending_pipe, 1);
+		if (ret != sizeof(data_pending_pipe)) {
+			ERR("Failed to receive data pending pipe");
+			goto error_fatal;
+		}
+
+		DBG("Received data pending pipe (%d)", data_pending_pipe);
+		ret = consumer_set_data_pending_pipe(data_pending_pipe);
+		if (ret) {
+			ret_code = LTTCOMM_CONSUMERD_ALREADY_SET;
+		}
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0) {
+			goto error_fatal;
+		}
+		break;
+	}
 	case LTTNG_CONSUMER_ROTATE_CHANNEL:
 	{
 		struct lttng_consumer_channel *channel;
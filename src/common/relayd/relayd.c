@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <inttypes.h>
+#include <urcu/system.h>
 
 #include <common/common.h>
 #include <common/defaults.h>
@@ -820,6 +821,228 @@ error:
 	return ret;
 }
 
+/*
+ * Send the buffers described by iov, retrying on partial sends.
+ *
+ * The number of sendmsg calls which sent data is added to 'nr_sends' when
+ * it is not NULL.
+ *
+ * Return 0 on success or else a negative errno value.
+ */
+static int send_iov(struct lttcomm_relayd_sock *rsock, struct iovec *iov,
+		size_t iovcnt, int flags, uint32_t *nr_sends)
+{
+	int ret = 0;
+
+	while (iovcnt > 0) {
+		ssize_t sent;
+
+		sent = rsock->sock.ops->sendmsgv(&rsock->sock, iov, iovcnt,
+				flags);
+		if (sent <= 0) {
+			ret = sent < 0 ? -errno : -EPIPE;
+			goto end;
+		}
+		if (nr_sends) {
+			(*nr_sends)++;
+		}
+
+		/* Skip what was sent. */
+		while (iovcnt > 0 && (size_t) sent >= iov->iov_len) {
+			sent -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + sent;
+			iov->iov_len -= sent;
+		}
+	}
+
+end:
+	return ret;
+}
+
+/*
+ * Try to enable MSG_ZEROCOPY sends of the payloads of data packets on a data
+ * socket. Zero-copy stays disabled if the kernel does not support it.
+ */
+void relayd_zerocopy_init(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy)
+{
+	assert(rsock);
+	assert(zerocopy);
+
+	zerocopy->next_id = 0;
+	zerocopy->has_completed = false;
+	CMM_STORE_SHARED(zerocopy->enabled, false);
+	if (lttcomm_sock_enable_zerocopy(&rsock->sock)) {
+		DBG("MSG_ZEROCOPY is not supported on relayd data socket %d",
+				rsock->sock.fd);
+		return;
+	}
+	CMM_STORE_SHARED(zerocopy->enabled, true);
+}
+
+/*
+ * Send a data packet, header and payload, with a single sendmsg call.
+ *
+ * If zero-copy is enabled and the payload is large enough, the packet is sent
+ * with MSG_ZEROCOPY and 'zerocopy_send' is marked pending: the kernel may
+ * still reference the header, copied in 'zerocopy_send', and the payload when
+ * this function returns. The caller MUST keep both unmodified, e.g. not
+ * return the payload to the ring buffer, until relayd_zerocopy_reap()
+ * returns. Reaping does not need the lock of the data socket, so it should be
+ * released before.
+ *
+ * Return 0 on success or else a negative errno value.
+ */
+int relayd_send_data(struct lttcomm_relayd_sock *rsock,
+		const struct lttcomm_relayd_data_hdr *hdr,
+		const void *payload, size_t len,
+		struct relayd_zerocopy *zerocopy,
+		struct relayd_zerocopy_send *zerocopy_send)
+{
+	int ret, flags = 0;
+	struct iovec iov[2];
+	uint32_t *nr_sends = NULL;
+	uint32_t first_id = 0;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(hdr);
+	assert(zerocopy_send);
+
+	zerocopy_send->pending = false;
+
+	if (rsock->sock.fd < 0) {
+		return -ECONNRESET;
+	}
+
+	DBG3("Relayd sending data packet of size %zu", len);
+
+	iov[0].iov_base = (void *) hdr;
+	iov[0].iov_len = sizeof(*hdr);
+	iov[1].iov_base = (void *) payload;
+	iov[1].iov_len = len;
+
+#ifdef MSG_ZEROCOPY
+	if (zerocopy && CMM_LOAD_SHARED(zerocopy->enabled) &&
+			len >= DEFAULT_RELAYD_ZEROCOPY_MIN_SIZE) {
+		/*
+		 * The header is not copied either: send it from storage which
+		 * outlives the caller's copy, until the send is reaped.
+		 */
+		zerocopy_send->hdr = *hdr;
+		iov[0].iov_base = &zerocopy_send->hdr;
+		flags |= MSG_ZEROCOPY;
+		first_id = zerocopy->next_id;
+		nr_sends = &zerocopy->next_id;
+	}
+#endif
+
+	ret = send_iov(rsock, iov, 2, flags, nr_sends);
+
+	if (!ret && nr_sends && zerocopy->next_id != first_id) {
+		zerocopy_send->pending = true;
+		zerocopy_send->id = zerocopy->next_id - 1;
+	}
+
+	return ret;
+}
+
+/*
+ * Wait until the kernel releases the payload of a MSG_ZEROCOPY send of
+ * relayd_send_data(). The completion notifications of a socket are consumed
+ * by one thread at a time, the others wait for it to release theirs.
+ *
+ * Zero-copy is disabled for the following packets of the socket if the
+ * kernel had to copy the payload anyway, e.g. over the loopback.
+ *
+ * Return 0 on success or else a negative errno value.
+ */
+int relayd_zerocopy_reap(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy,
+		const struct relayd_zerocopy_send *zerocopy_send)
+{
+	int ret = 0;
+	bool copied = false;
+	uint32_t completed_id;
+
+	assert(rsock);
+	assert(zerocopy);
+	assert(zerocopy_send);
+
+	if (!zerocopy_send->pending) {
+		goto end;
+	}
+
+	pthread_mutex_lock(&zerocopy->reap_lock);
+	if (zerocopy->has_completed &&
+			(int32_t) (zerocopy->completed_id - zerocopy_send->id) >= 0) {
+		/* Released by the notifications reaped for another send. */
+		goto end_unlock;
+	}
+
+	ret = lttcomm_sock_wait_zerocopy(&rsock->sock, zerocopy_send->id,
+			&copied, &completed_id);
+	if (ret < 0) {
+		ret = -errno;
+		goto end_unlock;
+	}
+	zerocopy->has_completed = true;
+	zerocopy->completed_id = completed_id;
+	if (copied) {
+		DBG("Relayd data socket %d copies MSG_ZEROCOPY sends, disabling zero-copy",
+				rsock->sock.fd);
+		CMM_STORE_SHARED(zerocopy->enabled, false);
+	}
+end_unlock:
+	pthread_mutex_unlock(&zerocopy->reap_lock);
+end:
+	return ret;
+}
+
+/*
+ * Send a metadata packet on the control socket, that is the command header,
+ * the metadata stream id and the payload, with a single sendmsg call.
+ *
+ * Return 0 on success or else a negative errno value.
+ */
+int relayd_send_metadata_packet(struct lttcomm_relayd_sock *rsock,
+		uint64_t stream_id, uint32_t padding,
+		const void *payload, size_t len)
+{
+	struct lttcomm_relayd_hdr header;
+	struct lttcomm_relayd_metadata_payload metadata_hdr;
+	struct iovec iov[3];
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+
+	if (rsock->sock.fd < 0) {
+		return -ECONNRESET;
+	}
+
+	DBG("Relayd sending metadata of size %zu", len);
+
+	memset(&header, 0, sizeof(header));
+	header.cmd = htobe32(RELAYD_SEND_METADATA);
+	header.data_size = htobe64(sizeof(metadata_hdr) + len);
+
+	metadata_hdr.stream_id = htobe64(stream_id);
+	metadata_hdr.padding_size = htobe32(padding);
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = &metadata_hdr;
+	iov[1].iov_len = sizeof(metadata_hdr);
+	iov[2].iov_base = (void *) payload;
+	iov[2].iov_len = len;
+
+	return send_iov(rsock, iov, 3, 0, NULL);
+}
+
 /*
  * Send close stream command to the relayd.
  */
@@ -1058,6 +1281,99 @@ error:
 	return ret;
 }
 
+bool relayd_supports_session_data_pending(
+		const struct lttcomm_relayd_sock *rsock)
+{
+	if (rsock->major > 2) {
+		return true;
+	} else if (rsock->major == 2 && rsock->minor >= 12) {
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Check whether data is pending or in flight for any stream of a session
+ * with a single command, in place of the begin data pending, per-stream data
+ * pending or quiescent control, and end data pending commands.
+ *
+ * Return 1 if data is pending, 0 if not, -ENOMEM if the command could not be
+ * built or another negative value on communication error.
+ */
+int relayd_session_data_pending(struct lttcomm_relayd_sock *rsock,
+		uint64_t id, unsigned int stream_count,
+		const struct relayd_data_pending_stream *streams)
+{
+	int ret;
+	unsigned int i;
+	struct lttng_dynamic_buffer payload;
+	struct lttcomm_relayd_generic_reply reply;
+	const struct lttcomm_relayd_session_data_pending msg = {
+		.session_id = htobe64(id),
+		.stream_count = htobe32((uint32_t) stream_count),
+	};
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(relayd_supports_session_data_pending(rsock));
+
+	lttng_dynamic_buffer_init(&payload);
+
+	DBG("Relayd session data pending for %u streams", stream_count);
+
+	ret = lttng_dynamic_buffer_append(&payload, &msg, sizeof(msg));
+	if (ret) {
+		ERR("Failed to allocate \"session data pending\" command payload");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	for (i = 0; i < stream_count; i++) {
+		const struct lttcomm_relayd_session_data_pending_stream comm_stream = {
+			.stream_id = htobe64(streams[i].stream_id),
+			.last_net_seq_num = htobe64(
+					streams[i].last_net_seq_num),
+			.metadata = streams[i].metadata,
+		};
+
+		ret = lttng_dynamic_buffer_append(&payload, &comm_stream,
+				sizeof(comm_stream));
+		if (ret) {
+			ERR("Failed to allocate \"session data pending\" command payload");
+			ret = -ENOMEM;
+			goto error;
+		}
+	}
+
+	/* Send command */
+	ret = send_command(rsock, RELAYD_SESSION_DATA_PENDING, payload.data,
+			payload.size, 0);
+	if (ret < 0) {
+		ERR("Failed to send \"session data pending\" command");
+		goto error;
+	}
+
+	/* Receive response */
+	ret = recv_reply(rsock, (void *) &reply, sizeof(reply));
+	if (ret < 0) {
+		ERR("Failed to receive \"session data pending\" command reply");
+		goto error;
+	}
+
+	ret = (int) be32toh(reply.ret_code);
+	if (ret < 0) {
+		ERR("Relayd session data pending replied error %d", ret);
+		goto error;
+	}
+
+	DBG("Relayd data is %s pending for session %" PRIu64,
+			ret == 1 ? "" : "NOT", id);
+
+error:
+	lttng_dynamic_buffer_reset(&payload);
+	return ret;
+}
+
 /*
  * Send index to the relayd.
  */
@@ -1128,6 +1444,205 @@ error:
 	return ret;
 }
 
+bool relayd_supports_index_batch(const struct lttcomm_relayd_sock *rsock)
+{
+	if (rsock->major > 2) {
+		return true;
+	} else if (rsock->major == 2 && rsock->minor >= 12) {
+		return true;
+	}
+	return false;
+}
+
+void relayd_index_batch_init(struct relayd_index_batch *batch)
+{
+	lttng_dynamic_buffer_init(&batch->payload);
+	batch->index_count = 0;
+	batch->pending_replies = 0;
+}
+
+void relayd_index_batch_fini(struct relayd_index_batch *batch)
+{
+	lttng_dynamic_buffer_reset(&batch->payload);
+	batch->index_count = 0;
+	batch->pending_replies = 0;
+}
+
+/*
+ * Drop the content of a batch along with its pending replies. Used once the
+ * control socket is known to be unusable.
+ */
+static void index_batch_discard(struct relayd_index_batch *batch)
+{
+	(void) lttng_dynamic_buffer_set_size(&batch->payload, 0);
+	batch->index_count = 0;
+	batch->pending_replies = 0;
+}
+
+/*
+ * Receive the reply to the oldest RELAYD_SEND_INDEXES command awaiting one.
+ */
+static int index_batch_recv_reply(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch)
+{
+	int ret;
+	struct lttcomm_relayd_generic_reply reply;
+
+	assert(batch->pending_replies > 0);
+
+	ret = recv_reply(rsock, (void *) &reply, sizeof(reply));
+	if (ret < 0) {
+		ERR("Failed to receive \"send indexes\" command reply");
+		goto error;
+	}
+	batch->pending_replies--;
+
+	reply.ret_code = be32toh(reply.ret_code);
+	if (reply.ret_code != LTTNG_OK) {
+		ret = -1;
+		ERR("Relayd send indexes replied error %d", reply.ret_code);
+		goto error;
+	}
+	ret = 0;
+	return ret;
+
+error:
+	index_batch_discard(batch);
+	return ret;
+}
+
+/*
+ * Append an index to a batch. The batch is sent to the relayd once it holds
+ * DEFAULT_RELAYD_INDEX_BATCH_SIZE indexes.
+ *
+ * Return 0 on success else a negative value.
+ */
+int relayd_index_batch_add(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch,
+		struct ctf_packet_index *index, uint64_t relay_stream_id,
+		uint64_t net_seq_num)
+{
+	int ret;
+	struct lttcomm_relayd_index msg;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(relayd_supports_index_batch(rsock));
+
+	if (batch->payload.size == 0) {
+		const struct lttcomm_relayd_send_indexes header = {};
+
+		ret = lttng_dynamic_buffer_append(&batch->payload, &header,
+				sizeof(header));
+		if (ret) {
+			ERR("Failed to allocate \"send indexes\" command payload");
+			goto error;
+		}
+	}
+
+	DBG("Relayd batching index for stream ID %" PRIu64, relay_stream_id);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.relay_stream_id = htobe64(relay_stream_id);
+	msg.net_seq_num = htobe64(net_seq_num);
+
+	/* The index is already in big endian. */
+	msg.packet_size = index->packet_size;
+	msg.content_size = index->content_size;
+	msg.timestamp_begin = index->timestamp_begin;
+	msg.timestamp_end = index->timestamp_end;
+	msg.events_discarded = index->events_discarded;
+	msg.stream_id = index->stream_id;
+	msg.stream_instance_id = index->stream_instance_id;
+	msg.packet_seq_num = index->packet_seq_num;
+
+	ret = lttng_dynamic_buffer_append(&batch->payload, &msg, sizeof(msg));
+	if (ret) {
+		ERR("Failed to allocate \"send indexes\" command payload");
+		goto error;
+	}
+	batch->index_count++;
+
+	if (batch->index_count >= DEFAULT_RELAYD_INDEX_BATCH_SIZE) {
+		ret = relayd_index_batch_flush(rsock, batch);
+	}
+
+error:
+	return ret;
+}
+
+/*
+ * Send the indexes accumulated in a batch without waiting for the relayd's
+ * acknowledgement, unless the maximal number of unacknowledged batches is
+ * reached, in which case the oldest replies are consumed first.
+ *
+ * Return 0 on success else a negative value.
+ */
+int relayd_index_batch_flush(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch)
+{
+	int ret = 0;
+	struct lttcomm_relayd_send_indexes *header;
+
+	if (batch->index_count == 0) {
+		goto end;
+	}
+
+	header = (typeof(header)) batch->payload.data;
+	header->index_count = htobe32((uint32_t) batch->index_count);
+
+	DBG("Relayd sending batch of %u indexes", batch->index_count);
+	ret = send_command(rsock, RELAYD_SEND_INDEXES, batch->payload.data,
+			batch->payload.size, 0);
+	if (ret < 0) {
+		ERR("Failed to send \"send indexes\" command");
+		index_batch_discard(batch);
+		goto end;
+	}
+
+	/* Keep the payload's storage around for the next batch. */
+	(void) lttng_dynamic_buffer_set_size(&batch->payload, 0);
+	batch->index_count = 0;
+	batch->pending_replies++;
+
+	while (batch->pending_replies > DEFAULT_RELAYD_INDEX_BATCH_WINDOW) {
+		ret = index_batch_recv_reply(rsock, batch);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Send the indexes accumulated in a batch and wait for the acknowledgement of
+ * every batch sent so far. Once this returns, another command can be sent on
+ * the control socket.
+ *
+ * Return 0 on success else a negative value.
+ */
+int relayd_index_batch_sync(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch)
+{
+	int ret;
+
+	ret = relayd_index_batch_flush(rsock, batch);
+	if (ret < 0) {
+		goto end;
+	}
+
+	while (batch->pending_replies > 0) {
+		ret = index_batch_recv_reply(rsock, batch);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+end:
+	return ret;
+}
+
 /*
  * Ask the relay to reset the metadata trace file (regeneration).
  */
@@ -18,6 +18,7 @@
 #ifndef _RELAYD_H
 #define _RELAYD_H
 
+#include <pthread.h>
 #include <unistd.h>
 #include <stdbool.h>
 
@@ -25,6 +26,7 @@
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/trace-chunk.h>
 #include <common/dynamic-array.h>
+#include <common/dynamic-buffer.h>
 
 struct relayd_stream_rotation_position {
 	uint64_t stream_id;
@@ -37,6 +39,68 @@ struct relayd_stream_rotation_position {
 	uint64_t rotate_at_seq_num;
 };
 
+/* Stream checked by a RELAYD_SESSION_DATA_PENDING command. */
+struct relayd_data_pending_stream {
+	uint64_t stream_id;
+	/* Sequence number of the last packet sent. Ignored for metadata. */
+	uint64_t last_net_seq_num;
+	bool metadata;
+};
+
+/*
+ * Indexes accumulated for a relay daemon control socket before being sent
+ * in a single RELAYD_SEND_INDEXES command (2.12+).
+ *
+ * The replies to those commands are not awaited when the batch is sent;
+ * at most DEFAULT_RELAYD_INDEX_BATCH_WINDOW commands can be awaiting a reply
+ * at any given time. All pending replies must be consumed, using
+ * relayd_index_batch_sync(), before any other command is sent on the
+ * control socket.
+ *
+ * A batch must be protected by the same lock as its control socket.
+ */
+struct relayd_index_batch {
+	/* RELAYD_SEND_INDEXES payload being assembled. */
+	struct lttng_dynamic_buffer payload;
+	unsigned int index_count;
+	/* Number of RELAYD_SEND_INDEXES commands awaiting a reply. */
+	unsigned int pending_replies;
+};
+
+/*
+ * MSG_ZEROCOPY state of a data socket, see relayd_send_data() and
+ * relayd_zerocopy_reap().
+ */
+struct relayd_zerocopy {
+	/* Read without lock by the senders, a stale value is harmless. */
+	bool enabled;
+	/*
+	 * Id assigned by the kernel to the next MSG_ZEROCOPY send. Protected by
+	 * the lock of the data socket.
+	 */
+	uint32_t next_id;
+	/*
+	 * Serializes the reaping of the completion notifications, protects
+	 * the fields below. Initialized by the owner of the data socket.
+	 */
+	pthread_mutex_t reap_lock;
+	/* Whether 'completed_id' is valid. */
+	bool has_completed;
+	/* Id of the last send released by the kernel. */
+	uint32_t completed_id;
+};
+
+/*
+ * MSG_ZEROCOPY send of a packet which is still referenced by the kernel. It
+ * must outlive the send, until relayd_zerocopy_reap() returns.
+ */
+struct relayd_zerocopy_send {
+	bool pending;
+	uint32_t id;
+	/* Header of the packet, sent from here since the kernel may read it late. */
+	struct lttcomm_relayd_data_hdr hdr;
+};
+
 int relayd_connect(struct lttcomm_relayd_sock *sock);
 int relayd_close(struct lttcomm_relayd_sock *sock);
 int relayd_create_session(struct lttcomm_relayd_sock *rsock,
@@ -60,6 +124,19 @@ int relayd_start_data(struct lttcomm_relayd_sock *sock);
 int relayd_send_metadata(struct lttcomm_relayd_sock *sock, size_t len);
 int relayd_send_data_hdr(struct lttcomm_relayd_sock *sock,
 		struct lttcomm_relayd_data_hdr *hdr, size_t size);
+int relayd_send_data(struct lttcomm_relayd_sock *rsock,
+		const struct lttcomm_relayd_data_hdr *hdr,
+		const void *payload, size_t len,
+		struct relayd_zerocopy *zerocopy,
+		struct relayd_zerocopy_send *zerocopy_send);
+int relayd_zerocopy_reap(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy,
+		const struct relayd_zerocopy_send *zerocopy_send);
+int relayd_send_metadata_packet(struct lttcomm_relayd_sock *rsock,
+		uint64_t stream_id, uint32_t padding,
+		const void *payload, size_t len);
+void relayd_zerocopy_init(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy);
 int relayd_data_pending(struct lttcomm_relayd_sock *sock, uint64_t stream_id,
 		uint64_t last_net_seq_num);
 int relayd_quiescent_control(struct lttcomm_relayd_sock *sock,
@@ -67,9 +144,25 @@ int relayd_quiescent_control(struct lttcomm_relayd_sock *sock,
 int relayd_begin_data_pending(struct lttcomm_relayd_sock *sock, uint64_t id);
 int relayd_end_data_pending(struct lttcomm_relayd_sock *sock, uint64_t id,
 		unsigned int *is_data_inflight);
+bool relayd_supports_session_data_pending(
+		const struct lttcomm_relayd_sock *rsock);
+int relayd_session_data_pending(struct lttcomm_relayd_sock *rsock,
+		uint64_t id, unsigned int stream_count,
+		const struct relayd_data_pending_stream *streams);
 int relayd_send_index(struct lttcomm_relayd_sock *rsock,
 		struct ctf_packet_index *index, uint64_t relay_stream_id,
 		uint64_t net_seq_num);
+bool relayd_supports_index_batch(const struct lttcomm_relayd_sock *rsock);
+void relayd_index_batch_init(struct relayd_index_batch *batch);
+void relayd_index_batch_fini(struct relayd_index_batch *batch);
+int relayd_index_batch_add(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch,
+		struct ctf_packet_index *index, uint64_t relay_stream_id,
+		uint64_t net_seq_num);
+int relayd_index_batch_flush(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch);
+int relayd_index_batch_sync(struct lttcomm_relayd_sock *rsock,
+		struct relayd_index_batch *batch);
 int relayd_reset_metadata(struct lttcomm_relayd_sock *rsock,
 		uint64_t stream_id, uint64_t version);
 /* `positions` is an array of `stream_count` relayd_stream_rotation_position. */
@@ -34,6 +34,8 @@ enum lttcomm_agent_command {
 	AGENT_CMD_REG_DONE		= 4,	/* End registration process. */
 	AGENT_CMD_APP_CTX_ENABLE	= 5,
 	AGENT_CMD_APP_CTX_DISABLE	= 6,
+	/* Enable a set of events and application contexts (2.1+). */
+	AGENT_CMD_ENABLE_BULK		= 7,
 };
 
 /*
@@ -69,6 +71,20 @@ struct lttcomm_agent_enable_event {
 	uint32_t filter_expression_length;
 } LTTNG_PACKED;
 
+/*
+ * Bulk enable command payload (2.1+). Will be immediately followed by
+ * 'event_count' enable event command payloads, each followed by its filter
+ * expression, then by 'app_ctx_count' application contexts, each made of the
+ * provider name and of the context name sent as Pascal-style strings (u32
+ * length, big endian, followed by the NULL-terminated string).
+ *
+ * A single generic reply is sent for the whole command.
+ */
+struct lttcomm_agent_enable_bulk {
+	uint32_t event_count;
+	uint32_t app_ctx_count;
+} LTTNG_PACKED;
+
 /*
  * Disable event command payload.
  */
@@ -47,6 +47,7 @@ static const struct lttcomm_proto_ops inet_ops = {
 	.listen = lttcomm_listen_inet_sock,
 	.recvmsg = lttcomm_recvmsg_inet_sock,
 	.sendmsg = lttcomm_sendmsg_inet_sock,
+	.sendmsgv = lttcomm_sendmsgv_inet_sock,
 };
 
 unsigned long lttcomm_inet_tcp_timeout;
@@ -413,16 +414,32 @@ LTTNG_HIDDEN
 ssize_t lttcomm_sendmsg_inet_sock(struct lttcomm_sock *sock, const void *buf,
 		size_t len, int flags)
 {
-	struct msghdr msg;
 	struct iovec iov[1];
+
+	iov[0].iov_base = (void *) buf;
+	iov[0].iov_len = len;
+
+	return lttcomm_sendmsgv_inet_sock(sock, iov, 1, flags);
+}
+
+/*
+ * Send the buffers described by the iovcnt entries of iov with a single
+ * sendmsg call.
+ *
+ * Return the size of sent data, which can be smaller than the total size of
+ * the buffers.
+ */
+LTTNG_HIDDEN
+ssize_t lttcomm_sendmsgv_inet_sock(struct lttcomm_sock *sock,
+		const struct iovec *iov, size_t iovcnt, int flags)
+{
+	struct msghdr msg;
 	ssize_t ret = -1;
 
 	memset(&msg, 0, sizeof(msg));
 
-	iov[0].iov_base = (void *) buf;
-	iov[0].iov_len = len;
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iov = (struct iovec *) iov;
+	msg.msg_iovlen = iovcnt;
 
 	switch (sock->proto) {
 	case LTTCOMM_SOCK_UDP:
@@ -157,6 +157,27 @@ struct lttcomm_relayd_quiescent_control {
 	uint64_t stream_id;
 } LTTNG_PACKED;
 
+struct lttcomm_relayd_session_data_pending_stream {
+	uint64_t stream_id;
+	/* Sequence number of the last packet, ignored for metadata. */
+	uint64_t last_net_seq_num;
+	/* Metadata streams only need a quiescent control check. */
+	uint8_t metadata;
+} LTTNG_PACKED;
+
+/*
+ * Data pending check of a session (2.12+), equivalent to a begin data
+ * pending command, a data pending or quiescent control command per stream
+ * and an end data pending command. The reply's ret_code is 1 if data is
+ * pending or in flight, 0 otherwise.
+ */
+struct lttcomm_relayd_session_data_pending {
+	uint64_t session_id;
+	uint32_t stream_count;
+	/* `stream_count` streams follow. */
+	struct lttcomm_relayd_session_data_pending_stream streams[];
+} LTTNG_PACKED;
+
 /*
  * Index data.
  */
@@ -193,6 +214,15 @@ static inline size_t lttcomm_relayd_index_len(uint32_t major, uint32_t minor)
 	abort();
 }
 
+/*
+ * Batch of indexes (2.12+). Indexes are always sent in their complete form.
+ */
+struct lttcomm_relayd_send_indexes {
+	uint32_t index_count;
+	/* `index_count` indexes follow. */
+	struct lttcomm_relayd_index indexes[];
+} LTTNG_PACKED;
+
 /*
  * Create session in 2.4 adds additionnal parameters for live reading.
  */
@@ -27,6 +27,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
+
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
 
 #include <common/common.h>
 
@@ -461,6 +466,156 @@ int lttcomm_sock_set_port(struct lttcomm_sock *sock, uint16_t port)
 	return 0;
 }
 
+#if defined(HAVE_LINUX_ERRQUEUE_H) && defined(SO_ZEROCOPY) && \
+		defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+
+/*
+ * Enable MSG_ZEROCOPY sends on a TCP socket.
+ *
+ * Return 0 on success or else -1 with errno set.
+ */
+LTTNG_HIDDEN
+int lttcomm_sock_enable_zerocopy(struct lttcomm_sock *sock)
+{
+	int ret, val = 1;
+
+	assert(sock);
+
+	ret = setsockopt(sock->fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val));
+	if (ret < 0) {
+		DBG("setsockopt SO_ZEROCOPY failed on socket %d (errno: %d)",
+				sock->fd, errno);
+	}
+
+	return ret;
+}
+
+/*
+ * Consume the MSG_ZEROCOPY completion notifications of a socket until the one
+ * of send 'id' is received, meaning that the pages of all the sends up to 'id'
+ * are not referenced by the kernel anymore. Ids are assigned by the kernel to
+ * each successful MSG_ZEROCOPY send of the socket, starting at 0.
+ *
+ * 'copied' is set if the kernel had to copy the data of a send, in which case
+ * MSG_ZEROCOPY only adds overhead for this socket. 'completed_id' is set to the
+ * id of the last send covered by the consumed notifications, which can be
+ * greater than 'id'.
+ *
+ * Return 0 on success or else -1 with errno set.
+ */
+LTTNG_HIDDEN
+int lttcomm_sock_wait_zerocopy(struct lttcomm_sock *sock, uint32_t id,
+		bool *copied, uint32_t *completed_id)
+{
+	int ret;
+	struct pollfd pfd;
+
+	assert(sock);
+	assert(copied);
+	assert(completed_id);
+
+	pfd.fd = sock->fd;
+	pfd.events = 0;
+
+	for (;;) {
+		char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+		struct msghdr msg;
+		struct cmsghdr *cmsg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(sock->fd, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			int sock_err = 0;
+			socklen_t optlen = sizeof(sock_err);
+
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				PERROR("recvmsg MSG_ERRQUEUE");
+				goto end;
+			}
+
+			/* A pending socket error is reported by POLLERR too. */
+			ret = getsockopt(sock->fd, SOL_SOCKET, SO_ERROR, &sock_err,
+					&optlen);
+			if (ret < 0) {
+				PERROR("getsockopt SO_ERROR");
+				goto end;
+			}
+			if (sock_err) {
+				errno = sock_err;
+				ret = -1;
+				goto end;
+			}
+
+			ret = poll(&pfd, 1, -1);
+			if (ret < 0 && errno != EINTR) {
+				PERROR("poll zerocopy completion");
+				goto end;
+			}
+			if (ret > 0 && (pfd.revents & (POLLHUP | POLLNVAL))) {
+				errno = EPIPE;
+				ret = -1;
+				goto end;
+			}
+			continue;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+				cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			struct sock_extended_err serr;
+
+			if (!((cmsg->cmsg_level == SOL_IP &&
+					cmsg->cmsg_type == IP_RECVERR) ||
+					(cmsg->cmsg_level == SOL_IPV6 &&
+					cmsg->cmsg_type == IPV6_RECVERR))) {
+				continue;
+			}
+
+			memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+			if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+					serr.ee_errno != 0) {
+				continue;
+			}
+			if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				*copied = true;
+			}
+			/* Notifications cover the id range [ee_info, ee_data]. */
+			if ((int32_t) (serr.ee_data - id) >= 0) {
+				*completed_id = serr.ee_data;
+				ret = 0;
+				goto end;
+			}
+		}
+	}
+
+end:
+	return ret;
+}
+
+#else /* HAVE_LINUX_ERRQUEUE_H && SO_ZEROCOPY && ... */
+
+LTTNG_HIDDEN
+int lttcomm_sock_enable_zerocopy(struct lttcomm_sock *sock)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+LTTNG_HIDDEN
+int lttcomm_sock_wait_zerocopy(struct lttcomm_sock *sock, uint32_t id,
+		bool *copied, uint32_t *completed_id)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* HAVE_LINUX_ERRQUEUE_H && SO_ZEROCOPY && ... */
+
 LTTNG_HIDDEN
 void lttcomm_init(void)
 {
@@ -26,6 +26,7 @@
 #define _LTTNG_SESSIOND_COMM_H
 
 #include <limits.h>
+#include <stdbool.h>
 #include <lttng/lttng.h>
 #include <lttng/snapshot-internal.h>
 #include <lttng/save-internal.h>
@@ -41,6 +42,7 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 #include "inet.h"
@@ -107,7 +109,9 @@ enum lttcomm_sessiond_command {
 	LTTNG_ROTATION_GET_INFO               = 46,
 	LTTNG_ROTATION_SET_SCHEDULE           = 47,
 	LTTNG_SESSION_LIST_ROTATION_SCHEDULES = 48,
-	LTTNG_CREATE_SESSION_EXT              = 49
+	LTTNG_CREATE_SESSION_EXT              = 49,
+	LTTNG_ENABLE_EVENT_BATCH              = 50,
+	LTTNG_DATA_PENDING_WAIT               = 51
 };
 
 enum lttcomm_relayd_command {
@@ -139,6 +143,10 @@ enum lttcomm_relayd_command {
 	RELAYD_CLOSE_TRACE_CHUNK            = 20,
 	/* Ask the relay whether a trace chunk exists (2.11+) */
 	RELAYD_TRACE_CHUNK_EXISTS           = 21,
+	/* Send a batch of indexes, acknowledged as a whole (2.12+) */
+	RELAYD_SEND_INDEXES                 = 22,
+	/* Check the data pending of all the streams of a session (2.12+) */
+	RELAYD_SESSION_DATA_PENDING         = 23,
 };
 
 /*
@@ -259,6 +267,8 @@ struct lttcomm_proto_ops {
 			int flags);
 	ssize_t (*sendmsg) (struct lttcomm_sock *sock, const void *buf,
 			size_t len, int flags);
+	ssize_t (*sendmsgv) (struct lttcomm_sock *sock, const struct iovec *iov,
+			size_t iovcnt, int flags);
 };
 
 /*
@@ -303,6 +313,22 @@ struct lttcomm_session_msg {
 			 * - unsigned char filter_bytecode[bytecode_len]
 			 */
 		} LTTNG_PACKED disable;
+		/* Enable a batch of events of a channel. */
+		struct {
+			char channel_name[LTTNG_SYMBOL_NAME_LEN];
+			/*
+			 * Number of struct lttcomm_event_batch_entry
+			 * transmitted after this structure.
+			 */
+			uint32_t count;
+		} LTTNG_PACKED enable_batch;
+		/*
+		 * Wait at most timeout_ms for the data of a session to
+		 * stop being pending.
+		 */
+		struct {
+			uint32_t timeout_ms;
+		} LTTNG_PACKED data_pending;
 		/* Create channel */
 		struct {
 			struct lttng_channel chan LTTNG_PACKED;
@@ -453,6 +479,20 @@ struct lttcomm_session_destroy_command_header {
 	int32_t rotation_state;
 };
 
+/*
+ * Event of the LTTNG_ENABLE_EVENT_BATCH command. After this structure, the
+ * following variable-length items are transmitted:
+ * - char exclusion_names[LTTNG_SYMBOL_NAME_LEN][exclusion_count]
+ * - char filter_expression[expression_len]
+ * - unsigned char filter_bytecode[bytecode_len]
+ */
+struct lttcomm_event_batch_entry {
+	struct lttng_event event LTTNG_PACKED;
+	uint32_t exclusion_count;
+	uint32_t expression_len;
+	uint32_t bytecode_len;
+} LTTNG_PACKED;
+
 /*
  * Data structure for the response from sessiond to the lttng client.
  */
@@ -770,6 +810,10 @@ LTTNG_HIDDEN int lttcomm_sock_get_port(const struct lttcomm_sock *sock,
  */
 LTTNG_HIDDEN int lttcomm_sock_set_port(struct lttcomm_sock *sock, uint16_t port);
 
+LTTNG_HIDDEN int lttcomm_sock_enable_zerocopy(struct lttcomm_sock *sock);
+LTTNG_HIDDEN int lttcomm_sock_wait_zerocopy(struct lttcomm_sock *sock,
+		uint32_t id, bool *copied, uint32_t *completed_id);
+
 LTTNG_HIDDEN void lttcomm_init(void);
 /* Get network timeout, in milliseconds */
 LTTNG_HIDDEN unsigned long lttcomm_get_network_timeout(void);
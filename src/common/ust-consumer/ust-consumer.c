@@ -211,7 +211,7 @@ static int send_stream_to_thread(struct lttng_consumer_stream *stream,
 		stream_pipe = ctx->consumer_metadata_pipe;
 	} else {
 		consumer_add_data_stream(stream);
-		stream_pipe = ctx->consumer_data_pipe;
+		stream_pipe = consumer_get_data_shard(ctx, stream->chan)->data_pipe;
 	}
 
 	/*
@@ -1088,10 +1088,93 @@ error:
 	return ret;
 }
 
+/*
+ * Copy the sub-buffers of a stream of a channel snapshot.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_copy_stream(
+		struct lttng_consumer_snapshot_stream *snapshot_stream,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret = 0;
+	struct lttng_consumer_stream *stream = snapshot_stream->stream;
+	unsigned long consumed_pos = snapshot_stream->consumed_pos;
+	const unsigned long produced_pos = snapshot_stream->produced_pos;
+	const bool use_relayd = stream->net_seq_idx != (uint64_t) -1ULL;
+
+	while ((long) (consumed_pos - produced_pos) < 0) {
+		ssize_t read_len;
+		unsigned long len, padded_len;
+
+		health_code_update();
+
+		DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
+
+		ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				PERROR("ustctl_get_subbuf snapshot");
+				goto end;
+			}
+			DBG("UST consumer get subbuf failed. Skipping it.");
+			consumed_pos += stream->max_sb_size;
+			snapshot_stream->lost_packets++;
+			ret = 0;
+			continue;
+		}
+
+		ret = ustctl_get_subbuf_size(stream->ustream, &len);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_padded_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
+				padded_len - len, NULL);
+		if (use_relayd) {
+			if (read_len != len) {
+				ret = -EPERM;
+				goto error_put_subbuf;
+			}
+		} else {
+			if (read_len != padded_len) {
+				ret = -EPERM;
+				goto error_put_subbuf;
+			}
+		}
+
+		ret = ustctl_put_subbuf(stream->ustream);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_put_subbuf");
+			goto end;
+		}
+		consumed_pos += stream->max_sb_size;
+	}
+end:
+	return ret;
+
+error_put_subbuf:
+	if (ustctl_put_subbuf(stream->ustream) < 0) {
+		ERR("Snapshot ustctl_put_subbuf");
+	}
+	return ret;
+}
+
 /*
  * Take a snapshot of all the stream of a channel.
  * RCU read-side lock and the channel lock must be held by the caller.
  *
+ * The snapshot is taken in two phases. The positions of all the streams are
+ * sampled in a single pass, so that the snapshots of the streams end at the
+ * same time, before their data is copied by multiple threads.
+ *
  * Returns 0 on success, < 0 on error
  */
 static int snapshot_channel(struct lttng_consumer_channel *channel,
@@ -1099,10 +1182,11 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 		uint64_t nb_packets_per_stream,
 		struct lttng_consumer_local_data *ctx)
 {
-	int ret;
+	int ret = 0;
 	unsigned use_relayd = 0;
-	unsigned long consumed_pos, produced_pos;
+	size_t i, nb_streams = 0, nb_locked_streams = 0;
 	struct lttng_consumer_stream *stream;
+	struct lttng_consumer_snapshot_stream *snapshot_streams = NULL;
 
 	assert(path);
 	assert(ctx);
@@ -1116,11 +1200,28 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 	assert(!channel->monitor);
 	DBG("UST consumer snapshot channel %" PRIu64, key);
 
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		nb_streams++;
+	}
+	if (!nb_streams) {
+		goto end;
+	}
+
+	snapshot_streams = zmalloc(sizeof(*snapshot_streams) * nb_streams);
+	if (!snapshot_streams) {
+		PERROR("zmalloc snapshot streams");
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	/* Prepare the output of every stream. */
 	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
 		health_code_update();
 
 		/* Lock stream because we are about to change its state. */
 		pthread_mutex_lock(&stream->lock);
+		snapshot_streams[nb_locked_streams++].stream = stream;
+
 		assert(channel->trace_chunk);
 		if (!lttng_trace_chunk_get(channel->trace_chunk)) {
 			/*
@@ -1129,7 +1230,7 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 			 */
 			ERR("Failed to acquire reference to channel's trace chunk");
 			ret = -1;
-			goto error_unlock;
+			goto end_close_streams;
 		}
 		assert(!stream->trace_chunk);
 		stream->trace_chunk = channel->trace_chunk;
@@ -1139,17 +1240,25 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 		if (use_relayd) {
 			ret = consumer_send_relayd_stream(stream, path);
 			if (ret < 0) {
-				goto error_unlock;
+				goto end_close_streams;
 			}
 		} else {
 			ret = consumer_stream_create_output_files(stream,
 					false);
 			if (ret < 0) {
-				goto error_unlock;
+				goto end_close_streams;
 			}
 			DBG("UST consumer snapshot stream (%" PRIu64 ")",
 					stream->key);
 		}
+	}
+
+	/* Flush every stream and sample its positions. */
+	for (i = 0; i < nb_streams; i++) {
+		struct lttng_consumer_snapshot_stream *snapshot_stream =
+				&snapshot_streams[i];
+
+		stream = snapshot_stream->stream;
 
 		/*
 		 * If tracing is active, we want to perform a "full" buffer flush.
@@ -1162,19 +1271,21 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 		ret = lttng_ustconsumer_take_snapshot(stream);
 		if (ret < 0) {
 			ERR("Taking UST snapshot");
-			goto error_unlock;
+			goto end_close_streams;
 		}
 
-		ret = lttng_ustconsumer_get_produced_snapshot(stream, &produced_pos);
+		ret = lttng_ustconsumer_get_produced_snapshot(stream,
+				&snapshot_stream->produced_pos);
 		if (ret < 0) {
 			ERR("Produced UST snapshot position");
-			goto error_unlock;
+			goto end_close_streams;
 		}
 
-		ret = lttng_ustconsumer_get_consumed_snapshot(stream, &consumed_pos);
+		ret = lttng_ustconsumer_get_consumed_snapshot(stream,
+				&snapshot_stream->consumed_pos);
 		if (ret < 0) {
 			ERR("Consumerd UST snapshot position");
-			goto error_unlock;
+			goto end_close_streams;
 		}
 
 		/*
@@ -1183,80 +1294,28 @@ static int snapshot_channel(struct lttng_consumer_channel *channel,
 		 * daemon should never send a maximum stream size that is lower than
 		 * subbuffer size.
 		 */
-		consumed_pos = consumer_get_consume_start_pos(consumed_pos,
-				produced_pos, nb_packets_per_stream,
-				stream->max_sb_size);
-
-		while ((long) (consumed_pos - produced_pos) < 0) {
-			ssize_t read_len;
-			unsigned long len, padded_len;
-
-			health_code_update();
-
-			DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
-
-			ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
-			if (ret < 0) {
-				if (ret != -EAGAIN) {
-					PERROR("ustctl_get_subbuf snapshot");
-					goto error_close_stream;
-				}
-				DBG("UST consumer get subbuf failed. Skipping it.");
-				consumed_pos += stream->max_sb_size;
-				stream->chan->lost_packets++;
-				continue;
-			}
-
-			ret = ustctl_get_subbuf_size(stream->ustream, &len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_subbuf_size");
-				goto error_put_subbuf;
-			}
-
-			ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_padded_subbuf_size");
-				goto error_put_subbuf;
-			}
+		snapshot_stream->consumed_pos = consumer_get_consume_start_pos(
+				snapshot_stream->consumed_pos,
+				snapshot_stream->produced_pos,
+				nb_packets_per_stream, stream->max_sb_size);
+	}
 
-			read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
-					padded_len - len, NULL);
-			if (use_relayd) {
-				if (read_len != len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			} else {
-				if (read_len != padded_len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			}
+	ret = lttng_consumer_snapshot_copy_streams(snapshot_streams, nb_streams,
+			snapshot_copy_stream, ctx);
+	for (i = 0; i < nb_streams; i++) {
+		channel->lost_packets += snapshot_streams[i].lost_packets;
+	}
 
-			ret = ustctl_put_subbuf(stream->ustream);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_put_subbuf");
-				goto error_close_stream;
-			}
-			consumed_pos += stream->max_sb_size;
-		}
+end_close_streams:
+	for (i = 0; i < nb_locked_streams; i++) {
+		stream = snapshot_streams[i].stream;
 
 		/* Simply close the stream so we can use it on the next snapshot. */
 		consumer_stream_close(stream);
 		pthread_mutex_unlock(&stream->lock);
 	}
-
-	rcu_read_unlock();
-	return 0;
-
-error_put_subbuf:
-	if (ustctl_put_subbuf(stream->ustream) < 0) {
-		ERR("Snapshot ustctl_put_subbuf");
-	}
-error_close_stream:
-	consumer_stream_close(stream);
-error_unlock:
-	pthread_mutex_unlock(&stream->lock);
+end:
+	free(snapshot_streams);
 	rcu_read_unlock();
 	return ret;
 }
@@ -1265,6 +1324,11 @@ error_unlock:
  * Receive the metadata updates from the sessiond. Supports receiving
  * overlapping metadata, but is needs to always belong to a contiguous
  * range starting from 0.
+ * The metadata is received in the receive buffer of the channel's metadata
+ * cache, without holding the metadata cache lock, which is only taken to
+ * copy it into the cache. The receive buffer is reused by every push. The
+ * part of the metadata which is already cached is identical and dropped, so
+ * that the cached metadata is never overwritten.
  * Be careful about the locks held when calling this function: it needs
  * the metadata cache flush to concurrently progress in order to
  * complete.
@@ -1274,32 +1338,52 @@ int lttng_ustconsumer_recv_metadata(int sock, uint64_t key, uint64_t offset,
 		struct lttng_consumer_channel *channel, int timer, int wait)
 {
 	int ret, ret_code = LTTCOMM_CONSUMERD_SUCCESS;
-	char *metadata_str;
+	char *cache_data;
+	uint64_t cached_len = 0;
+	struct consumer_metadata_cache *cache = channel->metadata_cache;
+	struct lttng_dynamic_buffer *recv_buffer = &cache->recv_buffer;
 
 	DBG("UST consumer push metadata key %" PRIu64 " of len %" PRIu64, key, len);
 
-	metadata_str = zmalloc(len * sizeof(char));
-	if (!metadata_str) {
-		PERROR("zmalloc metadata string");
-		ret_code = LTTCOMM_CONSUMERD_ENOMEM;
-		goto end;
+	pthread_mutex_lock(&cache->recv_lock);
+	if (lttng_dynamic_buffer_get_capacity_left(recv_buffer) < len) {
+		ret = lttng_dynamic_buffer_set_capacity(recv_buffer, len);
+		if (ret) {
+			ERR("Failed to grow the metadata receive buffer to %" PRIu64 " bytes",
+					len);
+			ret_code = LTTCOMM_CONSUMERD_ENOMEM;
+			goto end_unlock_recv;
+		}
 	}
 
 	health_code_update();
 
 	/* Receive metadata string. */
-	ret = lttcomm_recv_unix_sock(sock, metadata_str, len);
+	ret = lttcomm_recv_unix_sock(sock, recv_buffer->data, len);
 	if (ret < 0) {
 		/* Session daemon is dead so return gracefully. */
 		ret_code = ret;
-		goto end_free;
+		goto end_unlock_recv;
 	}
 
 	health_code_update();
 
-	pthread_mutex_lock(&channel->metadata_cache->lock);
-	ret = consumer_metadata_cache_write(channel, offset, len, version,
-			metadata_str);
+	pthread_mutex_lock(&cache->lock);
+	cache_data = consumer_metadata_cache_reserve(channel, offset, len,
+			version);
+	if (!cache_data) {
+		/* Unable to handle metadata. Notify session daemon. */
+		ret_code = LTTCOMM_CONSUMERD_ERROR_METADATA;
+		pthread_mutex_unlock(&cache->lock);
+		goto end_unlock_recv;
+	}
+	if (cache->max_offset > offset) {
+		cached_len = min_t(uint64_t, len, cache->max_offset - offset);
+	}
+	memcpy(cache_data + cached_len, recv_buffer->data + cached_len,
+			len - cached_len);
+
+	ret = consumer_metadata_cache_commit(channel, offset, len);
 	if (ret < 0) {
 		/* Unable to handle metadata. Notify session daemon. */
 		ret_code = LTTCOMM_CONSUMERD_ERROR_METADATA;
@@ -1308,13 +1392,14 @@ int lttng_ustconsumer_recv_metadata(int sock, uint64_t key, uint64_t offset,
 		 * not have been updated which could create an infinite loop below when
 		 * waiting for the metadata cache to be flushed.
 		 */
-		pthread_mutex_unlock(&channel->metadata_cache->lock);
-		goto end_free;
+		pthread_mutex_unlock(&cache->lock);
+		goto end_unlock_recv;
 	}
-	pthread_mutex_unlock(&channel->metadata_cache->lock);
+	pthread_mutex_unlock(&cache->lock);
+	pthread_mutex_unlock(&cache->recv_lock);
 
 	if (!wait) {
-		goto end_free;
+		goto end;
 	}
 	while (consumer_metadata_cache_flushed(channel, offset + len, timer)) {
 		DBG("Waiting for metadata to be flushed");
@@ -1323,9 +1408,10 @@ int lttng_ustconsumer_recv_metadata(int sock, uint64_t key, uint64_t offset,
 
 		usleep(DEFAULT_METADATA_AVAILABILITY_WAIT_TIME);
 	}
+	goto end;
 
-end_free:
-	free(metadata_str);
+end_unlock_recv:
+	pthread_mutex_unlock(&cache->recv_lock);
 end:
 	return ret_code;
 }
@@ -1964,6 +2050,30 @@ error_push_metadata_fatal:
 		}
 		goto end_msg_sessiond;
 	}
+	case LTTNG_CONSUMER_SET_DATA_PENDING_PIPE:
+	{
+		int data_pending_pipe;
+
+		ret_code = LTTCOMM_CONSUMERD_SUCCESS;
+		/* Successfully received the command's type. */
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0) {
+			goto error_fatal;
+		}
+
+		ret = lttcomm_recv_fds_unix_sock(sock, &data_pending_pipe, 1);
+		if (ret != sizeof(data_pending_pipe)) {
+			ERR("Failed to receive data pending pipe");
+			goto error_fatal;
+		}
+
+		DBG("Received data pending pipe (%d)", data_pending_pipe);
+		ret = consumer_set_data_pending_pipe(data_pending_pipe);
+		if (ret) {
+			ret_code = LTTCOMM_CONSUMERD_ALREADY_SET;
+		}
+		goto end_msg_sessiond;
+	}
 	case LTTNG_CONSUMER_ROTATE_CHANNEL:
 	{
 		struct lttng_consumer_channel *channel;
@@ -2665,6 +2775,7 @@ static int notify_if_more_data(struct lttng_consumer_stream *stream,
 {
 	int ret;
 	struct ustctl_consumer_stream *ustream;
+	struct lttng_consumer_data_shard *shard;
 
 	assert(stream);
 	assert(ctx);
@@ -2690,17 +2801,18 @@ static int notify_if_more_data(struct lttng_consumer_stream *stream,
 	/* This stream still has data. Flag it and wake up the data thread. */
 	stream->has_data = 1;
 
-	if (stream->monitor && !stream->hangup_flush_done && !ctx->has_wakeup) {
+	shard = consumer_get_data_shard(ctx, stream->chan);
+	if (stream->monitor && !stream->hangup_flush_done && !shard->has_wakeup) {
 		ssize_t writelen;
 
-		writelen = lttng_pipe_write(ctx->consumer_wakeup_pipe, "!", 1);
+		writelen = lttng_pipe_write(shard->wakeup_pipe, "!", 1);
 		if (writelen < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
 			ret = writelen;
 			goto end;
 		}
 
 		/* The wake up pipe has been notified. */
-		ctx->has_wakeup = 1;
+		shard->has_wakeup = 1;
 	}
 	ret = 0;
 
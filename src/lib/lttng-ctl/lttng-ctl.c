@@ -35,6 +35,7 @@
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/uri.h>
 #include <common/utils.h>
+#include <common/dynamic-array.h>
 #include <common/dynamic-buffer.h>
 #include <lttng/lttng.h>
 #include <lttng/health-internal.h>
@@ -717,22 +718,16 @@ static int _lttng_stop_tracing(const char *session_name, int wait)
 		goto end;
 	}
 
-	/* Check for data availability */
+	/* Wait for data availability */
 	do {
-		data_ret = lttng_data_pending(session_name);
+		data_ret = lttng_data_pending_wait(session_name,
+				DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US /
+					USEC_PER_MSEC);
 		if (data_ret < 0) {
 			/* Return the data available call error. */
 			ret = data_ret;
 			goto error;
 		}
-
-		/*
-		 * Data sleep time before retrying (in usec). Don't sleep if the
-		 * call returned value indicates availability.
-		 */
-		if (data_ret) {
-			usleep(DEFAULT_DATA_AVAILABILITY_WAIT_TIME_US);
-		}
 	} while (data_ret != 0);
 
 end:
@@ -941,20 +936,18 @@ error:
 
 /*
  * Generate the filter bytecode from a given filter expression string. Put the
- * newly allocated parser context in ctxp and populate the lsm object with the
- * expression len.
+ * newly allocated parser context in ctxp.
  *
  * Return 0 on success else a LTTNG_ERR_* code and ctxp is untouched.
  */
 static int generate_filter(char *filter_expression,
-		struct lttcomm_session_msg *lsm, struct filter_parser_ctx **ctxp)
+		struct filter_parser_ctx **ctxp)
 {
 	int ret;
 	struct filter_parser_ctx *ctx = NULL;
 	FILE *fmem = NULL;
 
 	assert(filter_expression);
-	assert(lsm);
 	assert(ctxp);
 
 	/*
@@ -1043,10 +1036,6 @@ static int generate_filter(char *filter_expression,
 	dbg_printf("Size of bytecode generated: %u bytes.\n",
 			bytecode_get_len(&ctx->bytecode->b));
 
-	lsm->u.enable.bytecode_len = sizeof(ctx->bytecode->b)
-		+ bytecode_get_len(&ctx->bytecode->b);
-	lsm->u.enable.expression_len = strlen(filter_expression) + 1;
-
 	/* No need to keep the memory stream. */
 	if (fclose(fmem) != 0) {
 		PERROR("fclose");
@@ -1067,31 +1056,25 @@ error:
 }
 
 /*
- * Enable event(s) for a channel, possibly with exclusions and a filter.
- * If no event name is specified, all events are enabled.
- * If no channel name is specified, the default name is used.
- * If filter expression is not NULL, the filter is set for the event.
- * If exclusion count is not zero, the exclusions are set for the event.
- * Returns size of returned session payload data or a negative error code.
+ * Append the exclusion names, filter expression and filter bytecode of an
+ * event to a buffer, in the order expected by the session daemon. For the
+ * agent domains, the filtering on the logger name and log level of the event
+ * is added to the filter expression.
+ *
+ * The lengths of the appended filter expression and bytecode are returned in
+ * expression_len and bytecode_len.
+ *
+ * Return 0 on success else a negative LTTng error code.
  */
-int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
-		struct lttng_event *ev, const char *channel_name,
+static int serialize_event_filter(struct lttng_dynamic_buffer *buffer,
+		enum lttng_domain_type domain, struct lttng_event *ev,
 		const char *original_filter_expression,
-		int exclusion_count, char **exclusion_list)
+		int exclusion_count, char **exclusion_list,
+		uint32_t *expression_len, uint32_t *bytecode_len)
 {
-	struct lttcomm_session_msg lsm;
-	struct lttng_dynamic_buffer send_buffer;
-	int ret = 0, i, fd_to_send = -1;
-	bool send_fd = false;
-	unsigned int free_filter_expression = 0;
+	int ret = 0, i;
+	bool free_filter_expression = false;
 	struct filter_parser_ctx *ctx = NULL;
-
-	/*
-	 * We have either a filter or some exclusions, so we need to set up
-	 * a variable-length memory block from where to send the data.
-	 */
-	lttng_dynamic_buffer_init(&send_buffer);
-
 	/*
 	 * Cast as non-const since we may replace the filter expression
 	 * by a dynamically allocated string. Otherwise, the original
@@ -1099,10 +1082,8 @@ int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 	 */
 	char *filter_expression = (char *) original_filter_expression;
 
-	if (handle == NULL || ev == NULL) {
-		ret = -LTTNG_ERR_INVALID;
-		goto error;
-	}
+	*expression_len = 0;
+	*bytecode_len = 0;
 
 	/*
 	 * Empty filter string will always be rejected by the parser
@@ -1111,77 +1092,43 @@ int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 	 */
 	if (filter_expression && filter_expression[0] == '\0') {
 		ret = -LTTNG_ERR_INVALID;
-		goto error;
+		goto end;
 	}
 
-	memset(&lsm, 0, sizeof(lsm));
+	if (domain == LTTNG_DOMAIN_JUL || domain == LTTNG_DOMAIN_LOG4J ||
+			domain == LTTNG_DOMAIN_PYTHON) {
+		char *agent_filter;
 
-	/* If no channel name, send empty string. */
-	if (channel_name == NULL) {
-		lttng_ctl_copy_string(lsm.u.enable.channel_name, "",
-				sizeof(lsm.u.enable.channel_name));
-	} else {
-		lttng_ctl_copy_string(lsm.u.enable.channel_name, channel_name,
-				sizeof(lsm.u.enable.channel_name));
-	}
-
-	lsm.cmd_type = LTTNG_ENABLE_EVENT;
-	if (ev->name[0] == '\0') {
-		/* Enable all events */
-		lttng_ctl_copy_string(ev->name, "*", sizeof(ev->name));
+		/* Setup JUL filter if needed. */
+		agent_filter = set_agent_filter(filter_expression, ev);
+		if (agent_filter) {
+			/*
+			 * With an agent filter, the original filter has
+			 * been added to it thus replace the filter
+			 * expression.
+			 */
+			filter_expression = agent_filter;
+			free_filter_expression = true;
+		}
 	}
 
-	COPY_DOMAIN_PACKED(lsm.domain, handle->domain);
-	memcpy(&lsm.u.enable.event, ev, sizeof(lsm.u.enable.event));
-
-	lttng_ctl_copy_string(lsm.session.name, handle->session_name,
-			sizeof(lsm.session.name));
-	lsm.u.enable.exclusion_count = exclusion_count;
-	lsm.u.enable.bytecode_len = 0;
-
 	/* Parse filter expression. */
-	if (filter_expression != NULL || handle->domain.type == LTTNG_DOMAIN_JUL
-			|| handle->domain.type == LTTNG_DOMAIN_LOG4J
-			|| handle->domain.type == LTTNG_DOMAIN_PYTHON) {
-		if (handle->domain.type == LTTNG_DOMAIN_JUL ||
-				handle->domain.type == LTTNG_DOMAIN_LOG4J ||
-				handle->domain.type == LTTNG_DOMAIN_PYTHON) {
-			char *agent_filter;
-
-			/* Setup JUL filter if needed. */
-			agent_filter = set_agent_filter(filter_expression, ev);
-			if (!agent_filter) {
-				if (!filter_expression) {
-					/*
-					 * No JUL and no filter, just skip
-					 * everything below.
-					 */
-					goto ask_sessiond;
-				}
-			} else {
-				/*
-				 * With an agent filter, the original filter has
-				 * been added to it thus replace the filter
-				 * expression.
-				 */
-				filter_expression = agent_filter;
-				free_filter_expression = 1;
-			}
-		}
-
-		ret = generate_filter(filter_expression, &lsm, &ctx);
+	if (filter_expression) {
+		ret = generate_filter(filter_expression, &ctx);
 		if (ret) {
-			goto filter_error;
+			goto end;
 		}
+		*expression_len = strlen(filter_expression) + 1;
+		*bytecode_len = sizeof(ctx->bytecode->b)
+			+ bytecode_get_len(&ctx->bytecode->b);
 	}
 
-	ret = lttng_dynamic_buffer_set_capacity(&send_buffer,
-			lsm.u.enable.bytecode_len
-			+ lsm.u.enable.expression_len
+	ret = lttng_dynamic_buffer_set_capacity(buffer, buffer->size
+			+ *bytecode_len + *expression_len
 			+ LTTNG_SYMBOL_NAME_LEN * exclusion_count);
 	if (ret) {
 		ret = -LTTNG_ERR_EXCLUSION_NOMEM;
-		goto mem_error;
+		goto end;
 	}
 
 	/* Put exclusion names first in the data. */
@@ -1193,33 +1140,114 @@ int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 		if (exclusion_len == LTTNG_SYMBOL_NAME_LEN) {
 			/* Exclusion is not NULL-terminated. */
 			ret = -LTTNG_ERR_INVALID;
-			goto mem_error;
+			goto end;
 		}
 
-		ret = lttng_dynamic_buffer_append(&send_buffer,
+		ret = lttng_dynamic_buffer_append(buffer,
 				*(exclusion_list + i),
 				LTTNG_SYMBOL_NAME_LEN);
 		if (ret) {
-			goto mem_error;
+			goto end;
 		}
 	}
 
 	/* Add filter expression next. */
 	if (filter_expression) {
-		ret = lttng_dynamic_buffer_append(&send_buffer,
-				filter_expression, lsm.u.enable.expression_len);
+		ret = lttng_dynamic_buffer_append(buffer,
+				filter_expression, *expression_len);
 		if (ret) {
-			goto mem_error;
+			goto end;
 		}
 	}
 	/* Add filter bytecode next. */
-	if (ctx && lsm.u.enable.bytecode_len != 0) {
-		ret = lttng_dynamic_buffer_append(&send_buffer,
-				&ctx->bytecode->b, lsm.u.enable.bytecode_len);
+	if (ctx) {
+		ret = lttng_dynamic_buffer_append(buffer,
+				&ctx->bytecode->b, *bytecode_len);
 		if (ret) {
-			goto mem_error;
+			goto end;
 		}
 	}
+
+end:
+	if (ctx) {
+		filter_bytecode_free(ctx);
+		filter_ir_free(ctx);
+		filter_parser_ctx_free(ctx);
+	}
+	if (free_filter_expression) {
+		/*
+		 * The filter expression has been replaced and must be freed as
+		 * it is not the original filter expression received as a
+		 * parameter.
+		 */
+		free(filter_expression);
+	}
+	return ret;
+}
+
+/*
+ * Enable event(s) for a channel, possibly with exclusions and a filter.
+ * If no event name is specified, all events are enabled.
+ * If no channel name is specified, the default name is used.
+ * If filter expression is not NULL, the filter is set for the event.
+ * If exclusion count is not zero, the exclusions are set for the event.
+ * Returns size of returned session payload data or a negative error code.
+ */
+int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
+		struct lttng_event *ev, const char *channel_name,
+		const char *filter_expression,
+		int exclusion_count, char **exclusion_list)
+{
+	struct lttcomm_session_msg lsm;
+	struct lttng_dynamic_buffer send_buffer;
+	uint32_t expression_len, bytecode_len;
+	int ret = 0, fd_to_send = -1;
+	bool send_fd = false;
+
+	/*
+	 * We may have a filter or some exclusions, so we need to set up
+	 * a variable-length memory block from where to send the data.
+	 */
+	lttng_dynamic_buffer_init(&send_buffer);
+
+	if (handle == NULL || ev == NULL) {
+		ret = -LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+
+	/* If no channel name, send empty string. */
+	if (channel_name == NULL) {
+		lttng_ctl_copy_string(lsm.u.enable.channel_name, "",
+				sizeof(lsm.u.enable.channel_name));
+	} else {
+		lttng_ctl_copy_string(lsm.u.enable.channel_name, channel_name,
+				sizeof(lsm.u.enable.channel_name));
+	}
+
+	lsm.cmd_type = LTTNG_ENABLE_EVENT;
+	if (ev->name[0] == '\0') {
+		/* Enable all events */
+		lttng_ctl_copy_string(ev->name, "*", sizeof(ev->name));
+	}
+
+	COPY_DOMAIN_PACKED(lsm.domain, handle->domain);
+	memcpy(&lsm.u.enable.event, ev, sizeof(lsm.u.enable.event));
+
+	lttng_ctl_copy_string(lsm.session.name, handle->session_name,
+			sizeof(lsm.session.name));
+	lsm.u.enable.exclusion_count = exclusion_count;
+
+	ret = serialize_event_filter(&send_buffer, handle->domain.type, ev,
+			filter_expression, exclusion_count, exclusion_list,
+			&expression_len, &bytecode_len);
+	if (ret) {
+		goto end;
+	}
+	lsm.u.enable.expression_len = expression_len;
+	lsm.u.enable.bytecode_len = bytecode_len;
+
 	if (ev->extended.ptr) {
 		struct lttng_event_extended *ev_ext =
 			(struct lttng_event_extended *) ev->extended.ptr;
@@ -1233,7 +1261,7 @@ int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 				ev_ext->probe_location, &send_buffer,
 				&fd_to_send);
 			if (ret < 0) {
-				goto mem_error;
+				goto end;
 			}
 
 			send_fd = fd_to_send >= 0;
@@ -1251,32 +1279,289 @@ int lttng_enable_event_with_exclusions(struct lttng_handle *handle,
 			send_fd ? 1 : 0,
 			send_buffer.size ? send_buffer.data : NULL,
 			send_buffer.size, NULL, NULL, 0);
+end:
+	lttng_dynamic_buffer_reset(&send_buffer);
+	return ret;
+}
 
-mem_error:
-	if (filter_expression && ctx) {
-		filter_bytecode_free(ctx);
-		filter_ir_free(ctx);
-		filter_parser_ctx_free(ctx);
+/*
+ * Event added to a batch, with copies of its filter expression and
+ * exclusions.
+ */
+struct lttng_event_batch_entry {
+	struct lttng_event event;
+	char *filter_expression;
+	int exclusion_count;
+	char **exclusion_list;
+};
+
+struct lttng_event_batch {
+	/* Array of struct lttng_event_batch_entry. */
+	struct lttng_dynamic_array entries;
+};
+
+static void event_batch_entry_fini(void *element)
+{
+	struct lttng_event_batch_entry *entry = element;
+	int i;
+
+	for (i = 0; i < entry->exclusion_count; i++) {
+		free(entry->exclusion_list[i]);
 	}
-filter_error:
-	if (free_filter_expression) {
-		/*
-		 * The filter expression has been replaced and must be freed as
-		 * it is not the original filter expression received as a
-		 * parameter.
-		 */
-		free(filter_expression);
+	free(entry->exclusion_list);
+	free(entry->filter_expression);
+}
+
+struct lttng_event_batch *lttng_event_batch_create(void)
+{
+	struct lttng_event_batch *batch;
+
+	batch = zmalloc(sizeof(*batch));
+	if (!batch) {
+		goto end;
+	}
+
+	lttng_dynamic_array_init(&batch->entries,
+			sizeof(struct lttng_event_batch_entry),
+			event_batch_entry_fini);
+end:
+	return batch;
+}
+
+void lttng_event_batch_destroy(struct lttng_event_batch *batch)
+{
+	if (!batch) {
+		return;
+	}
+
+	lttng_dynamic_array_reset(&batch->entries);
+	free(batch);
+}
+
+int lttng_event_batch_add(struct lttng_event_batch *batch,
+		const struct lttng_event *ev, const char *filter_expression,
+		int exclusion_count, char **exclusion_list)
+{
+	int ret = 0, i;
+	struct lttng_event_batch_entry entry;
+
+	if (!batch || !ev || exclusion_count < 0 ||
+			(exclusion_count && !exclusion_list)) {
+		ret = -LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	/* A probe location comes with a file descriptor to send. */
+	if (lttng_event_get_userspace_probe_location(ev)) {
+		ret = -LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	memcpy(&entry.event, ev, sizeof(entry.event));
+	entry.event.extended.ptr = NULL;
+	if (entry.event.name[0] == '\0') {
+		/* Enable all events */
+		lttng_ctl_copy_string(entry.event.name, "*",
+				sizeof(entry.event.name));
+	}
+
+	if (filter_expression) {
+		entry.filter_expression = strdup(filter_expression);
+		if (!entry.filter_expression) {
+			ret = -LTTNG_ERR_NOMEM;
+			goto error;
+		}
+	}
+
+	if (exclusion_count) {
+		entry.exclusion_list = zmalloc(exclusion_count * sizeof(char *));
+		if (!entry.exclusion_list) {
+			ret = -LTTNG_ERR_NOMEM;
+			goto error;
+		}
+
+		for (i = 0; i < exclusion_count; i++) {
+			entry.exclusion_list[i] = strdup(exclusion_list[i]);
+			if (!entry.exclusion_list[i]) {
+				ret = -LTTNG_ERR_NOMEM;
+				goto error;
+			}
+			entry.exclusion_count++;
+		}
+	}
+
+	ret = lttng_dynamic_array_add_element(&batch->entries, &entry);
+	if (ret) {
+		ret = -LTTNG_ERR_NOMEM;
+		goto error;
 	}
+end:
+	return ret;
 error:
-	/*
-	 * Return directly to the caller and don't ask the sessiond since
-	 * something went wrong in the parsing of data above.
-	 */
-	lttng_dynamic_buffer_reset(&send_buffer);
+	event_batch_entry_fini(&entry);
 	return ret;
+}
 
-ask_sessiond:
-	ret = lttng_ctl_ask_sessiond(&lsm, NULL);
+/*
+ * Send a LTTNG_ENABLE_EVENT_BATCH command and its events.
+ *
+ * A session daemon which doesn't know the command replies LTTNG_ERR_UND and
+ * closes the connection without reading the events: sending a batch larger
+ * than the socket buffer then fails. Such a failure is reported as
+ * -LTTNG_ERR_UND so that the caller falls back to enabling the events one by
+ * one. A session daemon which knows the command only processes it once all
+ * the events are received, so none of them is enabled in that case.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+static int ask_sessiond_enable_event_batch(struct lttcomm_session_msg *lsm,
+		const void *events, size_t events_len)
+{
+	int ret;
+	struct lttcomm_lttng_msg llm;
+
+	ret = connect_sessiond();
+	if (ret < 0) {
+		ret = -LTTNG_ERR_NO_SESSIOND;
+		goto end;
+	} else {
+		sessiond_socket = ret;
+		connected = 1;
+	}
+
+	ret = send_session_msg(lsm);
+	if (ret < 0) {
+		goto end;
+	}
+	ret = send_session_varlen(events, events_len);
+	if (ret < 0) {
+		DBG("Sending the event batch failed, assuming the session daemon does not support it");
+		ret = -LTTNG_ERR_UND;
+		goto end;
+	}
+
+	ret = recv_data_sessiond(&llm, sizeof(llm));
+	if (ret < 0) {
+		goto end;
+	}
+	if (llm.ret_code != LTTNG_OK) {
+		ret = -llm.ret_code;
+		goto end;
+	}
+	ret = 0;
+end:
+	disconnect_sessiond();
+	return ret;
+}
+
+/*
+ * Enable the events of a batch for a channel one by one, for session
+ * daemons which don't know the batch command.
+ */
+static int enable_event_batch_one_by_one(struct lttng_handle *handle,
+		const char *channel_name, struct lttng_event_batch *batch)
+{
+	int ret = 0;
+	size_t i;
+
+	for (i = 0; i < lttng_dynamic_array_get_count(&batch->entries); i++) {
+		struct lttng_event_batch_entry *entry =
+				lttng_dynamic_array_get_element(
+					&batch->entries, i);
+
+		ret = lttng_enable_event_with_exclusions(handle, &entry->event,
+				channel_name, entry->filter_expression,
+				entry->exclusion_count, entry->exclusion_list);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Enable all the events of a batch for a channel with a single command.
+ * If no channel name is specified, the default name is used.
+ * Returns 0 on success or a negative error code.
+ */
+int lttng_enable_event_batch(struct lttng_handle *handle,
+		const char *channel_name, struct lttng_event_batch *batch)
+{
+	int ret = 0;
+	size_t i, count;
+	struct lttcomm_session_msg lsm;
+	struct lttng_dynamic_buffer send_buffer;
+
+	lttng_dynamic_buffer_init(&send_buffer);
+
+	if (handle == NULL || batch == NULL) {
+		ret = -LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	count = lttng_dynamic_array_get_count(&batch->entries);
+	if (count == 0) {
+		goto end;
+	} else if (count > UINT32_MAX) {
+		ret = -LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+	lsm.cmd_type = LTTNG_ENABLE_EVENT_BATCH;
+	COPY_DOMAIN_PACKED(lsm.domain, handle->domain);
+	lttng_ctl_copy_string(lsm.session.name, handle->session_name,
+			sizeof(lsm.session.name));
+	/* If no channel name, send empty string. */
+	lttng_ctl_copy_string(lsm.u.enable_batch.channel_name,
+			channel_name ? channel_name : "",
+			sizeof(lsm.u.enable_batch.channel_name));
+	lsm.u.enable_batch.count = count;
+
+	for (i = 0; i < count; i++) {
+		struct lttng_event_batch_entry *entry =
+				lttng_dynamic_array_get_element(
+					&batch->entries, i);
+		struct lttcomm_event_batch_entry *comm_entry;
+		const size_t comm_entry_offset = send_buffer.size;
+		uint32_t expression_len, bytecode_len;
+
+		/* The entry header is filled once its payload is appended. */
+		ret = lttng_dynamic_buffer_set_size(&send_buffer,
+				comm_entry_offset + sizeof(*comm_entry));
+		if (ret) {
+			ret = -LTTNG_ERR_NOMEM;
+			goto end;
+		}
+
+		ret = serialize_event_filter(&send_buffer, handle->domain.type,
+				&entry->event, entry->filter_expression,
+				entry->exclusion_count, entry->exclusion_list,
+				&expression_len, &bytecode_len);
+		if (ret) {
+			goto end;
+		}
+
+		comm_entry = (struct lttcomm_event_batch_entry *)
+				(send_buffer.data + comm_entry_offset);
+		memcpy(&comm_entry->event, &entry->event,
+				sizeof(comm_entry->event));
+		comm_entry->exclusion_count = entry->exclusion_count;
+		comm_entry->expression_len = expression_len;
+		comm_entry->bytecode_len = bytecode_len;
+	}
+
+	ret = ask_sessiond_enable_event_batch(&lsm, send_buffer.data,
+			send_buffer.size);
+	if (ret == -LTTNG_ERR_UND) {
+		ret = enable_event_batch_one_by_one(handle, channel_name,
+				batch);
+	}
+end:
+	lttng_dynamic_buffer_reset(&send_buffer);
 	return ret;
 }
 
@@ -1378,10 +1663,13 @@ int lttng_disable_event_ext(struct lttng_handle *handle,
 			}
 		}
 
-		ret = generate_filter(filter_expression, &lsm, &ctx);
+		ret = generate_filter(filter_expression, &ctx);
 		if (ret) {
 			goto filter_error;
 		}
+		lsm.u.disable.bytecode_len = sizeof(ctx->bytecode->b)
+			+ bytecode_get_len(&ctx->bytecode->b);
+		lsm.u.disable.expression_len = strlen(filter_expression) + 1;
 	}
 
 	varlen_data = zmalloc(lsm.u.disable.bytecode_len
@@ -2834,12 +3122,8 @@ int _lttng_create_session_ext(const char *name, const char *url,
 	return -ENOSYS;
 }
 
-/*
- * For a given session name, this call checks if the data is ready to be read
- * or is still being extracted by the consumer(s) hence not ready to be used by
- * any readers.
- */
-int lttng_data_pending(const char *session_name)
+static int ask_data_pending(const char *session_name,
+		enum lttcomm_sessiond_command cmd_type, unsigned int timeout_ms)
 {
 	int ret;
 	struct lttcomm_session_msg lsm;
@@ -2850,7 +3134,8 @@ int lttng_data_pending(const char *session_name)
 	}
 
 	memset(&lsm, 0, sizeof(lsm));
-	lsm.cmd_type = LTTNG_DATA_PENDING;
+	lsm.cmd_type = cmd_type;
+	lsm.u.data_pending.timeout_ms = timeout_ms;
 
 	lttng_ctl_copy_string(lsm.session.name, session_name,
 			sizeof(lsm.session.name));
@@ -2874,6 +3159,41 @@ end:
 	return ret;
 }
 
+/*
+ * For a given session name, this call checks if the data is ready to be read
+ * or is still being extracted by the consumer(s) hence not ready to be used by
+ * any readers.
+ */
+int lttng_data_pending(const char *session_name)
+{
+	return ask_data_pending(session_name, LTTNG_DATA_PENDING, 0);
+}
+
+/*
+ * Same as lttng_data_pending(), but the session daemon only replies once the
+ * data is no longer pending or once timeout_ms has elapsed.
+ */
+int lttng_data_pending_wait(const char *session_name, unsigned int timeout_ms)
+{
+	int ret;
+
+	ret = ask_data_pending(session_name, LTTNG_DATA_PENDING_WAIT,
+			timeout_ms);
+	if (ret != -LTTNG_ERR_UND) {
+		goto end;
+	}
+
+	/* The session daemon predates this command: poll instead. */
+	ret = lttng_data_pending(session_name);
+	if (ret != 1) {
+		goto end;
+	}
+	usleep(timeout_ms * USEC_PER_MSEC);
+	ret = lttng_data_pending(session_name);
+end:
+	return ret;
+}
+
 /*
  * List PIDs in the tracker.
  *
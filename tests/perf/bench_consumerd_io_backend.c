@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Measure the throughput of the two backends that can be used by the consumer
+ * daemon's data threads to write the sub-buffers of their streams to local
+ * trace files:
+ *
+ *   - "sync": a blocking write(), a sync_file_range(WRITE) of the written
+ *     range and a blocking writeback wait followed by a
+ *     posix_fadvise(DONTNEED) of the previous sub-buffer (historical
+ *     behaviour);
+ *   - "io_uring": a single io_uring submission per sub-buffer carrying the
+ *     write and the same writeback hints, of which only the write is waited
+ *     for.
+ *
+ * A single thread writes one sub-buffer at a time to each of NR_STREAMS
+ * files in a round-robin fashion, as a data thread does. The throughput is
+ * reported both when the last sub-buffer has been written (the point at
+ * which the consumer daemon is done with its sub-buffers) and once all the
+ * writeback operations have completed.
+ *
+ * Each backend is measured on a tmpfs directory and on a disk-backed
+ * directory, set with the BENCH_TMPFS_DIR (default: /dev/shm) and
+ * BENCH_DISK_DIR (default: /var/tmp) environment variables.
+ *
+ * Usage: bench_consumerd_io_backend [NR_STREAMS [SUBBUF_SIZE_KIB [TOTAL_SIZE_MIB]]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/compat/fcntl.h>
+#include <common/compat/io-uring.h>
+#include <common/readwrite.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+#define NUM_TESTS			5
+#define DEFAULT_NR_STREAMS		16
+#define DEFAULT_SUBBUF_SIZE_KIB		1024
+#define DEFAULT_TOTAL_SIZE_MIB		1024
+#define DEFAULT_TMPFS_DIR		"/dev/shm"
+#define DEFAULT_DISK_DIR		"/var/tmp"
+/* Same sizing as the consumer daemon's io_uring instances. */
+#define IO_URING_ENTRIES		64
+#define IO_URING_OP_WRITE		1ULL
+
+enum backend {
+	BACKEND_SYNC,
+	BACKEND_IO_URING,
+};
+
+static const char *backend_names[] = {
+	[BACKEND_SYNC] = "sync",
+	[BACKEND_IO_URING] = "io_uring",
+};
+
+struct bench {
+	enum backend backend;
+	unsigned int nr_streams;
+	size_t subbuf_size;
+	uint64_t total_size;
+	char *subbuf;
+	int *fds;
+	/* Write position of each stream. */
+	off_t *offsets;
+	struct lttng_io_uring *ring;
+	unsigned int inflight;
+	bool write_done;
+	int32_t write_res;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_subbuf_sync(struct bench *bench, unsigned int stream)
+{
+	ssize_t ret;
+	const int fd = bench->fds[stream];
+	const off_t offset = bench->offsets[stream];
+
+	ret = lttng_write(fd, bench->subbuf, bench->subbuf_size);
+	if (ret != bench->subbuf_size) {
+		diag("write: %s", strerror(errno));
+		return -1;
+	}
+	(void) lttng_sync_file_range(fd, offset, bench->subbuf_size,
+			SYNC_FILE_RANGE_WRITE);
+	if (offset >= bench->subbuf_size) {
+		(void) lttng_sync_file_range(fd, offset - bench->subbuf_size,
+				bench->subbuf_size,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER);
+		(void) posix_fadvise(fd, offset - bench->subbuf_size,
+				bench->subbuf_size, POSIX_FADV_DONTNEED);
+	}
+	return 0;
+}
+
+static void complete_op(uint64_t user_data, int32_t res, void *data)
+{
+	struct bench *bench = data;
+
+	bench->inflight--;
+	if (user_data & IO_URING_OP_WRITE) {
+		bench->write_res = res;
+		bench->write_done = true;
+	}
+}
+
+static int wait_completions(struct bench *bench)
+{
+	int ret;
+
+	ret = lttng_io_uring_submit(bench->ring, 1);
+	if (ret < 0) {
+		diag("io_uring_enter: %s", strerror(-ret));
+		return -1;
+	}
+	(void) lttng_io_uring_reap(bench->ring, complete_op, bench);
+	return 0;
+}
+
+static int write_subbuf_io_uring(struct bench *bench, unsigned int stream)
+{
+	const int fd = bench->fds[stream];
+	const off_t offset = bench->offsets[stream];
+	const bool release_prev = offset >= bench->subbuf_size;
+	const unsigned int nr_ops = release_prev ? 4 : 2;
+
+	while (bench->inflight + nr_ops > IO_URING_ENTRIES) {
+		if (wait_completions(bench)) {
+			return -1;
+		}
+	}
+
+	(void) lttng_io_uring_queue_write(bench->ring, fd, bench->subbuf,
+			bench->subbuf_size, IO_URING_OP_WRITE, true);
+	(void) lttng_io_uring_queue_sync_file_range(bench->ring, fd, offset,
+			bench->subbuf_size, SYNC_FILE_RANGE_WRITE, 0, false);
+	if (release_prev) {
+		(void) lttng_io_uring_queue_sync_file_range(bench->ring, fd,
+				offset - bench->subbuf_size, bench->subbuf_size,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER, 0, true);
+		(void) lttng_io_uring_queue_fadvise(bench->ring, fd,
+				offset - bench->subbuf_size, bench->subbuf_size,
+				POSIX_FADV_DONTNEED, 0, false);
+	}
+	bench->inflight += nr_ops;
+	bench->write_done = false;
+
+	while (!bench->write_done) {
+		if (wait_completions(bench)) {
+			return -1;
+		}
+	}
+	if (bench->write_res != bench->subbuf_size) {
+		diag("io_uring write: %s", bench->write_res < 0 ?
+				strerror(-bench->write_res) : "short write");
+		return -1;
+	}
+	return 0;
+}
+
+static void close_files(struct bench *bench, const char *dir)
+{
+	unsigned int i;
+	char path[PATH_MAX];
+
+	for (i = 0; i < bench->nr_streams; i++) {
+		if (bench->fds[i] < 0) {
+			continue;
+		}
+		(void) close(bench->fds[i]);
+		snprintf(path, sizeof(path), "%s/bench-io-backend-%d-%u",
+				dir, (int) getpid(), i);
+		(void) unlink(path);
+	}
+}
+
+static int open_files(struct bench *bench, const char *dir)
+{
+	unsigned int i;
+	char path[PATH_MAX];
+
+	for (i = 0; i < bench->nr_streams; i++) {
+		bench->fds[i] = -1;
+	}
+	for (i = 0; i < bench->nr_streams; i++) {
+		snprintf(path, sizeof(path), "%s/bench-io-backend-%d-%u",
+				dir, (int) getpid(), i);
+		bench->fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC,
+				S_IRUSR | S_IWUSR);
+		if (bench->fds[i] < 0) {
+			diag("open %s: %s", path, strerror(errno));
+			return -1;
+		}
+		bench->offsets[i] = 0;
+	}
+	return 0;
+}
+
+static int run_bench(enum backend backend, const char *dir,
+		unsigned int nr_streams, size_t subbuf_size, uint64_t total_size)
+{
+	int ret = -1;
+	uint64_t written = 0, start, end_write, end_drain;
+	unsigned int stream = 0;
+	struct bench bench = {
+		.backend = backend,
+		.nr_streams = nr_streams,
+		.subbuf_size = subbuf_size,
+		.total_size = total_size,
+	};
+
+	bench.subbuf = malloc(subbuf_size);
+	bench.fds = calloc(nr_streams, sizeof(*bench.fds));
+	bench.offsets = calloc(nr_streams, sizeof(*bench.offsets));
+	if (!bench.subbuf || !bench.fds || !bench.offsets) {
+		diag("Allocation failure");
+		goto end;
+	}
+	memset(bench.subbuf, 0x42, subbuf_size);
+
+	if (backend == BACKEND_IO_URING) {
+		bench.ring = lttng_io_uring_create(IO_URING_ENTRIES);
+		if (!bench.ring) {
+			diag("io_uring creation failed: %s", strerror(errno));
+			goto end;
+		}
+	}
+
+	if (open_files(&bench, dir)) {
+		goto end_close;
+	}
+
+	start = now_ns();
+	while (written < total_size) {
+		if (backend == BACKEND_SYNC) {
+			ret = write_subbuf_sync(&bench, stream);
+		} else {
+			ret = write_subbuf_io_uring(&bench, stream);
+		}
+		if (ret) {
+			goto end_close;
+		}
+		bench.offsets[stream] += subbuf_size;
+		written += subbuf_size;
+		stream = (stream + 1) % nr_streams;
+	}
+	end_write = now_ns();
+
+	/* Wait for the writeback operations still in flight. */
+	while (bench.inflight > 0) {
+		if (wait_completions(&bench)) {
+			ret = -1;
+			goto end_close;
+		}
+	}
+	end_drain = now_ns();
+
+	diag("%s on %s: %" PRIu64 " MiB/s written, %" PRIu64 " MiB/s including writeback completion",
+			backend_names[backend], dir,
+			(written >> 20) * 1000000000ULL / (end_write - start),
+			(written >> 20) * 1000000000ULL / (end_drain - start));
+	ret = 0;
+end_close:
+	close_files(&bench, dir);
+	lttng_io_uring_destroy(bench.ring);
+end:
+	free(bench.subbuf);
+	free(bench.fds);
+	free(bench.offsets);
+	return ret;
+}
+
+static const char *get_dir(const char *env_name, const char *default_dir)
+{
+	const char *dir = getenv(env_name);
+
+	return dir ? dir : default_dir;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	bool io_uring_supported;
+	struct lttng_io_uring *ring;
+	unsigned int nr_streams = DEFAULT_NR_STREAMS;
+	size_t subbuf_size = DEFAULT_SUBBUF_SIZE_KIB * 1024ULL;
+	uint64_t total_size = DEFAULT_TOTAL_SIZE_MIB * 1024ULL * 1024ULL;
+	const char *dirs[] = {
+		get_dir("BENCH_TMPFS_DIR", DEFAULT_TMPFS_DIR),
+		get_dir("BENCH_DISK_DIR", DEFAULT_DISK_DIR),
+	};
+
+	if (argc > 1) {
+		nr_streams = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		subbuf_size = strtoul(argv[2], NULL, 10) * 1024ULL;
+	}
+	if (argc > 3) {
+		total_size = strtoull(argv[3], NULL, 10) * 1024ULL * 1024ULL;
+	}
+
+	plan_tests(NUM_TESTS);
+
+	ok(nr_streams > 0 && subbuf_size > 0 && subbuf_size <= UINT32_MAX &&
+			total_size >= subbuf_size, "Valid parameters");
+
+	ring = lttng_io_uring_create(IO_URING_ENTRIES);
+	io_uring_supported = ring != NULL;
+	lttng_io_uring_destroy(ring);
+
+	for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		ok(run_bench(BACKEND_SYNC, dirs[i], nr_streams, subbuf_size,
+				total_size) == 0,
+				"Write throughput of the sync backend on %s",
+				dirs[i]);
+		if (!io_uring_supported) {
+			skip(1, "io_uring is not supported");
+			continue;
+		}
+		ok(run_bench(BACKEND_IO_URING, dirs[i], nr_streams, subbuf_size,
+				total_size) == 0,
+				"Write throughput of the io_uring backend on %s",
+				dirs[i]);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Model benchmark of the two strategies that can be used by the consumer
+ * daemon's data thread to monitor its streams:
+ *
+ *   - "rebuild": a poll() array rebuilt from scratch every time a stream is
+ *     added or removed, scanned entirely after every wakeup (historical
+ *     behaviour);
+ *   - "incremental": a poll set (epoll when available) to which streams are
+ *     added and from which they are removed one at a time, and of which only
+ *     the ready streams are considered after a wakeup.
+ *
+ * This program does not run the consumer daemon's data thread: both
+ * strategies are reimplemented here and streams are simulated by pipes. A
+ * producer thread writes a timestamp to a random stream and waits for the
+ * consumer thread to have read it. Every CHURN_PERIOD wakeups, the producer
+ * also asks the consumer to remove a stream and add it back, as happens when
+ * short-lived applications come and go. The measured wakeup-to-consume
+ * latency thus only accounts for the monitoring of the streams, not for the
+ * reading and writing of their sub-buffers.
+ *
+ * Usage: bench_data_poll_model [NR_STREAMS [NR_WAKEUPS]]
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/compat/poll.h>
+#include <common/readwrite.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+#define NUM_TESTS		4
+#define DEFAULT_NR_STREAMS	10000
+#define DEFAULT_NR_WAKEUPS	20000
+/* Number of wakeups between two stream removal/addition. */
+#define CHURN_PERIOD		10
+
+enum strategy {
+	STRATEGY_REBUILD,
+	STRATEGY_INCREMENTAL,
+};
+
+static const char *strategy_names[] = {
+	[STRATEGY_REBUILD] = "rebuild",
+	[STRATEGY_INCREMENTAL] = "incremental",
+};
+
+struct bench {
+	enum strategy strategy;
+	unsigned int nr_streams;
+	unsigned int nr_wakeups;
+	/* Pipe of each stream; the consumer reads from [0]. */
+	int (*stream_pipes)[2];
+	/* Streams currently monitored by the consumer. */
+	bool *stream_active;
+	/* Used by the producer to request the removal of a stream. */
+	int ctrl_pipe[2];
+	/* Posted by the consumer once a wakeup has been handled. */
+	sem_t consumed;
+	/* Latency of each wakeup, in nanoseconds. */
+	uint64_t *latencies;
+	unsigned int nr_latencies;
+	int error;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Consume a timestamp from a ready stream and record the latency.
+ */
+static int consume_stream(struct bench *bench, int fd)
+{
+	uint64_t ts;
+	ssize_t ret;
+
+	ret = lttng_read(fd, &ts, sizeof(ts));
+	if (ret != sizeof(ts)) {
+		return -1;
+	}
+
+	bench->latencies[bench->nr_latencies++] = now_ns() - ts;
+	return 0;
+}
+
+/*
+ * Read a control message. Removing stream `id` and adding it back is handled
+ * by the caller. Returns the stream id, or -1 when the run is over.
+ */
+static int read_ctrl(struct bench *bench)
+{
+	int id;
+
+	if (lttng_read(bench->ctrl_pipe[0], &id, sizeof(id)) != sizeof(id)) {
+		return -1;
+	}
+	return id;
+}
+
+static void *consumer_rebuild(void *data)
+{
+	struct bench *bench = data;
+	struct pollfd *pollfd;
+	unsigned int nb_fd = 0, i;
+	bool need_update = true;
+
+	pollfd = calloc(bench->nr_streams + 1, sizeof(*pollfd));
+	if (!pollfd) {
+		bench->error = 1;
+		return NULL;
+	}
+
+	while (1) {
+		int ret;
+
+		if (need_update) {
+			/* Rebuild the whole array as update_poll_array() did. */
+			nb_fd = 0;
+			for (i = 0; i < bench->nr_streams; i++) {
+				if (!bench->stream_active[i]) {
+					continue;
+				}
+				pollfd[nb_fd].fd = bench->stream_pipes[i][0];
+				pollfd[nb_fd].events = POLLIN | POLLPRI;
+				nb_fd++;
+			}
+			pollfd[nb_fd].fd = bench->ctrl_pipe[0];
+			pollfd[nb_fd].events = POLLIN;
+			need_update = false;
+		}
+
+		ret = poll(pollfd, nb_fd + 1, -1);
+		if (ret < 0) {
+			bench->error = 1;
+			goto end;
+		}
+
+		/* The producer closes the control pipe at the end of the run. */
+		if (pollfd[nb_fd].revents & (POLLIN | POLLHUP)) {
+			const int id = read_ctrl(bench);
+
+			if (id < 0) {
+				goto end;
+			}
+			/*
+			 * The stream is removed and added back; a single
+			 * rebuild accounts for both updates.
+			 */
+			need_update = true;
+			continue;
+		}
+
+		/* Scan every stream. */
+		for (i = 0; i < nb_fd; i++) {
+			if (!(pollfd[i].revents & POLLIN)) {
+				continue;
+			}
+			if (consume_stream(bench, pollfd[i].fd)) {
+				bench->error = 1;
+				goto end;
+			}
+			sem_post(&bench->consumed);
+		}
+	}
+end:
+	if (bench->error) {
+		/* Unblock the producer. */
+		sem_post(&bench->consumed);
+	}
+	free(pollfd);
+	return NULL;
+}
+
+static void *consumer_incremental(void *data)
+{
+	struct bench *bench = data;
+	struct lttng_poll_event events;
+	unsigned int i;
+	int ret;
+
+	lttng_poll_init(&events);
+	ret = lttng_poll_create(&events, bench->nr_streams + 1, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		bench->error = 1;
+		goto end;
+	}
+
+	ret = lttng_poll_add(&events, bench->ctrl_pipe[0], LPOLLIN);
+	if (ret < 0) {
+		bench->error = 1;
+		goto end;
+	}
+	for (i = 0; i < bench->nr_streams; i++) {
+		ret = lttng_poll_add(&events, bench->stream_pipes[i][0],
+				LPOLLIN | LPOLLPRI);
+		if (ret < 0) {
+			bench->error = 1;
+			goto end;
+		}
+	}
+
+	while (1) {
+		int nb_ready;
+
+		nb_ready = lttng_poll_wait(&events, -1);
+		if (nb_ready < 0) {
+			bench->error = 1;
+			goto end;
+		}
+
+		/* Only consider the ready streams. */
+		for (i = 0; i < nb_ready; i++) {
+			const int fd = LTTNG_POLL_GETFD(&events, i);
+			const uint32_t revents = LTTNG_POLL_GETEV(&events, i);
+
+			if (!(revents & (LPOLLIN | LPOLLHUP))) {
+				continue;
+			}
+
+			if (fd == bench->ctrl_pipe[0]) {
+				const int id = read_ctrl(bench);
+				int stream_fd;
+
+				if (id < 0) {
+					goto end;
+				}
+				stream_fd = bench->stream_pipes[id][0];
+				ret = lttng_poll_del(&events, stream_fd);
+				if (ret < 0) {
+					bench->error = 1;
+					goto end;
+				}
+				ret = lttng_poll_add(&events, stream_fd,
+						LPOLLIN | LPOLLPRI);
+				if (ret < 0) {
+					bench->error = 1;
+					goto end;
+				}
+				continue;
+			}
+
+			if (consume_stream(bench, fd)) {
+				bench->error = 1;
+				goto end;
+			}
+			sem_post(&bench->consumed);
+		}
+	}
+end:
+	if (bench->error) {
+		/* Unblock the producer. */
+		sem_post(&bench->consumed);
+	}
+	lttng_poll_clean(&events);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t va = *(const uint64_t *) a, vb = *(const uint64_t *) b;
+
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+static int run_bench(enum strategy strategy, unsigned int nr_streams,
+		unsigned int nr_wakeups)
+{
+	int ret = -1;
+	unsigned int i, nr_pipes = 0;
+	pthread_t consumer;
+	struct bench bench = {
+		.strategy = strategy,
+		.nr_streams = nr_streams,
+		.nr_wakeups = nr_wakeups,
+		.ctrl_pipe = { -1, -1 },
+	};
+	uint64_t total = 0;
+
+	bench.stream_pipes = calloc(nr_streams, sizeof(*bench.stream_pipes));
+	bench.stream_active = calloc(nr_streams, sizeof(*bench.stream_active));
+	bench.latencies = calloc(nr_wakeups, sizeof(*bench.latencies));
+	if (!bench.stream_pipes || !bench.stream_active || !bench.latencies) {
+		diag("Failed to allocate benchmark state");
+		goto end;
+	}
+
+	for (nr_pipes = 0; nr_pipes < nr_streams; nr_pipes++) {
+		if (pipe(bench.stream_pipes[nr_pipes])) {
+			diag("Failed to create stream pipe %u", nr_pipes);
+			goto end;
+		}
+		bench.stream_active[nr_pipes] = true;
+	}
+	if (pipe(bench.ctrl_pipe)) {
+		diag("Failed to create control pipe");
+		goto end;
+	}
+	if (sem_init(&bench.consumed, 0, 0)) {
+		diag("Failed to initialize semaphore");
+		goto end;
+	}
+
+	if (pthread_create(&consumer, NULL,
+			strategy == STRATEGY_REBUILD ?
+				consumer_rebuild : consumer_incremental,
+			&bench)) {
+		diag("Failed to create consumer thread");
+		goto end_sem;
+	}
+
+	srand(42);
+	for (i = 0; i < nr_wakeups && !bench.error; i++) {
+		const int id = rand() % nr_streams;
+		uint64_t ts;
+
+		if (i % CHURN_PERIOD == 0) {
+			const int churn_id = rand() % nr_streams;
+
+			if (lttng_write(bench.ctrl_pipe[1], &churn_id,
+					sizeof(churn_id)) != sizeof(churn_id)) {
+				bench.error = 1;
+				break;
+			}
+		}
+
+		ts = now_ns();
+		if (lttng_write(bench.stream_pipes[id][1], &ts, sizeof(ts)) !=
+				sizeof(ts)) {
+			bench.error = 1;
+			break;
+		}
+		while (sem_wait(&bench.consumed) && errno == EINTR) {
+		}
+	}
+
+	/* Stop the consumer. */
+	(void) close(bench.ctrl_pipe[1]);
+	bench.ctrl_pipe[1] = -1;
+	pthread_join(consumer, NULL);
+
+	if (bench.error || bench.nr_latencies != nr_wakeups) {
+		diag("Benchmark run failed");
+		goto end_sem;
+	}
+
+	qsort(bench.latencies, bench.nr_latencies, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < bench.nr_latencies; i++) {
+		total += bench.latencies[i];
+	}
+	diag("%s: %u streams, %u wakeups: avg %" PRIu64 " ns, p50 %" PRIu64
+			" ns, p99 %" PRIu64 " ns, max %" PRIu64 " ns",
+			strategy_names[strategy], nr_streams, nr_wakeups,
+			total / bench.nr_latencies,
+			bench.latencies[bench.nr_latencies / 2],
+			bench.latencies[(bench.nr_latencies * 99) / 100],
+			bench.latencies[bench.nr_latencies - 1]);
+	ret = 0;
+
+end_sem:
+	sem_destroy(&bench.consumed);
+end:
+	for (i = 0; i < nr_pipes; i++) {
+		(void) close(bench.stream_pipes[i][0]);
+		(void) close(bench.stream_pipes[i][1]);
+	}
+	if (bench.ctrl_pipe[0] >= 0) {
+		(void) close(bench.ctrl_pipe[0]);
+	}
+	if (bench.ctrl_pipe[1] >= 0) {
+		(void) close(bench.ctrl_pipe[1]);
+	}
+	free(bench.stream_pipes);
+	free(bench.stream_active);
+	free(bench.latencies);
+	return ret;
+}
+
+/*
+ * Two fds are needed per stream; raise the limit as much as allowed.
+ */
+static unsigned int fit_nr_streams(unsigned int nr_streams)
+{
+	struct rlimit rlim;
+	unsigned int max_streams;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim)) {
+		return nr_streams;
+	}
+	rlim.rlim_cur = rlim.rlim_max;
+	(void) setrlimit(RLIMIT_NOFILE, &rlim);
+	(void) getrlimit(RLIMIT_NOFILE, &rlim);
+
+	/* Keep a few fds for stdio, the control pipe and the poll set. */
+	max_streams = rlim.rlim_cur > 64 ? (rlim.rlim_cur - 64) / 2 : 1;
+	if (nr_streams > max_streams) {
+		diag("Limiting the number of streams to %u (RLIMIT_NOFILE)",
+				max_streams);
+		nr_streams = max_streams;
+	}
+	return nr_streams;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	unsigned int nr_streams = DEFAULT_NR_STREAMS;
+	unsigned int nr_wakeups = DEFAULT_NR_WAKEUPS;
+
+	if (argc > 1) {
+		nr_streams = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		nr_wakeups = strtoul(argv[2], NULL, 10);
+	}
+
+	plan_tests(NUM_TESTS);
+
+	ok(nr_streams > 0 && nr_wakeups > 0, "Valid parameters");
+	nr_streams = fit_nr_streams(nr_streams);
+
+	ret = lttng_poll_set_max_size();
+	ok(ret == 0, "Set poll set maximal size");
+
+	ret = run_bench(STRATEGY_REBUILD, nr_streams, nr_wakeups);
+	ok(ret == 0, "Wakeup-to-consume latency with a rebuilt poll array");
+
+	ret = run_bench(STRATEGY_INCREMENTAL, nr_streams, nr_wakeups);
+	ok(ret == 0, "Wakeup-to-consume latency with an incremental poll set");
+
+	return exit_status();
+}
@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Measure the extraction throughput of lttng-crash on synthetic crash
+ * buffers.
+ *
+ * A trace made of NR_STREAMS stream files, each holding a UST crash buffer
+ * (crash ABI 0.0) of NUM_SUBBUF sub-buffers of SUBBUF_SIZE_KIB KiB, is
+ * generated in a temporary directory. All sub-buffers are fully committed
+ * except for the last one of each buffer, which is half committed. Two
+ * layouts are generated:
+ *
+ *   - "contiguous": the sub-buffers are laid out in the order in which they
+ *     are extracted, as is the case for a buffer that never wrapped;
+ *   - "scattered": the sub-buffers are laid out in reverse order, so that
+ *     no two consecutive packets are contiguous.
+ *
+ * The trace is extracted by lttng-crash once per job count of BENCH_JOBS
+ * (default: "1 2 4 8") and the size of each extracted stream file, as well
+ * as the content of the first one, are validated.
+ *
+ * The crash buffers are generated in BENCH_INPUT_DIR (default: /dev/shm) and
+ * extracted to BENCH_OUTPUT_DIR (default: /var/tmp). The lttng-crash binary
+ * is set with LTTNG_CRASH_BIN (default: the one of the build tree).
+ *
+ * Usage: bench_lttng_crash_extract [NR_STREAMS [SUBBUF_SIZE_KIB [NUM_SUBBUF]]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/readwrite.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+#define DEFAULT_NR_STREAMS		16
+#define DEFAULT_SUBBUF_SIZE_KIB		256
+#define DEFAULT_NUM_SUBBUF		128
+#define DEFAULT_JOBS			"1 2 4 8"
+#define DEFAULT_INPUT_DIR		"/dev/shm"
+#define DEFAULT_OUTPUT_DIR		"/var/tmp"
+#define DEFAULT_LTTNG_CRASH_BIN		"../../src/bin/lttng-crash/lttng-crash"
+#define MAX_RUNS			16
+
+/* Crash ABI 0.0, as understood by lttng-crash. */
+#define CRASH_ABI_MAGIC							\
+	{								\
+		0x17, 0x7B, 0xF1, 0x77, 0xBF, 0x17, 0x7B, 0xF1,		\
+		0x77, 0xBF, 0x17, 0x7B, 0xF1, 0x77, 0xBF, 0x17,		\
+	}
+#define CRASH_ABI_ENDIAN		0x1234
+#define CRASH_LAYOUT_TYPE_UST		0
+#define CRASH_MODE_DISCARD		1
+
+struct crash_abi_0_0 {
+	uint8_t magic[16];
+	uint64_t mmap_length;
+	uint16_t endian;
+	uint16_t major;
+	uint16_t minor;
+	uint8_t word_size;
+	uint8_t layout_type;
+
+	struct {
+		uint32_t prod_offset;
+		uint32_t consumed_offset;
+		uint32_t commit_hot_array;
+		uint32_t commit_hot_seq;
+		uint32_t buf_wsb_array;
+		uint32_t buf_wsb_id;
+		uint32_t sb_array;
+		uint32_t sb_array_shmp_offset;
+		uint32_t sb_backend_p_offset;
+		uint32_t content_size;
+		uint32_t packet_size;
+	} __attribute__((packed)) offset;
+	struct {
+		uint8_t prod_offset;
+		uint8_t consumed_offset;
+		uint8_t commit_hot_seq;
+		uint8_t buf_wsb_id;
+		uint8_t sb_array_shmp_offset;
+		uint8_t sb_backend_p_offset;
+		uint8_t content_size;
+		uint8_t packet_size;
+	} __attribute__((packed)) length;
+	struct {
+		uint32_t commit_hot_array;
+		uint32_t buf_wsb_array;
+		uint32_t sb_array;
+	} __attribute__((packed)) stride;
+
+	uint64_t buf_size;
+	uint64_t subbuf_size;
+	uint64_t num_subbuf;
+	uint32_t mode;
+} __attribute__((packed));
+
+/*
+ * Layout of a synthetic crash buffer file:
+ *
+ *   [0]            crash ABI header
+ *   [CTRL_OFFSET]  producer and consumer positions
+ *                  commit counters (one u64 per sub-buffer)
+ *                  write-side sub-buffer ids (one u64 per sub-buffer)
+ *                  sub-buffer table (one u64 per sub-buffer, pointing
+ *                    to the backend page entry of the sub-buffer)
+ *                  backend page entries (one u64 per sub-buffer, pointing
+ *                    to the sub-buffer data)
+ *   [data_offset]  sub-buffer data (page aligned)
+ *
+ * Each sub-buffer starts with a packet header holding its content and
+ * packet sizes (in bits) at PACKET_CONTENT_SIZE_OFFSET and
+ * PACKET_SIZE_OFFSET.
+ */
+#define CTRL_OFFSET			4096
+#define PACKET_CONTENT_SIZE_OFFSET	8
+#define PACKET_SIZE_OFFSET		16
+
+enum layout {
+	LAYOUT_CONTIGUOUS,
+	LAYOUT_SCATTERED,
+};
+
+static const char *layout_names[] = {
+	[LAYOUT_CONTIGUOUS] = "contiguous",
+	[LAYOUT_SCATTERED] = "scattered",
+};
+
+struct bench {
+	unsigned int nr_streams;
+	uint64_t subbuf_size;
+	uint64_t num_subbuf;
+	uint64_t data_offset;
+	uint64_t file_size;
+	const char *lttng_crash_bin;
+	char input_path[PATH_MAX];
+	char output_path[PATH_MAX];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *get_env(const char *env_name, const char *default_value)
+{
+	const char *value = getenv(env_name);
+
+	return value ? value : default_value;
+}
+
+/* Physical index of the sub-buffer extracted in position 'idx'. */
+static uint64_t physical_index(const struct bench *bench, enum layout layout,
+		uint64_t idx)
+{
+	return layout == LAYOUT_CONTIGUOUS ? idx : bench->num_subbuf - 1 - idx;
+}
+
+/* Size of the data extracted from a stream file. */
+static uint64_t expected_stream_size(const struct bench *bench)
+{
+	return (bench->num_subbuf - 1) * bench->subbuf_size +
+			bench->subbuf_size / 2;
+}
+
+static void put_u64(char *map, uint64_t offset, uint64_t value)
+{
+	memcpy(map + offset, &value, sizeof(value));
+}
+
+static void fill_header(const struct bench *bench, char *map)
+{
+	const uint8_t magic[] = CRASH_ABI_MAGIC;
+	const uint64_t n = bench->num_subbuf;
+	struct crash_abi_0_0 abi;
+
+	memset(&abi, 0, sizeof(abi));
+	memcpy(abi.magic, magic, sizeof(abi.magic));
+	abi.mmap_length = bench->file_size;
+	abi.endian = CRASH_ABI_ENDIAN;
+	abi.word_size = sizeof(uint64_t);
+	abi.layout_type = CRASH_LAYOUT_TYPE_UST;
+
+	abi.offset.prod_offset = CTRL_OFFSET;
+	abi.offset.consumed_offset = CTRL_OFFSET + 8;
+	abi.offset.commit_hot_array = CTRL_OFFSET + 16;
+	abi.offset.commit_hot_seq = 0;
+	abi.offset.buf_wsb_array = CTRL_OFFSET + 16 + 8 * n;
+	abi.offset.buf_wsb_id = 0;
+	abi.offset.sb_array = CTRL_OFFSET + 16 + 16 * n;
+	abi.offset.sb_array_shmp_offset = 0;
+	abi.offset.sb_backend_p_offset = 0;
+	abi.offset.content_size = PACKET_CONTENT_SIZE_OFFSET;
+	abi.offset.packet_size = PACKET_SIZE_OFFSET;
+
+	abi.length.prod_offset = 8;
+	abi.length.consumed_offset = 8;
+	abi.length.commit_hot_seq = 8;
+	abi.length.buf_wsb_id = 8;
+	abi.length.sb_array_shmp_offset = 8;
+	abi.length.sb_backend_p_offset = 8;
+	abi.length.content_size = 8;
+	abi.length.packet_size = 8;
+
+	abi.stride.commit_hot_array = 8;
+	abi.stride.buf_wsb_array = 8;
+	abi.stride.sb_array = 8;
+
+	abi.buf_size = n * bench->subbuf_size;
+	abi.subbuf_size = bench->subbuf_size;
+	abi.num_subbuf = n;
+	abi.mode = CRASH_MODE_DISCARD;
+	memcpy(map, &abi, sizeof(abi));
+}
+
+static void fill_buffer(const struct bench *bench, enum layout layout,
+		unsigned int stream, char *map)
+{
+	uint64_t idx;
+	const uint64_t n = bench->num_subbuf;
+	const uint64_t commit_hot_array = CTRL_OFFSET + 16;
+	const uint64_t buf_wsb_array = commit_hot_array + 8 * n;
+	const uint64_t sb_array = buf_wsb_array + 8 * n;
+	const uint64_t backend_pages = sb_array + 8 * n;
+
+	fill_header(bench, map);
+
+	/* Everything from the start of the buffer up to its end. */
+	put_u64(map, CTRL_OFFSET, n * bench->subbuf_size);
+	put_u64(map, CTRL_OFFSET + 8, 0);
+
+	for (idx = 0; idx < n; idx++) {
+		const uint64_t phys = physical_index(bench, layout, idx);
+		const uint64_t data = bench->data_offset +
+				phys * bench->subbuf_size;
+		/* The last sub-buffer is only half committed. */
+		const uint64_t seq_cc = idx == n - 1 ?
+				bench->subbuf_size / 2 : bench->subbuf_size;
+
+		put_u64(map, commit_hot_array + 8 * idx, seq_cc);
+		put_u64(map, buf_wsb_array + 8 * idx, phys);
+		put_u64(map, sb_array + 8 * phys, backend_pages + 8 * phys);
+		put_u64(map, backend_pages + 8 * phys, data);
+
+		memset(map + data, (int) ((stream + idx) & 0xFF),
+				bench->subbuf_size);
+		put_u64(map, data + PACKET_CONTENT_SIZE_OFFSET,
+				bench->subbuf_size * CHAR_BIT);
+		put_u64(map, data + PACKET_SIZE_OFFSET,
+				bench->subbuf_size * CHAR_BIT);
+	}
+}
+
+static int write_file(const char *dir, const char *name, const void *data,
+		size_t len)
+{
+	int fd, ret = 0;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		diag("open %s: %s", path, strerror(errno));
+		return -1;
+	}
+	if (lttng_write(fd, data, len) != len) {
+		diag("write %s: %s", path, strerror(errno));
+		ret = -1;
+	}
+	(void) close(fd);
+	return ret;
+}
+
+static int generate_trace(const struct bench *bench, enum layout layout)
+{
+	int ret;
+	char *map;
+	unsigned int i;
+	const char metadata[] = "/* CTF 1.8 */\n\n"
+			"trace {\n\tmajor = 1;\n\tminor = 8;\n"
+			"\tbyte_order = le;\n};\n";
+
+	map = mmap(NULL, bench->file_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		diag("mmap: %s", strerror(errno));
+		return -1;
+	}
+
+	ret = write_file(bench->input_path, "metadata", metadata,
+			sizeof(metadata) - 1);
+	for (i = 0; !ret && i < bench->nr_streams; i++) {
+		char name[NAME_MAX];
+
+		snprintf(name, sizeof(name), "chan_%u", i);
+		fill_buffer(bench, layout, i, map);
+		ret = write_file(bench->input_path, name, map,
+				bench->file_size);
+	}
+	(void) munmap(map, bench->file_size);
+	return ret;
+}
+
+static void remove_trace(const char *path, unsigned int nr_streams)
+{
+	unsigned int i;
+	char file[PATH_MAX];
+
+	snprintf(file, sizeof(file), "%s/metadata", path);
+	(void) unlink(file);
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(file, sizeof(file), "%s/chan_%u", path, i);
+		(void) unlink(file);
+	}
+	(void) rmdir(path);
+}
+
+static int run_lttng_crash(const struct bench *bench, unsigned int jobs)
+{
+	pid_t pid;
+	int status;
+	char jobs_str[16];
+
+	snprintf(jobs_str, sizeof(jobs_str), "%u", jobs);
+	pid = fork();
+	if (pid < 0) {
+		diag("fork: %s", strerror(errno));
+		return -1;
+	} else if (pid == 0) {
+		execl(bench->lttng_crash_bin, bench->lttng_crash_bin,
+				"-j", jobs_str, "-x", bench->output_path,
+				bench->input_path, (char *) NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		diag("waitpid: %s", strerror(errno));
+		return -1;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		diag("%s exited with status %d", bench->lttng_crash_bin,
+				status);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Validate the size of every extracted stream file and the content of the
+ * full packets of the first one.
+ */
+static int validate_output(const struct bench *bench)
+{
+	int fd, ret = 0;
+	unsigned int i;
+	uint64_t idx;
+	struct stat st;
+	char path[PATH_MAX];
+	char *packet = NULL;
+
+	for (i = 0; i < bench->nr_streams; i++) {
+		snprintf(path, sizeof(path), "%s/chan_%u",
+				bench->output_path, i);
+		if (stat(path, &st)) {
+			diag("stat %s: %s", path, strerror(errno));
+			return -1;
+		}
+		if (st.st_size != expected_stream_size(bench)) {
+			diag("%s: %" PRIu64 " bytes extracted, expected %" PRIu64,
+					path, (uint64_t) st.st_size,
+					expected_stream_size(bench));
+			return -1;
+		}
+	}
+
+	packet = malloc(bench->subbuf_size);
+	if (!packet) {
+		diag("Allocation failure");
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/chan_0", bench->output_path);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		diag("open %s: %s", path, strerror(errno));
+		free(packet);
+		return -1;
+	}
+	for (idx = 0; idx < bench->num_subbuf - 1; idx++) {
+		uint64_t j;
+
+		if (lttng_read(fd, packet, bench->subbuf_size) !=
+				bench->subbuf_size) {
+			diag("read %s: %s", path, strerror(errno));
+			ret = -1;
+			break;
+		}
+		/* Skip the packet header. */
+		for (j = PACKET_SIZE_OFFSET + 8; j < bench->subbuf_size; j++) {
+			if (packet[j] != (char) (idx & 0xFF)) {
+				break;
+			}
+		}
+		if (j != bench->subbuf_size) {
+			diag("%s: unexpected content in packet %" PRIu64,
+					path, idx);
+			ret = -1;
+			break;
+		}
+	}
+	(void) close(fd);
+	free(packet);
+	return ret;
+}
+
+static int run_bench(struct bench *bench, enum layout layout,
+		unsigned int jobs)
+{
+	int ret;
+	uint64_t start, end;
+	const uint64_t extracted = expected_stream_size(bench) *
+			bench->nr_streams;
+
+	snprintf(bench->output_path, sizeof(bench->output_path),
+			"%s/bench-crash-out-%d",
+			get_env("BENCH_OUTPUT_DIR", DEFAULT_OUTPUT_DIR),
+			(int) getpid());
+
+	start = now_ns();
+	ret = run_lttng_crash(bench, jobs);
+	end = now_ns();
+	if (ret) {
+		goto end;
+	}
+
+	ret = validate_output(bench);
+	if (ret) {
+		goto end;
+	}
+
+	diag("%s layout, %u job(s): %" PRIu64 " MiB extracted in %" PRIu64 " ms, %" PRIu64 " MiB/s",
+			layout_names[layout], jobs, extracted >> 20,
+			(end - start) / 1000000ULL,
+			(extracted >> 20) * 1000000000ULL / (end - start));
+end:
+	remove_trace(bench->output_path, bench->nr_streams);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, nr_jobs = 0, jobs[MAX_RUNS];
+	int layout;
+	char *jobs_list, *saveptr = NULL, *token;
+	struct bench bench = {
+		.nr_streams = DEFAULT_NR_STREAMS,
+		.subbuf_size = DEFAULT_SUBBUF_SIZE_KIB * 1024ULL,
+		.num_subbuf = DEFAULT_NUM_SUBBUF,
+		.lttng_crash_bin = get_env("LTTNG_CRASH_BIN",
+				DEFAULT_LTTNG_CRASH_BIN),
+	};
+
+	if (argc > 1) {
+		bench.nr_streams = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		bench.subbuf_size = strtoull(argv[2], NULL, 10) * 1024ULL;
+	}
+	if (argc > 3) {
+		bench.num_subbuf = strtoull(argv[3], NULL, 10);
+	}
+
+	jobs_list = strdup(get_env("BENCH_JOBS", DEFAULT_JOBS));
+	for (token = jobs_list ? strtok_r(jobs_list, " ", &saveptr) : NULL;
+			token && nr_jobs < MAX_RUNS;
+			token = strtok_r(NULL, " ", &saveptr)) {
+		jobs[nr_jobs++] = strtoul(token, NULL, 10);
+	}
+	free(jobs_list);
+
+	plan_tests(1 + 2 * (1 + nr_jobs));
+
+	/* Ring buffer sizes are powers of two. */
+	ok(bench.nr_streams > 0 && nr_jobs > 0 &&
+			bench.subbuf_size >= 4096 &&
+			!(bench.subbuf_size & (bench.subbuf_size - 1)) &&
+			bench.num_subbuf > 1 &&
+			!(bench.num_subbuf & (bench.num_subbuf - 1)),
+			"Valid parameters");
+
+	/* Page aligned start of the sub-buffer data. */
+	bench.data_offset = (CTRL_OFFSET + 16 + 32 * bench.num_subbuf +
+			4095) & ~4095ULL;
+	bench.file_size = bench.data_offset +
+			bench.num_subbuf * bench.subbuf_size;
+
+	for (layout = LAYOUT_CONTIGUOUS; layout <= LAYOUT_SCATTERED; layout++) {
+		int ret;
+
+		snprintf(bench.input_path, sizeof(bench.input_path),
+				"%s/bench-crash-in-%d",
+				get_env("BENCH_INPUT_DIR", DEFAULT_INPUT_DIR),
+				(int) getpid());
+		ret = mkdir(bench.input_path, S_IRWXU);
+		if (!ret) {
+			ret = generate_trace(&bench, layout);
+		}
+		ok(ret == 0, "Generate %u %s crash buffers of %" PRIu64 " KiB",
+				bench.nr_streams, layout_names[layout],
+				bench.file_size >> 10);
+		for (i = 0; i < nr_jobs; i++) {
+			if (ret) {
+				skip(1, "No crash buffers to extract");
+				continue;
+			}
+			ok(run_bench(&bench, layout, jobs[i]) == 0,
+					"Extraction throughput of the %s layout with %u job(s)",
+					layout_names[layout], jobs[i]);
+		}
+		remove_trace(bench.input_path, bench.nr_streams);
+	}
+
+	return exit_status();
+}
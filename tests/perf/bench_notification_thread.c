@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark of the channel sample handling of the notification thread.
+ *
+ * NR_TRIGGERS buffer usage triggers (4000 by default), half of them on a
+ * high usage condition and half on a low usage condition, are bound to one
+ * channel, and a client subscribes to all of their conditions. NR_SAMPLES
+ * samples (100000 by default) of the channel, whose usage follows a random
+ * walk, are then fed to the notification thread as a consumer daemon would.
+ * The time spent per sample and the number of notifications received by the
+ * client are reported.
+ *
+ * Usage: bench_notification_thread [NR_TRIGGERS [NR_SAMPLES]]
+ *
+ * The notification thread listens on the socket a session daemon would use:
+ * as root, no session daemon must be running. Otherwise, LTTNG_HOME is set to
+ * a temporary directory.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include <urcu.h>
+
+#include <tap/tap.h>
+
+#include <bin/lttng-sessiond/health-sessiond.h>
+#include <bin/lttng-sessiond/notification-thread.h>
+#include <bin/lttng-sessiond/notification-thread-commands.h>
+#include <bin/lttng-sessiond/thread.h>
+#include <common/common.h>
+#include <common/pipe.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+#include <common/utils.h>
+#include <lttng/lttng.h>
+
+struct health_app *health_sessiond;
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+int ust_consumerd32_fd;
+int ust_consumerd64_fd;
+
+#define NUM_TESTS		3
+#define DEFAULT_NR_TRIGGERS	4000
+#define DEFAULT_NR_SAMPLES	100000
+
+#define SESSION_NAME		"bench"
+#define CHANNEL_NAME		"channel0"
+#define CHANNEL_KEY		1
+#define CHANNEL_CAPACITY	(16ULL * 1024 * 1024)
+
+/* Largest change of the usage of the channel between two samples. */
+#define USAGE_STEP		(CHANNEL_CAPACITY / 64)
+
+struct notification_reader {
+	struct lttng_notification_channel *channel;
+	pthread_t thread;
+	unsigned long count;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Consume the notifications sent to the client until the notification thread
+ * closes its end of the channel.
+ */
+static void *notification_reader_thread(void *data)
+{
+	struct notification_reader *reader = data;
+
+	for (;;) {
+		enum lttng_notification_channel_status status;
+		struct lttng_notification *notification = NULL;
+
+		status = lttng_notification_channel_get_next_notification(
+				reader->channel, &notification);
+		if (status == LTTNG_NOTIFICATION_CHANNEL_STATUS_OK) {
+			reader->count++;
+			lttng_notification_destroy(notification);
+		} else if (status != LTTNG_NOTIFICATION_CHANNEL_STATUS_NOTIFICATIONS_DROPPED) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static struct lttng_condition *create_condition(size_t i, size_t nr_triggers)
+{
+	struct lttng_condition *condition;
+	const double ratio = (double) (i + 1) / (double) (nr_triggers + 1);
+
+	condition = i % 2 ? lttng_condition_buffer_usage_low_create() :
+			lttng_condition_buffer_usage_high_create();
+	if (!condition) {
+		goto error;
+	}
+	if (lttng_condition_buffer_usage_set_threshold_ratio(condition,
+			ratio) != LTTNG_CONDITION_STATUS_OK ||
+			lttng_condition_buffer_usage_set_session_name(condition,
+				SESSION_NAME) != LTTNG_CONDITION_STATUS_OK ||
+			lttng_condition_buffer_usage_set_channel_name(condition,
+				CHANNEL_NAME) != LTTNG_CONDITION_STATUS_OK ||
+			lttng_condition_buffer_usage_set_domain_type(condition,
+				LTTNG_DOMAIN_UST) != LTTNG_CONDITION_STATUS_OK) {
+		goto error;
+	}
+	return condition;
+error:
+	lttng_condition_destroy(condition);
+	return NULL;
+}
+
+/*
+ * Subscribe the client to the condition of each trigger and register the
+ * triggers with the notification thread.
+ *
+ * Returns 0 on success, else a negative value.
+ */
+static int register_triggers(struct notification_thread_handle *handle,
+		struct lttng_notification_channel *channel, size_t nr_triggers)
+{
+	size_t i;
+
+	for (i = 0; i < nr_triggers; i++) {
+		struct lttng_condition *condition;
+		struct lttng_action *action;
+		struct lttng_trigger *trigger;
+
+		condition = create_condition(i, nr_triggers);
+		action = lttng_action_notify_create();
+		if (!condition || !action) {
+			diag("Failed to create the condition of trigger %zu", i);
+			lttng_condition_destroy(condition);
+			lttng_action_destroy(action);
+			return -1;
+		}
+
+		if (lttng_notification_channel_subscribe(channel, condition) !=
+				LTTNG_NOTIFICATION_CHANNEL_STATUS_OK) {
+			diag("Failed to subscribe to the condition of trigger %zu",
+					i);
+			lttng_condition_destroy(condition);
+			lttng_action_destroy(action);
+			return -1;
+		}
+
+		trigger = lttng_trigger_create(condition, action);
+		if (!trigger) {
+			diag("Failed to create trigger %zu", i);
+			lttng_condition_destroy(condition);
+			lttng_action_destroy(action);
+			return -1;
+		}
+
+		/* The notification thread owns the registered triggers. */
+		if (notification_thread_command_register_trigger(handle,
+				trigger) != LTTNG_OK) {
+			diag("Failed to register trigger %zu", i);
+			lttng_trigger_destroy(trigger);
+			lttng_condition_destroy(condition);
+			lttng_action_destroy(action);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Write the samples to the channel monitoring pipe and wait for the
+ * notification thread to have handled all of them.
+ *
+ * Returns 0 on success, else a negative value.
+ */
+static int send_samples(struct notification_thread_handle *handle,
+		struct lttng_pipe *pipe, size_t nr_samples)
+{
+	size_t i;
+	int pending;
+	uint64_t usage = 0, consumed = 0;
+	char sync_name[] = "sync";
+
+	srand(42);
+	for (i = 0; i < nr_samples; i++) {
+		struct lttcomm_consumer_channel_monitor_msg msg = {
+			.key = CHANNEL_KEY,
+		};
+		const uint64_t step = (uint64_t) rand() % USAGE_STEP;
+
+		if (rand() % 2) {
+			usage = min_t(uint64_t, usage + step, CHANNEL_CAPACITY);
+		} else {
+			usage = usage > step ? usage - step : 0;
+		}
+		consumed += step;
+
+		msg.lowest = usage / 2;
+		msg.highest = usage;
+		msg.total_consumed = consumed;
+		if (lttng_write(lttng_pipe_get_writefd(pipe), &msg,
+				sizeof(msg)) != sizeof(msg)) {
+			diag("Failed to write sample %zu: %s", i,
+					strerror(errno));
+			return -1;
+		}
+	}
+
+	/* Wait for the notification thread to have read all the samples... */
+	do {
+		if (ioctl(handle->channel_monitoring_pipes.ust64_consumer,
+				FIONREAD, &pending)) {
+			diag("FIONREAD: %s", strerror(errno));
+			return -1;
+		}
+		if (pending) {
+			usleep(100);
+		}
+	} while (pending);
+
+	/* ... and to be done with the last one as it replies to a command. */
+	if (notification_thread_command_add_channel(handle, sync_name,
+			getuid(), getgid(), sync_name, CHANNEL_KEY + 1,
+			LTTNG_DOMAIN_UST, CHANNEL_CAPACITY) != LTTNG_OK) {
+		diag("Failed to synchronize with the notification thread");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The notification thread listens on the socket of the root session daemon
+ * when running as root, and under LTTNG_HOME otherwise.
+ *
+ * Returns 0 on success, else a negative value.
+ */
+static int setup_socket_dir(char *home, size_t home_len)
+{
+	const char *tmpdir = getenv("TMPDIR");
+	char rundir[PATH_MAX];
+
+	if (!getuid()) {
+		if (!access(DEFAULT_GLOBAL_NOTIFICATION_CHANNEL_UNIX_SOCK, F_OK)) {
+			diag("A root session daemon is running");
+			return -1;
+		}
+		return utils_mkdir_recursive(DEFAULT_LTTNG_RUNDIR, S_IRWXU,
+				-1, -1);
+	}
+
+	snprintf(home, home_len, "%s/bench-notification-XXXXXX",
+			tmpdir ? tmpdir : "/tmp");
+	if (!mkdtemp(home)) {
+		diag("mkdtemp: %s", strerror(errno));
+		return -1;
+	}
+	if (setenv("LTTNG_HOME", home, 1)) {
+		return -1;
+	}
+	snprintf(rundir, sizeof(rundir), DEFAULT_LTTNG_HOME_RUNDIR, home);
+	return utils_mkdir_recursive(rundir, S_IRWXU, -1, -1);
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	size_t nr_triggers = DEFAULT_NR_TRIGGERS, nr_samples = DEFAULT_NR_SAMPLES;
+	char home[PATH_MAX] = {};
+	char session_name[] = SESSION_NAME, channel_name[] = CHANNEL_NAME;
+	uint64_t start, duration;
+	struct lttng_pipe *pipe = NULL;
+	struct notification_thread_handle *handle = NULL;
+	struct lttng_thread *thread = NULL;
+	struct notification_reader reader = {};
+	bool reader_started = false;
+
+	if (argc > 1) {
+		nr_triggers = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		nr_samples = strtoul(argv[2], NULL, 0);
+	}
+	if (!nr_triggers || !nr_samples) {
+		fprintf(stderr, "Usage: %s [NR_TRIGGERS [NR_SAMPLES]]\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	plan_tests(NUM_TESTS);
+
+	health_sessiond = health_app_create(NR_HEALTH_SESSIOND_TYPES);
+	if (!health_sessiond || setup_socket_dir(home, sizeof(home))) {
+		skip(NUM_TESTS, "Failed to set up the notification thread environment");
+		goto end;
+	}
+
+	pipe = lttng_pipe_open(0);
+	if (!pipe) {
+		skip(NUM_TESTS, "Failed to create the channel monitoring pipe");
+		goto end;
+	}
+	handle = notification_thread_handle_create(NULL, pipe, NULL);
+	if (!handle) {
+		skip(NUM_TESTS, "Failed to create the notification thread handle");
+		goto end;
+	}
+	thread = launch_notification_thread(handle);
+	if (!thread) {
+		skip(NUM_TESTS, "Failed to launch the notification thread");
+		goto end;
+	}
+
+	ret = notification_thread_command_add_channel(handle, session_name,
+			getuid(), getgid(), channel_name, CHANNEL_KEY,
+			LTTNG_DOMAIN_UST, CHANNEL_CAPACITY);
+	reader.channel = lttng_notification_channel_create(
+			lttng_session_daemon_notification_endpoint);
+	ok(ret == LTTNG_OK && reader.channel &&
+			!register_triggers(handle, reader.channel, nr_triggers),
+			"Register %zu triggers on a channel", nr_triggers);
+
+	if (!reader.channel ||
+			pthread_create(&reader.thread, NULL,
+				notification_reader_thread, &reader)) {
+		skip(NUM_TESTS - 1, "Failed to launch the notification reader");
+		goto end;
+	}
+	reader_started = true;
+
+	start = now_ns();
+	ret = send_samples(handle, pipe, nr_samples);
+	duration = now_ns() - start;
+	ok(ret == 0, "Handle %zu channel samples", nr_samples);
+
+	diag("%zu triggers: %zu samples in %" PRIu64 " us (%" PRIu64 " ns/sample, %" PRIu64 " samples/s)",
+			nr_triggers, nr_samples, duration / 1000,
+			duration / nr_samples,
+			duration ? (uint64_t) nr_samples * 1000000000ULL / duration : 0);
+
+end:
+	if (thread) {
+		/* Closes the client connections, which stops the reader. */
+		lttng_thread_shutdown(thread);
+		lttng_thread_put(thread);
+	}
+	if (reader_started) {
+		pthread_join(reader.thread, NULL);
+		diag("%lu notifications received", reader.count);
+		ok(reader.count > 0, "Notifications are sent to the client");
+	}
+	lttng_notification_channel_destroy(reader.channel);
+	if (handle) {
+		notification_thread_handle_destroy(handle);
+	}
+	lttng_pipe_destroy(pipe);
+	if (home[0]) {
+		(void) utils_recursive_rmdir(home);
+	}
+	return exit_status();
+}
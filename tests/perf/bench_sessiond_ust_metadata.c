@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark of the CTF metadata generation of the session daemon.
+ *
+ * The metadata of a synthetic registry of NR_EVENTS events (10000 by default)
+ * of NR_FIELDS fields each (12 by default) is generated in memory only, and
+ * then also appended to a metadata file as done for sessions created with
+ * --shm-path. The generation time and the number of write system calls made
+ * are reported.
+ *
+ * Usage: bench_sessiond_ust_metadata [NR_EVENTS [NR_FIELDS]]
+ *
+ * The metadata file is created in $TMPDIR, or /tmp if unset.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <bin/lttng-sessiond/session.h>
+#include <bin/lttng-sessiond/ust-registry.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+#define NUM_TESTS		2
+#define DEFAULT_NR_EVENTS	10000
+#define DEFAULT_NR_FIELDS	12
+
+/*
+ * Only the channel and event metadata is generated: the session and enum
+ * lookups of the session daemon are not needed.
+ */
+struct ltt_session *session_find_by_id(uint64_t id)
+{
+	return NULL;
+}
+
+void session_put(struct ltt_session *session)
+{
+}
+
+struct ust_registry_enum *ust_registry_lookup_enum_by_id(
+		struct ust_registry_session *session,
+		const char *enum_name, uint64_t enum_id)
+{
+	return NULL;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Number of write system calls made by this process, -1 if unknown. */
+static int64_t write_syscalls(void)
+{
+	FILE *f;
+	char line[128];
+	long long syscw = -1;
+
+	f = fopen("/proc/self/io", "r");
+	if (!f) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "syscw: %lld", &syscw) == 1) {
+			break;
+		}
+	}
+	fclose(f);
+	return syscw;
+}
+
+static struct ustctl_field *create_fields(size_t nr_fields)
+{
+	size_t i;
+	struct ustctl_field *fields;
+
+	fields = calloc(nr_fields, sizeof(*fields));
+	if (!fields) {
+		return NULL;
+	}
+
+	for (i = 0; i < nr_fields; i++) {
+		struct ustctl_field *field = &fields[i];
+
+		snprintf(field->name, sizeof(field->name), "field_%zu", i);
+		switch (i % 3) {
+		case 0:
+			field->type.atype = ustctl_atype_integer;
+			field->type.u.basic.integer.size = 64;
+			field->type.u.basic.integer.alignment = 8;
+			field->type.u.basic.integer.signedness = 1;
+			field->type.u.basic.integer.encoding = ustctl_encode_none;
+			field->type.u.basic.integer.base = 10;
+			break;
+		case 1:
+			field->type.atype = ustctl_atype_string;
+			field->type.u.basic.string.encoding = ustctl_encode_UTF8;
+			break;
+		case 2:
+			field->type.atype = ustctl_atype_float;
+			field->type.u.basic._float.exp_dig = 11;
+			field->type.u.basic._float.mant_dig = 53;
+			field->type.u.basic._float.alignment = 8;
+			break;
+		}
+	}
+	return fields;
+}
+
+static void reset_registry(struct ust_registry_session *registry)
+{
+	free(registry->metadata);
+	registry->metadata = NULL;
+	registry->metadata_len = 0;
+	registry->metadata_alloc_len = 0;
+	registry->metadata_len_written = 0;
+}
+
+/*
+ * Generate the metadata of a channel and of its events and report the time
+ * it took.
+ *
+ * Return 0 on success, else a negative value.
+ */
+static int run_bench(struct ust_registry_session *registry,
+		struct ust_registry_event *events, size_t nr_events,
+		const char *desc)
+{
+	int ret;
+	size_t i;
+	uint64_t start, duration;
+	int64_t syscw_before, syscw_after;
+	struct ust_registry_channel chan = {
+		.chan_id = 0,
+		.header_type = USTCTL_CHANNEL_HEADER_LARGE,
+	};
+
+	syscw_before = write_syscalls();
+	start = now_ns();
+
+	ret = ust_metadata_channel_statedump(registry, &chan);
+	if (ret) {
+		diag("Channel metadata generation failed (ret = %d)", ret);
+		goto end;
+	}
+	for (i = 0; i < nr_events; i++) {
+		events[i].metadata_dumped = 0;
+		ret = ust_metadata_event_statedump(registry, &chan, &events[i]);
+		if (ret) {
+			diag("Event metadata generation failed (ret = %d)", ret);
+			goto end;
+		}
+	}
+
+	duration = now_ns() - start;
+	syscw_after = write_syscalls();
+
+	diag("%s: %zu events, %zu bytes of metadata in %" PRIu64 " us (%" PRIu64 " ns/event), %" PRId64 " write syscalls",
+			desc, nr_events, registry->metadata_len,
+			duration / 1000, duration / nr_events,
+			syscw_before < 0 || syscw_after < 0 ?
+				-1 : syscw_after - syscw_before);
+end:
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	size_t i, nr_events = DEFAULT_NR_EVENTS, nr_fields = DEFAULT_NR_FIELDS;
+	struct ust_registry_session registry = {};
+	struct ust_registry_event *events = NULL;
+	struct ustctl_field *fields = NULL;
+	const char *tmpdir;
+	char path[PATH_MAX];
+
+	if (argc > 1) {
+		nr_events = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		nr_fields = strtoul(argv[2], NULL, 0);
+	}
+	if (!nr_events) {
+		fprintf(stderr, "Usage: %s [NR_EVENTS [NR_FIELDS]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	plan_tests(NUM_TESTS);
+
+	events = calloc(nr_events, sizeof(*events));
+	fields = create_fields(nr_fields);
+	if (!events || (!fields && nr_fields)) {
+		diag("Failed to allocate the events");
+		goto end;
+	}
+
+	/* All the events share the same fields, which are only read. */
+	for (i = 0; i < nr_events; i++) {
+		snprintf(events[i].name, sizeof(events[i].name),
+				"provider_%zu:event_%zu", i / 100, i);
+		events[i].id = i;
+		events[i].loglevel_value = 13;
+		events[i].nr_fields = nr_fields;
+		events[i].fields = fields;
+	}
+
+	registry.byte_order = BYTE_ORDER;
+	registry.metadata_fd = -1;
+	ret = run_bench(&registry, events, nr_events, "In memory");
+	ok(ret == 0, "Generate the metadata of %zu events in memory", nr_events);
+	reset_registry(&registry);
+
+	tmpdir = getenv("TMPDIR");
+	snprintf(path, sizeof(path), "%s/bench-metadata-XXXXXX",
+			tmpdir ? tmpdir : "/tmp");
+	registry.metadata_fd = mkstemp(path);
+	if (registry.metadata_fd < 0) {
+		diag("Failed to create metadata file in %s: %s",
+				tmpdir ? tmpdir : "/tmp", strerror(errno));
+		ret = -1;
+	} else {
+		(void) unlink(path);
+		ret = run_bench(&registry, events, nr_events,
+				"With metadata file");
+		close(registry.metadata_fd);
+	}
+	ok(ret == 0, "Generate the metadata of %zu events with a metadata file",
+			nr_events);
+	reset_registry(&registry);
+
+end:
+	free(fields);
+	free(events);
+	return exit_status();
+}
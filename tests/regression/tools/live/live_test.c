@@ -48,7 +48,7 @@
 #define LIVE_TIMER 2000000
 
 /* Number of TAP tests in this file */
-#define NUM_TESTS 11
+#define NUM_TESTS 13
 #define mmap_size 524288
 
 int ust_consumerd32_fd;
@@ -628,6 +628,140 @@ error:
 	return -1;
 }
 
+/*
+ * Get the next indexes of all the streams of a session with a single
+ * command. Returns the number of indexes received.
+ */
+static
+int get_next_indexes(uint64_t session_id)
+{
+	struct lttng_viewer_cmd cmd;
+	struct lttng_viewer_get_next_indexes rq;
+	struct lttng_viewer_indexes rp;
+	struct lttng_viewer_stream_index index;
+	ssize_t ret_len;
+	uint32_t i, count;
+
+	cmd.cmd = htobe32(LTTNG_VIEWER_GET_NEXT_INDEXES);
+	cmd.data_size = htobe64(sizeof(rq));
+	cmd.cmd_version = htobe32(0);
+
+	memset(&rq, 0, sizeof(rq));
+	rq.id = htobe64(session_id);
+	rq.flags = htobe32(LTTNG_VIEWER_GET_NEXT_INDEXES_SESSION);
+	rq.max_indexes = htobe32(64);
+
+	ret_len = lttng_live_send(control_sock, &cmd, sizeof(cmd));
+	if (ret_len < 0) {
+		diag("Error sending cmd");
+		goto error;
+	}
+	ret_len = lttng_live_send(control_sock, &rq, sizeof(rq));
+	if (ret_len < 0) {
+		diag("Error sending get_next_indexes request");
+		goto error;
+	}
+	ret_len = lttng_live_recv(control_sock, &rp, sizeof(rp));
+	if (ret_len <= 0) {
+		diag("Error receiving indexes response");
+		goto error;
+	}
+	if (be32toh(rp.status) != LTTNG_VIEWER_INDEXES_OK) {
+		diag("Got status %u during LTTNG_VIEWER_GET_NEXT_INDEXES",
+				be32toh(rp.status));
+		goto error;
+	}
+
+	count = be32toh(rp.index_count);
+	if (count > 64) {
+		diag("Got %u indexes, more than requested", count);
+		goto error;
+	}
+	for (i = 0; i < count; i++) {
+		ret_len = lttng_live_recv(control_sock, &index, sizeof(index));
+		if (ret_len <= 0) {
+			diag("Error receiving index");
+			goto error;
+		}
+		if (be32toh(index.index.status) == LTTNG_VIEWER_INDEX_RETRY) {
+			diag("Got LTTNG_VIEWER_INDEX_RETRY in batched reply");
+			goto error;
+		}
+	}
+	return count;
+
+error:
+	return -1;
+}
+
+/*
+ * Get the same packet twice with a single command.
+ */
+static
+int get_data_packets(int id, uint64_t offset, uint64_t len)
+{
+	struct lttng_viewer_cmd cmd;
+	struct {
+		struct lttng_viewer_get_packets header;
+		struct lttng_viewer_get_packet packets[2];
+	} LTTNG_PACKED rq;
+	struct lttng_viewer_trace_packet rp;
+	ssize_t ret_len;
+	int i;
+
+	cmd.cmd = htobe32(LTTNG_VIEWER_GET_PACKETS);
+	cmd.data_size = htobe64(sizeof(rq));
+	cmd.cmd_version = htobe32(0);
+
+	memset(&rq, 0, sizeof(rq));
+	rq.header.packet_count = htobe32(2);
+	for (i = 0; i < 2; i++) {
+		rq.packets[i].stream_id = htobe64(session->streams[id].id);
+		/* Already in big endian. */
+		rq.packets[i].offset = offset;
+		rq.packets[i].len = htobe32(len);
+	}
+
+	ret_len = lttng_live_send(control_sock, &cmd, sizeof(cmd));
+	if (ret_len < 0) {
+		diag("Error sending cmd");
+		goto error;
+	}
+	ret_len = lttng_live_send(control_sock, &rq, sizeof(rq));
+	if (ret_len < 0) {
+		diag("Error sending get_data_packets request");
+		goto error;
+	}
+
+	for (i = 0; i < 2; i++) {
+		ret_len = lttng_live_recv(control_sock, &rp, sizeof(rp));
+		if (ret_len <= 0) {
+			diag("Error receiving data response");
+			goto error;
+		}
+		if (be32toh(rp.status) != LTTNG_VIEWER_GET_PACKET_OK ||
+				be32toh(rp.len) != len) {
+			diag("Got status %u and len %u during LTTNG_VIEWER_GET_PACKETS",
+					be32toh(rp.status), be32toh(rp.len));
+			goto error;
+		}
+		if (len > mmap_size) {
+			diag("mmap_size not big enough");
+			goto error;
+		}
+		ret_len = lttng_live_recv(control_sock,
+				session->streams[id].mmap_base, len);
+		if (ret_len <= 0) {
+			diag("Error receiving trace packet");
+			goto error;
+		}
+	}
+	return 0;
+
+error:
+	return -1;
+}
+
 int detach_viewer_session(uint64_t id)
 {
 	struct lttng_viewer_cmd cmd;
@@ -716,6 +850,14 @@ int main(int argc, char **argv)
 			first_packet_stream_id, first_packet_offset,
 			first_packet_len);
 
+	ret = get_next_indexes(session_id);
+	ok(ret >= 0, "Get next indexes of all streams, %d index(es) received",
+			ret);
+
+	ret = get_data_packets(first_packet_stream_id, first_packet_offset,
+			first_packet_len);
+	ok(ret == 0, "Get two data packets with a single command");
+
 	ret = detach_viewer_session(session_id);
 	ok(ret == 0, "Detach viewer session");
 
@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Simulate many concurrent live viewers reading from a relay daemon and
+ * report the latency of their requests.
+ *
+ * Each viewer runs in its own thread with its own connection to the relay
+ * daemon's live port. It attaches to the first live session no other viewer
+ * is attached to and, until the deadline, polls the next index of each of
+ * the session's data streams, reads every packet it is given and fetches the
+ * metadata whenever it is told there is new metadata. The latency of a
+ * request is the time elapsed between the start of its send and the
+ * reception of the last byte of its reply, payload included.
+ *
+ * Usage: live_viewers [NR_VIEWERS [DURATION_SEC [PORT]]]
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/defaults.h>
+
+#include <bin/lttng-relayd/lttng-viewer-abi.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+#define DEFAULT_NR_VIEWERS	16
+#define DEFAULT_DURATION	10	/* sec */
+
+/* Time to wait when no stream of a session has an index ready. */
+#define RETRY_DELAY_US		1000
+
+struct viewer_stream {
+	uint64_t id;
+	bool metadata;
+	bool hup;
+};
+
+struct viewer {
+	unsigned int id;
+	pthread_t thread;
+	int sock;
+	uint64_t session_id;
+	struct viewer_stream *streams;
+	unsigned int stream_count;
+	char *buf;
+	size_t buf_len;
+	/* Latency of each request, in ns. */
+	uint64_t *latencies;
+	size_t nr_latencies;
+	size_t max_latencies;
+	uint64_t bytes;
+	int error;
+};
+
+static unsigned int nr_viewers = DEFAULT_NR_VIEWERS;
+static unsigned int duration = DEFAULT_DURATION;
+static unsigned int port = DEFAULT_NETWORK_VIEWER_PORT;
+static pthread_barrier_t start_barrier;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t va = *(const uint64_t *) a, vb = *(const uint64_t *) b;
+
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+static int recv_all(struct viewer *viewer, void *buf, size_t len)
+{
+	ssize_t ret;
+	size_t copied = 0;
+
+	while (copied < len) {
+		ret = recv(viewer->sock, (char *) buf + copied, len - copied, 0);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			diag("Viewer %u: %s", viewer->id, ret ? strerror(errno) :
+					"relay daemon closed the connection");
+			return -1;
+		}
+		copied += ret;
+	}
+	return 0;
+}
+
+/*
+ * Send a command header followed by its payload.
+ */
+static int send_cmd(struct viewer *viewer, enum lttng_viewer_command cmd,
+		const void *payload, size_t len)
+{
+	ssize_t ret;
+	char msg[sizeof(struct lttng_viewer_cmd) + 64];
+	struct lttng_viewer_cmd *hdr = (struct lttng_viewer_cmd *) msg;
+	size_t sent = 0, msg_len = sizeof(*hdr) + len;
+
+	assert(len <= sizeof(msg) - sizeof(*hdr));
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->cmd = htobe32(cmd);
+	hdr->data_size = htobe64(len);
+	hdr->cmd_version = htobe32(0);
+	if (len) {
+		memcpy(msg + sizeof(*hdr), payload, len);
+	}
+
+	while (sent < msg_len) {
+		ret = send(viewer->sock, msg + sent, msg_len - sent,
+				MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret < 0) {
+			diag("Viewer %u: send: %s", viewer->id, strerror(errno));
+			return -1;
+		}
+		sent += ret;
+	}
+	return 0;
+}
+
+/*
+ * Receive a payload of 'len' bytes in the viewer's buffer.
+ */
+static int recv_payload(struct viewer *viewer, size_t len)
+{
+	if (len > viewer->buf_len) {
+		char *buf = realloc(viewer->buf, len);
+
+		if (!buf) {
+			diag("Viewer %u: failed to allocate %zu bytes",
+					viewer->id, len);
+			return -1;
+		}
+		viewer->buf = buf;
+		viewer->buf_len = len;
+	}
+	viewer->bytes += len;
+	return recv_all(viewer, viewer->buf, len);
+}
+
+static int record_latency(struct viewer *viewer, uint64_t start_ns)
+{
+	if (viewer->nr_latencies == viewer->max_latencies) {
+		size_t max = viewer->max_latencies ?
+				viewer->max_latencies * 2 : 4096;
+		uint64_t *latencies = realloc(viewer->latencies,
+				max * sizeof(*latencies));
+
+		if (!latencies) {
+			diag("Viewer %u: failed to allocate latency samples",
+					viewer->id);
+			return -1;
+		}
+		viewer->latencies = latencies;
+		viewer->max_latencies = max;
+	}
+	viewer->latencies[viewer->nr_latencies++] = now_ns() - start_ns;
+	return 0;
+}
+
+static int connect_viewer(struct viewer *viewer)
+{
+	struct sockaddr_in addr;
+	struct lttng_viewer_connect connect_rq;
+	struct lttng_viewer_create_session_response create_rp;
+
+	viewer->sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (viewer->sock < 0) {
+		diag("Viewer %u: socket: %s", viewer->id, strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(viewer->sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		diag("Viewer %u: connect: %s", viewer->id, strerror(errno));
+		return -1;
+	}
+
+	memset(&connect_rq, 0, sizeof(connect_rq));
+	connect_rq.major = htobe32(VERSION_MAJOR);
+	connect_rq.minor = htobe32(VERSION_MINOR);
+	connect_rq.type = htobe32(LTTNG_VIEWER_CLIENT_COMMAND);
+	if (send_cmd(viewer, LTTNG_VIEWER_CONNECT, &connect_rq,
+			sizeof(connect_rq)) ||
+			recv_all(viewer, &connect_rq, sizeof(connect_rq))) {
+		return -1;
+	}
+
+	if (send_cmd(viewer, LTTNG_VIEWER_CREATE_SESSION, NULL, 0) ||
+			recv_all(viewer, &create_rp, sizeof(create_rp))) {
+		return -1;
+	}
+	if (be32toh(create_rp.status) != LTTNG_VIEWER_CREATE_SESSION_OK) {
+		diag("Viewer %u: failed to create viewer session", viewer->id);
+		return -1;
+	}
+	return 0;
+}
+
+static int attach_session(struct viewer *viewer, uint64_t session_id)
+{
+	struct lttng_viewer_attach_session_request rq;
+	struct lttng_viewer_attach_session_response rp;
+	struct lttng_viewer_stream stream;
+	unsigned int i;
+
+	memset(&rq, 0, sizeof(rq));
+	rq.session_id = htobe64(session_id);
+	rq.seek = htobe32(LTTNG_VIEWER_SEEK_BEGINNING);
+	if (send_cmd(viewer, LTTNG_VIEWER_ATTACH_SESSION, &rq, sizeof(rq)) ||
+			recv_all(viewer, &rp, sizeof(rp))) {
+		return -1;
+	}
+
+	viewer->stream_count = be32toh(rp.streams_count);
+	if (be32toh(rp.status) != LTTNG_VIEWER_ATTACH_OK) {
+		/* Attached to by another viewer, try the next session. */
+		return 0;
+	}
+
+	viewer->streams = zmalloc(viewer->stream_count *
+			sizeof(*viewer->streams));
+	if (!viewer->streams) {
+		return -1;
+	}
+	for (i = 0; i < viewer->stream_count; i++) {
+		if (recv_all(viewer, &stream, sizeof(stream))) {
+			return -1;
+		}
+		viewer->streams[i].id = be64toh(stream.id);
+		viewer->streams[i].metadata = !!be32toh(stream.metadata_flag);
+	}
+	viewer->session_id = session_id;
+	return 1;
+}
+
+/*
+ * Attach to the first live session with streams to which no other viewer is
+ * attached.
+ */
+static int find_session(struct viewer *viewer)
+{
+	int ret;
+	struct lttng_viewer_list_sessions list;
+	struct lttng_viewer_session *sessions = NULL;
+	unsigned int i, count;
+
+	if (send_cmd(viewer, LTTNG_VIEWER_LIST_SESSIONS, NULL, 0) ||
+			recv_all(viewer, &list, sizeof(list))) {
+		ret = -1;
+		goto end;
+	}
+
+	count = be32toh(list.sessions_count);
+	sessions = zmalloc(count * sizeof(*sessions));
+	if (!sessions && count) {
+		ret = -1;
+		goto end;
+	}
+	if (recv_all(viewer, sessions, count * sizeof(*sessions))) {
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (be32toh(sessions[i].clients) > 0 ||
+				be32toh(sessions[i].streams) == 0) {
+			continue;
+		}
+		ret = attach_session(viewer, be64toh(sessions[i].id));
+		if (ret) {
+			goto end;
+		}
+	}
+	diag("Viewer %u: no live session left to attach to", viewer->id);
+	ret = -1;
+end:
+	free(sessions);
+	return ret < 0 ? -1 : 0;
+}
+
+static int get_metadata(struct viewer *viewer, struct viewer_stream *stream)
+{
+	struct lttng_viewer_get_metadata rq;
+	struct lttng_viewer_metadata_packet rp;
+	uint64_t start_ns;
+
+	rq.stream_id = htobe64(stream->id);
+
+	for (;;) {
+		start_ns = now_ns();
+		if (send_cmd(viewer, LTTNG_VIEWER_GET_METADATA, &rq,
+				sizeof(rq)) ||
+				recv_all(viewer, &rp, sizeof(rp))) {
+			return -1;
+		}
+		switch (be32toh(rp.status)) {
+		case LTTNG_VIEWER_METADATA_OK:
+			if (recv_payload(viewer, be64toh(rp.len))) {
+				return -1;
+			}
+			break;
+		case LTTNG_VIEWER_NO_NEW_METADATA:
+			return record_latency(viewer, start_ns);
+		default:
+			diag("Viewer %u: GET_METADATA error", viewer->id);
+			return -1;
+		}
+		if (record_latency(viewer, start_ns)) {
+			return -1;
+		}
+	}
+}
+
+static int get_all_metadata(struct viewer *viewer)
+{
+	unsigned int i;
+
+	for (i = 0; i < viewer->stream_count; i++) {
+		if (viewer->streams[i].metadata &&
+				get_metadata(viewer, &viewer->streams[i])) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read the next packet of a data stream, if any.
+ *
+ * Return 1 if a packet was read, 0 if none is available or if the stream is
+ * hung up, or -1 on error.
+ */
+static int read_next_packet(struct viewer *viewer, struct viewer_stream *stream)
+{
+	struct lttng_viewer_get_next_index index_rq;
+	struct lttng_viewer_index index;
+	struct lttng_viewer_get_packet packet_rq;
+	struct lttng_viewer_trace_packet packet;
+	uint64_t start_ns;
+
+	memset(&index_rq, 0, sizeof(index_rq));
+	index_rq.stream_id = htobe64(stream->id);
+
+	start_ns = now_ns();
+	if (send_cmd(viewer, LTTNG_VIEWER_GET_NEXT_INDEX, &index_rq,
+			sizeof(index_rq)) ||
+			recv_all(viewer, &index, sizeof(index)) ||
+			record_latency(viewer, start_ns)) {
+		return -1;
+	}
+
+	if (be32toh(index.flags) & LTTNG_VIEWER_FLAG_NEW_METADATA &&
+			get_all_metadata(viewer)) {
+		return -1;
+	}
+
+	switch (be32toh(index.status)) {
+	case LTTNG_VIEWER_INDEX_OK:
+		break;
+	case LTTNG_VIEWER_INDEX_RETRY:
+	case LTTNG_VIEWER_INDEX_INACTIVE:
+		return 0;
+	case LTTNG_VIEWER_INDEX_HUP:
+		stream->hup = true;
+		return 0;
+	default:
+		diag("Viewer %u: GET_NEXT_INDEX error on stream %" PRIu64,
+				viewer->id, stream->id);
+		return -1;
+	}
+
+	memset(&packet_rq, 0, sizeof(packet_rq));
+	packet_rq.stream_id = htobe64(stream->id);
+	/* Already in big endian. */
+	packet_rq.offset = index.offset;
+	packet_rq.len = htobe32(be64toh(index.packet_size) / CHAR_BIT);
+
+	start_ns = now_ns();
+	if (send_cmd(viewer, LTTNG_VIEWER_GET_PACKET, &packet_rq,
+			sizeof(packet_rq)) ||
+			recv_all(viewer, &packet, sizeof(packet))) {
+		return -1;
+	}
+	switch (be32toh(packet.status)) {
+	case LTTNG_VIEWER_GET_PACKET_OK:
+		if (recv_payload(viewer, be32toh(packet.len))) {
+			return -1;
+		}
+		break;
+	case LTTNG_VIEWER_GET_PACKET_ERR:
+		if (be32toh(packet.flags) & LTTNG_VIEWER_FLAG_NEW_METADATA) {
+			/* Read the metadata, the packet is read again later. */
+			return record_latency(viewer, start_ns) ||
+					get_all_metadata(viewer) ? -1 : 0;
+		}
+		/* Fall-through. */
+	default:
+		diag("Viewer %u: GET_PACKET error on stream %" PRIu64,
+				viewer->id, stream->id);
+		return -1;
+	}
+	return record_latency(viewer, start_ns) ? -1 : 1;
+}
+
+static void *viewer_thread(void *data)
+{
+	int ret;
+	struct viewer *viewer = data;
+	uint64_t deadline_ns;
+
+	viewer->error = connect_viewer(viewer) || find_session(viewer) ||
+			get_all_metadata(viewer);
+
+	/* Start all the viewers together once they are attached. */
+	(void) pthread_barrier_wait(&start_barrier);
+	if (viewer->error) {
+		goto end;
+	}
+	deadline_ns = now_ns() + (uint64_t) duration * 1000000000ULL;
+
+	while (now_ns() < deadline_ns) {
+		unsigned int i, nr_active = 0;
+		bool progress = false;
+
+		for (i = 0; i < viewer->stream_count; i++) {
+			struct viewer_stream *stream = &viewer->streams[i];
+
+			if (stream->metadata || stream->hup) {
+				continue;
+			}
+			nr_active++;
+			ret = read_next_packet(viewer, stream);
+			if (ret < 0) {
+				viewer->error = 1;
+				goto end;
+			}
+			progress |= ret > 0;
+		}
+		if (!nr_active) {
+			/* The session was destroyed. */
+			break;
+		}
+		if (!progress) {
+			(void) usleep(RETRY_DELAY_US);
+		}
+	}
+end:
+	if (viewer->sock >= 0) {
+		(void) close(viewer->sock);
+	}
+	return NULL;
+}
+
+static unsigned int parse_uint(const char *arg, unsigned int default_value)
+{
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(arg, &end, 0);
+	if (errno || *end || v == 0 || v > UINT_MAX) {
+		return default_value;
+	}
+	return (unsigned int) v;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	unsigned int i, nr_threads = 0;
+	struct viewer *viewers = NULL;
+	uint64_t *latencies = NULL;
+	size_t nr_latencies = 0;
+	uint64_t bytes = 0, start_ns, elapsed_ns;
+
+	if (argc > 1) {
+		nr_viewers = parse_uint(argv[1], DEFAULT_NR_VIEWERS);
+	}
+	if (argc > 2) {
+		duration = parse_uint(argv[2], DEFAULT_DURATION);
+	}
+	if (argc > 3) {
+		port = parse_uint(argv[3], DEFAULT_NETWORK_VIEWER_PORT);
+	}
+
+	plan_tests(nr_viewers + 1);
+
+	diag("%u concurrent live viewers for %u s on port %u", nr_viewers,
+			duration, port);
+
+	viewers = zmalloc(nr_viewers * sizeof(*viewers));
+	if (!viewers) {
+		diag("Failed to allocate viewers");
+		goto end;
+	}
+	ret = pthread_barrier_init(&start_barrier, NULL, nr_viewers + 1);
+	if (ret) {
+		diag("Failed to initialize barrier");
+		goto end;
+	}
+
+	for (i = 0; i < nr_viewers; i++) {
+		viewers[i].id = i;
+		viewers[i].sock = -1;
+		ret = pthread_create(&viewers[i].thread, NULL, viewer_thread,
+				&viewers[i]);
+		if (ret) {
+			diag("Failed to create viewer thread");
+			/* The barrier can't be reached anymore. */
+			exit(EXIT_FAILURE);
+		}
+		nr_threads++;
+	}
+
+	/* Wait for every viewer to be attached. */
+	(void) pthread_barrier_wait(&start_barrier);
+	start_ns = now_ns();
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(viewers[i].thread, NULL);
+	}
+	elapsed_ns = now_ns() - start_ns;
+	(void) pthread_barrier_destroy(&start_barrier);
+
+	for (i = 0; i < nr_viewers; i++) {
+		struct viewer *viewer = &viewers[i];
+
+		ok(!viewer->error, "Viewer %u: session %" PRIu64
+				", %zu requests, %" PRIu64 " bytes", i,
+				viewer->session_id, viewer->nr_latencies,
+				viewer->bytes);
+		nr_latencies += viewer->nr_latencies;
+		bytes += viewer->bytes;
+	}
+
+	latencies = zmalloc(nr_latencies * sizeof(*latencies));
+	if (!latencies && nr_latencies) {
+		diag("Failed to allocate latencies");
+		goto end;
+	}
+	nr_latencies = 0;
+	for (i = 0; i < nr_viewers; i++) {
+		struct viewer *viewer = &viewers[i];
+
+		memcpy(latencies + nr_latencies, viewer->latencies,
+				viewer->nr_latencies * sizeof(*latencies));
+		nr_latencies += viewer->nr_latencies;
+	}
+
+	ok(nr_latencies > 0, "%zu requests served, %" PRIu64 " bytes read",
+			nr_latencies, bytes);
+	if (nr_latencies > 0) {
+		qsort(latencies, nr_latencies, sizeof(uint64_t), cmp_u64);
+		diag("%u viewers: %.0f requests/s, p50 %" PRIu64 " us, p90 %" PRIu64
+				" us, p99 %" PRIu64 " us, p99.9 %" PRIu64
+				" us, max %" PRIu64 " us",
+				nr_viewers,
+				(double) nr_latencies * 1e9 / elapsed_ns,
+				latencies[nr_latencies / 2] / 1000,
+				latencies[(nr_latencies * 90) / 100] / 1000,
+				latencies[(nr_latencies * 99) / 100] / 1000,
+				latencies[(nr_latencies * 999) / 1000] / 1000,
+				latencies[nr_latencies - 1] / 1000);
+	}
+
+end:
+	for (i = 0; viewers && i < nr_viewers; i++) {
+		free(viewers[i].latencies);
+		free(viewers[i].streams);
+		free(viewers[i].buf);
+	}
+	free(latencies);
+	free(viewers);
+	return exit_status();
+}
@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <lttng/lttng.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+/* Number of TAP tests in this file */
+#define NUM_TESTS 17
+
+#define SESSION_NAME		"batch"
+#define CHANNEL_NAME		"batch_chan"
+#define FILTER_EXPRESSION	"intfield > 1"
+/* Larger than the socket buffer: an old session daemon doesn't read it. */
+#define NR_LARGE_BATCH_EVENTS	2048
+#define MAX_RECORDED_EVENTS	NR_LARGE_BATCH_EVENTS
+
+static char *exclusions[] = { "tp:excluded_a", "tp:excluded_b" };
+
+/* An event as received by the fake session daemon. */
+struct recorded_event {
+	char name[LTTNG_SYMBOL_NAME_LEN];
+	char channel_name[LTTNG_SYMBOL_NAME_LEN];
+	char filter_expression[sizeof(FILTER_EXPRESSION)];
+	bool has_bytecode;
+	uint32_t exclusion_count;
+	char exclusions[2][LTTNG_SYMBOL_NAME_LEN];
+};
+
+/*
+ * Fake session daemon listening on the client socket of the LTTNG_HOME
+ * session daemon. It either knows LTTNG_ENABLE_EVENT_BATCH, or replies
+ * LTTNG_ERR_UND to it and closes the connection without reading the events,
+ * as the session daemons which predate it do.
+ */
+static struct fake_sessiond {
+	int sock;
+	pthread_t thread;
+	bool batch_supported;
+	/* Reply to LTTNG_ENABLE_EVENT_BATCH when it is supported. */
+	uint32_t batch_ret_code;
+	unsigned int nr_batch_cmds;
+	unsigned int nr_enable_cmds;
+	unsigned int nr_events;
+	bool malformed;
+	struct recorded_event events[MAX_RECORDED_EVENTS];
+} fake;
+
+static char home_path[] = "/tmp/test_event_batch.XXXXXX";
+static char sock_path[PATH_MAX];
+static char rundir_path[PATH_MAX];
+
+static int recv_all(int sock, void *buf, size_t len)
+{
+	ssize_t ret;
+	char *p = buf;
+
+	while (len) {
+		ret = recv(sock, p, len, 0);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int reply(int sock, uint32_t cmd_type, uint32_t ret_code)
+{
+	struct lttcomm_lttng_msg llm = {
+		.cmd_type = cmd_type,
+		.ret_code = ret_code,
+	};
+
+	return send(sock, &llm, sizeof(llm), MSG_NOSIGNAL) == sizeof(llm) ?
+			0 : -1;
+}
+
+/*
+ * Receive the payload of an event: exclusion names, filter expression and
+ * filter bytecode, and record it.
+ */
+static int recv_event(int sock, const struct lttng_event *event,
+		const char *channel_name, uint32_t exclusion_count,
+		uint32_t expression_len, uint32_t bytecode_len)
+{
+	uint32_t i;
+	char *bytecode = NULL;
+	struct recorded_event *recorded;
+
+	if (fake.nr_events == MAX_RECORDED_EVENTS ||
+			exclusion_count > 2 ||
+			expression_len > sizeof(recorded->filter_expression) ||
+			!expression_len != !bytecode_len) {
+		fake.malformed = true;
+		return -1;
+	}
+	recorded = &fake.events[fake.nr_events++];
+	memcpy(recorded->name, event->name, sizeof(recorded->name));
+	memcpy(recorded->channel_name, channel_name,
+			sizeof(recorded->channel_name));
+	recorded->exclusion_count = exclusion_count;
+	for (i = 0; i < exclusion_count; i++) {
+		if (recv_all(sock, recorded->exclusions[i],
+				LTTNG_SYMBOL_NAME_LEN)) {
+			return -1;
+		}
+	}
+	if (recv_all(sock, recorded->filter_expression, expression_len)) {
+		return -1;
+	}
+	if (bytecode_len) {
+		bytecode = malloc(bytecode_len);
+		if (!bytecode || recv_all(sock, bytecode, bytecode_len)) {
+			free(bytecode);
+			return -1;
+		}
+		recorded->has_bytecode = true;
+		free(bytecode);
+	}
+	return 0;
+}
+
+static void handle_connection(int sock)
+{
+	uint32_t i;
+	struct lttng_event event;
+	struct lttcomm_session_msg lsm;
+	struct lttcomm_event_batch_entry entry;
+
+	if (recv_all(sock, &lsm, sizeof(lsm))) {
+		return;
+	}
+
+	switch (lsm.cmd_type) {
+	case LTTNG_ENABLE_EVENT_BATCH:
+		fake.nr_batch_cmds++;
+		if (!fake.batch_supported) {
+			/* Don't read the events. */
+			(void) reply(sock, lsm.cmd_type, LTTNG_ERR_UND);
+			return;
+		}
+		for (i = 0; i < lsm.u.enable_batch.count; i++) {
+			if (recv_all(sock, &entry, sizeof(entry))) {
+				return;
+			}
+			memcpy(&event, &entry.event, sizeof(event));
+			if (recv_event(sock, &event,
+					lsm.u.enable_batch.channel_name,
+					entry.exclusion_count,
+					entry.expression_len,
+					entry.bytecode_len)) {
+				return;
+			}
+		}
+		(void) reply(sock, lsm.cmd_type, fake.batch_ret_code);
+		break;
+	case LTTNG_ENABLE_EVENT:
+		fake.nr_enable_cmds++;
+		memcpy(&event, &lsm.u.enable.event, sizeof(event));
+		if (lsm.u.enable.userspace_probe_location_len ||
+				recv_event(sock, &event,
+					lsm.u.enable.channel_name,
+					lsm.u.enable.exclusion_count,
+					lsm.u.enable.expression_len,
+					lsm.u.enable.bytecode_len)) {
+			fake.malformed = true;
+			return;
+		}
+		(void) reply(sock, lsm.cmd_type, LTTNG_OK);
+		break;
+	default:
+		(void) reply(sock, lsm.cmd_type, LTTNG_ERR_UND);
+		break;
+	}
+}
+
+static void *fake_sessiond_thread(void *data)
+{
+	int sock;
+
+	/* The listening socket is shut down to stop the thread. */
+	while ((sock = accept(fake.sock, NULL, NULL)) >= 0) {
+		handle_connection(sock);
+		close(sock);
+	}
+	return NULL;
+}
+
+static int fake_sessiond_start(void)
+{
+	int ret;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (!mkdtemp(home_path)) {
+		diag("mkdtemp: %s", strerror(errno));
+		return -1;
+	}
+	ret = setenv(DEFAULT_LTTNG_HOME_ENV_VAR, home_path, 1);
+	if (ret) {
+		return -1;
+	}
+	snprintf(rundir_path, sizeof(rundir_path), DEFAULT_LTTNG_HOME_RUNDIR,
+			home_path);
+	snprintf(sock_path, sizeof(sock_path), DEFAULT_HOME_CLIENT_UNIX_SOCK,
+			home_path);
+	if (mkdir(rundir_path, S_IRWXU)) {
+		diag("mkdir: %s", strerror(errno));
+		return -1;
+	}
+
+	fake.sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fake.sock < 0) {
+		return -1;
+	}
+	strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+	if (bind(fake.sock, (struct sockaddr *) &addr, sizeof(addr)) ||
+			listen(fake.sock, 16)) {
+		diag("bind/listen: %s", strerror(errno));
+		return -1;
+	}
+	return pthread_create(&fake.thread, NULL, fake_sessiond_thread, NULL) ?
+			-1 : 0;
+}
+
+static void fake_sessiond_stop(void)
+{
+	shutdown(fake.sock, SHUT_RDWR);
+	pthread_join(fake.thread, NULL);
+	close(fake.sock);
+	unlink(sock_path);
+	rmdir(rundir_path);
+	rmdir(home_path);
+}
+
+static void fake_sessiond_reset(bool batch_supported, uint32_t batch_ret_code)
+{
+	fake.batch_supported = batch_supported;
+	fake.batch_ret_code = batch_ret_code;
+	fake.nr_batch_cmds = 0;
+	fake.nr_enable_cmds = 0;
+	fake.nr_events = 0;
+	fake.malformed = false;
+	memset(fake.events, 0, sizeof(fake.events));
+}
+
+static struct lttng_handle *create_handle(void)
+{
+	struct lttng_domain domain = { .type = LTTNG_DOMAIN_UST };
+
+	return lttng_create_handle(SESSION_NAME, &domain);
+}
+
+/* Batch of a plain event, a filtered one and one with exclusions. */
+static struct lttng_event_batch *create_batch(void)
+{
+	int ret;
+	struct lttng_event event;
+	struct lttng_event_batch *batch;
+
+	batch = lttng_event_batch_create();
+	if (!batch) {
+		return NULL;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.type = LTTNG_EVENT_TRACEPOINT;
+	strcpy(event.name, "tp:plain");
+	ret = lttng_event_batch_add(batch, &event, NULL, 0, NULL);
+	strcpy(event.name, "tp:filtered");
+	ret |= lttng_event_batch_add(batch, &event, FILTER_EXPRESSION, 0, NULL);
+	strcpy(event.name, "tp:excluded*");
+	ret |= lttng_event_batch_add(batch, &event, NULL, 2, exclusions);
+	if (ret) {
+		lttng_event_batch_destroy(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+/* Check that the fake session daemon received the events of create_batch(). */
+static bool batch_events_received(void)
+{
+	const struct recorded_event *events = fake.events;
+
+	return !fake.malformed && fake.nr_events == 3 &&
+			!strcmp(events[0].name, "tp:plain") &&
+			!strcmp(events[0].channel_name, CHANNEL_NAME) &&
+			!events[0].filter_expression[0] &&
+			!events[0].has_bytecode &&
+			!events[0].exclusion_count &&
+			!strcmp(events[1].name, "tp:filtered") &&
+			!strcmp(events[1].filter_expression,
+				FILTER_EXPRESSION) &&
+			events[1].has_bytecode &&
+			!events[1].exclusion_count &&
+			!strcmp(events[2].name, "tp:excluded*") &&
+			!events[2].has_bytecode &&
+			events[2].exclusion_count == 2 &&
+			!strcmp(events[2].exclusions[0], exclusions[0]) &&
+			!strcmp(events[2].exclusions[1], exclusions[1]);
+}
+
+static void test_batch_api(void)
+{
+	int ret;
+	struct lttng_event event;
+	struct lttng_event_batch *batch;
+	struct lttng_handle *handle;
+
+	memset(&event, 0, sizeof(event));
+	event.type = LTTNG_EVENT_TRACEPOINT;
+	strcpy(event.name, "tp:event");
+
+	batch = lttng_event_batch_create();
+	ok(batch != NULL, "Create an event batch");
+	ok(lttng_event_batch_add(NULL, &event, NULL, 0, NULL) ==
+			-LTTNG_ERR_INVALID,
+			"Adding to a NULL batch is rejected");
+	ok(lttng_event_batch_add(batch, NULL, NULL, 0, NULL) ==
+			-LTTNG_ERR_INVALID,
+			"Adding a NULL event is rejected");
+	ok(lttng_event_batch_add(batch, &event, NULL, 1, NULL) ==
+			-LTTNG_ERR_INVALID,
+			"Adding exclusions without names is rejected");
+
+	handle = create_handle();
+	ok(lttng_enable_event_batch(NULL, NULL, batch) == -LTTNG_ERR_INVALID,
+			"Enabling a batch without handle is rejected");
+	ok(lttng_enable_event_batch(handle, NULL, NULL) == -LTTNG_ERR_INVALID,
+			"Enabling a NULL batch is rejected");
+	ret = lttng_enable_event_batch(handle, NULL, batch);
+	ok(ret == 0, "Enabling an empty batch doesn't need a session daemon");
+
+	lttng_destroy_handle(handle);
+	lttng_event_batch_destroy(batch);
+}
+
+static void test_batch_wire_format(void)
+{
+	int ret;
+	struct lttng_event_batch *batch;
+	struct lttng_handle *handle;
+
+	handle = create_handle();
+	batch = create_batch();
+	if (!handle || !batch) {
+		diag("Failed to create the batch");
+		exit(EXIT_FAILURE);
+	}
+
+	fake_sessiond_reset(true, LTTNG_OK);
+	ret = lttng_enable_event_batch(handle, CHANNEL_NAME, batch);
+	ok(ret == 0, "Enable a batch of 3 events");
+	ok(fake.nr_batch_cmds == 1 && fake.nr_enable_cmds == 0,
+			"The batch is sent as a single command");
+	ok(batch_events_received(),
+			"The events, filter and exclusions of the batch are received in order");
+
+	fake_sessiond_reset(true, LTTNG_ERR_UST_EVENT_ENABLED);
+	ret = lttng_enable_event_batch(handle, CHANNEL_NAME, batch);
+	ok(ret == -LTTNG_ERR_UST_EVENT_ENABLED,
+			"The error of the session daemon is reported");
+	ok(fake.nr_batch_cmds == 1 && fake.nr_enable_cmds == 0,
+			"No fallback on a session daemon error");
+
+	lttng_event_batch_destroy(batch);
+	lttng_destroy_handle(handle);
+}
+
+static void test_batch_fallback(void)
+{
+	int ret, i;
+	bool names_ok = true;
+	struct lttng_event event;
+	struct lttng_event_batch *batch;
+	struct lttng_handle *handle;
+
+	handle = create_handle();
+	batch = create_batch();
+	if (!handle || !batch) {
+		diag("Failed to create the batch");
+		exit(EXIT_FAILURE);
+	}
+
+	fake_sessiond_reset(false, LTTNG_OK);
+	ret = lttng_enable_event_batch(handle, CHANNEL_NAME, batch);
+	ok(ret == 0, "Enable a batch with a session daemon which doesn't know batches");
+	ok(fake.nr_batch_cmds == 1 && fake.nr_enable_cmds == 3,
+			"The events are enabled one by one");
+	ok(batch_events_received(),
+			"The events, filter and exclusions are enabled in order");
+	lttng_event_batch_destroy(batch);
+
+	batch = lttng_event_batch_create();
+	if (!batch) {
+		diag("Failed to create the batch");
+		exit(EXIT_FAILURE);
+	}
+	memset(&event, 0, sizeof(event));
+	event.type = LTTNG_EVENT_TRACEPOINT;
+	for (i = 0; i < NR_LARGE_BATCH_EVENTS; i++) {
+		snprintf(event.name, sizeof(event.name), "tp:event_%d", i);
+		if (lttng_event_batch_add(batch, &event, FILTER_EXPRESSION, 0,
+				NULL)) {
+			diag("Failed to add an event to the batch");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	fake_sessiond_reset(false, LTTNG_OK);
+	ret = lttng_enable_event_batch(handle, CHANNEL_NAME, batch);
+	ok(ret == 0, "Enable a batch of %d events which can't be sent to a session daemon which doesn't know batches",
+			NR_LARGE_BATCH_EVENTS);
+	for (i = 0; i < fake.nr_events; i++) {
+		char name[LTTNG_SYMBOL_NAME_LEN];
+
+		snprintf(name, sizeof(name), "tp:event_%d", i);
+		names_ok &= !strcmp(fake.events[i].name, name);
+	}
+	ok(!fake.malformed && fake.nr_enable_cmds == NR_LARGE_BATCH_EVENTS &&
+			fake.nr_events == NR_LARGE_BATCH_EVENTS && names_ok,
+			"The %d events are enabled one by one, in order",
+			NR_LARGE_BATCH_EVENTS);
+
+	lttng_event_batch_destroy(batch);
+	lttng_destroy_handle(handle);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Event batch unit tests");
+	/* The fake session daemon may close a connection on the client. */
+	signal(SIGPIPE, SIG_IGN);
+
+	test_batch_api();
+
+	/* The root client always connects to the global session daemon. */
+	if (getuid() == 0) {
+		skip(NUM_TESTS - 7, "The fake session daemon is not reachable by root");
+		goto end;
+	}
+	if (fake_sessiond_start()) {
+		diag("Failed to start the fake session daemon");
+		return EXIT_FAILURE;
+	}
+	test_batch_wire_format();
+	test_batch_fallback();
+	fake_sessiond_stop();
+end:
+	return exit_status();
+}
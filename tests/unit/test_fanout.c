@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2020 The LTTng Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+#include <urcu.h>
+#include <urcu/uatomic.h>
+
+#include <bin/lttng-sessiond/fanout.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+/* Number of TAP tests in this file */
+#define NUM_TESTS 13
+
+#define NR_ITEMS		1000
+#define NR_THREADS		8
+
+/*
+ * The fake applications answer a command after APP_REPLY_DELAY_US, which
+ * stands for the round trip of a ustctl command to a busy application.
+ */
+#define NR_APPS			64
+#define APP_CMD_THREADS		16
+#define APP_REPLY_DELAY_US	2000
+#define APP_SOCKET_TIMEOUT_MS	200
+
+/* Time a call waits for the others to be in flight before giving up. */
+#define RENDEZVOUS_TIMEOUT_S	2
+
+struct counted_item {
+	unsigned long calls;
+	int value;
+};
+
+/*
+ * Rendezvous of the calls of a fan-out: each call waits until 'expected'
+ * calls are in flight. Once a call gives up, the others return right away so
+ * that a fan-out making its calls one at a time fails instead of hanging.
+ */
+struct rendezvous {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int expected;
+	unsigned int arrived;
+	unsigned int in_flight;
+	unsigned int max_in_flight;
+	bool failed;
+};
+
+/* A fake registered application: the sessiond end of its command socket. */
+struct fake_app {
+	int sock;
+	int app_sock;
+	bool hung;
+	pthread_t thread;
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int count_call(void *item, void *data)
+{
+	struct counted_item *counted = item;
+
+	uatomic_inc(&counted->calls);
+	/* Odd items fail. */
+	return counted->value % 2 ? -counted->value : counted->value;
+}
+
+static void rendezvous_reset(struct rendezvous *rdv, unsigned int expected)
+{
+	rdv->expected = expected;
+	rdv->arrived = 0;
+	rdv->in_flight = 0;
+	rdv->max_in_flight = 0;
+	rdv->failed = false;
+}
+
+static int rendezvous_call(void *item, void *data)
+{
+	int ret = 0;
+	struct rendezvous *rdv = data;
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += RENDEZVOUS_TIMEOUT_S;
+
+	pthread_mutex_lock(&rdv->lock);
+	rdv->arrived++;
+	rdv->in_flight++;
+	if (rdv->in_flight > rdv->max_in_flight) {
+		rdv->max_in_flight = rdv->in_flight;
+	}
+	pthread_cond_broadcast(&rdv->cond);
+	while (rdv->arrived < rdv->expected && !rdv->failed) {
+		ret = pthread_cond_timedwait(&rdv->cond, &rdv->lock, &deadline);
+		if (ret) {
+			rdv->failed = true;
+			pthread_cond_broadcast(&rdv->cond);
+		}
+	}
+	rdv->in_flight--;
+	ret = rdv->arrived < rdv->expected ? -ETIMEDOUT : 0;
+	pthread_mutex_unlock(&rdv->lock);
+	return ret;
+}
+
+static void *fake_app_thread(void *data)
+{
+	struct fake_app *app = data;
+	char cmd;
+
+	while (read(app->app_sock, &cmd, 1) == 1) {
+		if (app->hung) {
+			continue;
+		}
+		usleep(APP_REPLY_DELAY_US);
+		if (write(app->app_sock, &cmd, 1) != 1) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* Send a command to an application and wait for its reply, as ustctl does. */
+static int send_app_cmd(void *item, void *data)
+{
+	struct fake_app *app = item;
+	char cmd = 's', reply;
+
+	if (write(app->sock, &cmd, 1) != 1) {
+		return -errno;
+	}
+	if (read(app->sock, &reply, 1) != 1) {
+		return errno ? -errno : -EPIPE;
+	}
+	return reply == cmd ? 0 : -EINVAL;
+}
+
+static int fake_apps_create(struct fake_app *apps, size_t nr_apps)
+{
+	int ret, fds[2];
+	size_t i;
+	struct timeval timeout = {
+		.tv_sec = 0,
+		.tv_usec = APP_SOCKET_TIMEOUT_MS * 1000,
+	};
+
+	for (i = 0; i < nr_apps; i++) {
+		ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+		if (ret) {
+			diag("socketpair: %s", strerror(errno));
+			return -1;
+		}
+		apps[i].sock = fds[0];
+		apps[i].app_sock = fds[1];
+		ret = setsockopt(apps[i].sock, SOL_SOCKET, SO_RCVTIMEO,
+				&timeout, sizeof(timeout));
+		if (ret) {
+			diag("setsockopt: %s", strerror(errno));
+			return -1;
+		}
+		ret = pthread_create(&apps[i].thread, NULL, fake_app_thread,
+				&apps[i]);
+		if (ret) {
+			diag("pthread_create: %s", strerror(ret));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void fake_apps_destroy(struct fake_app *apps, size_t nr_apps)
+{
+	size_t i;
+
+	for (i = 0; i < nr_apps; i++) {
+		/* The application thread sees EOF. */
+		shutdown(apps[i].sock, SHUT_RDWR);
+		pthread_join(apps[i].thread, NULL);
+		close(apps[i].sock);
+		close(apps[i].app_sock);
+	}
+}
+
+static void test_all_items(void)
+{
+	size_t i, nr_errors, nr_once = 0, nr_results = 0;
+	struct counted_item *items;
+	void **item_ptrs;
+	int *results;
+
+	items = calloc(NR_ITEMS, sizeof(*items));
+	item_ptrs = calloc(NR_ITEMS, sizeof(*item_ptrs));
+	results = calloc(NR_ITEMS, sizeof(*results));
+	if (!items || !item_ptrs || !results) {
+		diag("Failed to allocate the items");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < NR_ITEMS; i++) {
+		items[i].value = i;
+		item_ptrs[i] = &items[i];
+	}
+
+	nr_errors = fanout_run(item_ptrs, NR_ITEMS, count_call, NULL, results,
+			NR_THREADS);
+	for (i = 0; i < NR_ITEMS; i++) {
+		nr_once += items[i].calls == 1;
+		nr_results += results[i] == (i % 2 ? -(int) i : (int) i);
+	}
+	ok(nr_once == NR_ITEMS, "Every item is processed exactly once");
+	ok(nr_results == NR_ITEMS, "Every result is stored in its item's slot");
+	ok(nr_errors == NR_ITEMS / 2, "Errors are counted (%zu)", nr_errors);
+
+	for (i = 0; i < NR_ITEMS; i++) {
+		items[i].calls = 0;
+	}
+	nr_errors = fanout_run(item_ptrs, NR_ITEMS, count_call, NULL, results, 0);
+	for (i = 0, nr_once = 0; i < NR_ITEMS; i++) {
+		nr_once += items[i].calls == 1;
+	}
+	ok(nr_once == NR_ITEMS && nr_errors == NR_ITEMS / 2,
+			"A thread limit of 0 processes the items in the calling thread");
+
+	nr_errors = fanout_run(item_ptrs, 0, count_call, NULL, results,
+			NR_THREADS);
+	ok(nr_errors == 0, "Fan-out of no items");
+
+	items[0].calls = items[1].calls = 0;
+	nr_errors = fanout_run(item_ptrs, 2, count_call, NULL, results,
+			NR_THREADS);
+	ok(items[0].calls == 1 && items[1].calls == 1 && nr_errors == 1,
+			"Fan-out of fewer items than threads");
+
+	free(results);
+	free(item_ptrs);
+	free(items);
+}
+
+static void test_concurrency(void)
+{
+	size_t nr_errors;
+	void *item_ptrs[APP_CMD_THREADS + 1] = {};
+	int results[APP_CMD_THREADS + 1];
+	struct rendezvous rdv = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+
+	rendezvous_reset(&rdv, APP_CMD_THREADS);
+	nr_errors = fanout_run(item_ptrs, APP_CMD_THREADS, rendezvous_call,
+			&rdv, results, APP_CMD_THREADS);
+	ok(nr_errors == 0 && rdv.max_in_flight == APP_CMD_THREADS,
+			"%d calls are in flight at once over %d threads (max %u)",
+			APP_CMD_THREADS, APP_CMD_THREADS, rdv.max_in_flight);
+
+	/* One call more than threads: the rendezvous can't be met. */
+	rendezvous_reset(&rdv, APP_CMD_THREADS + 1);
+	nr_errors = fanout_run(item_ptrs, APP_CMD_THREADS + 1, rendezvous_call,
+			&rdv, results, APP_CMD_THREADS);
+	ok(nr_errors > 0 && rdv.max_in_flight == APP_CMD_THREADS,
+			"No more than %d calls are in flight over %d threads (max %u)",
+			APP_CMD_THREADS, APP_CMD_THREADS, rdv.max_in_flight);
+}
+
+static void test_fake_apps(void)
+{
+	struct fake_app apps[NR_APPS] = {};
+	void *app_ptrs[NR_APPS];
+	int results[NR_APPS];
+	size_t i, nr_errors, nr_replies;
+	uint64_t start, sequential_us, parallel_us;
+
+	if (fake_apps_create(apps, NR_APPS)) {
+		diag("Failed to create the fake applications");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < NR_APPS; i++) {
+		app_ptrs[i] = &apps[i];
+	}
+
+	start = now_us();
+	nr_errors = fanout_run(app_ptrs, NR_APPS, send_app_cmd, NULL, results, 1);
+	sequential_us = now_us() - start;
+	ok(nr_errors == 0, "Start %d fake applications one at a time", NR_APPS);
+
+	start = now_us();
+	nr_errors = fanout_run(app_ptrs, NR_APPS, send_app_cmd, NULL, results,
+			APP_CMD_THREADS);
+	parallel_us = now_us() - start;
+	ok(nr_errors == 0, "Start %d fake applications over %d threads",
+			NR_APPS, APP_CMD_THREADS);
+
+	for (i = 0, nr_replies = 0; i < NR_APPS; i++) {
+		nr_replies += results[i] == 0;
+	}
+	ok(nr_replies == NR_APPS, "Every application replied over %d threads",
+			APP_CMD_THREADS);
+
+	/* Timings depend on the machine's load: reported, not checked. */
+	diag("Start of %d applications replying in %d us: %" PRIu64 " us sequentially, %" PRIu64 " us over %d threads",
+			NR_APPS, APP_REPLY_DELAY_US, sequential_us,
+			parallel_us, APP_CMD_THREADS);
+
+	/* An application which never replies only holds up its own thread. */
+	apps[NR_APPS / 2].hung = true;
+	start = now_us();
+	nr_errors = fanout_run(app_ptrs, NR_APPS, send_app_cmd, NULL, results,
+			APP_CMD_THREADS);
+	parallel_us = now_us() - start;
+	ok(nr_errors == 1 && results[NR_APPS / 2] < 0,
+			"The error of an unresponsive application is reported");
+	for (i = 0, nr_replies = 0; i < NR_APPS; i++) {
+		nr_replies += results[i] == 0;
+	}
+	ok(nr_replies == NR_APPS - 1,
+			"The other applications replied despite the unresponsive one");
+	diag("Start with an unresponsive application: %" PRIu64 " us (%d ms socket timeout)",
+			parallel_us, APP_SOCKET_TIMEOUT_MS);
+
+	fake_apps_destroy(apps, NR_APPS);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	rcu_register_thread();
+	diag("Fan-out unit tests");
+	test_all_items();
+	test_concurrency();
+	test_fake_apps();
+	rcu_unregister_thread();
+
+	return exit_status();
+}